@@ -9,24 +9,11 @@
 #include "analysis_liveness.h"
 #include "function.h"
 
+#include <limits>
+
 using namespace llvm;
 using namespace std;
 
-namespace
-{
-	LoopStatement* getParentLoop(NOT_NULL(Statement) statement)
-	{
-		for (Statement* parent = statement->getParent(); parent != nullptr; parent = parent->getParent())
-		{
-			if (auto loop = dyn_cast<LoopStatement>(parent))
-			{
-				return loop;
-			}
-		}
-		return nullptr;
-	}
-}
-
 unordered_set<Statement*> LivenessAnalysis::getStatements(ExpressionUse& expressionUse)
 {
 	auto topLevelUser = expressionUse.getUser();
@@ -129,6 +116,7 @@ void LivenessAnalysis::collectStatementIndices(StatementList& list)
 		else if (auto loop = dyn_cast<LoopStatement>(stmt))
 		{
 			collectStatementIndices(loop->getLoopBody());
+			loopRanges.emplace_back(index, flatStatements.size());
 		}
 		else if (auto exprStatement = dyn_cast<ExpressionStatement>(stmt))
 		{
@@ -155,71 +143,154 @@ void LivenessAnalysis::collectStatementIndices(StatementList& list)
 	}
 }
 
-bool LivenessAnalysis::liveRangeContains(Expression *liveVariable, Statement *stmt)
+void LivenessAnalysis::sortUseRoots(SmallVectorImpl<ExpressionUseRoot>& statements)
 {
-	auto compareStatementMore = [&](size_t index, ExpressionUseRoot& statement)
+	sort(statements.begin(), statements.end(), [=](ExpressionUseRoot& a, ExpressionUseRoot& b)
 	{
-		return index > statementStartIndices.at(statement.getStatement());
-	};
-	
-	auto compareStatementLess = [&](size_t index, ExpressionUseRoot& statement)
+		size_t aIndex = statementStartIndices.at(a.getStatement());
+		size_t bIndex = statementStartIndices.at(b.getStatement());
+		if (aIndex < bIndex)
+		{
+			 return true;
+		}
+		if (aIndex > bIndex)
+		{
+			 return false;
+		}
+		return a.isUse() < b.isUse();
+	});
+}
+
+LivenessAnalysis::LiveRangeSet& LivenessAnalysis::getLiveRangeSet(Expression* liveVariable)
+{
+	auto insertResult = liveRanges.insert({liveVariable, {}});
+	LiveRangeSet& ranges = insertResult.first->second;
+	if (!insertResult.second)
 	{
-		return index < statementStartIndices.at(statement.getStatement());
-	};
-	
+		return ranges;
+	}
+
+	size_t statementCount = flatStatements.size();
+	ranges.liveStatements.resize(statementCount);
+	ranges.defStatements.resize(statementCount);
+
 	auto& varUsers = usingStatements.at(liveVariable);
-	size_t statementIndex = statementStartIndices.at(stmt);
-	
-	auto previousUseDef = upper_bound(varUsers.begin(), varUsers.end(), statementIndex, compareStatementMore);
-	auto nextUseDef = upper_bound(varUsers.begin(), varUsers.end(), statementIndex, compareStatementLess);
-	
-	// If there is at least one def before this statement, and at least one use after this statement, then
-	// the live range of liveVariable contains this statement.
-	// (As a shortcut, if we find a use before this statement, then necessarily there also has to be a def.)
-	if (previousUseDef != varUsers.end() && nextUseDef != varUsers.end() && nextUseDef->isUse())
+	if (!erasedStatements.empty())
 	{
-		return true;
+		// Use/def roots on statements deleted since collection describe program points that no
+		// longer exist; prune them before they get baked into the range.
+		varUsers.erase(remove_if(varUsers.begin(), varUsers.end(), [&](ExpressionUseRoot& useDef)
+		{
+			return erasedStatements.count(useDef.getStatement()) != 0;
+		}), varUsers.end());
 	}
-	
-	// Linearly, there is no next use/def or the next use/def is a def. Check if stmt is inside a loop and
-	// see if the previous definition could reach a use at the start of the loop.
-	// This is conservative with regards to break statements.
-	for (auto parentLoop = getParentLoop(stmt); parentLoop != nullptr; parentLoop = getParentLoop(parentLoop))
+	for (ExpressionUseRoot& useDef : varUsers)
 	{
-		// See if there's a use between the original statement and the end of the loop.
-		auto useDefBeforeLoopEnd = lower_bound(varUsers.begin(), nextUseDef, statementEndIndices.at(parentLoop), [=](ExpressionUseRoot& statement, size_t index)
+		if (useDef.isDef())
 		{
-			return statementStartIndices.at(statement.getStatement()) < index;
-		});
-		
-		if (useDefBeforeLoopEnd != varUsers.begin())
+			ranges.defStatements.set(statementStartIndices.at(useDef.getStatement()));
+		}
+	}
+
+	// Linearly, the variable is live from one use/def to the following use. Nothing reaches the very
+	// first use/def, so its own statement stays dead.
+	for (size_t i = 1; i < varUsers.size(); ++i)
+	{
+		if (varUsers[i].isUse())
 		{
-			--useDefBeforeLoopEnd;
-			if (statementStartIndices.at(useDefBeforeLoopEnd->getStatement()) > statementIndex)
+			size_t begin = statementStartIndices.at(varUsers[i - 1].getStatement());
+			size_t end = statementStartIndices.at(varUsers[i].getStatement());
+			if (i == 1)
 			{
-				return useDefBeforeLoopEnd->isUse();
+				++begin;
+			}
+			if (begin < end)
+			{
+				ranges.liveStatements.set(begin, end);
 			}
 		}
-		
-		// See if there's a use between the start of the loop and the original statement.
-		auto useDefAfterLoopStart = upper_bound(varUsers.begin(), nextUseDef, statementStartIndices.at(parentLoop), compareStatementLess);
-		if (useDefAfterLoopStart != nextUseDef)
+	}
+
+	// Loops extend live ranges beyond what the flat statement order shows: a value read early in the
+	// body is read again on the next iteration, and break statements can leave the body from almost
+	// anywhere. Conservatively, keep the variable live from the loop header up to its last use in the
+	// body, and across the whole body when the first use/def in it reads a value carried around the
+	// back-edge.
+	for (const auto& loopRange : loopRanges)
+	{
+		bool carriedAroundBackEdge = false;
+		bool seenAnyInLoop = false;
+		size_t lastUseIndex = 0;
+		bool anyUseInLoop = false;
+		for (ExpressionUseRoot& useDef : varUsers)
+		{
+			size_t index = statementStartIndices.at(useDef.getStatement());
+			if (index <= loopRange.first || index >= loopRange.second)
+			{
+				continue;
+			}
+
+			if (!seenAnyInLoop)
+			{
+				carriedAroundBackEdge = useDef.isUse();
+				seenAnyInLoop = true;
+			}
+			if (useDef.isUse())
+			{
+				anyUseInLoop = true;
+				lastUseIndex = index;
+			}
+		}
+
+		if (carriedAroundBackEdge)
+		{
+			ranges.liveStatements.set(loopRange.first, loopRange.second);
+		}
+		else if (anyUseInLoop)
+		{
+			ranges.liveStatements.set(loopRange.first, lastUseIndex);
+		}
+	}
+
+	return ranges;
+}
+
+pair<size_t, size_t> LivenessAnalysis::getLiveExtent(Expression* expression)
+{
+	auto insertResult = liveExtents.insert({expression, {numeric_limits<size_t>::max(), 0}});
+	auto& extent = insertResult.first->second;
+	if (insertResult.second)
+	{
+		LiveRangeSet& ranges = getLiveRangeSet(expression);
+		for (const BitVector* bits : { &ranges.liveStatements, &ranges.defStatements })
 		{
-			if (statementStartIndices.at(useDefBeforeLoopEnd->getStatement()) < statementIndex)
+			for (int index = bits->find_first(); index != -1; index = bits->find_next(index))
 			{
-				return useDefAfterLoopStart->isUse();
+				extent.first = min(extent.first, size_t(index));
+				extent.second = max(extent.second, size_t(index));
 			}
 		}
 	}
-	
-	return false;
+	return extent;
+}
+
+bool LivenessAnalysis::liveRangeContains(Expression *liveVariable, Statement *stmt)
+{
+	return getLiveRangeSet(liveVariable).liveStatements.test(statementStartIndices.at(stmt));
 }
 
 bool LivenessAnalysis::interferenceFree(Expression *a, Expression *b)
 {
+	// Word-parallel test first: if no def of b falls on a statement where a is live, no individual
+	// def needs to be looked at.
+	if (!getLiveRangeSet(a).liveStatements.anyCommon(getLiveRangeSet(b).defStatements))
+	{
+		return true;
+	}
+
 	return !any_of(usingStatements.at(b), [=](ExpressionUseRoot& useDef)
 	{
-		if (useDef.isDef())
+		if (useDef.isDef() && erasedStatements.count(useDef.getStatement()) == 0)
 		{
 			Statement* statement = useDef.getStatement();
 			return liveRangeContains(a, statement) && !assignmentAssigns(statement, b, a);
@@ -228,6 +299,49 @@ bool LivenessAnalysis::interferenceFree(Expression *a, Expression *b)
 	});
 }
 
+void LivenessAnalysis::statementErased(Statement& statement)
+{
+	auto indexIter = statementStartIndices.find(&statement);
+	if (indexIter == statementStartIndices.end())
+	{
+		return;
+	}
+
+	erasedStatements.insert(&statement);
+	memoryOperations.erase(indexIter->second);
+
+	// The flat index becomes a dead slot. Scrub it from the ranges that were already materialized;
+	// ranges computed from now on skip the statement through erasedStatements. Cached extents only
+	// shrink when a statement disappears, so leaving them alone stays conservative.
+	for (auto& pair : liveRanges)
+	{
+		pair.second.liveStatements.reset(indexIter->second);
+		pair.second.defStatements.reset(indexIter->second);
+	}
+}
+
+void LivenessAnalysis::expressionReplaced(Expression& from, Expression& to)
+{
+	auto fromUsers = usingStatements.find(&from);
+	if (fromUsers == usingStatements.end())
+	{
+		return;
+	}
+
+	// The rewrite relinked the ExpressionUse objects in place, so the recorded roots stay valid
+	// and now describe uses and defs of `to`. Fold them into its list and drop both cached range
+	// sets; the next query recomputes them from the merged list.
+	auto fromList = move(fromUsers->second);
+	usingStatements.erase(fromUsers);
+	auto& toUsers = usingStatements[&to];
+	toUsers.append(fromList.begin(), fromList.end());
+	sortUseRoots(toUsers);
+	liveRanges.erase(&from);
+	liveRanges.erase(&to);
+	liveExtents.erase(&from);
+	liveExtents.erase(&to);
+}
+
 void LivenessAnalysis::collectStatementIndices(FunctionNode& function)
 {
 	assignedExpressions.clear();
@@ -235,7 +349,11 @@ void LivenessAnalysis::collectStatementIndices(FunctionNode& function)
 	statementStartIndices.clear();
 	statementEndIndices.clear();
 	flatStatements.clear();
-	
+	loopRanges.clear();
+	liveRanges.clear();
+	liveExtents.clear();
+	erasedStatements.clear();
+
 	collectStatementIndices(function.getBody());
 	for (auto& pair : usesDefs)
 	{
@@ -250,20 +368,7 @@ void LivenessAnalysis::collectStatementIndices(FunctionNode& function)
 			}
 		}
 		
-		sort(statements.begin(), statements.end(), [=](ExpressionUseRoot& a, ExpressionUseRoot& b)
-		{
-			size_t aIndex = statementStartIndices.at(a.getStatement());
-			size_t bIndex = statementStartIndices.at(b.getStatement());
-			if (aIndex < bIndex)
-			{
-				 return true;
-			}
-			if (aIndex > bIndex)
-			{
-				 return false;
-			}
-			return a.isUse() < b.isUse();
-		});
+		sortUseRoots(statements);
 	}
 	
 	usesDefs.clear();
@@ -10,9 +10,11 @@
 #ifndef analysis_liveness_hpp
 #define analysis_liveness_hpp
 
+#include "ast_context.h"
 #include "expression_use.h"
 #include "statements.h"
 
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/PointerIntPair.h>
 #include <llvm/ADT/SmallVector.h>
 
@@ -53,28 +55,52 @@ public:
 	Statement* getStatement() { return statement; }
 };
 
-class LivenessAnalysis
+class LivenessAnalysis : public AstStructureListener
 {
+	// Dense liveness facts for one assigned expression, indexed by flat statement number. Bit tests
+	// replace the binary searches that interference queries used to make, and whole-word operations
+	// let us rule out interference between two variables without looking at individual statements.
+	struct LiveRangeSet
+	{
+		llvm::BitVector liveStatements;
+		llvm::BitVector defStatements;
+	};
+
 	std::deque<Expression*> assignedExpressions;
 	std::unordered_map<Expression*, llvm::SmallVector<ExpressionUseRoot, 16>> usingStatements;
 	std::unordered_map<Statement*, size_t> statementStartIndices;
 	std::unordered_map<Statement*, size_t> statementEndIndices;
 	std::set<size_t> memoryOperations;
 	std::deque<Statement*> flatStatements;
-	
+	std::deque<std::pair<size_t, size_t>> loopRanges;
+	std::unordered_map<Expression*, LiveRangeSet> liveRanges;
+	std::unordered_map<Expression*, std::pair<size_t, size_t>> liveExtents;
+
+	// Statements deleted while this analysis was live, reported through an AstRewriteTransaction.
+	// Their flat indices become dead slots: def facts on them are dropped, and stale live bits are
+	// harmless because interference only ever tests liveness against defs.
+	std::unordered_set<Statement*> erasedStatements;
+
 	// intermediate dictionary, gets cleared at some point
 	std::unordered_map<Expression*, llvm::SmallVector<AssignableUseDef, 16>> usesDefs;
-	
+
 	std::unordered_set<Statement*> getStatements(ExpressionUse& expressionUse);
 	void collectAssignments(Statement* statement, ExpressionUser::iterator iter, ExpressionUser::iterator end);
 	bool assignmentAssigns(Statement* assignment, Expression* left, Expression* right);
 	void collectStatementIndices(StatementList& list);
+	void sortUseRoots(llvm::SmallVectorImpl<ExpressionUseRoot>& statements);
+	LiveRangeSet& getLiveRangeSet(Expression* liveVariable);
 	bool liveRangeContains(Expression* liveVariable, Statement* stmt);
 	bool interferenceFree(Expression* a, Expression* b);
 	
 public:
 	void collectStatementIndices(FunctionNode& function);
-	
+
+	// Structural delta hooks, so that a rewrite phase opened with an AstRewriteTransaction can keep
+	// this analysis current instead of forcing collectStatementIndices to run again.
+	virtual void statementErased(Statement& statement) override;
+	virtual void expressionReplaced(Expression& from, Expression& to) override;
+
 	const std::set<size_t>& getMemoryOperations() const
 	{
 		return memoryOperations;
@@ -104,6 +130,22 @@ public:
 	{
 		return interferenceFree(a, b) && interferenceFree(b, a);
 	}
+
+	// Raw live sets, for callers that aggregate liveness over whole groups of variables.
+	const llvm::BitVector& getLiveStatements(Expression* expression)
+	{
+		return getLiveRangeSet(expression).liveStatements;
+	}
+
+	const llvm::BitVector& getDefStatements(Expression* expression)
+	{
+		return getLiveRangeSet(expression).defStatements;
+	}
+
+	// First and last statement index where the variable is live or defined, computed once per
+	// variable and cached. Two variables whose extents don't overlap cannot interfere, which lets
+	// congruence screening accept such pairs without any bit-level test.
+	std::pair<size_t, size_t> getLiveExtent(Expression* expression);
 };
 
 #endif /* analysis_liveness_hpp */
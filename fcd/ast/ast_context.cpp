@@ -10,16 +10,38 @@
 #include "ast_context.h"
 #include "expressions.h"
 #include "metadata.h"
+#include "statistics.h"
 
 #include <llvm/IR/InstVisitor.h>
 
 #include <deque>
+#include <mutex>
 
 using namespace std;
 using namespace llvm;
 
 namespace
 {
+	StatCounter negationsReused("ast.conditions.negation_reuse");
+	StatCounter phisLoweredInPlace("ast.phis.lowered_in_place");
+
+	// The φs of one block form a parallel copy at each incoming edge, which is why φ lowering
+	// normally buffers through a "phi_in" variable: copies execute sequentially and must all read
+	// pre-edge values. A block's lone φ has no other copy to order against, so it can be assigned
+	// in place at the edge, and the buffer variable (plus the merge work it costs the congruence
+	// pass) never materializes. Self-references are fine: `i = i + 1` reads the current value
+	// before the write, which is exactly the φ semantics for a lone φ.
+	bool isLonePhi(llvm::PHINode& phi)
+	{
+		auto iter = phi.getParent()->begin();
+		if (&*iter != &phi)
+		{
+			return false;
+		}
+		++iter;
+		return !isa<llvm::PHINode>(*iter);
+	}
+
 	NAryOperatorExpression::NAryOperatorType getOperator(BinaryOperator::BinaryOps op)
 	{
 #define MAP_OP(x, y) [BinaryOperator::x] = NAryOperatorExpression::y
@@ -456,22 +478,35 @@ struct std::hash<pair<const ExpressionType*, size_t>>
 	}
 };
 
+// Uniquing table for ExpressionTypes, shared by every AstContext in the process (see
+// AstContext::sharedTypes). ExpressionTypes are immutable once built, so the same integer, pointer
+// or array type no longer has to be rebuilt for every function, and type pointer-equality holds
+// across functions and across batched inputs. Parallel structuring converts types on several
+// threads at once, so the indexed accessors lock.
 class AstContext::TypeIndex
 {
 	VoidExpressionType voidType;
+	mutex indexLock;
 	unordered_map<unsigned short, unique_ptr<IntegerExpressionType>> intTypes;
 	unordered_map<const ExpressionType*, unique_ptr<PointerExpressionType>> pointerTypes;
 	unordered_map<pair<const ExpressionType*, size_t>, unique_ptr<ArrayExpressionType>> arrayTypes;
 
 	// Function types and struct types are managed but not indexed.
 	deque<unique_ptr<ExpressionType>> unindexedTypes;
-	
+
+	// Converted LLVM struct types, keyed by the (context-uniqued) llvm::StructType. A conversion
+	// appends the fields after creating the object and recurses into nested structures, so the
+	// whole conversion runs under this recursive lock instead of the per-call index lock.
+	recursive_mutex structureConversionLock;
+	unordered_map<const llvm::StructType*, StructExpressionType*> structureConversions;
+
 public:
 	VoidExpressionType& getVoid() { return voidType; }
-	
+
 	IntegerExpressionType& getIntegerType(bool isSigned, unsigned short numBits)
 	{
 		unsigned short key = static_cast<unsigned short>(((isSigned != false) << 15) | (numBits & 0x7fff));
+		lock_guard<mutex> guard(indexLock);
 		auto& ptr = intTypes[key];
 		if (ptr == nullptr)
 		{
@@ -479,9 +514,10 @@ public:
 		}
 		return *ptr;
 	}
-	
+
 	PointerExpressionType& getPointerTo(const ExpressionType& pointee)
 	{
+		lock_guard<mutex> guard(indexLock);
 		auto& ptr = pointerTypes[&pointee];
 		if (ptr == nullptr)
 		{
@@ -489,10 +525,11 @@ public:
 		}
 		return *ptr;
 	}
-	
+
 	ArrayExpressionType& getArrayOf(const ExpressionType& elementType, size_t numElements)
 	{
 		pair<const ExpressionType*, size_t> key(&elementType, numElements);
+		lock_guard<mutex> guard(indexLock);
 		auto& ptr = arrayTypes[key];
 		if (ptr == nullptr)
 		{
@@ -500,39 +537,52 @@ public:
 		}
 		return *ptr;
 	}
-	
+
 	StructExpressionType& getStructure(string name)
 	{
+		lock_guard<mutex> guard(indexLock);
 		unindexedTypes.emplace_back(new StructExpressionType(name));
 		return llvm::cast<StructExpressionType>(*unindexedTypes.back());
 	}
-	
+
 	FunctionExpressionType& getFunction(const ExpressionType& returnType)
 	{
+		lock_guard<mutex> guard(indexLock);
 		unindexedTypes.emplace_back(new FunctionExpressionType(returnType));
 		return llvm::cast<FunctionExpressionType>(*unindexedTypes.back());
 	}
-	
-	size_t size() const
+
+	// Holds the structure conversion lock for the caller's scope; the slot stays valid for as long
+	// as the table does.
+	unique_lock<recursive_mutex> lockStructureConversions()
+	{
+		return unique_lock<recursive_mutex>(structureConversionLock);
+	}
+
+	StructExpressionType*& structureConversionSlot(const llvm::StructType* structure)
+	{
+		return structureConversions[structure];
+	}
+
+	size_t size()
 	{
+		lock_guard<mutex> guard(indexLock);
 		return 1 + intTypes.size() + pointerTypes.size() + arrayTypes.size() + unindexedTypes.size();
 	}
 };
 
-void* AstContext::prepareStorageAndUses(unsigned useCount, size_t storage)
+AstContext::TypeIndex& AstContext::sharedTypes()
+{
+	// The table outlives every context: pseudocode printing and AST export rely on type identity
+	// being stable across the whole run.
+	static TypeIndex index;
+	return index;
+}
+
+static void initializeUseArray(ExpressionUse* useBegin, ExpressionUse* useEnd)
 {
-	size_t useDataSize = sizeof(ExpressionUseArrayHead) + sizeof(ExpressionUse) * useCount;
-	size_t totalSize = useDataSize + storage;
-	auto pointer = pool.allocateDynamic<char>(totalSize, alignof(void*));
-	
-	// Prepare use data
-	auto nextUseArray = reinterpret_cast<ExpressionUseArrayHead*>(pointer);
-	new (nextUseArray) ExpressionUseArrayHead;
-	
-	auto useBegin = reinterpret_cast<ExpressionUse*>(&nextUseArray[1]);
-	auto useEnd = useBegin + useCount;
 	auto firstUse = useEnd - 1;
-	
+
 	ptrdiff_t bitsToEncode = 0;
 	auto useIter = useEnd;
 	while (useIter != useBegin)
@@ -551,18 +601,80 @@ void* AstContext::prepareStorageAndUses(unsigned useCount, size_t storage)
 		}
 		new (useIter) ExpressionUse(tag);
 	}
-	
+}
+
+void* AstContext::prepareStorageAndUses(unsigned useCount, size_t storage)
+{
+	size_t useDataSize = sizeof(ExpressionUseArrayHead) + sizeof(ExpressionUse) * useCount;
+	size_t totalSize = useDataSize + storage;
+	auto pointer = pool.allocateDynamic<char>(totalSize, alignof(void*));
+
+	// Prepare use data
+	auto nextUseArray = reinterpret_cast<ExpressionUseArrayHead*>(pointer);
+	new (nextUseArray) ExpressionUseArrayHead;
+
+	auto useBegin = reinterpret_cast<ExpressionUse*>(&nextUseArray[1]);
+	initializeUseArray(useBegin, useBegin + useCount);
+
 	// The rest of the buffer will be initialized by a placement new
 	auto objectStorage = reinterpret_cast<void*>(pointer + useDataSize);
 	assert((reinterpret_cast<uintptr_t>(objectStorage) & (alignof(void*) - 1)) == 0);
-	
+
 	return objectStorage;
 }
 
+void AstContext::allocateHungOffUses(ExpressionUseArrayHead& head, unsigned useCount, ExpressionUser& user)
+{
+	// Hung-off arrays aren't adjacent to their user, so the use walk identifies their end with a
+	// tagged pointer to the user instead of the user's (aligned) vtable pointer.
+	size_t useDataSize = sizeof(ExpressionUseArrayHead) + sizeof(ExpressionUse) * useCount;
+	size_t totalSize = useDataSize + sizeof(PointerIntPair<void*, 1>);
+	auto pointer = pool.allocateDynamic<char>(totalSize, alignof(void*));
+
+	auto nextUseArray = reinterpret_cast<ExpressionUseArrayHead*>(pointer);
+	new (nextUseArray) ExpressionUseArrayHead;
+
+	auto useBegin = reinterpret_cast<ExpressionUse*>(&nextUseArray[1]);
+	auto useEnd = useBegin + useCount;
+	initializeUseArray(useBegin, useEnd);
+
+	auto userTag = new (useEnd) PointerIntPair<void*, 1>;
+	userTag->setPointerAndInt(&user, 1);
+
+	head.allocInfo = ExpressionUseAllocInfo(useCount, 0);
+	head.array = useBegin;
+}
+
+ExpressionUse& AstContext::addOperand(ExpressionUser& user, NOT_NULL(Expression) expression)
+{
+	// Find the last use array. Appends always go there: earlier arrays are necessarily full, since
+	// a new array only gets hung off once the previous one runs out.
+	auto info = &user.allocInfo;
+	auto arrayEnd = reinterpret_cast<ExpressionUse*>(&user);
+	auto head = &reinterpret_cast<ExpressionUseArrayHead*>(arrayEnd - info->allocated)[-1];
+	while (head->array != nullptr)
+	{
+		info = &head->allocInfo;
+		arrayEnd = head->array + info->allocated;
+		head = &reinterpret_cast<ExpressionUseArrayHead*>(head->array)[-1];
+	}
+
+	if (info->used == info->allocated)
+	{
+		allocateHungOffUses(*head, std::max(info->allocated, 4u), user);
+		info = &head->allocInfo;
+		arrayEnd = head->array + info->allocated;
+	}
+
+	ExpressionUse& use = *(arrayEnd - info->used - 1);
+	info->used++;
+	use.setUse(expression);
+	return use;
+}
+
 AstContext::AstContext(DumbAllocator& pool, Module* module)
 : pool(pool)
 , module(module)
-, types(new TypeIndex)
 {
 	trueExpr = token(getIntegerType(false, 1), "true");
 	falseExpr = token(getIntegerType(false, 1), "false");
@@ -642,8 +754,13 @@ Statement* AstContext::statementFor(Instruction &inst)
 		return expr(callExpr);
 	}
 	
-	if (isa<PHINode>(inst))
+	if (auto phi = dyn_cast<PHINode>(&inst))
 	{
+		if (isLonePhi(*phi))
+		{
+			// Lone φs are assigned in place at each incoming edge; there is no copy to emit here.
+			return nullptr;
+		}
 		Expression* phiOut = expressionFor(inst);
 		Expression* phiIn = phiReadsToWrites[phiOut];
 		assert(phiIn != nullptr);
@@ -672,30 +789,59 @@ Statement* AstContext::statementFor(Instruction &inst)
 
 Expression* AstContext::negate(NOT_NULL(Expression) expr)
 {
-	if (auto unary = dyn_cast<UnaryOperatorExpression>(expr))
-	if (unary->getType() == UnaryOperatorExpression::LogicalNegate)
+	// Condition synthesis negates the same branch conditions over and over (once per outgoing edge,
+	// then again at every region collapse); pairing each expression with its negation caps that at
+	// one node per polarity instead of a fresh tree per call.
+	Expression* expression = expr;
+	if (Expression* partner = expression->negationPartner)
 	{
-		return unary->getOperand();
+		++negationsReused;
+		return partner;
 	}
-	
+
+	Expression* negated = nullptr;
+	if (auto unaryExpression = dyn_cast<UnaryOperatorExpression>(expr))
+	if (unaryExpression->getType() == UnaryOperatorExpression::LogicalNegate)
+	{
+		negated = unaryExpression->getOperand();
+	}
+
+	if (negated == nullptr)
 	if (auto token = dyn_cast<TokenExpression>(expr))
 	{
-		if (strcmp(token->token, "true") == 0)
+		if (token->token == "true")
 		{
-			return expressionForFalse();
+			negated = expressionForFalse();
 		}
-		if (strcmp(token->token, "false") == 0)
+		if (token->token == "false")
 		{
-			return expressionForTrue();
+			negated = expressionForTrue();
 		}
 	}
-	
-	return unary(UnaryOperatorExpression::LogicalNegate, expr);
+
+	if (negated == nullptr)
+	{
+		negated = unary(UnaryOperatorExpression::LogicalNegate, expr);
+	}
+
+	if (negated->negationPartner == nullptr)
+	{
+		expression->negationPartner = negated;
+		negated->negationPartner = expression;
+	}
+	return negated;
 }
 
 ExpressionStatement* AstContext::phiAssignment(PHINode &phi, Value &value)
 {
 	auto linkedExpression = expressionFor(phi);
+	if (isLonePhi(phi))
+	{
+		++phisLoweredInPlace;
+		auto assignment = nary(NAryOperatorExpression::Assign, linkedExpression, expressionFor(value));
+		return expr(assignment);
+	}
+
 	auto& phiWrite = phiReadsToWrites[linkedExpression];
 	if (phiWrite == nullptr)
 	{
@@ -737,7 +883,10 @@ const ExpressionType& AstContext::getType(Type &type)
 	}
 	else if (auto structure = dyn_cast<StructType>(&type))
 	{
-		auto& structType = structTypeMap[structure];
+		// Conversions are shared across contexts; the lock covers the whole conversion so no other
+		// thread can observe the structure before its fields are appended.
+		auto conversionGuard = sharedTypes().lockStructureConversions();
+		auto& structType = sharedTypes().structureConversionSlot(structure);
 		if (structType == nullptr)
 		{
 			string name;
@@ -776,30 +925,30 @@ const ExpressionType& AstContext::getType(Type &type)
 
 const VoidExpressionType& AstContext::getVoid()
 {
-	return types->getVoid();
+	return sharedTypes().getVoid();
 }
 
 const IntegerExpressionType& AstContext::getIntegerType(bool isSigned, unsigned short numBits)
 {
-	return types->getIntegerType(isSigned, numBits);
+	return sharedTypes().getIntegerType(isSigned, numBits);
 }
 
 const PointerExpressionType& AstContext::getPointerTo(const ExpressionType& pointee)
 {
-	return types->getPointerTo(pointee);
+	return sharedTypes().getPointerTo(pointee);
 }
 
 const ArrayExpressionType& AstContext::getArrayOf(const ExpressionType& elementType, size_t numElements)
 {
-	return types->getArrayOf(elementType, numElements);
+	return sharedTypes().getArrayOf(elementType, numElements);
 }
 
 StructExpressionType& AstContext::createStructure(string name)
 {
-	return types->getStructure(move(name));
+	return sharedTypes().getStructure(move(name));
 }
 
 FunctionExpressionType& AstContext::createFunction(const ExpressionType &returnType)
 {
-	return types->getFunction(returnType);
+	return sharedTypes().getFunction(returnType);
 }
@@ -15,8 +15,13 @@
 #include "expressions.h"
 #include "not_null.h"
 #include "statements.h"
+#include "string_intern.h"
 
+#include <llvm/ADT/SmallVector.h>
+
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <unordered_map>
 #include <utility>
 
@@ -33,18 +38,46 @@ namespace llvm
 class Expression;
 class ExpressionUser;
 
+// Receives the structural deltas recorded during an AstRewriteTransaction. Analyses that hold
+// references into the statement tree implement this so they can fold a rewrite into their own
+// data instead of being rebuilt from scratch after it.
+class AstStructureListener
+{
+protected:
+	~AstStructureListener() = default;
+
+public:
+	// The statement was unlinked from its list and its references dropped.
+	virtual void statementErased(Statement& statement) = 0;
+	// Every use of `from` was relinked to `to`; the ExpressionUse objects themselves survived.
+	virtual void expressionReplaced(Expression& from, Expression& to) = 0;
+};
+
 class AstContext
 {
 	friend class InstToExpr;
 	class TypeIndex;
-	
+
 	DumbAllocator& pool;
 	llvm::Module* module;
 	std::unordered_map<Expression*, Expression*> phiReadsToWrites;
 	std::unordered_map<llvm::Value*, Expression*> expressionMap;
-	std::unique_ptr<TypeIndex> types;
-	std::unordered_map<const llvm::StructType*, StructExpressionType*> structTypeMap;
-	
+
+	// Run-wide type table shared by every context: ExpressionTypes are immutable once built, so
+	// identical types are the same object in every function and type pointer-equality holds across
+	// batched inputs. Defined in the translation unit.
+	static TypeIndex& sharedTypes();
+
+	// Uniquing tables for the immutable leaf expressions. Leaves vastly outnumber interior nodes and have
+	// no operands that a pass could later rewrite in place, so structurally identical ones can safely be
+	// the same object and equality on them becomes a pointer compare. (Interior nodes can't be uniqued as
+	// long as setOperand mutates them after creation.)
+	std::unordered_map<const ExpressionType*, std::unordered_map<uint64_t, NumericExpression*>> uniqueNumerics;
+	std::unordered_map<const ExpressionType*, std::unordered_map<const char*, TokenExpression*>> uniqueTokens;
+
+	// Listeners registered by live AstRewriteTransactions; usually empty or one element deep.
+	llvm::SmallVector<AstStructureListener*, 2> structureListeners;
+
 	ExpressionReference trueExpr;
 	ExpressionReference falseExpr;
 	ExpressionReference undef;
@@ -58,7 +91,8 @@ class AstContext
 	Expression* uncachedExpressionFor(llvm::Value& value);
 	
 	void* prepareStorageAndUses(unsigned useCount, size_t storageSize);
-	
+	void allocateHungOffUses(ExpressionUseArrayHead& head, unsigned useCount, ExpressionUser& user);
+
 	template<typename T, typename... TElements>
 	void setOperand(T* object, unsigned index, NOT_NULL(Expression) expression, TElements&&... elems)
 	{
@@ -81,7 +115,17 @@ class AstContext
 			: pool.allocateDynamic<char>(sizeof(T), alignof(T));
 		return new (result) T(*this, useCount, std::forward<TArgs>(args)...);
 	}
-	
+
+	// Allocates a user whose inline use array is larger than its initial operand count, so that operands
+	// appended later fill the spare slots instead of hanging off a separate array.
+	template<typename T, typename... TArgs, typename = typename std::enable_if<std::is_base_of<Expression, T>::value, T>::type>
+	T* allocateWithSpareUses(unsigned allocatedUses, unsigned usedUses, TArgs&&... args)
+	{
+		assert(allocatedUses > 0 && allocatedUses >= usedUses);
+		void* result = prepareStorageAndUses(allocatedUses, sizeof(T));
+		return new (result) T(*this, allocatedUses, usedUses, std::forward<TArgs>(args)...);
+	}
+
 	template<typename T, typename... TArgs, typename = typename std::enable_if<std::is_base_of<Statement, T>::value, T>::type>
 	T* allocateStatement(unsigned useCount, TArgs&&... args)
 	{
@@ -112,16 +156,23 @@ public:
 	}
 	
 	Statement* statementFor(llvm::Instruction& inst);
-	
+
+	// Appends an operand at the end of the user's operand list. This is O(1) and keeps operands
+	// contiguous as long as the user has spare allocated uses; when it runs out, a new use array is
+	// hung off the full one.
+	ExpressionUse& addOperand(ExpressionUser& user, NOT_NULL(Expression) expression);
+
 #pragma mark - Expressions
 	UnaryOperatorExpression* unary(UnaryOperatorExpression::UnaryOperatorType type, NOT_NULL(Expression) operand)
 	{
 		return allocate<true, UnaryOperatorExpression>(1, type, operand);
 	}
 	
-	NAryOperatorExpression* nary(NAryOperatorExpression::NAryOperatorType type, unsigned numElements = 2)
+	// The capacity hint reserves room for operands appended after creation (through addOperand), so
+	// that they land in the inline use array instead of forcing a hung-off one.
+	NAryOperatorExpression* nary(NAryOperatorExpression::NAryOperatorType type, unsigned numElements = 2, unsigned capacity = 0)
 	{
-		return allocate<true, NAryOperatorExpression>(numElements, type);
+		return allocateWithSpareUses<NAryOperatorExpression>(std::max(numElements, capacity), numElements, type);
 	}
 	
 	template<typename Iterator, typename = typename std::enable_if<std::is_convertible<decltype(*std::declval<Iterator>()), Expression*>::value, void>::type>
@@ -134,13 +185,11 @@ public:
 			return *begin;
 		}
 		
+		// Materialize the range and hand it to setOperands, which links every use in one pass over
+		// the use array instead of walking it once per operand.
+		llvm::SmallVector<Expression*, 16> operands(begin, end);
 		auto result = nary(type, count);
-		unsigned index = 0;
-		for (auto iter = begin; iter != end; ++iter)
-		{
-			setOperand(result, index, *iter);
-			++index;
-		}
+		result->setOperands(operands.begin(), operands.end());
 		return result;
 	}
 	
@@ -164,17 +213,31 @@ public:
 	
 	NumericExpression* numeric(const IntegerExpressionType& type, uint64_t ui)
 	{
-		return allocate<false, NumericExpression>(0, type, ui);
+		NumericExpression*& unique = uniqueNumerics[&type][ui];
+		if (unique == nullptr)
+		{
+			unique = allocate<false, NumericExpression>(0, type, ui);
+		}
+		return unique;
 	}
-	
+
 	TokenExpression* token(const ExpressionType& type, llvm::StringRef string)
 	{
-		return allocate<false, TokenExpression>(0, type, string);
+		// Intern once up front so the uniquing key is a pointer instead of a string copy.
+		llvm::StringRef interned = StringInternTable::intern(string);
+		TokenExpression*& unique = uniqueTokens[&type][interned.data()];
+		if (unique == nullptr)
+		{
+			unique = allocate<false, TokenExpression>(0, type, interned);
+		}
+		return unique;
 	}
 	
 	CallExpression* call(NOT_NULL(Expression) callee, unsigned numParams = 0)
 	{
-		return allocate<true, CallExpression>(numParams + 1, callee);
+		// The overwhelming majority of calls have at most 4 parameters: round the allocation up so
+		// that addParameter stays contiguous for them.
+		return allocateWithSpareUses<CallExpression>(std::max(numParams, 4u) + 1, numParams + 1, callee);
 	}
 	
 	CastExpression* cast(const ExpressionType& type,  NOT_NULL(Expression) value)
@@ -259,9 +322,42 @@ public:
 		}
 	}
 	
+#pragma mark - Rewrite transactions
+	void addStructureListener(AstStructureListener& listener)
+	{
+		structureListeners.push_back(&listener);
+	}
+
+	void removeStructureListener(AstStructureListener& listener)
+	{
+		structureListeners.erase(std::find(structureListeners.begin(), structureListeners.end(), &listener));
+	}
+
+	// Unlinks the statement, drops its references and reports the deletion to registered listeners.
+	// Rewrites that run inside a transaction must erase statements through this instead of calling
+	// StatementList::erase directly.
+	void eraseStatement(Statement& statement)
+	{
+		StatementList::erase(&statement);
+		statement.dropAllReferences();
+		for (AstStructureListener* listener : structureListeners)
+		{
+			listener->statementErased(statement);
+		}
+	}
+
+	// Reports that every use of `from` now reads `to`; the caller has already relinked the uses.
+	void notifyExpressionReplaced(Expression& from, Expression& to)
+	{
+		for (AstStructureListener* listener : structureListeners)
+		{
+			listener->expressionReplaced(from, to);
+		}
+	}
+
 #pragma mark - Φ Nodes
 	ExpressionStatement* phiAssignment(llvm::PHINode& phi, llvm::Value& value);
-	
+
 #pragma mark - Types
 	const ExpressionType& getType(llvm::Type& type);
 	const VoidExpressionType& getVoid();
@@ -272,4 +368,28 @@ public:
 	FunctionExpressionType& createFunction(const ExpressionType& returnType);
 };
 
+// Scopes a rewrite phase during which `listener` is told about the structural deltas of every
+// mutation routed through the context, so an analysis computed before the phase stays usable
+// throughout it. The listener is detached when the transaction goes out of scope.
+class AstRewriteTransaction
+{
+	AstContext& ctx;
+	AstStructureListener& listener;
+
+public:
+	AstRewriteTransaction(AstContext& ctx, AstStructureListener& listener)
+	: ctx(ctx), listener(listener)
+	{
+		ctx.addStructureListener(listener);
+	}
+
+	AstRewriteTransaction(const AstRewriteTransaction&) = delete;
+	AstRewriteTransaction& operator=(const AstRewriteTransaction&) = delete;
+
+	~AstRewriteTransaction()
+	{
+		ctx.removeStructureListener(listener);
+	}
+};
+
 #endif /* expression_context_hpp */
@@ -11,6 +11,7 @@
 #define fcd__ast_ast_passes_h
 
 #include "pass.h"
+#include "pass_export.h"
 #include "pass_print.h"
 
 // Combines consecutive control flow statements.
@@ -33,17 +34,7 @@ public:
 	virtual const char* getName() const override;
 };
 
-// Removes assignments to __undefined.
-class AstRemoveUndef final : public AstFunctionPass
-{
-protected:
-	virtual void doRun(FunctionNode& fn) override;
-	
-public:
-	virtual const char* getName() const override;
-};
-
-// Simplifies expressions.
+// Simplifies expressions and drops assignments to __undefined.
 class AstSimplifyExpressions final : public AstFunctionPass
 {
 	virtual void doRun(FunctionNode& fn) override;
@@ -56,8 +47,15 @@ public:
 // (Do note that the current implementation is *not* idempotent! Only the first run is assumed to be correct.)
 class AstMergeCongruentVariables : public AstFunctionPass {
 	virtual void doRun(FunctionNode& fn) override;
-	
+
 public:
+	// Expensive: congruence runs a liveness analysis whose cost grows superlinearly with the body,
+	// so functions above --gate-statement-limit skip it and print with redundant variables instead.
+	AstMergeCongruentVariables()
+	: AstFunctionPass(false, true)
+	{
+	}
+
 	virtual const char* getName() const override;
 };
 
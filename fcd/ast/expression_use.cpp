@@ -96,11 +96,15 @@ void ExpressionUse::setUse(Expression *target)
 	{
 		return;
 	}
-	
+
 	// unlink
 	setPrevNext(next);
 	setNextPrev(prev.getPointer());
-	
+	if (expression != nullptr)
+	{
+		expression->useCount--;
+	}
+
 	// link with new expression
 	expression = target;
 	if (expression == nullptr)
@@ -111,6 +115,7 @@ void ExpressionUse::setUse(Expression *target)
 	{
 		next = expression->firstUse;
 		expression->firstUse = this;
+		expression->useCount++;
 	}
 	prev.setPointer(nullptr);
 	setNextPrev(this);
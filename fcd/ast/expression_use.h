@@ -23,6 +23,8 @@ class ExpressionUser;
 
 class ExpressionUse
 {
+	friend class Expression; // for the use-list splice in replaceAllUsesWith
+
 	llvm::PointerIntPair<ExpressionUse*, 2, unsigned> prev;
 	ExpressionUse* next;
 	Expression* expression;
@@ -77,7 +77,7 @@ ExpressionUse& ExpressionUser::getOperandUse(unsigned int index)
 	iterateUseArrays(this, allocInfo, [&](ExpressionUse* begin, ExpressionUse* end)
 	{
 		ptrdiff_t count = end - begin;
-		if (count >= index)
+		if (count > static_cast<ptrdiff_t>(index))
 		{
 			result = end - index - 1;
 			return false;
@@ -92,6 +92,24 @@ ExpressionUse& ExpressionUser::getOperandUse(unsigned int index)
 	return *result;
 }
 
+void ExpressionUser::setOperands(Expression* const* begin, Expression* const* end)
+{
+	auto remaining = static_cast<unsigned>(end - begin);
+	iterateUseArrays(this, allocInfo, [&](ExpressionUse* useBegin, ExpressionUse* useEnd)
+	{
+		// Within an array, operand i lives at useEnd - i - 1, so fill back-to-front to keep the
+		// input order.
+		for (auto use = useEnd; use != useBegin && remaining != 0; --remaining)
+		{
+			--use;
+			use->setUse(*begin);
+			++begin;
+		}
+		return remaining != 0;
+	});
+	assert(remaining == 0 && "more operands than allocated uses"); (void) remaining;
+}
+
 unsigned ExpressionUser::operands_size() const
 {
 	unsigned count = 0;
@@ -132,6 +132,8 @@ public:
 	typedef UseIterator<true> const_iterator;
 	
 private:
+	friend class AstContext; // appending operands updates allocInfo and walks the use array chain
+
 	ExpressionUseAllocInfo allocInfo;
 	UserType userType;
 	
@@ -162,7 +164,13 @@ public:
 	const Expression* getOperand(unsigned index) const { return getOperandUse(index).getUse(); }
 	
 	void setOperand(unsigned index, Expression* expression) { getOperandUse(index).setUse(expression); }
-	
+
+	// Writes operands 0 through (end - begin - 1) in a single pass over the use array chain. This is
+	// equivalent to calling setOperand once per index, but getOperandUse walks the chain from the end
+	// for every call, which makes per-index assignment quadratic on wide users; prefer this when
+	// building an operand list all at once. The range must not be longer than the used operand slots.
+	void setOperands(Expression* const* begin, Expression* const* end);
+
 	unsigned operands_size() const;
 	const_iterator operands_begin() const { return const_iterator(allocInfo.allocated == 0 ? nullptr : this); }
 	const_iterator operands_cbegin() const { return operands_begin(); }
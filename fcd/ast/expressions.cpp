@@ -12,6 +12,7 @@
 #include "function.h"
 #include "print.h"
 #include "statements.h"
+#include "string_intern.h"
 
 #include <llvm/Support/raw_os_ostream.h>
 
@@ -83,27 +84,46 @@ bool Expression::defaultEqualityCheck(const Expression &a, const Expression &b)
 	return false;
 }
 
-unsigned Expression::uses_size() const
+void Expression::replaceAllUsesWith(Expression *expression)
 {
-	unsigned size = 0;
-	for (auto iter = uses_begin(); iter != uses_end(); ++iter)
+	if (expression == this || firstUse == nullptr)
 	{
-		++size;
+		return;
 	}
-	return size;
-}
 
-void Expression::replaceAllUsesWith(Expression *expression)
-{
-	if (expression == this)
+	if (negationPartner != nullptr)
 	{
+		negationPartner->negationPartner = nullptr;
+		negationPartner = nullptr;
+	}
+
+	if (expression == nullptr)
+	{
+		while (auto use = firstUse)
+		{
+			use->setUse(nullptr);
+		}
 		return;
 	}
-	
-	while (auto use = firstUse)
+
+	// Retarget every use in place, then splice the whole list at the front of the replacement's:
+	// one pass instead of an unlink/relink per use.
+	ExpressionUse* last = firstUse;
+	for (ExpressionUse* use = firstUse; use != nullptr; use = use->next)
 	{
-		use->setUse(expression);
+		use->expression = expression;
+		last = use;
 	}
+
+	last->next = expression->firstUse;
+	if (expression->firstUse != nullptr)
+	{
+		expression->firstUse->prev.setPointer(last);
+	}
+	expression->firstUse = firstUse;
+	expression->useCount += useCount;
+	firstUse = nullptr;
+	useCount = 0;
 }
 
 Statement* Expression::ancestorOfAllUses()
@@ -276,7 +296,7 @@ bool NumericExpression::operator==(const Expression& that) const
 
 
 TokenExpression::TokenExpression(AstContext& ctx, unsigned uses, const ExpressionType& type, llvm::StringRef token)
-: Expression(Token, ctx, uses), expressionType(type), token(ctx.getPool().copyString(token))
+: Expression(Token, ctx, uses), expressionType(type), token(StringInternTable::intern(token))
 {
 	assert(uses == 0);
 	assert(token.size() > 0 && token[0] != '\0');
@@ -286,7 +306,8 @@ bool TokenExpression::operator==(const Expression& that) const
 {
 	if (auto tokenExpr = llvm::dyn_cast<TokenExpression>(&that))
 	{
-		return strcmp(this->token, tokenExpr->token) == 0;
+		// Tokens are interned, so identical contents means identical storage.
+		return this->token.data() == tokenExpr->token.data();
 	}
 	return false;
 }
@@ -317,6 +338,11 @@ CallExpression::const_iterator CallExpression::params_begin() const
 	return iter;
 }
 
+void CallExpression::addParameter(Expression* expression)
+{
+	ctx.addOperand(*this, expression);
+}
+
 bool CastExpression::operator==(const Expression& that) const
 {
 	return defaultEqualityCheck(*this, that);
@@ -381,7 +407,7 @@ bool AssemblyExpression::operator==(const Expression& that) const
 AssignableExpression::AssignableExpression(AstContext& ctx, unsigned uses, const ExpressionType& type, StringRef prefix, bool addressable)
 : Expression(Assignable, ctx, uses)
 , expressionType(type)
-, prefix(ctx.getPool().copyString(prefix))
+, prefix(StringInternTable::intern(prefix))
 , addressable(addressable)
 {
 	assert(uses == 0);
@@ -392,7 +418,7 @@ bool AssignableExpression::operator==(const Expression& that) const
 	if (auto thatAssignable = dyn_cast<AssignableExpression>(&that))
 	{
 		return &expressionType == &thatAssignable->expressionType
-			&& strcmp(prefix, thatAssignable->prefix) == 0;
+			&& prefix.data() == thatAssignable->prefix.data();
 	}
 	return false;
 }
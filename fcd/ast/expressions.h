@@ -29,9 +29,16 @@ class Expression : public ExpressionUser
 	using OptionallyConst = typename std::conditional<B, typename std::add_const<T>::type, typename std::remove_const<T>::type>::type;
 	
 	friend class ExpressionUse;
-	
+	friend class AstContext;
+
 private:
 	class ExpressionUse* firstUse;
+	unsigned useCount;
+	// Negation pairing (see AstContext::negate): once a negation of this expression has been
+	// materialized, both nodes point at each other so that repeated negations during condition
+	// synthesis reuse the same node instead of growing fresh trees. replaceAllUsesWith breaks the
+	// pairing, since it retargets the partner's operand along with every other use.
+	Expression* negationPartner;
 	
 protected:
 	static bool defaultEqualityCheck(const Expression& a, const Expression& b);
@@ -80,7 +87,7 @@ public:
 	}
 	
 	Expression(UserType type, AstContext& ctx, unsigned allocatedUses, unsigned usedUses)
-	: ExpressionUser(type, allocatedUses, usedUses), firstUse(nullptr)
+	: ExpressionUser(type, allocatedUses, usedUses), firstUse(nullptr), useCount(0), negationPartner(nullptr)
 	{
 		assert(type >= ExpressionMin && type < ExpressionMax);
 		// The context parameter only forces subclasses to accept one, for uniformity purposes.
@@ -105,7 +112,7 @@ public:
 	
 	// Be mindful that this counts uses from unreferenced users too (which is rarely what you want).
 	// For best results, the AST should be cloned.
-	unsigned uses_size() const;
+	unsigned uses_size() const { return useCount; }
 	bool uses_empty() const { return firstUse == nullptr; }
 	bool uses_many() const { return firstUse != nullptr && firstUse->getNext() != nullptr; }
 	
@@ -212,11 +219,18 @@ public:
 	{
 		return node->getUserType() == NAryOperator;
 	}
-	
+
+	using ExpressionUser::setOperands;
+
 	NAryOperatorExpression(AstContext& ctx, unsigned uses, NAryOperatorType type)
-	: Expression(NAryOperator, ctx, uses), type(type)
+	: NAryOperatorExpression(ctx, uses, uses, type)
+	{
+	}
+
+	NAryOperatorExpression(AstContext& ctx, unsigned allocatedUses, unsigned usedUses, NAryOperatorType type)
+	: Expression(NAryOperator, ctx, allocatedUses, usedUses), type(type)
 	{
-		assert(uses > 0);
+		assert(usedUses > 0);
 	}
 	
 	template<typename... TExpressionType>
@@ -342,7 +356,9 @@ struct NumericExpression final : public Expression
 struct TokenExpression final : public Expression
 {
 	const ExpressionType& expressionType;
-	NOT_NULL(const char) token;
+	// Interned process-wide (see string_intern.h): identical tokens share storage and compare
+	// by pointer, and the length comes precomputed for printing.
+	llvm::StringRef token;
 	
 	static bool classof(const ExpressionUser* node)
 	{
@@ -357,16 +373,23 @@ struct TokenExpression final : public Expression
 
 class CallExpression final : public Expression
 {
+	AstContext& ctx;
+
 public:
 	static bool classof(const ExpressionUser* node)
 	{
 		return node->getUserType() == Call;
 	}
-	
+
 	explicit CallExpression(AstContext& ctx, unsigned uses, NOT_NULL(Expression) callee)
-	: Expression(Call, ctx, uses)
+	: CallExpression(ctx, uses, uses, callee)
+	{
+	}
+
+	CallExpression(AstContext& ctx, unsigned allocatedUses, unsigned usedUses, NOT_NULL(Expression) callee)
+	: Expression(Call, ctx, allocatedUses, usedUses), ctx(ctx)
 	{
-		assert(uses > 0);
+		assert(usedUses > 0);
 		setCallee(callee);
 	}
 	
@@ -494,7 +517,8 @@ struct AssemblyExpression final : public Expression
 struct AssignableExpression final : public Expression
 {
 	const ExpressionType& expressionType;
-	NOT_NULL(const char) prefix;
+	// Interned process-wide, like TokenExpression::token.
+	llvm::StringRef prefix;
 	bool addressable;
 	
 	static bool classof(const ExpressionUser* node)
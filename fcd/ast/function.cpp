@@ -21,7 +21,7 @@
 using namespace llvm;
 using namespace std;
 
-void FunctionNode::print(llvm::raw_ostream &os)
+void FunctionNode::printPrototype(llvm::raw_ostream& os)
 {
 	const ExpressionType& returnType = context.getType(*function.getReturnType());
 	FunctionExpressionType& functionType = context.createFunction(returnType);
@@ -35,7 +35,12 @@ void FunctionNode::print(llvm::raw_ostream &os)
 		functionType.append(context.getType(*arg.getType()), argName);
 	}
 	StatementPrintVisitor::declare(os, functionType, function.getName());
-	
+}
+
+void FunctionNode::print(llvm::raw_ostream &os)
+{
+	printPrototype(os);
+
 	if (hasBody())
 	{
 		os << '\n';
@@ -47,7 +47,9 @@ public:
 	
 	StatementList& getBody() { return *body; }
 	bool hasBody() const { return !body->empty(); }
-	
+
+	// Prints the declaration header only: return type, name and named parameters, no terminator.
+	void printPrototype(llvm::raw_ostream& os);
 	void print(llvm::raw_ostream& os);
 	void dump() const;
 };
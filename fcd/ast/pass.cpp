@@ -7,15 +7,60 @@
 // license. See LICENSE.md for details.
 //
 
+#include "command_line.h"
 #include "pass.h"
+#include "phase_timing.h"
+#include "statistics.h"
 
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/Support/PrettyStackTrace.h>
+#include <llvm/Support/raw_ostream.h>
 
 using namespace llvm;
 using namespace std;
 
 namespace
 {
+	cl::opt<unsigned> gateStatementLimit("gate-statement-limit", cl::desc("Functions whose structured body has more statements than this skip the expensive AST passes; the cheap combiners still run. 0 disables the gate."), cl::init(100000), whitelist());
+
+	StatCounter gatedAstSkips("ast.sizegate.skips");
+
+	// Statement count of the body, nested bodies included; the gate only pays for it on passes
+	// that declared themselves expensive.
+	size_t countStatements(StatementList& list)
+	{
+		size_t count = 0;
+		SmallVector<Statement*, 32> stack;
+		for (Statement* statement : list)
+		{
+			stack.push_back(statement);
+		}
+		while (!stack.empty())
+		{
+			Statement* statement = stack.pop_back_val();
+			++count;
+			if (auto ifElse = dyn_cast<IfElseStatement>(statement))
+			{
+				for (Statement* child : ifElse->getIfBody())
+				{
+					stack.push_back(child);
+				}
+				for (Statement* child : ifElse->getElseBody())
+				{
+					stack.push_back(child);
+				}
+			}
+			else if (auto loop = dyn_cast<LoopStatement>(statement))
+			{
+				for (Statement* child : loop->getLoopBody())
+				{
+					stack.push_back(child);
+				}
+			}
+		}
+		return count;
+	}
+
 	void getUsingStatements(unordered_set<Statement*>& set, Expression* expr)
 	{
 		for (auto& use : expr->uses())
@@ -43,6 +88,7 @@ void AstModulePass::run(deque<unique_ptr<FunctionNode>>& fn)
 {
 	if (fn.size() > 0)
 	{
+		PhaseTimingScope timing(string("ast: ") + getName());
 		doRun(fn);
 	}
 }
@@ -53,8 +99,19 @@ void AstFunctionPass::doRun(deque<unique_ptr<FunctionNode>>& list)
 	{
 		if (runOnDeclarations || funcNode->hasBody())
 		{
+			if (expensive && gateStatementLimit != 0 && funcNode->hasBody())
+			{
+				size_t statements = countStatements(funcNode->getBody());
+				if (statements > gateStatementLimit)
+				{
+					errs() << "fcd: " << funcNode->getFunction().getName() << ": " << statements << " statements exceed the gating limit; skipping " << getName() << '\n';
+					++gatedAstSkips;
+					continue;
+				}
+			}
+
 			PrettyStackTraceFormat runPass("Running AST pass \"%s\" on function \"%s\"", getName(), string(funcNode->getFunction().getName()).c_str());
-			
+
 			this->fn = funcNode.get();
 			doRun(*funcNode);
 		}
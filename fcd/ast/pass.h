@@ -34,19 +34,23 @@ class AstFunctionPass : public AstModulePass
 {
 	FunctionNode* fn;
 	bool runOnDeclarations;
-	
+	bool expensive;
+
 protected:
 	AstContext& context() { return fn->getContext(); }
-	
+
 	virtual void doRun(std::deque<std::unique_ptr<FunctionNode>>& function) override final;
 	virtual void doRun(FunctionNode& function) = 0;
-	
+
 public:
-	AstFunctionPass(bool runOnDeclarations = false)
-	: runOnDeclarations(runOnDeclarations)
+	// Passes that declare themselves expensive are skipped on functions whose structured body has
+	// more statements than --gate-statement-limit, so one pathological function can't dominate the
+	// AST phase; the skip is reported when it happens.
+	AstFunctionPass(bool runOnDeclarations = false, bool expensive = false)
+	: runOnDeclarations(runOnDeclarations), expensive(expensive)
 	{
 	}
-	
+
 	virtual ~AstFunctionPass() = default;
 };
 
@@ -7,21 +7,34 @@
 // license. See LICENSE.md for details.
 //
 
+#include "command_line.h"
+#include "cpu_affinity.h"
 #include "metadata.h"
 #include "pass_backend.h"
 #include "passes.h"
 #include "pre_ast_cfg.h"
+#include "statistics.h"
 
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/PostOrderIterator.h>
 #include <llvm/ADT/SCCIterator.h>
+#include <llvm/Support/MathExtras.h>
 #include <llvm/Analysis/DominanceFrontierImpl.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/raw_os_ostream.h>
 
 #include <algorithm>
+#include <chrono>
 #include <deque>
 #include <list>
+#include <map>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 using namespace llvm;
@@ -29,15 +42,15 @@ using namespace std;
 
 namespace
 {
-	uint64_t getVirtualAddress(FunctionNode& node)
-	{
-		if (auto address = md::getVirtualAddress(node.getFunction()))
-		{
-			return address->getLimitedValue();
-		}
-		return 0;
-	}
-	
+	// One pathological function (an interpreter dispatch loop, say) shouldn't be able to stall a
+	// whole corpus run. Functions over either ceiling are emitted as a prototype instead of being
+	// structured; everything else in the module still comes out in full.
+	cl::opt<unsigned> structuringBlockLimit("structuring-block-limit", cl::desc("Emit functions with more than this many basic blocks as a prototype instead of structuring them (0 = no limit)"), cl::init(0), whitelist());
+	cl::opt<unsigned> structuringTimeLimit("structuring-time-limit", cl::desc("Give up structuring a function after this many seconds and emit its prototype instead (0 = no limit)"), cl::init(0), whitelist());
+	cl::opt<bool> unorderedFunctions("unordered-functions", cl::desc("Emit functions in completion order instead of input order; pair with --pseudocode-index so consumers can seek or reassemble"), whitelist());
+	StatCounter conjunctionsReused("ast.conditions.conjunction_reuse");
+	StatCounter conditionTermsDropped("ast.conditions.terms_eliminated");
+
 	struct DfsStackItem
 	{
 		PreAstBasicBlock& block;
@@ -55,6 +68,13 @@ namespace
 		}
 	};
 	
+	// Membership test for structuring sets keyed by dense block ID. Blocks created after a set was
+	// sized (redirectors, fake exits) can never be members of it, so out-of-range IDs test false.
+	bool isMember(const BitVector& set, const PreAstBasicBlock& block)
+	{
+		return block.blockId < set.size() && set.test(block.blockId);
+	}
+
 	void ensureLoopsExit(PreAstContext& function)
 	{
 		// This ensures that every loop has an exit for the purpose of calculating the post-dominator tree.
@@ -63,12 +83,16 @@ namespace
 			if (iter.hasLoop())
 			{
 				bool hasOutsideSuccessor = false;
-				SmallPtrSet<PreAstBasicBlock*, 16> loopMembers(iter->begin(), iter->end());
+				BitVector loopMembers(function.size());
+				for (auto block : *iter)
+				{
+					loopMembers.set(block->blockId);
+				}
 				for (auto block : *iter)
 				{
 					hasOutsideSuccessor = any_of(block->successors, [&](PreAstBasicBlockEdge* edge)
 					{
-						return loopMembers.count(edge->to) == 0;
+						return !isMember(loopMembers, *edge->to);
 					});
 					
 					if (hasOutsideSuccessor)
@@ -83,7 +107,7 @@ namespace
 					{
 						auto outsidePredecessorIter = find_if(block->predecessors, [&](PreAstBasicBlockEdge* edge)
 						{
-							return loopMembers.count(edge->from) == 0;
+							return !isMember(loopMembers, *edge->from);
 						});
 						
 						if (outsidePredecessorIter != block->predecessors.end())
@@ -106,26 +130,6 @@ namespace
 		return *a == *b;
 	}
 	
-	bool areOpposites(const Expression& a, const Expression& b)
-	{
-		if (auto unary = dyn_cast<UnaryOperatorExpression>(&a))
-		if (unary->getType() == UnaryOperatorExpression::LogicalNegate)
-		{
-			return unary->getOperand() == &b;
-		}
-		if (auto unary = dyn_cast<UnaryOperatorExpression>(&b))
-		if (unary->getType() == UnaryOperatorExpression::LogicalNegate)
-		{
-			return unary->getOperand() == &a;
-		}
-		return false;
-	}
-	
-	struct ConjunctionEntry
-	{
-		SmallVector<Expression*, 4> expressions;
-	};
-	
 	SmallVector<Expression*, 4> splitNaryOperator(Expression& expr, NAryOperatorExpression::NAryOperatorType type)
 	{
 		SmallVector<Expression*, 4> result;
@@ -144,125 +148,345 @@ namespace
 		return result;
 	}
 	
-	template<typename TIter>
-	Expression* createDisjunction(AstContext& ctx, TIter begin, TIter end)
+	// A dedicated engine for reaching conditions. Pattern-independent structuring emits
+	// sum-of-products conditions whose term count explodes on irreducible or deeply merged CFGs,
+	// far past what the token-level simplifier claws back after the fact. The engine keeps one
+	// table of atomic predicates per function and represents every term as positive/negative
+	// literal masks over it, then runs the classic two-level reductions (contradiction, absorption,
+	// unit deletion, single-literal consensus) to a fixpoint before any AST node is built, so
+	// conditions stay canonical and minimal as regions fold and never feed their redundancy into
+	// the next collapse.
+	class ConditionEngine
 	{
-		// This removes trivially true expressions from disjunctions. For instance, the following:
-		// (A) || (!A && B) || (!A && !B && C)
-		// should be simplified as A || B || C.
-		// (The function relies on the format of the conditionals that reaching conditions create: it's absolutely not
-		// a general-purpose expression simplification algorithm.)
-		
-		SmallVector<ConjunctionEntry, 4> inputConjunctions;
-		SmallVector<size_t, 4> sizeOneConjunctions;
-		SmallVector<size_t, 4> largerConjunctions;
-		for (auto iter = begin; iter != end; ++iter)
+		typedef SmallVector<uint64_t, 2> LiteralSet;
+
+		// One product term: x ∈ positive means the term requires x, x ∈ negative means it
+		// requires !x. Bit indices are ids into the atom table.
+		struct Term
+		{
+			LiteralSet positive;
+			LiteralSet negative;
+		};
+
+		AstContext& ctx;
+		SmallVector<Expression*, 16> atoms;
+		DenseMap<Expression*, unsigned> atomIds;
+
+		static bool testBit(const LiteralSet& set, unsigned index)
 		{
-			size_t index = inputConjunctions.size();
-			inputConjunctions.emplace_back();
-			auto& conjunction = inputConjunctions.back();
-			conjunction.expressions = splitNaryOperator(**iter, NAryOperatorExpression::ShortCircuitAnd);
-			if (conjunction.expressions.size() == 1)
+			return (set[index / 64] >> (index % 64) & 1) != 0;
+		}
+
+		static void setBit(LiteralSet& set, unsigned index)
+		{
+			set[index / 64] |= uint64_t(1) << (index % 64);
+		}
+
+		static void clearBit(LiteralSet& set, unsigned index)
+		{
+			set[index / 64] &= ~(uint64_t(1) << (index % 64));
+		}
+
+		static bool intersects(const LiteralSet& a, const LiteralSet& b)
+		{
+			for (size_t i = 0; i < a.size(); ++i)
 			{
-				sizeOneConjunctions.push_back(index);
+				if ((a[i] & b[i]) != 0)
+				{
+					return true;
+				}
 			}
-			else if (conjunction.expressions.size() != 0)
+			return false;
+		}
+
+		static bool isSubsetOf(const LiteralSet& a, const LiteralSet& b)
+		{
+			for (size_t i = 0; i < a.size(); ++i)
 			{
-				largerConjunctions.push_back(index);
+				if ((a[i] & ~b[i]) != 0)
+				{
+					return false;
+				}
 			}
-			else
+			return true;
+		}
+
+		static bool isEmpty(const Term& term)
+		{
+			for (uint64_t word : term.positive)
+			{
+				if (word != 0)
+				{
+					return false;
+				}
+			}
+			for (uint64_t word : term.negative)
+			{
+				if (word != 0)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		static size_t literalCount(const Term& term)
+		{
+			size_t count = 0;
+			for (uint64_t word : term.positive)
 			{
-				llvm_unreachable("empty conjunction?!");
+				count += countPopulation(word);
 			}
+			for (uint64_t word : term.negative)
+			{
+				count += countPopulation(word);
+			}
+			return count;
 		}
-		
-		SmallVector<NOT_NULL(Expression), 4> resultExpressions;
-		if (sizeOneConjunctions.size() > 0)
+
+		// True when a's literals are a subset of b's, meaning a implies the disjunction whenever b
+		// does and b is redundant.
+		static bool subsumes(const Term& a, const Term& b)
 		{
-			do
+			return isSubsetOf(a.positive, b.positive) && isSubsetOf(a.negative, b.negative);
+		}
+
+		unsigned atomId(Expression* literal, bool& negated)
+		{
+			negated = false;
+			Expression* atom = literal;
+			while (auto unaryExpression = dyn_cast<UnaryOperatorExpression>(atom))
 			{
-				auto sizeOneEntryIter = sizeOneConjunctions.end() - 1;
-				auto sizeOne = &inputConjunctions[*sizeOneEntryIter];
-				sizeOneConjunctions.erase(sizeOneEntryIter);
-				
-				auto largerEntryIter = largerConjunctions.begin();
-				while (largerEntryIter != largerConjunctions.end())
+				if (unaryExpression->getType() != UnaryOperatorExpression::LogicalNegate)
 				{
-					auto larger = &inputConjunctions[*largerEntryIter];
-					auto iter = find_if(larger->expressions, [&](Expression* expr) {
-						return areOpposites(*sizeOne->expressions.front(), *expr);
-					});
-					if (iter != larger->expressions.end())
-					{
-						larger->expressions.erase(iter);
-						if (larger->expressions.size() == 1)
-						{
-							largerEntryIter = largerConjunctions.erase(largerEntryIter);
-							sizeOneConjunctions.push_back(*largerEntryIter);
-							continue;
-						}
-					}
-					++largerEntryIter;
+					break;
 				}
+				negated = !negated;
+				atom = unaryExpression->getOperand();
 			}
-			while (sizeOneConjunctions.size() > 0);
-			
-			if (largerConjunctions.size() > 1)
+
+			auto insertResult = atomIds.insert({atom, unsigned(atoms.size())});
+			if (insertResult.second)
+			{
+				atoms.push_back(atom);
+			}
+			return insertResult.first->second;
+		}
+
+		Expression* literalFor(unsigned id, bool negated)
+		{
+			return negated ? ctx.negate(atoms[id]) : atoms[id];
+		}
+
+		Expression* buildConjunction(const Term& term)
+		{
+			SmallVector<Expression*, 4> literals;
+			for (unsigned id = 0; id < atoms.size(); ++id)
 			{
-				// Count occurrences of expressions.
-				unordered_map<Expression*, unsigned> occurrences;
-				for (auto conjunction : largerConjunctions)
+				if (id / 64 >= term.positive.size())
+				{
+					break;
+				}
+				if (testBit(term.positive, id))
+				{
+					literals.push_back(literalFor(id, false));
+				}
+				if (testBit(term.negative, id))
 				{
-					for (auto expression : inputConjunctions[conjunction].expressions)
+					literals.push_back(literalFor(id, true));
+				}
+			}
+			if (literals.size() == 0)
+			{
+				return ctx.expressionForTrue();
+			}
+			return ctx.nary(NAryOperatorExpression::ShortCircuitAnd, literals.begin(), literals.end(), true);
+		}
+
+	public:
+		ConditionEngine(AstContext& ctx)
+		: ctx(ctx)
+		{
+		}
+
+		template<typename TIter>
+		Expression* createDisjunction(TIter begin, TIter end)
+		{
+			// Decompose every input into (atom, polarity) literals first, so that the masks can be
+			// sized once the whole batch has registered its atoms.
+			SmallVector<SmallVector<pair<unsigned, bool>, 4>, 4> inputs;
+			for (auto iter = begin; iter != end; ++iter)
+			{
+				inputs.emplace_back();
+				for (Expression* literal : splitNaryOperator(**iter, NAryOperatorExpression::ShortCircuitAnd))
+				{
+					bool negated;
+					unsigned id = atomId(literal, negated);
+					inputs.back().push_back({id, negated});
+				}
+			}
+
+			size_t words = (atoms.size() + 63) / 64;
+			SmallVector<Term, 4> terms;
+			for (auto& literals : inputs)
+			{
+				Term term;
+				term.positive.assign(words, 0);
+				term.negative.assign(words, 0);
+				for (auto& literal : literals)
+				{
+					setBit(literal.second ? term.negative : term.positive, literal.first);
+				}
+				// x && !x is unsatisfiable and contributes nothing to a disjunction.
+				if (intersects(term.positive, term.negative))
+				{
+					++conditionTermsDropped;
+					continue;
+				}
+				terms.push_back(move(term));
+			}
+
+			for (bool changed = true; changed;)
+			{
+				changed = false;
+
+				// Absorption: any term whose literals include all of another term's is redundant.
+				for (size_t i = 0; i < terms.size(); ++i)
+				{
+					for (size_t j = terms.size(); j-- > i + 1;)
 					{
-						++occurrences[expression];
+						if (subsumes(terms[i], terms[j]))
+						{
+							terms.erase(terms.begin() + j);
+							++conditionTermsDropped;
+							changed = true;
+						}
+						else if (subsumes(terms[j], terms[i]))
+						{
+							terms[i] = move(terms[j]);
+							terms.erase(terms.begin() + j);
+							++conditionTermsDropped;
+							changed = true;
+						}
 					}
 				}
-				
-				// The simplest and most reasonable thing to do is th simplify for expressions that are present in
-				// every remaining expressions. This is not a perfect solution, but the problem is NP-complete, so yeah.
-				SmallVector<Expression*, 1> commonSubExpressions;
-				for (const auto& pair : occurrences)
+
+				// Unit deletion: once some term is the single literal x, !x is dead weight in every
+				// other term (x || (!x && rest) == x || rest).
+				for (size_t i = 0; i < terms.size(); ++i)
 				{
-					if (pair.second == largerConjunctions.size())
+					if (literalCount(terms[i]) != 1)
+					{
+						continue;
+					}
+					for (size_t j = 0; j < terms.size(); ++j)
 					{
-						commonSubExpressions.push_back(pair.first);
+						if (j == i)
+						{
+							continue;
+						}
+						if (intersects(terms[i].positive, terms[j].negative))
+						{
+							for (size_t word = 0; word < words; ++word)
+							{
+								terms[j].negative[word] &= ~terms[i].positive[word];
+							}
+							changed = true;
+						}
+						if (intersects(terms[i].negative, terms[j].positive))
+						{
+							for (size_t word = 0; word < words; ++word)
+							{
+								terms[j].positive[word] &= ~terms[i].negative[word];
+							}
+							changed = true;
+						}
 					}
 				}
-				
-				if (commonSubExpressions.size() > 0)
+
+				// Consensus on a single complemented literal: (C && x) || (C && !x) == C.
+				for (size_t i = 0; i < terms.size() && !changed; ++i)
 				{
-					SmallVector<Expression*, 4> remainingConjunctions;
-					for (auto conjunctionIndex : largerConjunctions)
+					for (size_t j = i + 1; j < terms.size() && !changed; ++j)
 					{
-						auto& expressions = inputConjunctions[conjunctionIndex].expressions;
-						for (Expression* subExpression : commonSubExpressions)
+						unsigned differing = 0;
+						unsigned differingId = 0;
+						for (unsigned id = 0; id < atoms.size() && differing < 2; ++id)
 						{
-							expressions.erase(remove(expressions.begin(), expressions.end(), subExpression));
+							bool posMismatch = testBit(terms[i].positive, id) != testBit(terms[j].positive, id);
+							bool negMismatch = testBit(terms[i].negative, id) != testBit(terms[j].negative, id);
+							if (posMismatch != negMismatch)
+							{
+								// A literal present in one term and absent from the other: not a
+								// pure polarity flip, so the rule doesn't apply.
+								differing = 2;
+							}
+							else if (posMismatch)
+							{
+								++differing;
+								differingId = id;
+							}
+						}
+						if (differing == 1)
+						{
+							clearBit(terms[i].positive, differingId);
+							clearBit(terms[i].negative, differingId);
+							terms.erase(terms.begin() + j);
+							++conditionTermsDropped;
+							changed = true;
 						}
-						auto expression = ctx.nary(NAryOperatorExpression::ShortCircuitAnd, expressions.begin(), expressions.end(), true);
-						remainingConjunctions.push_back(expression);
 					}
-					commonSubExpressions.push_back(createDisjunction(ctx, remainingConjunctions.begin(), remainingConjunctions.end()));
-					resultExpressions.push_back(ctx.nary(NAryOperatorExpression::ShortCircuitAnd, commonSubExpressions.begin(), commonSubExpressions.end(), true));
-					
-					// Remove in reverse order to avoid invalidating indices that are still used.
-					sort(largerConjunctions.begin(), largerConjunctions.end());
-					for (auto iter = largerConjunctions.rbegin(); iter != largerConjunctions.rend(); ++iter)
+				}
+
+				// A term with no literals left is vacuously true, and so is the disjunction.
+				for (Term& term : terms)
+				{
+					if (isEmpty(term))
 					{
-						inputConjunctions.erase(inputConjunctions.begin() + *iter);
+						return ctx.expressionForTrue();
 					}
 				}
 			}
+
+			if (terms.size() == 0)
+			{
+				return ctx.expressionForFalse();
+			}
+
+			// Factor literals common to every term, so the result reads as C && (A || B) instead of
+			// repeating C in every branch of the disjunction.
+			Term common = terms.front();
+			for (size_t i = 1; i < terms.size(); ++i)
+			{
+				for (size_t word = 0; word < words; ++word)
+				{
+					common.positive[word] &= terms[i].positive[word];
+					common.negative[word] &= terms[i].negative[word];
+				}
+			}
+
+			SmallVector<Expression*, 4> disjuncts;
+			for (Term& term : terms)
+			{
+				if (terms.size() > 1)
+				{
+					for (size_t word = 0; word < words; ++word)
+					{
+						term.positive[word] &= ~common.positive[word];
+						term.negative[word] &= ~common.negative[word];
+					}
+				}
+				disjuncts.push_back(buildConjunction(term));
+			}
+
+			Expression* disjunction = ctx.nary(NAryOperatorExpression::ShortCircuitOr, disjuncts.begin(), disjuncts.end(), true);
+			if (terms.size() > 1 && !isEmpty(common))
+			{
+				disjunction = ctx.nary(NAryOperatorExpression::ShortCircuitAnd, buildConjunction(common), disjunction);
+			}
+			return disjunction;
 		}
-		
-		for (auto& conjunction : inputConjunctions)
-		{
-			auto andedExpression = ctx.nary(NAryOperatorExpression::ShortCircuitAnd, conjunction.expressions.begin(), conjunction.expressions.end(), true);
-			resultExpressions.push_back(andedExpression);
-		}
-		return ctx.nary(NAryOperatorExpression::ShortCircuitOr, resultExpressions.begin(), resultExpressions.end(), true);
-	}
+	};
 	
 	class Structurizer
 	{
@@ -279,7 +503,30 @@ namespace
 		DomFrontier& domFrontier;
 		list<PreAstBasicBlock*> blocksInReversePostOrder;
 		typedef decltype(blocksInReversePostOrder)::iterator block_iterator;
-		
+		chrono::steady_clock::time_point deadline;
+		bool abandoned;
+		// Reaching conditions in switch-heavy regions rebuild the same AND-sequences over and over
+		// across sibling blocks and successive collapses; keying on the operand sequence shares one
+		// node per distinct list for the lifetime of the function.
+		std::map<std::vector<Expression*>, Expression*> conjunctionCache;
+		// Atom table persists for the whole function, so conditions come out canonical across
+		// successive region collapses.
+		ConditionEngine conditions;
+
+		Expression* cachedConjunction(Expression** begin, Expression** end)
+		{
+			auto& cached = conjunctionCache[vector<Expression*>(begin, end)];
+			if (cached == nullptr)
+			{
+				cached = ctx.nary(NAryOperatorExpression::ShortCircuitAnd, begin, end);
+			}
+			else
+			{
+				++conjunctionsReused;
+			}
+			return cached;
+		}
+
 		bool isRegion(PreAstBasicBlock* entry, PreAstBasicBlock* exit)
 		{
 			typedef PreAstBasicBlockRegionTraits::DomFrontierT::DomSetType DomSetType;
@@ -336,20 +583,33 @@ namespace
 			return true;
 		}
 		
-		bool regionContains(PreAstBasicBlock* entry, PreAstBasicBlock* exit, PreAstBasicBlock* block)
+		// Collects the blocks of the entry/exit region into a set, straight from the dominator tree.
+		// The entry dominates every member, so the members are exactly the surviving blocks of the
+		// entry's dominator subtree — minus the exit's own subtree when the entry dominates the exit
+		// too. removeRegionFromDomTree already erased everything collapsed by earlier reductions, so
+		// this costs one subtree walk per reduction instead of two dominance queries per block of
+		// the whole remaining function.
+		void collectRegionMembers(PreAstBasicBlock* entry, PreAstBasicBlock* exit, BitVector& members)
 		{
-			if (domTree.getNode(block) == nullptr)
+			auto entryNode = domTree.getNode(entry);
+			if (entryNode == nullptr)
 			{
-				return false;
+				return;
 			}
-			
-			if (exit == nullptr)
+
+			bool entryDominatesExit = exit != nullptr && domTree.dominates(entry, exit);
+			SmallVector<PreAstBasicBlockRegionTraits::DomTreeNodeT*, 16> toVisit;
+			toVisit.push_back(entryNode);
+			while (toVisit.size() > 0)
 			{
-				// top-level region contains everything
-				return true;
+				auto node = toVisit.pop_back_val();
+				if (entryDominatesExit && node->getBlock() == exit)
+				{
+					continue;
+				}
+				members.set(node->getBlock()->blockId);
+				toVisit.append(node->begin(), node->end());
 			}
-			
-			return domTree.dominates(entry, block) && !(domTree.dominates(exit, block) && domTree.dominates(entry, exit));
 		}
 		
 		StatementReference foldBasicBlocks(block_iterator begin, block_iterator end)
@@ -361,17 +621,17 @@ namespace
 			
 			// Do we have loops?
 			bool isLoop = false;
-			SmallPtrSet<PreAstBasicBlock*, 16> memberBlocks;
+			BitVector memberBlocks(function.size());
 			for (PreAstBasicBlock* bb : make_range(begin, end))
 			{
 				// Identify back-edges. If we find any back-edge, we know that we have to wrap this region in a loop
 				// and insert break statements.
-				memberBlocks.insert(bb);
+				memberBlocks.set(bb->blockId);
 				if (!isLoop)
 				{
 					for (auto succEdge : bb->successors)
 					{
-						if (memberBlocks.count(succEdge->to))
+						if (isMember(memberBlocks, *succEdge->to))
 						{
 							isLoop = true;
 							break;
@@ -388,7 +648,7 @@ namespace
 				{
 					for (auto edge : bb->successors)
 					{
-						if (memberBlocks.count(edge->to) == 0)
+						if (!isMember(memberBlocks, *edge->to))
 						{
 							loopExit = edge->to;
 							break;
@@ -401,7 +661,7 @@ namespace
 					for (PreAstBasicBlockEdge* exitingEdge : loopExit->predecessors)
 					{
 						PreAstBasicBlock& predecessor = *exitingEdge->from;
-						if (memberBlocks.count(&predecessor) > 0)
+						if (isMember(memberBlocks, predecessor))
 						{
 							Statement* conditionalBreak = ctx.breakStatement(exitingEdge->edgeCondition);
 							predecessor.blockStatement->push_back(conditionalBreak);
@@ -486,7 +746,7 @@ namespace
 							auto copySize = copyEnd - copyBegin;
 							if (copySize != 0)
 							{
-								Expression* subsequence = ctx.nary(NAryOperatorExpression::ShortCircuitAnd, copyBegin, copyEnd);
+								Expression* subsequence = cachedConjunction(copyBegin, copyEnd);
 								disjunctionTerms.push_back(subsequence);
 							}
 						}
@@ -496,7 +756,7 @@ namespace
 					if (disjunctionTerms.size() > 0)
 					{
 						// (Some more post-processing for inverted prefixes happens here.)
-						Expression* disjunctionExpression = createDisjunction(ctx, disjunctionTerms.rbegin(), disjunctionTerms.rend());
+						Expression* disjunctionExpression = conditions.createDisjunction(disjunctionTerms.rbegin(), disjunctionTerms.rend());
 						statementToInsert = { ctx.ifElse(disjunctionExpression, move(statementToInsert).take()) };
 					}
 					for (Expression* term : make_range(commonSuffix.rbegin(), commonSuffix.rend()))
@@ -525,16 +785,20 @@ namespace
 		// return.second -> exit
 		StatementReference splitAndFoldRegion(block_iterator entry, block_iterator exit)
 		{
-			SmallPtrSet<PreAstBasicBlock*, 8> allBlocks;
+			BitVector allBlocks(function.size());
 			auto blocksEnd = blocksInReversePostOrder.end();
 			if (exit == blocksEnd)
 			{
-				allBlocks.insert(blocksInReversePostOrder.begin(), blocksInReversePostOrder.end());
+				for (PreAstBasicBlock* block : blocksInReversePostOrder)
+				{
+					allBlocks.set(block->blockId);
+				}
 			}
-			
+
 			// Do a depth-first search to identify loop nodes.
-			unordered_set<PreAstBasicBlock*> loopNodes;
-			unordered_set<PreAstBasicBlock*> regionNodes { *entry };
+			BitVector loopNodes(function.size());
+			BitVector regionNodes(function.size());
+			regionNodes.set((*entry)->blockId);
 			deque<PreAstBasicBlock*> orderedLoopNodes;
 			deque<PreAstBasicBlock*> orderedRegionNodes { *entry };
 			SmallVector<PreAstBasicBlockEdge*, 4> backEdges;
@@ -556,7 +820,7 @@ namespace
 				// Do not traverse blocks that are outside of this region. This means that we have to stop when we get
 				// to the exit. If the exit is the end iterator, then we are in the presence of a loop, and we have to
 				// stop whenever we see a block that hasn't been visited by the region algorithm yet.
-				if (allBlocks.count(edge->to) == 0)
+				if (!isMember(allBlocks, *edge->to))
 				{
 					continue;
 				}
@@ -564,9 +828,10 @@ namespace
 				{
 					continue;
 				}
-				
-				if (regionNodes.insert(edge->to).second)
+
+				if (!isMember(regionNodes, *edge->to))
 				{
+					regionNodes.set(edge->to->blockId);
 					orderedRegionNodes.push_back(edge->to);
 				}
 				
@@ -576,12 +841,13 @@ namespace
 					backEdges.push_back(edge);
 				}
 				
-				if (edgeToIter != dfsStack.end() || loopNodes.count(edge->to) != 0)
+				if (edgeToIter != dfsStack.end() || isMember(loopNodes, *edge->to))
 				{
 					for (auto& item : dfsStack)
 					{
-						if (loopNodes.insert(&item.block).second)
+						if (!isMember(loopNodes, item.block))
 						{
+							loopNodes.set(item.block.blockId);
 							orderedLoopNodes.push_back(&item.block);
 						}
 					}
@@ -592,7 +858,7 @@ namespace
 				}
 			}
 			
-			if (loopNodes.size() == 0)
+			if (orderedLoopNodes.empty())
 			{
 				return foldBasicBlocks(entry, exit);
 			}
@@ -607,15 +873,15 @@ namespace
 			{
 				for (PreAstBasicBlockEdge* edge : block->predecessors)
 				{
-					if (loopNodes.count(edge->from) == 0)
+					if (!isMember(loopNodes, *edge->from))
 					{
 						enteringEdges.push_back(edge);
 					}
 				}
-				
+
 				for (PreAstBasicBlockEdge* edge : block->successors)
 				{
-					if (loopNodes.count(edge->to) == 0)
+					if (!isMember(loopNodes, *edge->to))
 					{
 						exitingEdges.push_back(edge);
 					}
@@ -632,12 +898,12 @@ namespace
 				if (&edge != &enteringEdges.front() && edge->to != enteringEdges.front()->to)
 				{
 					PreAstBasicBlock* newEntry = &function.createRedirectorBlock(enteringEdges);
-					if (loopNodes.count(*entry) == 0)
+					if (!isMember(loopNodes, **entry))
 					{
 						// Insert new block before the first loop node.
 						auto insertPosition = find_if(blocksInReversePostOrder, [&](PreAstBasicBlock* block)
 						{
-							return loopNodes.count(block) != 0;
+							return isMember(loopNodes, *block);
 						});
 						loopEntry = blocksInReversePostOrder.insert(insertPosition, newEntry);
 					}
@@ -686,18 +952,57 @@ namespace
 			return result;
 		}
 		
+		// Keeps the dominator tree in sync as a region collapses into its entry block. Blocks swallowed by
+		// the region no longer exist in the graph; their subtrees are reparented to the entry (which now
+		// stands for the whole region) and their nodes erased. This keeps dominance queries correct without
+		// recalculating the tree, so the cost of each reduction scales with the region instead of the
+		// whole function.
+		void removeRegionFromDomTree(PreAstBasicBlock* entry, block_iterator begin, block_iterator end)
+		{
+			auto entryNode = domTree.getNode(entry);
+			if (entryNode == nullptr)
+			{
+				return;
+			}
+
+			for (PreAstBasicBlock* block : make_range(begin, end))
+			{
+				if (block == entry)
+				{
+					continue;
+				}
+				if (auto node = domTree.getNode(block))
+				{
+					// eraseNode only accepts leaves; hoist children (copied, since reparenting mutates the
+					// list) to the entry's node first.
+					SmallVector<PreAstBasicBlockRegionTraits::DomTreeNodeT*, 8> children(node->begin(), node->end());
+					for (auto child : children)
+					{
+						domTree.changeImmediateDominator(child, entryNode);
+					}
+					domTree.eraseNode(block);
+				}
+			}
+		}
+
 		bool reduceRegion(PreAstBasicBlock* exit)
 		{
 			size_t regionSize = 0;
 			PreAstBasicBlock* entry = blocksInReversePostOrder.front();
-			
+
+			BitVector members(function.size());
+			collectRegionMembers(entry, exit, members);
+			size_t memberCount = members.count();
+
 			// As it turns out, cycles in the blocks list can cause nodes belonging to a single region to *not* be
-			// contiguous. This function therefore rearranges blocks as necessary.
+			// contiguous. This function therefore rearranges blocks as necessary. The scan stops as soon as every
+			// member has been seen, which keeps each reduction proportional to the region being folded instead of
+			// the whole block list.
 			auto regionEnd = blocksInReversePostOrder.end();
 			auto iter = blocksInReversePostOrder.begin();
-			while (iter != blocksInReversePostOrder.end())
+			while (iter != blocksInReversePostOrder.end() && regionSize < memberCount)
 			{
-				if (regionContains(entry, exit, *iter))
+				if (isMember(members, **iter))
 				{
 					++regionSize;
 					if (regionEnd != blocksInReversePostOrder.end())
@@ -712,9 +1017,13 @@ namespace
 				{
 					regionEnd = iter;
 				}
-				
+
 				++iter;
 			}
+			if (regionEnd == blocksInReversePostOrder.end())
+			{
+				regionEnd = iter;
+			}
 			
 			if (regionSize == 1)
 			{
@@ -746,7 +1055,7 @@ namespace
 				while (predIter != exit->predecessors.end())
 				{
 					// This leaves unreachable nodes pointing to exit, but we're going to get rid of the graph anyway.
-					if (regionContains(entry, exit, (*predIter)->from))
+					if (isMember(members, *(*predIter)->from))
 					{
 						predIter = exit->predecessors.erase(predIter);
 					}
@@ -762,21 +1071,33 @@ namespace
 			
 			auto beginErase = blocksInReversePostOrder.begin();
 			++beginErase;
+			removeRegionFromDomTree(entry, beginErase, regionEnd);
 			blocksInReversePostOrder.erase(beginErase, regionEnd);
 			
 			return true;
 		}
 		
 	public:
-		Structurizer(PreAstContext& function, DomTree& domTree, PostDomTree& postDomTree, DomFrontier& domFrontier)
+		Structurizer(PreAstContext& function, DomTree& domTree, PostDomTree& postDomTree, DomFrontier& domFrontier, chrono::steady_clock::time_point deadline)
 		: ctx(function.getContext()), function(function), domTree(domTree), postDomTree(postDomTree), domFrontier(domFrontier)
+		, deadline(deadline), abandoned(false), conditions(function.getContext())
 		{
 		}
-		
+
+		// True when structurizeFunction bailed out on its deadline; the returned statement
+		// reference is then meaningless and the function should be demoted.
+		bool ranOutOfTime() const { return abandoned; }
+
 		StatementReference structurizeFunction()
 		{
 			for (PreAstBasicBlock* entry : post_order(&function))
 			{
+				if (chrono::steady_clock::now() >= deadline)
+				{
+					abandoned = true;
+					return StatementReference();
+				}
+
 				blocksInReversePostOrder.push_front(entry);
 				
 				// "entry" is only a possible entry if this test passes.
@@ -815,7 +1136,7 @@ char AstBackEnd::ID = 0;
 static RegisterPass<AstBackEnd> astBackEnd("-ast-backend", "Produce AST from LLVM module");
 
 AstBackEnd::AstBackEnd()
-: ModulePass(ID)
+: ModulePass(ID), parallelJobs(1), prototypeOutput(nullptr)
 {
 }
 
@@ -837,34 +1158,86 @@ void AstBackEnd::addPass(AstModulePass *pass)
 bool AstBackEnd::runOnModule(llvm::Module &m)
 {
 	outputNodes.clear();
-	
+	workerContexts.clear();
+
+	// Declaration nodes stay on the original module; only bodies need structuring.
+	vector<Function*> toStructure;
 	for (Function& fn : m)
 	{
 		outputNodes.emplace_back(new FunctionNode(fn));
-		output = outputNodes.back().get();
 		if (!md::isPrototype(fn))
 		{
-			runOnFunction(fn);
+			toStructure.push_back(&fn);
 		}
 	}
-	
-	// sort outputNodes by virtual address, then by name
-	sort(outputNodes.begin(), outputNodes.end(), [](unique_ptr<FunctionNode>& a, unique_ptr<FunctionNode>& b)
+
+	// The index decodes each function's address metadata once instead of once per comparison.
+	FunctionAddressIndex addressIndex;
+	addressIndex.build(m);
+	auto orderedBefore = [&](FunctionNode& a, FunctionNode& b)
 	{
-		auto virtA = getVirtualAddress(*a);
-		auto virtB = getVirtualAddress(*b);
+		auto virtA = addressIndex.getAddress(a.getFunction());
+		auto virtB = addressIndex.getAddress(b.getFunction());
 		if (virtA < virtB)
 		{
 			return true;
 		}
 		else if (virtA == virtB)
 		{
-			return a->getFunction().getName() < b->getFunction().getName();
+			return a.getFunction().getName() < b.getFunction().getName();
 		}
 		else
 		{
 			return false;
 		}
+	};
+
+	// Two-stage emission: signatures are settled by now, so the whole declaration section can go
+	// out before the first body is even structured. Duplicates are left out because the printing
+	// pass renders them as #define aliases instead of declarations.
+	if (prototypeOutput != nullptr)
+	{
+		vector<FunctionNode*> prototypes;
+		for (auto& node : outputNodes)
+		{
+			if (!md::getDuplicateOf(node->getFunction()))
+			{
+				prototypes.push_back(node.get());
+			}
+		}
+		sort(prototypes.begin(), prototypes.end(), [&](FunctionNode* a, FunctionNode* b)
+		{
+			return orderedBefore(*a, *b);
+		});
+		for (FunctionNode* node : prototypes)
+		{
+			node->printPrototype(*prototypeOutput);
+			*prototypeOutput << ";\n";
+		}
+		if (!prototypes.empty())
+		{
+			*prototypeOutput << '\n';
+		}
+		prototypeOutput->flush();
+	}
+
+	unsigned jobs = static_cast<unsigned>(min<size_t>(parallelJobs, toStructure.size()));
+	if (jobs > 1)
+	{
+		structureFunctionsInParallel(m, toStructure, jobs);
+	}
+	else
+	{
+		for (Function* fn : toStructure)
+		{
+			outputNodes.push_back(structureFunction(*fn));
+		}
+	}
+
+	// sort outputNodes by virtual address, then by name
+	sort(outputNodes.begin(), outputNodes.end(), [&](unique_ptr<FunctionNode>& a, unique_ptr<FunctionNode>& b)
+	{
+		return orderedBefore(*a, *b);
 	});
 	
 	// run passes
@@ -876,26 +1249,134 @@ bool AstBackEnd::runOnModule(llvm::Module &m)
 	return false;
 }
 
-void AstBackEnd::runOnFunction(Function& fn)
+unique_ptr<FunctionNode> AstBackEnd::structureFunction(Function& fn)
 {
-	// Create AST block graph.
-	outputNodes.emplace_back(new FunctionNode(fn));
-	FunctionNode& result = *outputNodes.back();
-	blockGraph.reset(new PreAstContext(result.getContext()));
-	blockGraph->generateBlocks(fn);
-	
+	// Create AST block graph. Everything here is local to the node (which owns its pool and
+	// AstContext), so structureFunction can run concurrently for different functions.
+	auto structureStart = chrono::steady_clock::now();
+	auto recordStructureTime = [&]
+	{
+		auto elapsed = chrono::steady_clock::now() - structureStart;
+		md::addTimingNanoseconds(fn, "structure", chrono::duration_cast<chrono::nanoseconds>(elapsed).count());
+	};
+	unique_ptr<FunctionNode> result(new FunctionNode(fn));
+
+	if (structuringBlockLimit != 0 && fn.size() > structuringBlockLimit)
+	{
+		// Leaving the body empty makes the node print as a prototype.
+		errs() << "fcd: " << fn.getName() << ": " << fn.size() << " basic blocks exceed the structuring limit; emitting prototype only\n";
+		return result;
+	}
+
+	PreAstContext blockGraph(result->getContext());
+	blockGraph.generateBlocks(fn);
+
 	// Ensure that loops all have an exit node, for the sake of the post-dominator tree.
-	ensureLoopsExit(*blockGraph);
-	
+	ensureLoopsExit(blockGraph);
+
 	// Compute regions.
 	PreAstBasicBlockRegionTraits::DomTreeT domTree(false);
 	PreAstBasicBlockRegionTraits::PostDomTreeT postDomTree(true);
 	PreAstBasicBlockRegionTraits::DomFrontierT dominanceFrontier;
-	domTree.recalculate(*blockGraph);
-	postDomTree.recalculate(*blockGraph);
+	domTree.recalculate(blockGraph);
+	postDomTree.recalculate(blockGraph);
 	dominanceFrontier.analyze(domTree);
-	Structurizer structurizer(*blockGraph, domTree, postDomTree, dominanceFrontier);
-	result.getBody() = structurizer.structurizeFunction().take();
+
+	auto deadline = chrono::steady_clock::time_point::max();
+	if (structuringTimeLimit != 0)
+	{
+		deadline = chrono::steady_clock::now() + chrono::seconds(structuringTimeLimit);
+	}
+	Structurizer structurizer(blockGraph, domTree, postDomTree, dominanceFrontier, deadline);
+	StatementReference body = structurizer.structurizeFunction();
+	if (structurizer.ranOutOfTime())
+	{
+		errs() << "fcd: " << fn.getName() << ": structuring exceeded the time limit; emitting prototype only\n";
+		recordStructureTime();
+		return result;
+	}
+	result->getBody() = move(body).take();
+	recordStructureTime();
+	return result;
+}
+
+void AstBackEnd::structureFunctionsInParallel(Module& m, const vector<Function*>& toStructure, unsigned jobs)
+{
+	// Same approach as the parallel phases of the frontend: snapshot the module as bitcode and give
+	// each worker its own LLVMContext copy, since structuring creates constants and types and
+	// LLVMContext is not thread-safe. Functions are partitioned round-robin and results land in
+	// per-function slots, so the output is deterministic regardless of scheduling.
+	SmallVector<char, 0> moduleBits;
+	raw_svector_ostream moduleOs(moduleBits);
+	WriteBitcodeToFile(&m, moduleOs);
+
+	vector<unique_ptr<FunctionNode>> structured(toStructure.size());
+	vector<char> emitted(toStructure.size());
+	mutex emissionLock;
+	workerContexts.resize(jobs);
+	vector<thread> workers;
+	for (unsigned workerIndex = 0; workerIndex < jobs; ++workerIndex)
+	{
+		workers.emplace_back([&, workerIndex]()
+		{
+			pinWorkerThread(workerIndex);
+			auto context = std::make_unique<LLVMContext>();
+			MemoryBufferRef bufferRef(StringRef(moduleBits.data(), moduleBits.size()), "fcd-ast-worker");
+			auto workerModule = parseBitcodeFile(bufferRef, *context);
+			if (!workerModule)
+			{
+				consumeError(workerModule.takeError());
+				return;
+			}
+
+			for (size_t i = workerIndex; i < toStructure.size(); i += jobs)
+			{
+				// A function can fail to survive the round-trip with its body and name intact;
+				// leaving the slot empty hands it to the serial fallback below.
+				Function* fn = workerModule.get()->getFunction(toStructure[i]->getName());
+				if (fn != nullptr && !fn->isDeclaration())
+				{
+					auto node = structureFunction(*fn);
+					if (unorderedFunctions)
+					{
+						// Completed functions go straight to the output instead of waiting in
+						// their ordered slot; the pseudocode index is what keeps the result
+						// consumable despite the scheduling-dependent order.
+						lock_guard<mutex> lock(emissionLock);
+						outputNodes.push_back(move(node));
+						emitted[i] = 1;
+					}
+					else
+					{
+						structured[i] = move(node);
+					}
+				}
+			}
+
+			workerContexts[workerIndex] = make_pair(move(context), move(workerModule.get()));
+		});
+	}
+
+	for (thread& worker : workers)
+	{
+		worker.join();
+	}
+
+	for (size_t i = 0; i < toStructure.size(); ++i)
+	{
+		// Slots from a worker whose module copy failed to parse are redone serially on the original.
+		if (unorderedFunctions)
+		{
+			if (!emitted[i])
+			{
+				outputNodes.push_back(structureFunction(*toStructure[i]));
+			}
+		}
+		else
+		{
+			outputNodes.push_back(structured[i] != nullptr ? move(structured[i]) : structureFunction(*toStructure[i]));
+		}
+	}
 }
 
 AstBackEnd* createAstBackEnd()
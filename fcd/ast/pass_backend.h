@@ -32,22 +32,26 @@
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
-
-class PreAstContext;
+#include <utility>
+#include <vector>
 
 // XXX Make this a legit LLVM backend?
 // Doesn't sound like a bad idea, but I don't really know where to start.
 class AstBackEnd final : public llvm::ModulePass
 {
-	std::unique_ptr<PreAstContext> blockGraph;
 	std::deque<std::unique_ptr<FunctionNode>> outputNodes;
 	std::deque<std::unique_ptr<AstModulePass>> passes;
-	FunctionNode* output;
-	
-	inline DumbAllocator& pool() { return output->getPool(); }
-	
-	void runOnFunction(llvm::Function& fn);
-	
+	// Worker copies of the module made for parallel structuring. They stay alive for as long as the
+	// output nodes, since structured nodes reference functions inside them.
+	std::vector<std::pair<std::unique_ptr<llvm::LLVMContext>, std::unique_ptr<llvm::Module>>> workerContexts;
+	unsigned parallelJobs;
+	// When set, every function prototype is printed here before structuring begins, so consumers
+	// that only need declarations see them long before the first body is ready.
+	llvm::raw_ostream* prototypeOutput;
+
+	std::unique_ptr<FunctionNode> structureFunction(llvm::Function& fn);
+	void structureFunctionsInParallel(llvm::Module& m, const std::vector<llvm::Function*>& toStructure, unsigned jobs);
+
 public:
 	static char ID;
 	
@@ -61,8 +65,11 @@ public:
 	
 	virtual void getAnalysisUsage(llvm::AnalysisUsage &au) const override;
 	virtual bool runOnModule(llvm::Module& m) override;
-	
+
 	void addPass(AstModulePass* pass);
+
+	void setParallelJobs(unsigned jobs) { parallelJobs = jobs; }
+	void setPrototypeOutput(llvm::raw_ostream& output) { prototypeOutput = &output; }
 };
 
 AstBackEnd* createAstBackEnd();
@@ -9,8 +9,11 @@
 
 #include "analysis_liveness.h"
 #include "ast_passes.h"
+#include "statistics.h"
 #include "visitor.h"
 
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/EquivalenceClasses.h>
 #include <llvm/ADT/SmallVector.h>
 
 #include <set>
@@ -40,6 +43,14 @@ namespace
 		}
 		return true;
 	}
+
+	// When the aggregated live sets of two congruence classes overlap, deciding the merge requires
+	// pairwise queries between their members. Past this many pairs, give up on that one merge rather
+	// than stall on pathological functions.
+	constexpr size_t maxPairwiseCongruenceChecks = 0x10000;
+
+	StatCounter congruenceTypeRejects("ast.congruence.type_rejects");
+	StatCounter congruenceExtentMerges("ast.congruence.extent_merges");
 }
 
 namespace
@@ -60,11 +71,11 @@ namespace
 				while (assignment->uses_size() > 0)
 				{
 					auto statement = cast<ExpressionStatement>(assignment->uses_begin()->getUser());
-					StatementList::erase(statement);
-					statement->dropAllReferences();
+					ctx.eraseStatement(*statement);
 				}
 			}
 		}
+		ctx.notifyExpressionReplaced(*toReplace, *replaceWith);
 	}
 }
 
@@ -72,7 +83,12 @@ void AstMergeCongruentVariables::doRun(FunctionNode &fn)
 {
 	LivenessAnalysis liveness;
 	liveness.collectStatementIndices(fn);
-	
+
+	// Every rewrite below goes through the context so that the analysis absorbs each delta as it
+	// happens and its facts stay valid for the whole run, instead of going stale after the first
+	// statement erasure.
+	AstRewriteTransaction transaction(context(), liveness);
+
 	// Can we remove explicit load and call expression statements?
 	// Loads and calls are special in that they are themselves rooted as statements. For instance, a load expression for
 	// `foo` has a `foo;` statement, which typically gets rewritten as `int anon1 = foo;` by the printer, and subsequent
@@ -135,8 +151,7 @@ void AstMergeCongruentVariables::doRun(FunctionNode &fn)
 			// first case `foo()` is called unconditionally.
 			if (declaration->getParentList() == firstUse->getParentList())
 			{
-				StatementList::erase(declaration);
-				declaration->dropAllReferences();
+				context().eraseStatement(*declaration);
 			}
 		}
 	}
@@ -164,19 +179,127 @@ void AstMergeCongruentVariables::doRun(FunctionNode &fn)
 		}
 	}
 	
+	// Grow congruence classes with a union-find instead of deciding every candidate pair in isolation.
+	// Candidates whose variables already ended up in the same class cost nothing, and a merge is
+	// normally decided by one word-parallel test against the aggregated liveness of the two classes;
+	// members only get compared pairwise when the aggregates overlap.
+	EquivalenceClasses<Expression*> congruenceClasses;
+	auto collectClass = [&](Expression* key, SmallVectorImpl<Expression*>& members, pair<size_t, size_t>& extent, bool& hasAddressable)
+	{
+		for (auto iter = congruenceClasses.findLeader(key); iter != congruenceClasses.member_end(); ++iter)
+		{
+			members.push_back(*iter);
+			auto memberExtent = liveness.getLiveExtent(*iter);
+			extent.first = min(extent.first, memberExtent.first);
+			extent.second = max(extent.second, memberExtent.second);
+			hasAddressable |= isExpressionAddressable(*iter);
+		}
+	};
+	auto aggregateLiveness = [&](const SmallVectorImpl<Expression*>& members, BitVector& live, BitVector& defs)
+	{
+		for (Expression* member : members)
+		{
+			live |= liveness.getLiveStatements(member);
+			defs |= liveness.getDefStatements(member);
+		}
+	};
+
+	for (auto& candidate : candidateSet)
+	{
+		// Variables of different types never merge; reject the pair before any class bookkeeping.
+		// Expression types are uniqued by the context, so this is a pointer comparison.
+		if (&candidate.first->getExpressionType(context()) != &candidate.second->getExpressionType(context()))
+		{
+			++congruenceTypeRejects;
+			continue;
+		}
+
+		congruenceClasses.insert(candidate.first);
+		congruenceClasses.insert(candidate.second);
+		if (congruenceClasses.getLeaderValue(candidate.first) == congruenceClasses.getLeaderValue(candidate.second))
+		{
+			continue;
+		}
+
+		SmallVector<Expression*, 8> membersA;
+		SmallVector<Expression*, 8> membersB;
+		auto extentA = make_pair(numeric_limits<size_t>::max(), size_t(0));
+		auto extentB = extentA;
+		bool addressableA = false;
+		bool addressableB = false;
+		collectClass(candidate.first, membersA, extentA, addressableA);
+		collectClass(candidate.second, membersB, extentB, addressableB);
+
+		// Only the non-addressable side of a merge can be renamed, so a class can absorb at most one
+		// addressable variable.
+		if (addressableA && addressableB)
+		{
+			continue;
+		}
+
+		// If the live-or-def extents of the two classes don't even overlap, no statement can carry
+		// both sides and the merge is safe without materializing any live set.
+		if (extentA.second < extentB.first || extentB.second < extentA.first)
+		{
+			++congruenceExtentMerges;
+			congruenceClasses.unionSets(candidate.first, candidate.second);
+			continue;
+		}
+
+		BitVector liveA, defsA, liveB, defsB;
+		aggregateLiveness(membersA, liveA, defsA);
+		aggregateLiveness(membersB, liveB, defsB);
+
+		bool congruent;
+		if (!liveA.anyCommon(defsB) && !liveB.anyCommon(defsA))
+		{
+			congruent = true;
+		}
+		else if (membersA.size() * membersB.size() <= maxPairwiseCongruenceChecks)
+		{
+			congruent = all_of(membersA, [&](Expression* a)
+			{
+				return all_of(membersB, [&](Expression* b)
+				{
+					return liveness.congruent(a, b);
+				});
+			});
+		}
+		else
+		{
+			congruent = false;
+		}
+
+		if (congruent)
+		{
+			congruenceClasses.unionSets(candidate.first, candidate.second);
+		}
+	}
+
 	// Only merge after we're officially done touching the liveness analysis object, since it holds a ton of references.
 	deque<pair<ExpressionReference, ExpressionReference>> mergeList;
-	for (auto& candidate : candidateSet)
+	for (auto iter = congruenceClasses.begin(); iter != congruenceClasses.end(); ++iter)
 	{
-		if (liveness.congruent(candidate.first, candidate.second))
+		if (!iter->isLeader())
 		{
-			if (!isExpressionAddressable(candidate.first))
+			continue;
+		}
+
+		// Keep the addressable member if the class has one, since it is the member that cannot be renamed.
+		Expression* representative = nullptr;
+		for (auto member = congruenceClasses.member_begin(iter); member != congruenceClasses.member_end(); ++member)
+		{
+			if (representative == nullptr || isExpressionAddressable(*member))
 			{
-				mergeList.emplace_back(candidate.first, candidate.second);
+				representative = *member;
 			}
-			else if (!isExpressionAddressable(candidate.second))
+		}
+
+		for (auto member = congruenceClasses.member_begin(iter); member != congruenceClasses.member_end(); ++member)
+		{
+			if (*member != representative)
 			{
-				mergeList.emplace_back(candidate.second, candidate.first);
+				mergeList.emplace_back(*member, representative);
 			}
 		}
 	}
@@ -0,0 +1,335 @@
+//
+// pass_export.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "expression_type.h"
+#include "metadata.h"
+#include "pass_export.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	// Every record starts with the magic and a format version, so that concatenated streams from
+	// separate runs (or appended shards) stay readable and consumers can detect format changes.
+	//
+	// Record layout, where all integers are LEB128 varints unless stated otherwise:
+	//   "FCDA" (4 raw bytes), version, kind (1 byte)
+	//   kind 0 (function): name, virtual address, statement list
+	//   kind 1 (alias): name, aliasee name
+	//
+	// Types and expressions are emitted with local back-references: the first occurrence within a
+	// record writes tag 0 followed by an inline definition and implicitly receives the next id in
+	// pre-order; later occurrences write id + 1. This preserves expression sharing (the AST is a
+	// DAG) without any global state, keeping records self-contained.
+	constexpr char recordMagic[4] = { 'F', 'C', 'D', 'A' };
+	constexpr uint64_t formatVersion = 1;
+
+	// Records from parallel AST backends (see the sharded pseudocode path) interleave at record
+	// granularity; this lock keeps each record's bytes contiguous.
+	mutex outputLock;
+
+	class AstSerializer
+	{
+		raw_ostream& os;
+		AstContext& astContext;
+		unordered_map<const ExpressionType*, uint64_t> typeIds;
+		unordered_map<const Expression*, uint64_t> exprIds;
+
+		void writeByte(uint8_t byte)
+		{
+			os.write(static_cast<char>(byte));
+		}
+
+		void writeVarint(uint64_t value)
+		{
+			while (value >= 0x80)
+			{
+				writeByte(static_cast<uint8_t>(value) | 0x80);
+				value >>= 7;
+			}
+			writeByte(static_cast<uint8_t>(value));
+		}
+
+		void writeString(StringRef string)
+		{
+			writeVarint(string.size());
+			os.write(string.data(), string.size());
+		}
+
+		void writeType(const ExpressionType& type)
+		{
+			auto iter = typeIds.find(&type);
+			if (iter != typeIds.end())
+			{
+				writeVarint(iter->second + 1);
+				return;
+			}
+
+			writeVarint(0);
+			typeIds.insert({&type, typeIds.size()});
+			writeByte(static_cast<uint8_t>(type.getType()));
+			switch (type.getType())
+			{
+				case ExpressionType::Void:
+					break;
+
+				case ExpressionType::Integer:
+				{
+					const auto& integer = cast<IntegerExpressionType>(type);
+					writeByte(integer.isSigned());
+					writeVarint(integer.getBits());
+					break;
+				}
+
+				case ExpressionType::Pointer:
+					writeType(cast<PointerExpressionType>(type).getNestedType());
+					break;
+
+				case ExpressionType::Array:
+				{
+					const auto& array = cast<ArrayExpressionType>(type);
+					writeType(array.getNestedType());
+					writeVarint(array.size());
+					break;
+				}
+
+				case ExpressionType::Structure:
+				{
+					const auto& structure = cast<StructExpressionType>(type);
+					writeString(structure.getName());
+					writeVarint(structure.size());
+					for (const ExpressionTypeField& field : structure)
+					{
+						writeString(field.name);
+						writeType(field.type);
+					}
+					break;
+				}
+
+				case ExpressionType::Function:
+				{
+					const auto& function = cast<FunctionExpressionType>(type);
+					writeType(function.getReturnType());
+					writeVarint(function.size());
+					for (const ExpressionTypeField& parameter : function)
+					{
+						writeString(parameter.name);
+						writeType(parameter.type);
+					}
+					break;
+				}
+			}
+		}
+
+		void writeExpression(const Expression& expression)
+		{
+			auto iter = exprIds.find(&expression);
+			if (iter != exprIds.end())
+			{
+				writeVarint(iter->second + 1);
+				return;
+			}
+
+			writeVarint(0);
+			exprIds.insert({&expression, exprIds.size()});
+			writeByte(static_cast<uint8_t>(expression.getUserType()));
+			switch (expression.getUserType())
+			{
+				case ExpressionUser::Token:
+				{
+					const auto& token = cast<TokenExpression>(expression);
+					writeType(token.expressionType);
+					writeString(token.token);
+					break;
+				}
+
+				case ExpressionUser::Numeric:
+				{
+					const auto& numeric = cast<NumericExpression>(expression);
+					writeType(numeric.expressionType);
+					writeVarint(numeric.ui64);
+					break;
+				}
+
+				case ExpressionUser::UnaryOperator:
+					writeByte(static_cast<uint8_t>(cast<UnaryOperatorExpression>(expression).getType()));
+					break;
+
+				case ExpressionUser::NAryOperator:
+					writeByte(static_cast<uint8_t>(cast<NAryOperatorExpression>(expression).getType()));
+					break;
+
+				case ExpressionUser::MemberAccess:
+				case ExpressionUser::PointerAccess:
+					writeVarint(cast<MemberAccessExpression>(expression).getFieldIndex());
+					break;
+
+				case ExpressionUser::Cast:
+					writeType(cast<CastExpression>(expression).getExpressionType(astContext));
+					break;
+
+				case ExpressionUser::Aggregate:
+					writeType(cast<AggregateExpression>(expression).getExpressionType(astContext));
+					break;
+
+				case ExpressionUser::Assembly:
+				{
+					const auto& assembly = cast<AssemblyExpression>(expression);
+					writeType(assembly.expressionType);
+					writeString(StringRef(assembly.assembly));
+					break;
+				}
+
+				case ExpressionUser::Assignable:
+				{
+					const auto& assignable = cast<AssignableExpression>(expression);
+					writeType(assignable.expressionType);
+					writeString(assignable.prefix);
+					writeByte(assignable.addressable);
+					break;
+				}
+
+				case ExpressionUser::Call:
+				case ExpressionUser::Ternary:
+				case ExpressionUser::Subscript:
+					// no scalar payload; the operand list below carries everything
+					break;
+
+				default:
+					llvm_unreachable("unhandled expression type!");
+			}
+
+			writeVarint(expression.operands_size());
+			for (const ExpressionUse& use : expression.operands())
+			{
+				writeExpression(*use.getUse());
+			}
+		}
+
+		void writeStatement(const Statement& statement)
+		{
+			writeByte(static_cast<uint8_t>(statement.getUserType()));
+			switch (statement.getUserType())
+			{
+				case ExpressionUser::IfElse:
+				{
+					const auto& ifElse = cast<IfElseStatement>(statement);
+					writeExpression(*ifElse.getCondition());
+					writeList(ifElse.getIfBody());
+					writeList(ifElse.getElseBody());
+					break;
+				}
+
+				case ExpressionUser::Loop:
+				{
+					const auto& loop = cast<LoopStatement>(statement);
+					writeByte(static_cast<uint8_t>(loop.getPosition()));
+					writeExpression(*loop.getCondition());
+					writeList(loop.getLoopBody());
+					break;
+				}
+
+				case ExpressionUser::Keyword:
+				{
+					const auto& keyword = cast<KeywordStatement>(statement);
+					writeString(StringRef(keyword.name));
+					if (const Expression* operand = keyword.getOperand())
+					{
+						writeByte(1);
+						writeExpression(*operand);
+					}
+					else
+					{
+						writeByte(0);
+					}
+					break;
+				}
+
+				case ExpressionUser::Expr:
+					writeExpression(*cast<ExpressionStatement>(statement).getExpression());
+					break;
+
+				default:
+					llvm_unreachable("unhandled statement type!");
+			}
+		}
+
+	public:
+		AstSerializer(raw_ostream& os, AstContext& astContext)
+		: os(os), astContext(astContext)
+		{
+		}
+
+		void writeList(const StatementList& list)
+		{
+			writeVarint(list.size());
+			for (const Statement* statement : list)
+			{
+				writeStatement(*statement);
+			}
+		}
+
+		void writeRecordHeader(uint8_t kind, StringRef name, uint64_t virtualAddress)
+		{
+			os.write(recordMagic, sizeof recordMagic);
+			writeVarint(formatVersion);
+			writeByte(kind);
+			writeString(name);
+			writeVarint(virtualAddress);
+		}
+
+		void writeAliasee(StringRef name)
+		{
+			writeString(name);
+		}
+	};
+}
+
+void AstExport::doRun(deque<unique_ptr<FunctionNode>>& functions)
+{
+	string bytes;
+	raw_string_ostream byteStream(bytes);
+	for (unique_ptr<FunctionNode>& fn : functions)
+	{
+		Function& function = fn->getFunction();
+		uint64_t virtualAddress = 0;
+		if (auto address = md::getVirtualAddress(function))
+		{
+			virtualAddress = address->getLimitedValue();
+		}
+
+		// Ids are local to each record, so every function gets a fresh serializer.
+		AstSerializer serializer(byteStream, fn->getContext());
+		if (auto original = md::getDuplicateOf(function))
+		{
+			serializer.writeRecordHeader(1, function.getName(), virtualAddress);
+			serializer.writeAliasee(original->getString());
+		}
+		else if (!fn->getBody().empty())
+		{
+			serializer.writeRecordHeader(0, function.getName(), virtualAddress);
+			serializer.writeList(fn->getBody());
+		}
+	}
+	byteStream.flush();
+
+	lock_guard<mutex> lock(outputLock);
+	output.write(bytes.data(), bytes.size());
+	output.flush();
+}
+
+const char* AstExport::getName() const
+{
+	return "Export AST";
+}
@@ -0,0 +1,37 @@
+//
+// pass_export.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__ast_pass_export_h
+#define fcd__ast_pass_export_h
+
+#include "pass.h"
+
+#include <llvm/Support/raw_ostream.h>
+
+// Writes a compact binary serialization of the final AST (see --emit-ast), so downstream tools can
+// consume the structure directly instead of re-parsing the pseudocode with a C front-end. Each
+// function is one self-contained record, which makes the format safe to append to and allows
+// parallel backends to interleave whole records into the same stream.
+class AstExport final : public AstModulePass
+{
+	llvm::raw_ostream& output;
+
+protected:
+	virtual void doRun(std::deque<std::unique_ptr<FunctionNode>>& functions) override;
+
+public:
+	AstExport(llvm::raw_ostream& output)
+	: output(output)
+	{
+	}
+
+	virtual const char* getName() const override;
+};
+
+#endif /* fcd__ast_pass_export_h */
@@ -7,28 +7,127 @@
 // license. See LICENSE.md for details.
 //
 
+#include "command_line.h"
+#include "metadata.h"
 #include "pass_print.h"
 
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
+
+#include <memory>
+#include <system_error>
+
 using namespace llvm;
 using namespace std;
 
+namespace
+{
+	cl::opt<bool> printFunctionTimings("function-timings", cl::desc("Annotate each function with its per-phase decompilation cost and statement count, so corpus runs can track per-function regressions"), whitelist());
+	cl::opt<string> pseudocodeIndex("pseudocode-index", cl::desc("Write one \"name address offset\" line per emitted function to this file, so consumers can seek into the output or reassemble it when functions are emitted out of order"), cl::value_desc("filename"), whitelist());
+
+	// Statement count of the structured body, nested bodies included: a size proxy that pairs with
+	// the phase timings without requiring the reader to parse the pseudocode.
+	size_t countStatements(StatementList& list)
+	{
+		size_t count = 0;
+		SmallVector<Statement*, 32> stack;
+		for (Statement* statement : list)
+		{
+			stack.push_back(statement);
+		}
+		while (!stack.empty())
+		{
+			Statement* statement = stack.pop_back_val();
+			++count;
+			if (auto ifElse = dyn_cast<IfElseStatement>(statement))
+			{
+				for (Statement* child : ifElse->getIfBody())
+				{
+					stack.push_back(child);
+				}
+				for (Statement* child : ifElse->getElseBody())
+				{
+					stack.push_back(child);
+				}
+			}
+			else if (auto loop = dyn_cast<LoopStatement>(statement))
+			{
+				for (Statement* child : loop->getLoopBody())
+				{
+					stack.push_back(child);
+				}
+			}
+		}
+		return count;
+	}
+}
+
 void AstPrint::doRun(deque<std::unique_ptr<FunctionNode>> &functions)
 {
+	unique_ptr<raw_fd_ostream> indexOut;
+	if (pseudocodeIndex.getNumOccurrences() > 0)
+	{
+		error_code indexError;
+		indexOut = std::make_unique<raw_fd_ostream>(pseudocodeIndex, indexError, sys::fs::F_None);
+		if (indexError)
+		{
+			errs() << "couldn't write pseudocode index " << pseudocodeIndex << ": " << indexError.message() << '\n';
+			indexOut.reset();
+		}
+	}
+	auto recordFunction = [&](FunctionNode& fn)
+	{
+		if (indexOut != nullptr)
+		{
+			uint64_t address = 0;
+			if (auto constantAddress = md::getVirtualAddress(fn.getFunction()))
+			{
+				address = constantAddress->getLimitedValue();
+			}
+			*indexOut << fn.getFunction().getName() << " 0x";
+			indexOut->write_hex(address);
+			*indexOut << ' ' << output.tell() << '\n';
+		}
+	};
+
 	for (const auto& file : includes)
 	{
 		output << "#include \"" << file << "\"\n";
 	}
-	
+
 	if (includes.size() > 0)
 	{
 		output << '\n';
 	}
-	
+
 	for (unique_ptr<FunctionNode>& fn : functions)
 	{
-		if (!fn->getBody().empty())
+		if (auto original = md::getDuplicateOf(fn->getFunction()))
+		{
+			// The body was folded into the original's after lifting; print the name as an alias so
+			// references to either still read correctly.
+			recordFunction(*fn);
+			StringRef name = fn->getFunction().getName();
+			output << "// " << name << " is identical to " << original->getString() << '\n';
+			output << "#define " << name << ' ' << original->getString() << "\n\n";
+			output.flush();
+		}
+		else if (!fn->getBody().empty())
 		{
+			recordFunction(*fn);
+			if (printFunctionTimings)
+			{
+				Function& llvmFn = fn->getFunction();
+				output << "// " << llvmFn.getName().str() << ": lift "
+					<< format("%.3f", md::getTimingNanoseconds(llvmFn, "lift") / 1e6) << " ms, structure "
+					<< format("%.3f", md::getTimingNanoseconds(llvmFn, "structure") / 1e6) << " ms, "
+					<< countStatements(fn->getBody()) << " statements\n";
+			}
 			fn->print(output);
+			// Flush each function as it completes so that output streams instead of accumulating,
+			// and so partial results survive if a later function dies.
+			output.flush();
 		}
 	}
 }
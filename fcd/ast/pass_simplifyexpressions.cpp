@@ -8,6 +8,7 @@
 //
 
 #include "ast_passes.h"
+#include "statistics.h"
 #include "visitor.h"
 
 #include <unordered_set>
@@ -17,6 +18,23 @@ using namespace std;
 
 namespace
 {
+	StatCounter expressionsSimplified("ast.expressions.simplified");
+	StatCounter undefAssignmentsRemoved("ast.statements.undef_assignments_removed");
+
+	// Folded in from the former standalone undef pass: spotting these during the simplifier's walk
+	// saves a full traversal of the tree, which matters on functions with hundreds of thousands of
+	// statements.
+	bool isUndefAssignment(AstContext& ctx, Expression& expr)
+	{
+		if (auto nary = llvm::dyn_cast<NAryOperatorExpression>(&expr))
+		if (nary->getType() == NAryOperatorExpression::Assign)
+		if (nary->getOperand(nary->operands_size() - 1) == ctx.expressionForUndef())
+		{
+			return true;
+		}
+		return false;
+	}
+
 	inline UnaryOperatorExpression* match(Expression* expr, UnaryOperatorExpression::UnaryOperatorType type)
 	{
 		if (auto unary = dyn_cast_or_null<UnaryOperatorExpression>(expr))
@@ -48,7 +66,27 @@ namespace
 	{
 		AstContext& ctx;
 		std::unordered_set<const ExpressionUser*> visitedExpressions;
-		
+		SmallVector<ExpressionUser*, 16> worklist;
+
+		// Redirects every use of `replaced` to `replacement` and requeues the affected users, so that
+		// simplifications cascade up the def-use chains instead of requiring another full tree walk.
+		void replaceAndRequeueUsers(Expression& replaced, NOT_NULL(Expression) replacement)
+		{
+			++expressionsSimplified;
+			while (!replaced.uses_empty())
+			{
+				auto& front = *replaced.uses_begin();
+				front.setUse(replacement);
+
+				auto user = front.getUser();
+				if (isa<Expression>(user) && visitedExpressions.erase(user))
+				{
+					worklist.push_back(user);
+				}
+			}
+			replaced.dropAllReferences();
+		}
+
 		void collectExpressionTerms(NAryOperatorExpression& baseExpression, SmallVectorImpl<Expression*>& trueTerms, SmallVectorImpl<Expression*>& falseTerms)
 		{
 			for (ExpressionUse& use : baseExpression.operands())
@@ -155,8 +193,7 @@ namespace
 			{
 				if (auto innerNegate = match(operand, UnaryOperatorExpression::LogicalNegate))
 				{
-					unary.replaceAllUsesWith(innerNegate->getOperand());
-					unary.dropAllReferences();
+					replaceAndRequeueUsers(unary, innerNegate->getOperand());
 				}
 				else if (auto innerNary = dyn_cast<NAryOperatorExpression>(operand))
 				{
@@ -165,8 +202,7 @@ namespace
 					{
 						auto flippedOp = static_cast<NAryOperatorExpression::NAryOperatorType>(op ^ 1);
 						auto replacement = ctx.nary(flippedOp, innerNary->getOperand(0), innerNary->getOperand(1));
-						unary.replaceAllUsesWith(replacement);
-						unary.dropAllReferences();
+						replaceAndRequeueUsers(unary, replacement);
 					}
 				}
 			}
@@ -174,8 +210,7 @@ namespace
 			{
 				if (auto innerAddressOf = match(operand, UnaryOperatorExpression::AddressOf))
 				{
-					unary.replaceAllUsesWith(innerAddressOf->getOperand());
-					unary.dropAllReferences();
+					replaceAndRequeueUsers(unary, innerAddressOf->getOperand());
 				}
 			}
 		}
@@ -193,24 +228,7 @@ namespace
 			
 			if (result != &nary)
 			{
-				bool needsRevisiting = result == ctx.expressionForTrue() || result == ctx.expressionForFalse();
-				while (!nary.uses_empty())
-				{
-					auto& front = *nary.uses_begin();
-					front.setUse(result);
-					
-					// Re-visit expressions if we detected a tautology/contradiction.
-					if (needsRevisiting)
-					{
-						auto user = front.getUser();
-						if (isa<Expression>(user) && visitedExpressions.erase(user))
-						{
-							visit(*user);
-						}
-					}
-				}
-				
-				nary.dropAllReferences();
+				replaceAndRequeueUsers(nary, result);
 			}
 		}
 		
@@ -257,8 +275,7 @@ namespace
 			if (auto constantIndex = dyn_cast<NumericExpression>(subscript.getIndex()))
 			if (constantIndex->ui64 == 0)
 			{
-				subscript.replaceAllUsesWith(addressOf->getOperand());
-				subscript.dropAllReferences();
+				replaceAndRequeueUsers(subscript, addressOf->getOperand());
 			}
 		}
 		
@@ -286,7 +303,19 @@ namespace
 				AstVisitor<ExpressionSimplifierVisitor, false>::visit(user);
 			}
 		}
-		
+
+		// Visits `user` and then drains the worklist of users whose operands were replaced, so that
+		// simplifications exposed by a replacement are applied before moving to the next statement.
+		void simplify(ExpressionUser& user)
+		{
+			visit(user);
+			while (!worklist.empty())
+			{
+				ExpressionUser* requeued = worklist.pop_back_val();
+				visit(*requeued);
+			}
+		}
+
 		void visitDefault(ExpressionUser& user)
 		{
 			llvm_unreachable("unimplemented expression simplification case");
@@ -295,41 +324,33 @@ namespace
 	
 	class StatementSimplifierVisitor : public AstVisitor<StatementSimplifierVisitor, false>
 	{
+		AstContext& ctx;
 		ExpressionSimplifierVisitor exprVisitor;
-		
+
 	public:
 		StatementSimplifierVisitor(AstContext& ctx)
-		: exprVisitor(ctx)
+		: ctx(ctx), exprVisitor(ctx)
 		{
 		}
 		
+		// Bodies are walked by the iterative driver in doRun; only the statement's own expressions
+		// need simplifying here. Interpreter loops nest statements deeply enough that recursing per
+		// level used to overflow the thread stack.
 		void visitIfElse(IfElseStatement& ifElse)
 		{
-			exprVisitor.visit(*ifElse.getCondition());
-			for (Statement* stmt : ifElse.getIfBody())
-			{
-				visit(*stmt);
-			}
-			for (Statement* stmt : ifElse.getElseBody())
-			{
-				visit(*stmt);
-			}
+			exprVisitor.simplify(*ifElse.getCondition());
 		}
-		
+
 		void visitLoop(LoopStatement& loop)
 		{
-			exprVisitor.visit(*loop.getCondition());
-			for (Statement* stmt : loop.getLoopBody())
-			{
-				visit(*stmt);
-			}
+			exprVisitor.simplify(*loop.getCondition());
 		}
 		
 		void visitKeyword(KeywordStatement& keyword)
 		{
 			if (auto operand = keyword.getOperand())
 			{
-				exprVisitor.visit(*operand);
+				exprVisitor.simplify(*operand);
 			}
 		}
 		
@@ -337,7 +358,15 @@ namespace
 		{
 			if (auto expr = expression.getExpression())
 			{
-				exprVisitor.visit(*expr);
+				if (isUndefAssignment(ctx, *expr))
+				{
+					// The driver already popped this statement, so dropping it in place is safe;
+					// eraseStatement notifies any live analyses.
+					ctx.eraseStatement(expression);
+					++undefAssignmentsRemoved;
+					return;
+				}
+				exprVisitor.simplify(*expr);
 			}
 		}
 		
@@ -351,7 +380,7 @@ namespace
 void AstSimplifyExpressions::doRun(FunctionNode &fn)
 {
 	StatementSimplifierVisitor visitor(fn.getContext());
-	visitAll(visitor, fn.getBody());
+	visitAllIterative(visitor, fn.getBody());
 }
 
 const char* AstSimplifyExpressions::getName() const
@@ -88,13 +88,14 @@ void PreAstBasicBlock::printAsOperand(llvm::raw_ostream& os, bool printType)
 }
 
 PreAstContext::PreAstContext(AstContext& ctx)
-: ctx(ctx)
+: ctx(ctx), pool(ctx.getPool())
 {
 }
 
 void PreAstContext::generateBlocks(Function& fn)
 {
 	std::unordered_map<llvm::BasicBlock*, Statement*> phiInStatements;
+	blockMapping.reserve(fn.size());
 	for (BasicBlock& bbRef : fn)
 	{
 		PreAstBasicBlock& preAstBB = createBlock();
@@ -10,6 +10,7 @@
 #ifndef pre_ast_cfg_h
 #define pre_ast_cfg_h
 
+#include "dumb_allocator.h"
 #include "not_null.h"
 
 #include <llvm/ADT/ArrayRef.h>
@@ -51,7 +52,11 @@ struct PreAstBasicBlock
 	
 	llvm::BasicBlock* block;
 	StatementReference blockStatement;
-	
+	// Dense ID, assigned at creation and unique within the owning PreAstContext. It identifies the
+	// object itself — content swaps don't move it — so the structurizer's membership sets can be
+	// BitVectors indexed by ID instead of pointer hash sets.
+	unsigned blockId;
+
 	PreAstBasicBlock() = default;
 	PreAstBasicBlock(const PreAstBasicBlock&) = delete;
 	PreAstBasicBlock(PreAstBasicBlock&&);
@@ -65,7 +70,10 @@ struct PreAstBasicBlock
 class PreAstContext
 {
 	AstContext& ctx;
-	std::deque<PreAstBasicBlockEdge> edgeList;
+	// Edges are trivially destructible and numerous (one per CFG edge, plus whatever the structurizer
+	// synthesizes), so they come out of the AST's arena instead of their own container. Blocks own
+	// non-trivial members and stay in a deque, which already hands out stable, chunk-contiguous storage.
+	DumbAllocator& pool;
 	std::deque<PreAstBasicBlock> blockList;
 	std::unordered_map<llvm::BasicBlock*, PreAstBasicBlock*> blockMapping;
 	
@@ -84,13 +92,13 @@ public:
 	
 	PreAstBasicBlockEdge& createEdge(PreAstBasicBlock& from, PreAstBasicBlock& to, Expression& edgeCondition)
 	{
-		edgeList.emplace_back(from, to, edgeCondition);
-		return edgeList.back();
+		return *pool.allocate<PreAstBasicBlockEdge>(from, to, edgeCondition);
 	}
 	
 	PreAstBasicBlock& createBlock()
 	{
 		blockList.emplace_back();
+		blockList.back().blockId = static_cast<unsigned>(blockList.size() - 1);
 		return blockList.back();
 	}
 	
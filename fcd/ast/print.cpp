@@ -154,6 +154,19 @@ namespace
 	{
 		return move(os.str());
 	}
+
+	raw_ostream& tabulate(raw_ostream& os, unsigned count)
+	{
+		static const char tabs[] = "\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+		constexpr size_t tabCount = sizeof tabs - 1;
+		while (count > tabCount)
+		{
+			os << tabs;
+			count -= tabCount;
+		}
+		os.write(tabs, count);
+		return os;
+	}
 	
 	template<typename TCollection>
 	void getStatementParents(PrintableItem* statement, TCollection& ancestry)
@@ -202,7 +215,7 @@ StatementPrintVisitor::Tokenization* StatementPrintVisitor::getIdentifier(const
 			raw_string_ostream(identifier.token) << "anon" << tokenId;
 			
 			os << identifier.token << " = " << lineValue << ';';
-			auto user = currentScope->appendItem(take(os).c_str());
+			auto user = currentScope->appendItem(take(os));
 			
 			usedByStatement.push_back(&expression);
 			fillUsers(user);
@@ -231,12 +244,12 @@ void StatementPrintVisitor::printWithParentheses(unsigned int precedence, const
 	}
 }
 
-void StatementPrintVisitor::visit(unique_ptr<PrintableScope> childScope, const StatementList& list)
+void StatementPrintVisitor::visit(PrintableScope* childScope, const StatementList& list)
 {
 	pushScope(childScope, [&] {
 		visitAll(*this, list);
 	});
-	currentScope->appendItem(move(childScope));
+	currentScope->appendItem(childScope);
 }
 
 void StatementPrintVisitor::fillUsers(PrintableItem* user)
@@ -307,28 +320,45 @@ void StatementPrintVisitor::insertDeclarations()
 		// print declaration/definition
 		string newLine;
 		raw_string_ostream lineSS(newLine);
-		declare(lineSS, tokenKey->getExpressionType(ctx), variable);
+		typePrinter.declareCached(lineSS, tokenKey->getExpressionType(ctx), variable);
 		if (onePastCommonAncestor == parents.end() && firstAssignment != info.users.end())
 		{
 			// modify statement to make it a definition since the first assignment is in the common ancestor
 			auto line = cast<PrintableLine>(*firstAssignment);
 			lineSS << " = " << line->line().substr(variable.size() + 3);
-			line->line() = move(lineSS.str());
+			line->setLine(lineSS.str());
 		}
 		else
 		{
 			// insert new line in closest parent
 			lineSS << ";";
 			auto closestAncestor = *(onePastCommonAncestor - 1);
-			closestAncestor->prependItem(lineSS.str().c_str());
+			closestAncestor->prependItem(lineSS.str());
 		}
 	}
 }
 
 StatementPrintVisitor::StatementPrintVisitor(AstContext& ctx, bool tokenize)
 : ctx(ctx), tokenize(tokenize), parentExpression(nullptr), currentExpression(nullptr), os(currentValue)
+, directOut(nullptr), directIndent(0)
+{
+	currentScope = itemPool.allocate<PrintableScope>(nullptr, itemPool);
+}
+
+raw_ostream& StatementPrintVisitor::directLine()
 {
-	currentScope.reset(new PrintableScope(nullptr));
+	return tabulate(*directOut, directIndent);
+}
+
+// Emits a brace-delimited body straight to the output stream, producing the same bytes
+// PrintableScope::print would, without allocating any items.
+void StatementPrintVisitor::printDirectBody(const StatementList& list)
+{
+	directLine() << "{\n";
+	++directIndent;
+	visitAll(*this, list);
+	--directIndent;
+	directLine() << "}\n";
 }
 
 void StatementPrintVisitor::visit(const ExpressionUser &user)
@@ -523,7 +553,7 @@ void StatementPrintVisitor::visitCast(const CastExpression& cast)
 		os << (intType->isSigned() ? "__sext " : "__zext ");
 	}
 	
-	CTypePrinter::print(os, cast.getExpressionType(ctx));
+	typePrinter.printCached(os, cast.getExpressionType(ctx));
 	os << ')';
 	os << expr;
 }
@@ -578,20 +608,35 @@ void StatementPrintVisitor::visitAssignable(const AssignableExpression &assignab
 void StatementPrintVisitor::print(AstContext& ctx, raw_ostream& os, const StatementList& statements, bool tokenize)
 {
 	StatementPrintVisitor printer(ctx, tokenize);
-	visitAll(printer, statements);
-	
-	if (tokenize)
+	if (!tokenize)
 	{
-		printer.insertDeclarations();
+		// No token metadata means no declarations to insert after the fact, so the text can stream
+		// out as statements are visited instead of accumulating in a printable tree first.
+		printer.directOut = &os;
+		printer.printDirectBody(statements);
+		return;
 	}
+	visitAll(printer, statements);
+
+	printer.insertDeclarations();
 	printer.currentScope->print(os, 0);
 }
 
 void StatementPrintVisitor::print(AstContext& ctx, raw_ostream &os, const ExpressionUser& user, bool tokenize)
 {
 	StatementPrintVisitor printer(ctx, tokenize);
+	if (!tokenize && isa<Statement>(user))
+	{
+		printer.directOut = &os;
+		os << "{\n";
+		++printer.directIndent;
+		printer.visit(user);
+		--printer.directIndent;
+		os << "}\n";
+		return;
+	}
 	printer.visit(user);
-	
+
 	if (isa<Expression>(user))
 	{
 		os << printer.os.str() << '\n';
@@ -613,6 +658,28 @@ void StatementPrintVisitor::declare(raw_ostream& os, const ExpressionType &type,
 
 void StatementPrintVisitor::visitIfElse(const IfElseStatement& ifElse)
 {
+	if (directOut != nullptr)
+	{
+		const StatementList* nextStatementList = nullptr;
+		const Statement* nextStatement = &ifElse;
+		const char* elsePrefix = "";
+		while (const auto nextIfElse = dyn_cast_or_null<IfElseStatement>(nextStatement))
+		{
+			visit(*nextIfElse->getCondition());
+			directLine() << elsePrefix << "if (" << take(os) << ")\n";
+			printDirectBody(nextIfElse->getIfBody());
+			elsePrefix = "else ";
+			nextStatementList = &nextIfElse->getElseBody();
+			nextStatement = nextStatementList->single();
+		}
+		if (!nextStatementList->empty())
+		{
+			directLine() << "else \n";
+			printDirectBody(*nextStatementList);
+		}
+		return;
+	}
+
 	string prefix;
 	raw_string_ostream outSS(prefix);
 	
@@ -620,15 +687,15 @@ void StatementPrintVisitor::visitIfElse(const IfElseStatement& ifElse)
 	const Statement* nextStatement = &ifElse;
 	while (const auto nextIfElse = dyn_cast_or_null<IfElseStatement>(nextStatement))
 	{
-		auto scope = llvm::make_unique<PrintableScope>(currentScope.get());
-		
+		auto scope = itemPool.allocate<PrintableScope>(currentScope, itemPool);
+
 		visit(*nextIfElse->getCondition());
-		fillUsers(scope.get());
+		fillUsers(scope);
 		outSS << "if (" << take(os) << ')';
-		
-		scope->prefix() = take(outSS);
-		
-		visit(move(scope), nextIfElse->getIfBody());
+
+		scope->setPrefix(take(outSS));
+
+		visit(scope, nextIfElse->getIfBody());
 		
 		outSS << "else ";
 		nextStatementList = &nextIfElse->getElseBody();
@@ -637,27 +704,46 @@ void StatementPrintVisitor::visitIfElse(const IfElseStatement& ifElse)
 	
 	if (!nextStatementList->empty())
 	{
-		auto scope = llvm::make_unique<PrintableScope>(currentScope.get());
-		scope->prefix() = take(outSS);
-		
-		visit(move(scope), *nextStatementList);
+		auto scope = itemPool.allocate<PrintableScope>(currentScope, itemPool);
+		scope->setPrefix(take(outSS));
+
+		visit(scope, *nextStatementList);
 	}
 }
 
 void StatementPrintVisitor::visitLoop(const LoopStatement& loop)
 {
+	if (directOut != nullptr)
+	{
+		if (loop.getPosition() == LoopStatement::PreTested)
+		{
+			visit(*loop.getCondition());
+			directLine() << "while (" << take(os) << ")\n";
+			printDirectBody(loop.getLoopBody());
+		}
+		else
+		{
+			assert(loop.getPosition() == LoopStatement::PostTested);
+			directLine() << "do\n";
+			printDirectBody(loop.getLoopBody());
+			visit(*loop.getCondition());
+			directLine() << "while (" << take(os) << ");\n";
+		}
+		return;
+	}
+
 	string prefix;
 	raw_string_ostream outSS(prefix);
-	auto scope = llvm::make_unique<PrintableScope>(currentScope.get());
-	
+	auto scope = itemPool.allocate<PrintableScope>(currentScope, itemPool);
+
 	if (loop.getPosition() == LoopStatement::PreTested)
 	{
 		visit(*loop.getCondition());
-		fillUsers(scope.get());
+		fillUsers(scope);
 		outSS << "while (" << take(os) << ')';
-		scope->prefix() = take(outSS);
-		
-		visit(move(scope), loop.getLoopBody());
+		scope->setPrefix(take(outSS));
+
+		visit(scope, loop.getLoopBody());
 	}
 	else
 	{
@@ -670,16 +756,29 @@ void StatementPrintVisitor::visitLoop(const LoopStatement& loop)
 			visit(*loop.getCondition());
 		});
 		
-		fillUsers(scope.get());
+		fillUsers(scope);
 		outSS << "while (" << take(os) << ");";
-		scope->prefix() = "do";
-		scope->suffix() = take(outSS);
-		currentScope->appendItem(move(scope));
+		scope->setPrefix("do");
+		scope->setSuffix(take(outSS));
+		currentScope->appendItem(scope);
 	}
 }
 
 void StatementPrintVisitor::visitKeyword(const KeywordStatement& keyword)
 {
+	if (directOut != nullptr)
+	{
+		auto& line = directLine();
+		line << keyword.name;
+		if (auto operand = keyword.getOperand())
+		{
+			visit(*operand);
+			line << ' ' << take(os);
+		}
+		line << ";\n";
+		return;
+	}
+
 	string prefix;
 	raw_string_ostream outSS(prefix);
 	outSS << keyword.name;
@@ -690,7 +789,7 @@ void StatementPrintVisitor::visitKeyword(const KeywordStatement& keyword)
 		outSS << ' ' << take(os);
 	}
 	outSS << ';';
-	auto user = currentScope->appendItem(take(outSS).c_str());
+	auto user = currentScope->appendItem(take(outSS));
 	fillUsers(user);
 }
 
@@ -698,12 +797,18 @@ void StatementPrintVisitor::visitExpr(const ExpressionStatement& expression)
 {
 	const Expression& expr = *expression.getExpression();
 	visit(expr);
-	
+
+	if (directOut != nullptr)
+	{
+		directLine() << take(os) << ";\n";
+		return;
+	}
+
 	// Only print something if the expression wasn't turned into a token.
 	if (tokens.find(&expr) == tokens.end())
 	{
 		os << ';';
-		auto user = currentScope->appendItem(take(os).c_str());
+		auto user = currentScope->appendItem(take(os));
 		fillUsers(user);
 	}
 	else
@@ -716,7 +821,13 @@ void StatementPrintVisitor::visitExpr(const ExpressionStatement& expression)
 void StatementPrintVisitor::visitTemporary(const ExpressionUser& reference)
 {
 	visit(*reference.getOperand(0));
-	
+
+	if (directOut != nullptr)
+	{
+		directLine() << "TEMPORARY {" << take(os) << "}\n";
+		return;
+	}
+
 	string prefix;
 	raw_string_ostream outSS(prefix);
 	
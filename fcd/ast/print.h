@@ -11,6 +11,7 @@
 #define fcd__ast_print_h
 
 #include "print_item.h"
+#include "type_printer.h"
 #include "visitor.h"
 
 #include <llvm/ADT/SmallPtrSet.h>
@@ -35,24 +36,35 @@ class StatementPrintVisitor final : public AstVisitor<StatementPrintVisitor>
 	std::vector<const Expression*> orderedTokens;
 	std::unordered_map<const Expression*, Tokenization> tokens;
 	std::unordered_set<const Expression*> noTokens;
+	// Memoizes type renderings for this function; the visitor never outlives its AstContext.
+	CTypePrinter typePrinter;
 	bool tokenize;
 	
 	std::string currentValue;
-	std::unique_ptr<PrintableScope> currentScope;
+	// Arena for the printable tree; the items and their text die with the visitor.
+	DumbAllocator itemPool;
+	PrintableScope* currentScope;
 	const Expression* parentExpression;
 	const Expression* currentExpression;
 	llvm::raw_string_ostream os;
 	llvm::SmallVector<const Expression*, 16> usedByStatement;
-	
+	// Direct-emit mode: when set (only without tokenization), statements stream straight here with
+	// manual indentation and the printable tree is never built. Token declarations are the only
+	// reason the tree exists, so text-only printing can skip the per-line arena copies entirely.
+	llvm::raw_ostream* directOut;
+	unsigned directIndent;
+
 	Tokenization* getIdentifier(const Expression& expression);
-	
+
 	void printWithParentheses(unsigned precedence, const Expression& expression);
-	void visit(std::unique_ptr<PrintableScope> childScope, const StatementList& stmt);
+	void visit(PrintableScope* childScope, const StatementList& stmt);
 	void fillUsers(PrintableItem* user);
 	void insertDeclarations();
-	
+	llvm::raw_ostream& directLine();
+	void printDirectBody(const StatementList& list);
+
 	template<typename TAction>
-	void pushScope(std::unique_ptr<PrintableScope>& childScope, TAction&& action)
+	void pushScope(PrintableScope*& childScope, TAction&& action)
 	{
 		std::swap(currentScope, childScope);
 		action();
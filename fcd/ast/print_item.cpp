@@ -26,6 +26,15 @@ namespace
 		os.write(tabs, count);
 		return os;
 	}
+
+	StringRef copyToPool(DumbAllocator& pool, StringRef string)
+	{
+		if (string.empty())
+		{
+			return StringRef();
+		}
+		return StringRef(pool.copyString(string), string.size());
+	}
 }
 
 void PrintableItem::dump() const
@@ -33,26 +42,64 @@ void PrintableItem::dump() const
 	print(errs(), 0);
 }
 
+PrintableLine::PrintableLine(PrintableScope* parent, StringRef line)
+: PrintableItem(Statement, parent), lineString(copyToPool(parent->pool, line))
+{
+}
+
+void PrintableLine::setLine(StringRef line)
+{
+	// The previous copy stays behind in the arena; rewrites are rare enough not to care.
+	lineString = copyToPool(getParent()->pool, line);
+}
+
 void PrintableLine::print(raw_ostream &os, unsigned int indent) const
 {
 	tabulate(os, indent) << lineString << '\n';
 }
 
-PrintableItem* PrintableScope::prependItem(string line)
+void PrintableScope::setPrefix(StringRef prefix)
+{
+	prefixString = copyToPool(pool, prefix);
+}
+
+void PrintableScope::setSuffix(StringRef suffix)
 {
-	prepended.emplace_back(llvm::make_unique<PrintableLine>(this, move(line)));
-	return prepended.back().get();
+	suffixString = copyToPool(pool, suffix);
 }
 
-PrintableItem* PrintableScope::appendItem(string line)
+PrintableItem* PrintableScope::prependItem(StringRef line)
 {
-	return appendItem(llvm::make_unique<PrintableLine>(this, move(line)));
+	auto item = pool.allocate<PrintableLine>(this, line);
+	if (prependedLast == nullptr)
+	{
+		prependedFirst = item;
+	}
+	else
+	{
+		prependedLast->nextItem = item;
+	}
+	prependedLast = item;
+	return item;
+}
+
+PrintableItem* PrintableScope::appendItem(StringRef line)
+{
+	return appendItem(pool.allocate<PrintableLine>(this, line));
 }
 
-PrintableItem* PrintableScope::appendItem(unique_ptr<PrintableItem> statement)
+PrintableItem* PrintableScope::appendItem(PrintableItem* statement)
 {
-	items.emplace_back(move(statement));
-	return items.back().get();
+	if (itemLast == nullptr)
+	{
+		itemFirst = statement;
+	}
+	else
+	{
+		itemLast->nextItem = statement;
+	}
+	itemLast = statement;
+	return statement;
 }
 
 void PrintableScope::print(raw_ostream &os, unsigned int indent) const
@@ -62,17 +109,17 @@ void PrintableScope::print(raw_ostream &os, unsigned int indent) const
 		tabulate(os, indent) << prefixString << '\n';
 	}
 	tabulate(os, indent) << "{\n";
-	
-	for (const auto& item : prepended)
+
+	for (const PrintableItem* item = prependedFirst; item != nullptr; item = item->nextItem)
 	{
 		item->print(os, indent + 1);
 	}
-	
-	for (const auto& item : items)
+
+	for (const PrintableItem* item = itemFirst; item != nullptr; item = item->nextItem)
 	{
 		item->print(os, indent + 1);
 	}
-	
+
 	tabulate(os, indent) << "}\n";
 	if (!suffixString.empty())
 	{
@@ -10,15 +10,18 @@
 #ifndef print_item_hpp
 #define print_item_hpp
 
+#include "dumb_allocator.h"
 #include "not_null.h"
 
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
 
-#include <deque>
-#include <string>
-
 class PrintableScope;
 
+// The printable tree lives in a DumbAllocator arena: items are trivially destructible, link to
+// their siblings intrusively, and every text fragment is copied exactly once into the arena.
+// This keeps huge outputs from paying one heap allocation per line plus repeated std::string
+// growth during assembly.
 class PrintableItem
 {
 public:
@@ -27,72 +30,78 @@ public:
 		Scope,
 		Statement,
 	};
-	
+
 private:
 	Type discriminant;
 	PrintableScope* parent;
-	
+	PrintableItem* nextItem;
+
+	friend class PrintableScope;
+
 public:
 	PrintableItem(Type type, PrintableScope* parent)
-	: discriminant(type), parent(parent)
+	: discriminant(type), parent(parent), nextItem(nullptr)
 	{
 	}
-	
+
 	Type getType() const { return discriminant; }
 	PrintableScope* getParent() { return parent; }
-	
+
 	virtual void print(llvm::raw_ostream& os, unsigned indent) const = 0;
 	void dump() const;
 };
 
 class PrintableLine : public PrintableItem
 {
-	std::string lineString;
-	
+	llvm::StringRef lineString;
+
 public:
 	static bool classof(const PrintableItem* stmt)
 	{
 		return stmt->getType() == Statement;
 	}
-	
-	PrintableLine(PrintableScope* parent, std::string line)
-	: PrintableItem(Statement, parent), lineString(line)
-	{
-	}
-	
-	std::string& line() { return lineString; }
-	const std::string& line() const { return lineString; }
-	
+
+	PrintableLine(PrintableScope* parent, llvm::StringRef line);
+
+	llvm::StringRef line() const { return lineString; }
+	void setLine(llvm::StringRef line);
+
 	virtual void print(llvm::raw_ostream& os, unsigned indent) const override;
 };
 
 class PrintableScope : public PrintableItem
 {
-	std::string prefixString;
-	std::string suffixString;
-	std::deque<std::unique_ptr<PrintableItem>> prepended;
-	std::deque<std::unique_ptr<PrintableItem>> items;
-	
+	DumbAllocator& pool;
+	llvm::StringRef prefixString;
+	llvm::StringRef suffixString;
+	PrintableItem* prependedFirst;
+	PrintableItem* prependedLast;
+	PrintableItem* itemFirst;
+	PrintableItem* itemLast;
+
+	friend class PrintableLine;
+
 public:
 	static bool classof(const PrintableItem* stmt)
 	{
 		return stmt->getType() == Scope;
 	}
-	
-	PrintableScope(PrintableScope* parent)
-	: PrintableItem(Scope, parent)
+
+	PrintableScope(PrintableScope* parent, DumbAllocator& pool)
+	: PrintableItem(Scope, parent), pool(pool)
+	, prependedFirst(nullptr), prependedLast(nullptr), itemFirst(nullptr), itemLast(nullptr)
 	{
 	}
-	
-	std::string& prefix() { return prefixString; }
-	const std::string& prefix() const { return prefixString; }
-	std::string& suffix() { return suffixString; }
-	const std::string& suffix() const { return suffixString; }
-	
-	PrintableItem* prependItem(std::string line);
-	PrintableItem* appendItem(std::string line);
-	PrintableItem* appendItem(std::unique_ptr<PrintableItem> statement);
-	
+
+	llvm::StringRef prefix() const { return prefixString; }
+	llvm::StringRef suffix() const { return suffixString; }
+	void setPrefix(llvm::StringRef prefix);
+	void setSuffix(llvm::StringRef suffix);
+
+	PrintableItem* prependItem(llvm::StringRef line);
+	PrintableItem* appendItem(llvm::StringRef line);
+	PrintableItem* appendItem(PrintableItem* statement);
+
 	virtual void print(llvm::raw_ostream& os, unsigned indent) const override;
 };
 
@@ -22,9 +22,11 @@ StatementList::StatementList(Statement* parent, StatementList&& that)
 {
 	first = that.first;
 	last = that.last;
+	count = that.count;
 	that.first = nullptr;
 	that.last = nullptr;
-	
+	that.count = 0;
+
 	for (auto stmt = first; stmt != nullptr; stmt = stmt->next)
 	{
 		stmt->list = this;
@@ -45,7 +47,8 @@ Statement* StatementList::pop_front()
 	Statement* result = first;
 	first = first->next;
 	(first == nullptr ? last : first->previous) = nullptr;
-	
+	count--;
+
 	result->list = nullptr;
 	result->previous = nullptr;
 	result->next = nullptr;
@@ -57,7 +60,8 @@ Statement* StatementList::pop_back()
 	Statement* result = last;
 	last = last->previous;
 	(last == nullptr ? first : last->next) = nullptr;
-	
+	count--;
+
 	result->list = nullptr;
 	result->previous = nullptr;
 	result->next = nullptr;
@@ -67,12 +71,14 @@ Statement* StatementList::pop_back()
 StatementList& StatementList::operator=(StatementList&& that)
 {
 	auto oldFirst = first;
-	
+
 	first = that.first;
 	last = that.last;
+	count = that.count;
 	that.first = nullptr;
 	that.last = nullptr;
-	
+	that.count = 0;
+
 	for (auto stmt = first; stmt != nullptr; stmt = stmt->next)
 	{
 		stmt->list = this;
@@ -134,16 +140,78 @@ void StatementList::insert(iterator iter, NOT_NULL(Statement) statement)
 	}
 	
 	statement->list = this;
+	count++;
 }
 
 void StatementList::insert(iterator iter, StatementList &&that)
 {
-	while (!that.empty())
+	splice(iter, that, that.begin(), that.end());
+}
+
+void StatementList::splice(iterator position, StatementList& that, iterator begin, iterator end)
+{
+	if (begin == end)
+	{
+		return;
+	}
+
+	Statement* rangeFirst = *begin;
+	Statement* rangeLast = end == that.end() ? that.last : (*end)->previous;
+	assert(rangeFirst->list == &that && rangeLast->list == &that);
+
+	// Unlink the whole range at once.
+	Statement* beforeRange = rangeFirst->previous;
+	Statement* afterRange = rangeLast->next;
+	(beforeRange == nullptr ? that.first : beforeRange->next) = afterRange;
+	(afterRange == nullptr ? that.last : afterRange->previous) = beforeRange;
+	rangeFirst->previous = nullptr;
+	rangeLast->next = nullptr;
+
+	// Adopting the range is the only per-statement work: each statement's list back-pointer has to
+	// be retargeted, and the size caches adjusted by the same walk.
+	size_t rangeLength = 0;
+	for (Statement* stmt = rangeFirst; stmt != nullptr; stmt = stmt->next)
+	{
+		stmt->list = this;
+		rangeLength++;
+	}
+	that.count -= rangeLength;
+	count += rangeLength;
+
+	// Link the range in front of the insertion point.
+	Statement* insertBefore = *position;
+	if (insertBefore == nullptr)
 	{
-		Statement* first = that.front();
-		erase(first);
-		insert(iter, first);
+		if (last == nullptr)
+		{
+			first = rangeFirst;
+		}
+		else
+		{
+			rangeFirst->previous = last;
+			last->next = rangeFirst;
+		}
+		last = rangeLast;
+	}
+	else if (Statement* prev = insertBefore->previous)
+	{
+		prev->next = rangeFirst;
+		rangeFirst->previous = prev;
+		insertBefore->previous = rangeLast;
+		rangeLast->next = insertBefore;
 	}
+	else
+	{
+		first->previous = rangeLast;
+		rangeLast->next = first;
+		first = rangeFirst;
+	}
+}
+
+void StatementList::takeAllFrom(StatementList& that)
+{
+	assert(this != &that);
+	splice(end(), that, that.begin(), that.end());
 }
 
 void StatementList::push_front(NOT_NULL(Statement) statement)
@@ -161,15 +229,13 @@ void StatementList::push_front(NOT_NULL(Statement) statement)
 		statement->next = first;
 	}
 	first = statement;
+	count++;
 }
 
 void StatementList::push_front(StatementList&& that)
 {
 	assert(this != &that);
-	while (!that.empty())
-	{
-		push_front(that.pop_back());
-	}
+	splice(begin(), that, that.begin(), that.end());
 }
 
 void StatementList::push_back(NOT_NULL(Statement) statement)
@@ -187,15 +253,12 @@ void StatementList::push_back(NOT_NULL(Statement) statement)
 		statement->previous = last;
 	}
 	last = statement;
+	count++;
 }
 
 void StatementList::push_back(StatementList&& that)
 {
-	assert(this != &that);
-	while (!that.empty())
-	{
-		push_back(that.pop_front());
-	}
+	takeAllFrom(that);
 }
 
 void StatementList::erase(NOT_NULL(Statement) statement)
@@ -215,6 +278,7 @@ StatementList::iterator StatementList::erase(iterator iter)
 	Statement* oldNext = target->next;
 	(oldPrev == nullptr ? first : oldPrev->next) = target->next;
 	(oldNext == nullptr ? last : oldNext->previous) = target->previous;
+	count--;
 	target->list = nullptr;
 	target->previous = nullptr;
 	target->next = nullptr;
@@ -235,6 +299,7 @@ void StatementList::clear()
 	}
 	first = nullptr;
 	last = nullptr;
+	count = 0;
 }
 
 void StatementList::print(raw_ostream& os) const
@@ -26,6 +26,7 @@ class StatementList
 	Statement* owner;
 	Statement* first;
 	Statement* last;
+	size_t count;
 	
 public:
 	template<bool IsConst>
@@ -78,7 +79,7 @@ public:
 	typedef StatementIterator<true> const_iterator;
 	
 	explicit StatementList(Statement* parent)
-	: owner(parent), first(nullptr), last(nullptr)
+	: owner(parent), first(nullptr), last(nullptr), count(0)
 	{
 	}
 	
@@ -93,6 +94,7 @@ public:
 	Statement* pop_back();
 	
 	bool empty() const { return first == nullptr; }
+	size_t size() const { return count; }
 	Statement* single() { return first == last ? first : nullptr; }
 	const Statement* single() const { return first == last ? first : nullptr; }
 	bool multiple() const { return first != last; }
@@ -116,6 +118,13 @@ public:
 	void push_back(NOT_NULL(Statement) statement);
 	void push_back(StatementList&& that);
 	
+	// Moves [begin, end) from `that` (which may be this list) in front of `position`. All relinking
+	// is constant-time; the only per-statement work left is retargeting parent list back-pointers.
+	// `position` must not be inside [begin, end).
+	void splice(iterator position, StatementList& that, iterator begin, iterator end);
+	// Moves the whole contents of `that` to the end of this list.
+	void takeAllFrom(StatementList& that);
+
 	static void erase(NOT_NULL(Statement) statement);
 	iterator erase(iterator iter);
 	
@@ -0,0 +1,30 @@
+//
+// string_intern.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "string_intern.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+using namespace llvm;
+using namespace std;
+
+StringRef StringInternTable::intern(StringRef value)
+{
+	// Parallel structuring builds ASTs on several threads at once, so the table has to lock.
+	// The set is node-based: entries never move, which makes the returned pointers stable
+	// for the lifetime of the process.
+	static mutex lock;
+	static unordered_set<string> table;
+
+	lock_guard<mutex> guard(lock);
+	const string& entry = *table.insert(value.str()).first;
+	return StringRef(entry);
+}
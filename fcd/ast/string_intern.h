@@ -0,0 +1,26 @@
+//
+// string_intern.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__ast_string_intern_h
+#define fcd__ast_string_intern_h
+
+#include <llvm/ADT/StringRef.h>
+
+// Process-wide intern table for identifier strings: register tokens, type and function names,
+// assignable prefixes. The same contents always intern to the same NUL-terminated buffer, so
+// recurring names are stored once for the whole process instead of once per function arena,
+// equality between interned strings reduces to a pointer compare, and the returned StringRef
+// carries a precomputed length that printers can write out without re-scanning the bytes.
+class StringInternTable
+{
+public:
+	static llvm::StringRef intern(llvm::StringRef value);
+};
+
+#endif /* fcd__ast_string_intern_h */
@@ -12,6 +12,8 @@
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/ErrorHandling.h>
 
+#include <cassert>
+
 using namespace llvm;
 using namespace std;
 
@@ -127,6 +129,46 @@ void CTypePrinter::declare(raw_ostream& os, const ExpressionType& type, const st
 	print(os, type, identifier);
 }
 
+void CTypePrinter::printCached(raw_ostream& os, const ExpressionType& type)
+{
+	string& rendered = renderedTypes[&type];
+	if (rendered.empty())
+	{
+		raw_string_ostream renderedOs(rendered);
+		print(renderedOs, type);
+		renderedOs.flush();
+	}
+	os << rendered;
+}
+
+void CTypePrinter::declareCached(raw_ostream& os, const ExpressionType& type, const string& identifier)
+{
+	if (identifier.empty())
+	{
+		declare(os, type, identifier);
+		return;
+	}
+
+	// Every rendering starts with the base type name, so an empty prefix means a fresh entry.
+	auto& parts = declarationParts[&type];
+	if (parts.first.empty())
+	{
+		// Render once with a placeholder identifier and split around it. The placeholder is a
+		// control character, so it can't occur in a legitimate rendering, and it takes the same
+		// spacing decisions as a real identifier would.
+		string rendered;
+		raw_string_ostream renderedOs(rendered);
+		print(renderedOs, type, "\x01");
+		renderedOs.flush();
+
+		size_t position = rendered.find('\x01');
+		assert(position != string::npos);
+		parts.first = rendered.substr(0, position);
+		parts.second = rendered.substr(position + 1);
+	}
+	os << parts.first << identifier << parts.second;
+}
+
 void CTypePrinter::print(raw_ostream& os, const ExpressionType& type, string middle)
 {
 	switch (type.getType())
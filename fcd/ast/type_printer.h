@@ -15,9 +15,19 @@
 #include <llvm/Support/raw_ostream.h>
 
 #include <string>
+#include <unordered_map>
+#include <utility>
 
 class CTypePrinter
 {
+	// Memoized renderings, keyed by the uniqued ExpressionType pointers that the owning
+	// AstContext guarantees. A printer instance must not outlive that context, since the
+	// type objects die with it; the static entry points below stay available for one-off
+	// printing. Declarations cache as a (prefix, suffix) pair around the identifier, since
+	// C declarator syntax can weave the name into the middle of the type.
+	std::unordered_map<const ExpressionType*, std::string> renderedTypes;
+	std::unordered_map<const ExpressionType*, std::pair<std::string, std::string>> declarationParts;
+
 	static void printMiddleIfAny(llvm::raw_ostream& os, const std::string& middle);
 	static void print(llvm::raw_ostream& os, const VoidExpressionType&, std::string middle);
 	static void print(llvm::raw_ostream& os, const IntegerExpressionType& intTy, std::string middle);
@@ -25,10 +35,13 @@ class CTypePrinter
 	static void print(llvm::raw_ostream& os, const ArrayExpressionType& arrayTy, std::string middle);
 	static void print(llvm::raw_ostream& os, const StructExpressionType& structTy, std::string middle);
 	static void print(llvm::raw_ostream& os, const FunctionExpressionType& funcTy, std::string middle);
-	
+
 public:
 	static void declare(llvm::raw_ostream& os, const ExpressionType& type, const std::string& identifier);
 	static void print(llvm::raw_ostream& os, const ExpressionType& type, std::string middle = "");
+
+	void printCached(llvm::raw_ostream& os, const ExpressionType& type);
+	void declareCached(llvm::raw_ostream& os, const ExpressionType& type, const std::string& identifier);
 };
 
 #endif /* type_printer_hpp */
@@ -12,6 +12,10 @@
 
 #include "ast_context.h"
 
+#include <llvm/ADT/SmallVector.h>
+
+#include <algorithm>
+
 #define DELEGATE_CALL(suffix, type) \
 	ReturnType visit##type(OptionallyConst<UsesConst, type##suffix>& o) { return d().visit##suffix(o); }
 
@@ -130,4 +134,41 @@ void visitAll(AstVisitor<Derived, IsConst, void>& visitor, typename std::conditi
 	}
 }
 
+// Drives `visitor` over every statement of `list` and of every nested body, in pre-order source
+// order, with an explicit stack. Interpreter loops structure into statement trees thousands of
+// levels deep, which overflows thread stacks when every nesting level costs a recursive frame;
+// visitors that only act on each statement — without rebuilding the tree — can traverse this way
+// and must not descend into bodies themselves, since the driver does.
+template<typename Derived>
+void visitAllIterative(AstVisitor<Derived, false, void>& visitor, StatementList& list)
+{
+	llvm::SmallVector<Statement*, 32> stack;
+	auto pushBody = [&](StatementList& body)
+	{
+		size_t firstPushed = stack.size();
+		for (Statement* statement : body)
+		{
+			stack.push_back(statement);
+		}
+		// The stack pops back-to-front; reverse what was just pushed so the body stays in source order.
+		std::reverse(stack.begin() + firstPushed, stack.end());
+	};
+
+	pushBody(list);
+	while (!stack.empty())
+	{
+		Statement* statement = stack.pop_back_val();
+		visitor.visit(*statement);
+		if (auto ifElse = llvm::dyn_cast<IfElseStatement>(statement))
+		{
+			pushBody(ifElse->getElseBody());
+			pushBody(ifElse->getIfBody());
+		}
+		else if (auto loop = llvm::dyn_cast<LoopStatement>(statement))
+		{
+			pushBody(loop->getLoopBody());
+		}
+	}
+}
+
 #endif /* fcd__ast_visitor_h */
@@ -110,20 +110,6 @@ namespace
 		return result;
 	}
 	
-	unordered_map<const TargetRegisterInfo*, ModRefInfo> translateToModRef(const CallInformation& callInfo)
-	{
-		unordered_map<const TargetRegisterInfo*, ModRefInfo> result;
-		auto returnCutoff = callInfo.return_begin();
-		for (auto iter = callInfo.begin(); iter != callInfo.end(); ++iter)
-		{
-			if (iter->type == ValueInformation::IntegerRegister)
-			{
-				result[iter->registerInfo] |= iter < returnCutoff ? MRI_Ref : MRI_Mod;
-			}
-		}
-		return result;
-	}
-	
 	SExpression* backtrackSExpressionOfValue(const TargetInfo& target, MemorySSA& mssa, ExpressionContext& context, Value* value)
 	{
 		if (auto constant = dyn_cast<ConstantInt>(value))
@@ -135,7 +121,7 @@ namespace
 		{
 			// For registers, follow memory SSA. For program memory, do a leap of faith and assume ~Mod for every
 			// location restored. This is an UNSAFE solution to a largely UNCOMPUTABLE problem.
-			if (!md::isProgramMemory(*load))
+			if (!target.metadataKinds().isProgramMemory(*load))
 			{
 				MemoryAccess* parent = cast<MemoryUse>(mssa.getMemoryAccess(load))->getDefiningAccess();
 				if (auto useOrDef = cast<MemoryUseOrDef>(parent))
@@ -412,22 +398,35 @@ bool CallingConvention_AnyArch_AnyCC::analyzeFunction(ParameterRegistry &registr
 	// directly.
 	while (calls.size() > 0)
 	{
-		unordered_map<const TargetRegisterInfo*, unsigned> callResult;
+		// Register sets as bitmasks of canonical register indices (see
+		// TargetInfo::canonicalRegisterIndex): merging a callee's footprint is two ORs instead of
+		// a hash map union.
+		uint64_t refs = 0;
+		uint64_t mods = 0;
 		auto dominant = findDominantValues(preDom, calls);
 		for (CallInst* call : dominant)
 		{
 			Function* callee = call->getCalledFunction();
-			for (const auto& pair : translateToModRef(*registry.getCallInfo(*callee)))
+			const CallInformation& callInfo = *registry.getCallInfo(*callee);
+			auto returnCutoff = callInfo.return_begin();
+			for (auto iter = callInfo.begin(); iter != callInfo.end(); ++iter)
 			{
-				callResult[pair.first] |= pair.second;
+				if (iter->type == ValueInformation::IntegerRegister)
+				{
+					uint64_t bit = uint64_t(1) << target.canonicalRegisterIndex(*iter->registerInfo);
+					(iter < returnCutoff ? refs : mods) |= bit;
+				}
 			}
-			
+
 			calls.erase(find(calls.begin(), calls.end(), call));
 		}
-		
-		for (const auto& pair : callResult)
+
+		for (uint64_t mask = refs | mods; mask != 0; mask &= mask - 1)
 		{
-			resultMap[pair.first] = static_cast<ModRefInfo>(pair.second);
+			unsigned index = static_cast<unsigned>(__builtin_ctzll(mask));
+			uint64_t bit = uint64_t(1) << index;
+			auto modRef = static_cast<ModRefInfo>(((refs & bit) != 0 ? MRI_Ref : MRI_NoModRef) | ((mods & bit) != 0 ? MRI_Mod : MRI_NoModRef));
+			resultMap[&target.canonicalRegisterAtIndex(index)] = modRef;
 		}
 	}
 	
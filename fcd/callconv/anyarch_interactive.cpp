@@ -9,11 +9,15 @@
 
 #include "anyarch_interactive.h"
 #include "cc_common.h"
+#include "command_line.h"
 #include "metadata.h"
 #include "targetinfo.h"
 
 #include <llvm/IR/Constants.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
 
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 
@@ -23,14 +27,27 @@ using namespace std;
 namespace
 {
 	RegisterCallingConvention<CallingConvention_AnyArch_Interactive> registerAnyInteractive;
-	
+
+	cl::opt<string> answersFile("cc-answers", cl::desc("Remember interactive calling convention answers in this file, keyed by binary hash and function address, and replay them on later runs"), cl::value_desc("file"), whitelist());
+
 	template<typename T, size_t N>
 	constexpr size_t countof(T (&)[N])
 	{
 		return N;
 	}
-	
+
 	const char yesNoChars[] = {'y', '1', 'n', '0'};
+
+	string md5OfExecutable(Executable& executable)
+	{
+		MD5 hash;
+		hash.update(makeArrayRef(executable.begin(), executable.end()));
+		MD5::MD5Result result;
+		hash.final(result);
+		SmallString<32> hashString;
+		MD5::stringifyResult(result, hashString);
+		return hashString.str().str();
+	}
 }
 
 const char* CallingConvention_AnyArch_Interactive::name = "any/interactive";
@@ -51,10 +68,53 @@ bool CallingConvention_AnyArch_Interactive::matches(TargetInfo &target, Executab
 	return false;
 }
 
+void CallingConvention_AnyArch_Interactive::loadAnswers()
+{
+	if (answersLoaded)
+	{
+		return;
+	}
+	answersLoaded = true;
+
+	// A missing file just means that no answer has been recorded yet.
+	ifstream input(answersFile);
+	string key;
+	unsigned returns;
+	unsigned parameterCount;
+	while (input >> key >> returns >> parameterCount)
+	{
+		answers[key] = { returns != 0, parameterCount };
+	}
+}
+
 bool CallingConvention_AnyArch_Interactive::analyzeFunction(ParameterRegistry &registry, CallInformation &fillOut, llvm::Function &function)
 {
 	TargetInfo& info = registry.getTargetInfo();
-		
+
+	string answerKey;
+	if (!answersFile.empty())
+	if (auto address = md::getVirtualAddress(function))
+	if (Executable* executable = registry.getExecutable())
+	{
+		if (executable != hashedExecutable)
+		{
+			hashedExecutable = executable;
+			executableHash = md5OfExecutable(*executable);
+		}
+		loadAnswers();
+
+		raw_string_ostream keyStream(answerKey);
+		keyStream << executableHash << ':';
+		keyStream.write_hex(address->getLimitedValue());
+		keyStream.flush();
+
+		auto iter = answers.find(answerKey);
+		if (iter != answers.end())
+		{
+			return hackhack_fillFromParamInfo(function.getContext(), registry, fillOut, iter->second.returns, iter->second.parameterCount, false);
+		}
+	}
+
 	cout << function.getName().str();
 	if (auto address = md::getVirtualAddress(function))
 	{
@@ -97,5 +157,20 @@ bool CallingConvention_AnyArch_Interactive::analyzeFunction(ParameterRegistry &r
 	while (cin.fail());
 	
 	bool returns = yesNoReturns == 'y' || yesNoReturns == '1';
+
+	if (!answerKey.empty())
+	{
+		answers[answerKey] = { returns, numberOfParameters };
+		ofstream output(answersFile, ios::app);
+		if (output)
+		{
+			output << answerKey << ' ' << (returns ? 1 : 0) << ' ' << numberOfParameters << '\n';
+		}
+		else
+		{
+			cout << "Couldn't record answer to " << answersFile << "!" << endl;
+		}
+	}
+
 	return hackhack_fillFromParamInfo(function.getContext(), registry, fillOut, returns, numberOfParameters, false);
 }
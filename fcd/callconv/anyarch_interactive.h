@@ -14,9 +14,24 @@
 #include "params_registry.h"
 
 #include <string>
+#include <unordered_map>
 
 class CallingConvention_AnyArch_Interactive : public CallingConvention
 {
+	struct Answer
+	{
+		bool returns;
+		unsigned parameterCount;
+	};
+
+	// Answers remembered across runs, keyed by "<binary md5>:<function address>". See --cc-answers.
+	std::unordered_map<std::string, Answer> answers;
+	bool answersLoaded = false;
+	const Executable* hashedExecutable = nullptr;
+	std::string executableHash;
+
+	void loadAnswers();
+
 public:
 	static const char* name;
 	
@@ -0,0 +1,199 @@
+//
+// anyarch_library.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "anyarch_library.h"
+#include "command_line.h"
+
+#include <llvm/IR/DerivedTypes.h>
+
+#include <algorithm>
+#include <cctype>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <unordered_map>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	RegisterCallingConvention<CallingConvention_AnyArch_Library> registerAnyLibrary;
+
+	cl::list<string> extraSummaries("lib-summary", cl::desc("Add a library function summary, formatted as name:argcount:flags where flags may contain 'r' (returns a value) and 'v' (vararg). Can be specified multiple times"), whitelist());
+
+	struct FunctionSummary
+	{
+		const char* name;
+		uint8_t argumentCount;
+		bool returnsValue;
+		bool isVararg;
+	};
+
+	// Summaries are architecture-neutral: integer/pointer argument counts that the system calling
+	// convention turns into its own register assignment. Sorted by name for binary search.
+	const FunctionSummary knownFunctions[] = {
+		{"_ZdaPv", 1, false, false}, // operator delete[]
+		{"_ZdlPv", 1, false, false}, // operator delete
+		{"_Znam", 1, true, false}, // operator new[]
+		{"_Znwm", 1, true, false}, // operator new
+		{"abort", 0, false, false},
+		{"atoi", 1, true, false},
+		{"calloc", 2, true, false},
+		{"exit", 1, false, false},
+		{"fclose", 1, true, false},
+		{"fgets", 3, true, false},
+		{"fopen", 2, true, false},
+		{"fprintf", 1, true, true},
+		{"fputc", 2, true, false},
+		{"fputs", 2, true, false},
+		{"fread", 4, true, false},
+		{"free", 1, false, false},
+		{"fwrite", 4, true, false},
+		{"getenv", 1, true, false},
+		{"malloc", 1, true, false},
+		{"memchr", 3, true, false},
+		{"memcmp", 3, true, false},
+		{"memcpy", 3, true, false},
+		{"memmove", 3, true, false},
+		{"memset", 3, true, false},
+		{"printf", 1, true, true},
+		{"putchar", 1, true, false},
+		{"puts", 1, true, false},
+		{"qsort", 4, false, false},
+		{"realloc", 2, true, false},
+		{"scanf", 1, true, true},
+		{"snprintf", 2, true, true},
+		{"sprintf", 1, true, true},
+		{"sscanf", 2, true, true},
+		{"strcat", 2, true, false},
+		{"strchr", 2, true, false},
+		{"strcmp", 2, true, false},
+		{"strcpy", 2, true, false},
+		{"strdup", 1, true, false},
+		{"strlen", 1, true, false},
+		{"strncmp", 3, true, false},
+		{"strncpy", 3, true, false},
+		{"strrchr", 2, true, false},
+		{"strstr", 2, true, false},
+		{"strtol", 3, true, false},
+	};
+
+	const unordered_map<string, FunctionSummary>& userSummaries()
+	{
+		static unordered_map<string, FunctionSummary> summaries;
+		static bool parsed = false;
+		if (!parsed)
+		{
+			parsed = true;
+			for (const string& entry : extraSummaries)
+			{
+				auto firstColon = entry.find(':');
+				auto secondColon = firstColon == string::npos ? string::npos : entry.find(':', firstColon + 1);
+				if (firstColon == string::npos || firstColon == 0)
+				{
+					continue;
+				}
+
+				string name = entry.substr(0, firstColon);
+				string count = entry.substr(firstColon + 1, secondColon - firstColon - 1);
+				string flags = secondColon == string::npos ? "" : entry.substr(secondColon + 1);
+				if (count.size() == 0 || !all_of(count.begin(), count.end(), [](char c) { return isdigit(c) != 0; }))
+				{
+					continue;
+				}
+
+				FunctionSummary& summary = summaries[name];
+				summary.name = nullptr;
+				summary.argumentCount = static_cast<uint8_t>(atoi(count.c_str()));
+				summary.returnsValue = flags.find('r') != string::npos;
+				summary.isVararg = flags.find('v') != string::npos;
+			}
+		}
+		return summaries;
+	}
+
+	const FunctionSummary* findSummary(StringRef functionName)
+	{
+		// Strip the numeric suffix that setName appends when an import name collides with an
+		// existing function.
+		auto dotIndex = functionName.find('.');
+		if (dotIndex != StringRef::npos)
+		{
+			StringRef suffix = functionName.substr(dotIndex + 1);
+			if (suffix.size() > 0 && all_of(suffix.begin(), suffix.end(), [](char c) { return isdigit(c) != 0; }))
+			{
+				functionName = functionName.substr(0, dotIndex);
+			}
+		}
+
+		string name = functionName.str();
+		const auto& extras = userSummaries();
+		auto extraIter = extras.find(name);
+		if (extraIter != extras.end())
+		{
+			return &extraIter->second;
+		}
+
+		auto iter = lower_bound(begin(knownFunctions), end(knownFunctions), name, [](const FunctionSummary& summary, const string& name)
+		{
+			return strcmp(summary.name, name.c_str()) < 0;
+		});
+		if (iter != end(knownFunctions) && name == iter->name)
+		{
+			return &*iter;
+		}
+		return nullptr;
+	}
+}
+
+const char* CallingConvention_AnyArch_Library::name = "any/library";
+
+const char* CallingConvention_AnyArch_Library::getName() const
+{
+	return name;
+}
+
+const char* CallingConvention_AnyArch_Library::getHelp() const
+{
+	return "uses signature summaries of well-known library functions";
+}
+
+bool CallingConvention_AnyArch_Library::matches(TargetInfo &target, Executable &executable) const
+{
+	// Never the primary convention; ParameterRegistry inserts it into the chain explicitly.
+	return false;
+}
+
+bool CallingConvention_AnyArch_Library::analyzeFunction(ParameterRegistry &registry, CallInformation &fillOut, llvm::Function &func)
+{
+	const FunctionSummary* summary = findSummary(func.getName());
+	if (summary == nullptr)
+	{
+		return false;
+	}
+
+	// Turn the summary into a function type and let the system calling convention do the register
+	// assignment, the same path that header file prototypes take.
+	LLVMContext& ctx = func.getContext();
+	Type* integer = Type::getIntNTy(ctx, registry.getTargetInfo().getPointerSize() * CHAR_BIT);
+	Type* returnType = summary->returnsValue ? integer : Type::getVoidTy(ctx);
+	vector<Type*> parameters(summary->argumentCount, integer);
+	FunctionType* type = FunctionType::get(returnType, parameters, summary->isVararg);
+
+	for (CallingConvention* cc : registry)
+	{
+		if (cc != this && cc->analyzeFunctionType(registry, fillOut, *type))
+		{
+			fillOut.setVararg(summary->isVararg);
+			return true;
+		}
+	}
+	return false;
+}
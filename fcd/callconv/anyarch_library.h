@@ -0,0 +1,31 @@
+//
+// anyarch_library.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef anyarch_library_h
+#define anyarch_library_h
+
+#include "call_conv.h"
+#include "params_registry.h"
+
+// Answers parameter recovery queries for well-known library functions from a precompiled table of
+// signature summaries, so that stubs for common libc/libstdc++ symbols don't need header files or
+// full register-usage analysis.
+class CallingConvention_AnyArch_Library : public CallingConvention
+{
+public:
+	static const char* name;
+
+	virtual const char* getName() const override;
+	virtual const char* getHelp() const override;
+
+	virtual bool matches(TargetInfo& target, Executable& executable) const override;
+	virtual bool analyzeFunction(ParameterRegistry& registry, CallInformation& fillOut, llvm::Function& func) override;
+};
+
+#endif /* anyarch_library_h */
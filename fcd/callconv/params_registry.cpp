@@ -9,13 +9,17 @@
 
 #include "anyarch_anycc.h"
 #include "anyarch_interactive.h"
+#include "anyarch_library.h"
 #include "call_conv.h"
 #include "command_line.h"
 #include "executable.h"
 #include "metadata.h"
 #include "params_registry.h"
 #include "pass_executable.h"
+#include "statistics.h"
 
+#include <llvm/ADT/SCCIterator.h>
+#include <llvm/Analysis/CallGraph.h>
 #include <llvm/Analysis/PostDominators.h>
 #include <llvm/Analysis/TargetLibraryInfo.h>
 #include <llvm/IR/Dominators.h>
@@ -27,6 +31,9 @@ using namespace std;
 
 namespace
 {
+	StatCounter functionAnalysesRun("params.analyses.run");
+	StatCounter functionAnalysesMemoized("params.analyses.memo_hits");
+
 	class CallingConventionParser : public cl::generic_parser_base
 	{
 		struct OptionInfo : public GenericOptionInfo
@@ -179,7 +186,7 @@ ModRefInfo ParameterRegistryAAResults::getModRefInfo(ImmutableCallSite cs, const
 char ParameterRegistry::ID = 0;
 
 ParameterRegistry::ParameterRegistry()
-: ModulePass(ID)
+: ModulePass(ID), targetInfo(nullptr)
 {
 }
 
@@ -192,6 +199,7 @@ CallInformation* ParameterRegistry::analyzeFunction(Function& fn)
 	CallInformation& info = aaResults->callInformation[&fn];
 	if (info.getStage() == CallInformation::New)
 	{
+		++functionAnalysesRun;
 		for (CallingConvention* cc : ccChain)
 		{
 			PrettyStackTraceFormat analyzingFunction("Analyzing function \"%s\" with calling convention \"%s\"",
@@ -222,6 +230,10 @@ CallInformation* ParameterRegistry::analyzeFunction(Function& fn)
 
 void ParameterRegistry::setupCCChain()
 {
+	// Known library functions are answered from signature summaries before any body analysis runs,
+	// so that convention goes ahead of the system convention.
+	addCallingConvention(CallingConvention::getCallingConvention(CallingConvention_AnyArch_Library::name));
+
 	if (defaultCC != nullptr)
 	{
 		addCallingConvention(defaultCC);
@@ -234,8 +246,8 @@ void ParameterRegistry::setupCCChain()
 			addCallingConvention(cc);
 		}
 	}
-	
-	if (ccChain.size() >= 1)
+
+	if (ccChain.size() >= 2)
 	{
 		addCallingConvention(CallingConvention::getCallingConvention(CallingConvention_AnyArch_AnyCC::name));
 		addCallingConvention(CallingConvention::getCallingConvention(CallingConvention_AnyArch_Interactive::name));
@@ -264,7 +276,8 @@ const CallInformation* ParameterRegistry::getCallInfo(Function &function)
 	{
 		return analyzing ? analyzeFunction(function) : nullptr;
 	}
-	
+
+	++functionAnalysesMemoized;
 	return &iter->second;
 }
 
@@ -411,17 +424,29 @@ bool ParameterRegistry::runOnModule(Module& m)
 	aaHack.reset(new ProgramMemoryAAResult);
 	setupCCChain();
 	
-	aaResults.reset(new ParameterRegistryAAResults(TargetInfo::getTargetInfo(m)));
+	aaResults.reset(new ParameterRegistryAAResults(*targetInfo));
 	
 	TemporaryTrue isAnalyzing(analyzing);
-	for (auto& fn : m.getFunctionList())
+
+	// Visit strongly connected components of the call graph bottom-up, so that by the time a calling
+	// convention follows a call chain out of a function, the callees' information is already memoized
+	// instead of being derived partway through every caller's analysis. Functions within one SCC still
+	// see each other in the Analyzing stage, which the stage machinery already accounts for.
+	CallGraph callGraph(m);
+	for (auto iter = scc_begin(&callGraph); iter != scc_end(&callGraph); ++iter)
 	{
-		if (!md::isPrototype(fn) && md::getAssemblyString(fn) == nullptr)
+		for (CallGraphNode* node : *iter)
 		{
-			analyzeFunction(fn);
+			if (Function* fn = node->getFunction())
+			{
+				if (!md::isPrototype(*fn) && md::getAssemblyString(*fn) == nullptr)
+				{
+					analyzeFunction(*fn);
+				}
+			}
 		}
 	}
-	
+
 	return false;
 }
 
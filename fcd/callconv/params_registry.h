@@ -189,11 +189,11 @@ class ParameterRegistryAAResults : public llvm::AAResultBase<ParameterRegistryAA
 	friend class ParameterRegistry;
 	
 	std::unordered_map<const llvm::Function*, CallInformation> callInformation;
-	std::unique_ptr<TargetInfo> targetInfo;
-	
+	TargetInfo* targetInfo;
+
 public:
-	ParameterRegistryAAResults(std::unique_ptr<TargetInfo> targetInfo)
-	: targetInfo(move(targetInfo))
+	ParameterRegistryAAResults(TargetInfo& targetInfo)
+	: targetInfo(&targetInfo)
 	{
 	}
 	
@@ -217,7 +217,7 @@ public:
 class ParameterRegistry final : public llvm::ModulePass
 {
 	std::unique_ptr<ParameterRegistryAAResults> aaResults;
-	std::unique_ptr<TargetInfo> targetInfo;
+	TargetInfo* targetInfo;
 	std::unique_ptr<ProgramMemoryAAResult> aaHack;
 	std::deque<CallingConvention*> ccChain;
 	std::unordered_map<const llvm::Function*, std::pair<unsigned, std::unique_ptr<llvm::MemorySSA>>> mssas;
@@ -105,19 +105,19 @@ Expression* ExpressionContext::simplify(Expression* x)
 		Expression* root = nullptr;
 		for (Expression* pos : operands.plus)
 		{
-			root = root == nullptr ? pos : pool.allocate<AddExpression>(root, pos);
+			root = root == nullptr ? pos : createAdd(root, pos);
 		}
-		
+
 		for (Expression* neg : operands.minus)
 		{
-			Expression* negated = pool.allocate<NegateExpression>(neg);
-			root = root == nullptr ? negated : pool.allocate<AddExpression>(root, negated);
+			Expression* negated = createNegate(neg);
+			root = root == nullptr ? negated : createAdd(root, negated);
 		}
-		
+
 		if (operands.constant != 0)
 		{
-			Expression* constant = pool.allocate<ConstantIntExpression>(operands.constant);
-			root = root == nullptr ? constant : pool.allocate<AddExpression>(root, constant);
+			Expression* constant = createConstant(operands.constant);
+			root = root == nullptr ? constant : createAdd(root, constant);
 		}
 		return root;
 	}
@@ -17,6 +17,10 @@
 #include <llvm/Support/Casting.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <map>
+#include <unordered_map>
+#include <utility>
+
 namespace symbolic
 {
 	class Expression
@@ -159,38 +163,76 @@ namespace symbolic
 	class ExpressionContext
 	{
 		DumbAllocator pool;
-		
+
+		// Uniquing tables: operands are uniqued recursively, so structurally equal trees always end up
+		// as the same object and equality tests reduce to pointer comparisons.
+		std::map<std::pair<Expression*, Expression*>, AddExpression*> adds;
+		std::unordered_map<Expression*, NegateExpression*> negates;
+		std::unordered_map<int64_t, ConstantIntExpression*> constants;
+		std::unordered_map<Expression*, LoadExpression*> loads;
+		std::unordered_map<const TargetRegisterInfo*, LiveOnEntryExpression*> liveOnEntries;
+
 	public:
 		inline AddExpression* createAdd(Expression* left, Expression* right)
 		{
-			return pool.allocate<AddExpression>(left, right);
+			// Addition is commutative; order the key by address so that a+b and b+a share a node.
+			if (right < left)
+			{
+				std::swap(left, right);
+			}
+			AddExpression*& add = adds[{left, right}];
+			if (add == nullptr)
+			{
+				add = pool.allocate<AddExpression>(left, right);
+			}
+			return add;
 		}
-		
+
 		inline NegateExpression* createNegate(Expression* operand)
 		{
-			return pool.allocate<NegateExpression>(operand);
+			NegateExpression*& negate = negates[operand];
+			if (negate == nullptr)
+			{
+				negate = pool.allocate<NegateExpression>(operand);
+			}
+			return negate;
 		}
-		
+
 		inline ConstantIntExpression* createConstant(int64_t value)
 		{
-			return pool.allocate<ConstantIntExpression>(value);
+			ConstantIntExpression*& constant = constants[value];
+			if (constant == nullptr)
+			{
+				constant = pool.allocate<ConstantIntExpression>(value);
+			}
+			return constant;
 		}
-		
+
 		inline ConstantIntExpression* createConstant(const llvm::APInt& value)
 		{
 			return createConstant(static_cast<int64_t>(value.getLimitedValue()));
 		}
-		
+
 		inline LoadExpression* createLoad(Expression* expr)
 		{
-			return pool.allocate<LoadExpression>(expr);
+			LoadExpression*& load = loads[expr];
+			if (load == nullptr)
+			{
+				load = pool.allocate<LoadExpression>(expr);
+			}
+			return load;
 		}
-		
+
 		inline LiveOnEntryExpression* createLiveOnEntry(const TargetRegisterInfo* info)
 		{
-			return pool.allocate<LiveOnEntryExpression>(info);
+			LiveOnEntryExpression*& liveOnEntry = liveOnEntries[info];
+			if (liveOnEntry == nullptr)
+			{
+				liveOnEntry = pool.allocate<LiveOnEntryExpression>(info);
+			}
+			return liveOnEntry;
 		}
-		
+
 		Expression* simplify(Expression* that);
 	};
 }
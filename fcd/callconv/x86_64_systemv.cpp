@@ -24,6 +24,7 @@
 
 #include "cc_common.h"
 #include "metadata.h"
+#include "statistics.h"
 #include "x86_64_systemv.h"
 
 #include <llvm/IR/PatternMatch.h>
@@ -38,7 +39,10 @@ using namespace std;
 namespace
 {
 	RegisterCallingConvention<CallingConvention_x86_64_systemv> registerSysV;
-	
+
+	StatCounter sysvFastPathHits("cc.sysv.fast_path");
+	StatCounter sysvFullAnalyses("cc.sysv.full_walk");
+
 	const char* parameterRegisters[] = { "rdi", "rsi", "rdx", "rcx", "r8", "r9" };
 	const char* returnRegisters[] = {"rax", "rdx"};
 	
@@ -93,6 +97,112 @@ namespace
 		return type == Type::getVoidTy(type->getContext());
 	}
 	
+	// Cheap screen for the most common shape of SysV function: every integer parameter lives in
+	// the first four parameter registers, and the function reads it from the register struct in
+	// its entry block before ever writing it back. When the screen passes, a single ordered walk
+	// of the entry block classifies every parameter register and the MemorySSA liveness walk is
+	// skipped entirely; anything unusual (escaping register addresses, accesses outside the entry
+	// block, r8/r9 arguments, gaps in the register sequence) fails the screen and falls through
+	// to the full analysis.
+	bool tryFastPathParameters(TargetInfo& targetInfo, CallInformation& callInfo, Function& function, const unordered_multimap<const TargetRegisterInfo*, GetElementPtrInst*>& geps)
+	{
+		constexpr size_t registerCount = sizeof parameterRegisters / sizeof *parameterRegisters;
+		BasicBlock& entry = function.getEntryBlock();
+
+		// Collect the address of every parameter register, making sure that each one is only ever
+		// loaded from or stored to within the entry block. Addresses that escape through casts or
+		// stores are the full analysis' problem.
+		unordered_map<const Value*, size_t> addresses;
+		for (size_t i = 0; i < registerCount; ++i)
+		{
+			const TargetRegisterInfo* smallReg = targetInfo.registerNamed(parameterRegisters[i]);
+			const TargetRegisterInfo& regInfo = targetInfo.largestOverlappingRegister(*smallReg);
+			auto range = geps.equal_range(&regInfo);
+			for (auto iter = range.first; iter != range.second; ++iter)
+			{
+				GetElementPtrInst* gep = iter->second;
+				if (gep->getParent() != &entry)
+				{
+					return false;
+				}
+
+				for (auto& use : gep->uses())
+				{
+					auto user = dyn_cast<Instruction>(use.getUser());
+					if (user == nullptr || user->getParent() != &entry)
+					{
+						return false;
+					}
+
+					if (auto store = dyn_cast<StoreInst>(user))
+					{
+						if (store->getPointerOperand() != gep)
+						{
+							return false;
+						}
+					}
+					else if (!isa<LoadInst>(user))
+					{
+						return false;
+					}
+				}
+				addresses.insert({gep, i});
+			}
+		}
+
+		// One ordered walk of the entry block: a register that is loaded before it is stored holds
+		// a parameter. Since every address above refers to a distinct field of the register struct,
+		// no other memory operation can alias them and program order is all that matters.
+		bool written[registerCount] = {};
+		bool isParameter[registerCount] = {};
+		for (Instruction& inst : entry)
+		{
+			if (auto load = dyn_cast<LoadInst>(&inst))
+			{
+				auto iter = addresses.find(load->getPointerOperand());
+				if (iter != addresses.end() && !written[iter->second])
+				{
+					isParameter[iter->second] = true;
+				}
+			}
+			else if (auto store = dyn_cast<StoreInst>(&inst))
+			{
+				auto iter = addresses.find(store->getPointerOperand());
+				if (iter != addresses.end())
+				{
+					written[iter->second] = true;
+				}
+			}
+		}
+
+		// Only accept a gap-free prefix of at most rdi/rsi/rdx/rcx.
+		size_t parameterCount = 0;
+		while (parameterCount < registerCount && isParameter[parameterCount])
+		{
+			parameterCount++;
+		}
+
+		if (parameterCount > 4)
+		{
+			return false;
+		}
+
+		for (size_t i = parameterCount; i < registerCount; ++i)
+		{
+			if (isParameter[i])
+			{
+				return false;
+			}
+		}
+
+		for (size_t i = 0; i < parameterCount; ++i)
+		{
+			const TargetRegisterInfo* smallReg = targetInfo.registerNamed(parameterRegisters[i]);
+			callInfo.addParameter(ValueInformation::IntegerRegister, &targetInfo.largestOverlappingRegister(*smallReg));
+		}
+		return true;
+	}
+
 	void identifyParameterCandidates(TargetInfo& target, MemorySSA& mssa, MemoryAccess* access, CallInformation& fillOut)
 	{
 		// Look for values that are written but not used by the caller (parameters).
@@ -150,7 +260,7 @@ namespace
 							}
 						}
 					}
-					else if (md::isProgramMemory(*store))
+					else if (target.metadataKinds().isProgramMemory(*store))
 					{
 						// this could be a stack register
 						Value* origin = nullptr;
@@ -285,45 +395,54 @@ bool CallingConvention_x86_64_systemv::analyzeFunction(ParameterRegistry &regist
 		}
 	}
 	
-	// Look at temporary registers that are read before they are written
-	MemorySSA& mssa = *registry.getMemorySSA(function);
-	for (const char* regName : parameterRegisters)
+	// Look at temporary registers that are read before they are written. Most functions fit the
+	// plain SysV shape that the fast path recognizes; everything else pays for the MemorySSA walk.
+	if (tryFastPathParameters(targetInfo, callInfo, function, geps))
 	{
-		const TargetRegisterInfo* smallReg = targetInfo.registerNamed(regName);
-		const TargetRegisterInfo& regInfo = targetInfo.largestOverlappingRegister(*smallReg);
-		auto range = geps.equal_range(&regInfo);
-		
-		vector<Instruction*> addresses;
-		for (auto iter = range.first; iter != range.second; ++iter)
-		{
-			addresses.push_back(iter->second);
-		}
-		
-		for (size_t i = 0; i < addresses.size(); ++i)
+		++sysvFastPathHits;
+	}
+	else
+	{
+		++sysvFullAnalyses;
+		MemorySSA& mssa = *registry.getMemorySSA(function);
+		for (const char* regName : parameterRegisters)
 		{
-			Instruction* addressInst = addresses[i];
-			for (auto& use : addressInst->uses())
+			const TargetRegisterInfo* smallReg = targetInfo.registerNamed(regName);
+			const TargetRegisterInfo& regInfo = targetInfo.largestOverlappingRegister(*smallReg);
+			auto range = geps.equal_range(&regInfo);
+
+			vector<Instruction*> addresses;
+			for (auto iter = range.first; iter != range.second; ++iter)
+			{
+				addresses.push_back(iter->second);
+			}
+
+			for (size_t i = 0; i < addresses.size(); ++i)
 			{
-				if (auto load = dyn_cast<LoadInst>(use.getUser()))
+				Instruction* addressInst = addresses[i];
+				for (auto& use : addressInst->uses())
 				{
-					MemoryAccess* parent = cast<MemoryUse>(mssa.getMemoryAccess(load))->getDefiningAccess();
-					if (mssa.isLiveOnEntryDef(parent))
+					if (auto load = dyn_cast<LoadInst>(use.getUser()))
 					{
-						// register argument!
-						callInfo.addParameter(ValueInformation::IntegerRegister, &regInfo);
+						MemoryAccess* parent = cast<MemoryUse>(mssa.getMemoryAccess(load))->getDefiningAccess();
+						if (mssa.isLiveOnEntryDef(parent))
+						{
+							// register argument!
+							callInfo.addParameter(ValueInformation::IntegerRegister, &regInfo);
+						}
 					}
-				}
-				else if (auto cast = dyn_cast<CastInst>(use.getUser()))
-				{
-					if (cast->getType()->isPointerTy())
+					else if (auto cast = dyn_cast<CastInst>(use.getUser()))
 					{
-						addresses.push_back(cast);
+						if (cast->getType()->isPointerTy())
+						{
+							addresses.push_back(cast);
+						}
 					}
 				}
 			}
 		}
 	}
-	
+
 	// Does the function refer to values at an offset above the initial rsp value?
 	// Assume that rsp is known to be preserved.
 	auto spRange = geps.equal_range(targetInfo.getStackPointer());
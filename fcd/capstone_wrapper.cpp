@@ -99,6 +99,28 @@ capstone_iter::operation_result capstone_iter::next()
 	return success;
 }
 
+capstone_batch::capstone_batch(csh handle, size_t capacity)
+: borrowed_handle(handle), decoded(0)
+{
+	memory.reserve(capacity);
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		memory.emplace_back(cs_malloc(handle));
+	}
+}
+
+size_t capstone_batch::disassemble(const uint8_t* begin, const uint8_t* end, uint64_t virtual_address)
+{
+	assert(end >= begin);
+	size_t remaining = static_cast<size_t>(end - begin);
+	decoded = 0;
+	while (decoded < memory.size() && cs_disasm_iter(borrowed_handle, &begin, &remaining, &virtual_address, memory[decoded].get()))
+	{
+		decoded++;
+	}
+	return decoded;
+}
+
 capstone::capstone(csh handle)
 : handle(handle)
 {
@@ -139,6 +161,11 @@ capstone::inst_ptr capstone::alloc()
 	return inst_ptr(cs_malloc(handle));
 }
 
+capstone_batch capstone::create_batch(size_t capacity)
+{
+	return capstone_batch(handle, capacity);
+}
+
 bool capstone::disassemble(cs_insn* into, const uint8_t *begin, const uint8_t *end, uint64_t virtual_address)
 {
 	size_t size = size_t(end - begin);
@@ -14,6 +14,7 @@
 
 #include <capstone/capstone.h>
 #include <memory>
+#include <vector>
 
 class capstone_error_category final : public std::error_category
 {
@@ -65,21 +66,43 @@ struct cs_free_deleter
 	}
 };
 
+// A reusable pre-allocated decode buffer: instruction and detail storage is allocated once at creation
+// and refilled by each disassemble() call, so decoding a run of instructions doesn't touch the allocator.
+class capstone_batch
+{
+	friend class capstone;
+
+	csh borrowed_handle;
+	std::vector<std::unique_ptr<cs_insn, cs_free_deleter>> memory;
+	size_t decoded;
+
+	capstone_batch(csh handle, size_t capacity);
+
+public:
+	capstone_batch(capstone_batch&& that) = default;
+
+	inline size_t size() const { return decoded; }
+	inline cs_insn& operator[](size_t index) { return *memory[index]; }
+
+	size_t disassemble(const uint8_t* begin, const uint8_t* end, uint64_t virtual_address);
+};
+
 class capstone
 {
 	csh handle;
-	
+
 	capstone(csh handle);
-	
+
 public:
 	typedef std::unique_ptr<cs_insn, cs_free_deleter> inst_ptr;
 	static llvm::ErrorOr<capstone> create(cs_arch arch, unsigned mode);
-	
+
 	capstone(capstone&& that);
 	~capstone();
-	
+
 	inst_ptr alloc();
-	
+	capstone_batch create_batch(size_t capacity);
+
 	bool disassemble(cs_insn* into, const uint8_t* begin, const uint8_t* end, uint64_t virtual_address);
 	capstone_iter begin(const uint8_t* begin, const uint8_t* end, uint64_t virtual_address = 0);
 };
@@ -8,11 +8,21 @@
 //
 
 #include "code_generator.h"
+#include "command_line.h"
 #include "metadata.h"
+#include "statistics.h"
 
+#include <llvm/Analysis/ConstantFolding.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Intrinsics.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Support/Error.h>
 #include <llvm/Support/raw_os_ostream.h>
 #include <llvm/Support/SourceMgr.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+#include <llvm/Transforms/Utils/Local.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
 
 #include <string>
 
@@ -24,6 +34,10 @@ extern "C" const char fcd_emulator_end_x86;
 
 namespace
 {
+	cl::opt<unsigned> outlineHandlerThreshold("outline-handlers", cl::desc("Call instruction handlers with at least this many IR instructions instead of inlining them at lift time; they are inlined back after the early optimization passes have run (0 = always inline)"), cl::init(0), whitelist());
+
+	StatCounter handlersOutlined("lifter.handlers.outlined_calls");
+
 	Type* getMemoryType(LLVMContext& ctx, size_t size)
 	{
 		if (size == 1 || size == 2 || size == 4 || size == 8)
@@ -32,6 +46,30 @@ namespace
 		}
 		llvm_unreachable("invalid pointer size");
 	}
+
+	// Whether this operand embeds the given address as an integer constant, directly or inside an
+	// aggregate constant. Global values have link-time addresses, not embedded immediates, so their
+	// initializers are not visited.
+	bool mentionsAddress(Value* operand, uint64_t address)
+	{
+		if (auto integer = dyn_cast<ConstantInt>(operand))
+		{
+			return integer->getLimitedValue() == address;
+		}
+
+		if (auto constant = dyn_cast<Constant>(operand))
+		if (!isa<GlobalValue>(constant))
+		{
+			for (Value* suboperand : constant->operands())
+			{
+				if (mentionsAddress(suboperand, address))
+				{
+					return true;
+				}
+			}
+		}
+		return false;
+	}
 	
 	class x86CodeGenerator final : public CodeGenerator
 	{
@@ -41,7 +79,7 @@ namespace
 		bool isIntrinsic(StringRef name)
 		{
 			static unordered_set<string> x86Intrins = {
-				"x86_jump_intrin", "x86_call_intrin", "x86_ret_intrin", "x86_read_mem", "x86_write_mem"
+				"x86_jump_intrin", "x86_call_intrin", "x86_ret_intrin", "x86_read_mem", "x86_write_mem", "x86_write_mem_rep"
 			};
 			
 			return x86Intrins.count(name) != 0;
@@ -156,6 +194,86 @@ namespace
 				md::setProgramMemory(*storeInst);
 				translated->eraseFromParent();
 			}
+			else if (name == "x86_write_mem_rep")
+			{
+				// Ascending rep store: `count` items of `size` bytes starting at `intptr`. When the fill
+				// value is one byte repeated this is llvm.memset, which covers stosb and zero fills of any
+				// width; other fills become a plain counted store loop, either way without the emulator's
+				// per-iteration register traffic.
+				Value* intptr = translated->getOperand(1);
+				Value* count = translated->getOperand(2);
+				Value* size = translated->getOperand(3);
+				Value* value = translated->getOperand(4);
+
+				LLVMContext& ctx = translated->getContext();
+				Module* module = translated->getParent()->getParent()->getParent();
+				uint64_t itemSize = cast<ConstantInt>(size)->getLimitedValue();
+				Type* i8 = Type::getInt8Ty(ctx);
+				Type* i64 = Type::getInt64Ty(ctx);
+
+				Value* fillByte = nullptr;
+				if (itemSize == 1)
+				{
+					fillByte = CastInst::Create(Instruction::Trunc, value, i8, "", translated);
+				}
+				else if (auto constantValue = dyn_cast<ConstantInt>(value))
+				{
+					uint64_t pattern = constantValue->getLimitedValue();
+					uint8_t lowByte = static_cast<uint8_t>(pattern);
+					bool splat = true;
+					for (uint64_t byteIndex = 1; byteIndex < itemSize; ++byteIndex)
+					{
+						splat &= static_cast<uint8_t>(pattern >> (byteIndex * 8)) == lowByte;
+					}
+					if (splat)
+					{
+						fillByte = ConstantInt::get(i8, lowByte);
+					}
+				}
+
+				if (fillByte != nullptr)
+				{
+					Value* totalBytes = BinaryOperator::CreateMul(count, ConstantInt::get(i64, itemSize), "", translated);
+					Value* pointer = CastInst::Create(CastInst::IntToPtr, intptr, i8->getPointerTo(), "", translated);
+					Function* memsetIntrin = Intrinsic::getDeclaration(module, Intrinsic::memset, { i8->getPointerTo(), i64 });
+					Type* i32 = Type::getInt32Ty(ctx);
+					Type* i1 = Type::getInt1Ty(ctx);
+					CallInst::Create(memsetIntrin, { pointer, fillByte, totalBytes, ConstantInt::get(i32, 1), ConstantInt::get(i1, 0) }, "", translated);
+					translated->eraseFromParent();
+				}
+				else
+				{
+					BasicBlock* preheader = translated->getParent();
+					BasicBlock* exit = preheader->splitBasicBlock(translated);
+					Function* fn = preheader->getParent();
+					BasicBlock* header = BasicBlock::Create(ctx, "", fn, exit);
+					BasicBlock* body = BasicBlock::Create(ctx, "", fn, exit);
+
+					preheader->getTerminator()->setSuccessor(0, header);
+
+					PHINode* index = PHINode::Create(i64, 2, "", header);
+					index->addIncoming(ConstantInt::get(i64, 0), preheader);
+					auto hasMoreItems = new ICmpInst(*header, ICmpInst::ICMP_ULT, index, count, "");
+					BranchInst::Create(body, exit, hasMoreItems, header);
+
+					Value* offset = BinaryOperator::CreateMul(index, ConstantInt::get(i64, itemSize), "", body);
+					Value* itemAddress = BinaryOperator::CreateAdd(intptr, offset, "", body);
+					Type* itemType = getMemoryType(ctx, itemSize);
+					Value* pointer = CastInst::Create(CastInst::IntToPtr, itemAddress, itemType->getPointerTo(), "", body);
+					Value* itemValue = value;
+					if (itemValue->getType() != itemType)
+					{
+						itemValue = CastInst::Create(Instruction::Trunc, itemValue, itemType, "", body);
+					}
+					StoreInst* storeInst = new StoreInst(itemValue, pointer, body);
+					md::setProgramMemory(*storeInst);
+					Value* nextIndex = BinaryOperator::CreateAdd(index, ConstantInt::get(i64, 1), "", body);
+					index->addIncoming(nextIndex, body);
+					BranchInst::Create(header, body);
+
+					translated->eraseFromParent();
+				}
+			}
 		}
 		
 	protected:
@@ -215,7 +333,29 @@ namespace
 				}
 			}
 		}
-		
+
+		virtual bool mustInlineEagerly(llvm::Function& handler) override
+		{
+			// Jumps, calls and returns resolve against the per-site function and block maps, so
+			// handlers that contain them cannot be shared behind a call.
+			for (BasicBlock& block : handler)
+			{
+				for (Instruction& inst : block)
+				{
+					if (auto call = dyn_cast<CallInst>(&inst))
+					if (Function* callee = call->getCalledFunction())
+					{
+						StringRef name = callee->getName();
+						if (name == "x86_jump_intrin" || name == "x86_call_intrin" || name == "x86_ret_intrin")
+						{
+							return true;
+						}
+					}
+				}
+			}
+			return false;
+		}
+
 	public:
 		x86CodeGenerator(LLVMContext& ctx)
 		: CodeGenerator(ctx)
@@ -308,6 +448,85 @@ namespace
 	};
 }
 
+InlinedBodyMemo::~InlinedBodyMemo()
+{
+	clear();
+}
+
+bool InlinedBodyMemo::instantiate(Function* target, Function* handler, Value* detail, BasicBlock* nextBlock)
+{
+	auto iter = bodies.find({handler, detail});
+	if (iter == bodies.end())
+	{
+		return false;
+	}
+
+	// Clone the exemplar to the end of the function and stitch it in, replaying the edges that
+	// inlining would have created. The only address-dependent value in a remembered body is its
+	// fall-through edge, which gets remapped to this occurrence's successor.
+	CachedBody& cached = iter->second;
+	ValueToValueMapTy valueMap;
+	valueMap[cached.successor] = nextBlock;
+	BasicBlock* blockBeforeInstruction = &target->back();
+	BasicBlock* clone = CloneBasicBlock(cached.exemplar, valueMap, "", target);
+	for (Instruction& inst : *clone)
+	{
+		RemapInstruction(&inst, valueMap, RF_IgnoreMissingLocals | RF_NoModuleLevelChanges);
+	}
+	BranchInst::Create(clone, blockBeforeInstruction);
+	return true;
+}
+
+void InlinedBodyMemo::remember(Function* handler, Value* detail, BasicBlock* body, BasicBlock* fallthrough, uint64_t nextAddress)
+{
+	auto key = make_pair(handler, detail);
+	if (bodies.count(key) != 0)
+	{
+		return;
+	}
+
+	if (body->getTerminator() == nullptr || !isa<BranchInst>(body->getTerminator()))
+	{
+		return;
+	}
+
+	for (Instruction& inst : *body)
+	{
+		if (isa<PHINode>(inst))
+		{
+			return;
+		}
+
+		for (Value* operand : inst.operands())
+		{
+			if (mentionsAddress(operand, nextAddress))
+			{
+				return;
+			}
+		}
+	}
+
+	// Keep a detached copy rather than a pointer into the function: a later jump into the middle of
+	// this code run would split the live block and change what it contains.
+	ValueToValueMapTy valueMap;
+	BasicBlock* exemplar = CloneBasicBlock(body, valueMap);
+	for (Instruction& inst : *exemplar)
+	{
+		RemapInstruction(&inst, valueMap, RF_IgnoreMissingLocals | RF_NoModuleLevelChanges);
+	}
+	bodies[key] = {exemplar, fallthrough};
+}
+
+void InlinedBodyMemo::clear()
+{
+	for (auto& pair : bodies)
+	{
+		pair.second.exemplar->dropAllReferences();
+		delete pair.second.exemplar;
+	}
+	bodies.clear();
+}
+
 CodeGenerator::CodeGenerator(llvm::LLVMContext& ctx)
 : ctx(ctx)
 {
@@ -317,8 +536,26 @@ bool CodeGenerator::initGenerator(const char* begin, const char* end)
 {
 	assert(end >= begin);
 	
-	SMDiagnostic errors;
 	MemoryBufferRef buffer(StringRef(begin, static_cast<uintptr_t>(end - begin)), "IRImplementation");
+	if (isBitcode(reinterpret_cast<const unsigned char*>(begin), reinterpret_cast<const unsigned char*>(end)))
+	{
+		// Load the emulator lazily: a typical binary only exercises a small part of the ISA, so only the
+		// instruction implementations that lifting actually inlines ever get materialized. The image was
+		// internalized and dead-stripped at build time, so materialized bodies are ready to inline as-is.
+		if (auto module = getLazyBitcodeModule(buffer, ctx))
+		{
+			generatorModule = move(module.get());
+			return true;
+		}
+		else
+		{
+			logAllUnhandledErrors(module.takeError(), errs(), "emulator module: ");
+			assert(false);
+			return false;
+		}
+	}
+
+	SMDiagnostic errors;
 	if (auto module = parseIR(buffer, errors, ctx))
 	{
 		generatorModule = move(module);
@@ -342,12 +579,68 @@ unique_ptr<CodeGenerator> CodeGenerator::x86(LLVMContext &ctx)
 	return nullptr;
 }
 
-void CodeGenerator::inlineFunction(Function *target, Function *toInline, ArrayRef<Value *> parameters, AddressToFunction& funcMap, AddressToBlock &blockMap, uint64_t nextAddress)
+BasicBlock* CodeGenerator::inlineFunction(Function *target, Function *toInline, ArrayRef<Value *> parameters, AddressToFunction& funcMap, AddressToBlock &blockMap, uint64_t nextAddress)
 {
 	assert(toInline->arg_size() == parameters.size());
+	if (Error error = toInline->materialize())
+	{
+		// The emulator module is embedded in fcd itself; this can only fail if the blob is corrupt.
+		logAllUnhandledErrors(move(error), errs(), "materializing emulator function: ");
+		abort();
+	}
+
 	Module& targetModule = *target->getParent();
+
+	// Cost-model mode: huge handlers front-load massive IR growth when flattened at every call
+	// site, and the early optimization passes then crawl over all of it. Over the
+	// --outline-handlers threshold, a position-independent handler is copied once into the target
+	// module and called, marked always-inline so that the inliner flattens it back after the
+	// expensive early passes have run on the small IR.
+	if (outlineHandlerThreshold != 0)
+	{
+		auto decision = outlineDecisions.find(toInline);
+		if (decision == outlineDecisions.end())
+		{
+			size_t handlerCost = 0;
+			for (BasicBlock& block : *toInline)
+			{
+				handlerCost += block.size();
+			}
+			bool outline = handlerCost >= outlineHandlerThreshold && !mustInlineEagerly(*toInline);
+			decision = outlineDecisions.insert({toInline, outline}).first;
+		}
+
+		if (decision->second)
+		{
+			string copyName = (toInline->getName() + ".outlined").str();
+			Function* copy = targetModule.getFunction(copyName);
+			if (copy == nullptr)
+			{
+				copy = Function::Create(toInline->getFunctionType(), GlobalValue::PrivateLinkage, copyName, &targetModule);
+				copy->addFnAttr(Attribute::AlwaysInline);
+				ValueToValueMapTy copyMap;
+				getModuleLevelValueChanges(copyMap, targetModule);
+				auto copyArgIter = copy->arg_begin();
+				for (Argument& arg : toInline->args())
+				{
+					copyMap[&arg] = &*copyArgIter;
+					++copyArgIter;
+				}
+				SmallVector<ReturnInst*, 1> copyReturns;
+				CloneFunctionInto(copy, toInline, copyMap, true, copyReturns);
+				resolveIntrinsics(*copy, funcMap, blockMap);
+			}
+
+			BasicBlock* thisBlock = &target->back();
+			CallInst::Create(copy, SmallVector<Value*, 4>(parameters.begin(), parameters.end()), "", thisBlock);
+			BranchInst::Create(blockMap.blockToInstruction(nextAddress), thisBlock);
+			++handlersOutlined;
+			return nullptr;
+		}
+	}
+
 	auto iter = toInline->arg_begin();
-	
+
 	ValueToValueMapTy valueMap;
 	getModuleLevelValueChanges(valueMap, targetModule);
 	for (Value* parameter : parameters)
@@ -359,12 +652,20 @@ void CodeGenerator::inlineFunction(Function *target, Function *toInline, ArrayRe
 	SmallVector<ReturnInst*, 1> returns;
 	Function::iterator blockBeforeInstruction = target->back().getIterator();
 	CloneAndPruneFunctionInto(target, toInline, valueMap, true, returns);
-	
+
 	// Stitch blocks together
 	Function::iterator firstNewBlock = blockBeforeInstruction;
 	++firstNewBlock;
 	BranchInst::Create(&*firstNewBlock, &*blockBeforeInstruction);
-	
+
+	// Collect the cloned blocks before redirecting returns, since that can append unrelated stub
+	// blocks to the function.
+	SmallVector<BasicBlock*, 16> newBlocks;
+	for (auto iter = firstNewBlock; iter != target->end(); ++iter)
+	{
+		newBlocks.push_back(&*iter);
+	}
+
 	// Redirect returns
 	BasicBlock* nextBlock = blockMap.blockToInstruction(nextAddress);
 	for (auto ret : returns)
@@ -372,6 +673,48 @@ void CodeGenerator::inlineFunction(Function *target, Function *toInline, ArrayRe
 		BranchInst::Create(nextBlock, ret);
 		ret->eraseFromParent();
 	}
-	
+
+	// The operand details are compile-time constants by the time a handler is inlined, so fold them
+	// through the cloned body right away. This resolves the operand-shape dispatch that the generic
+	// handlers contain and deletes the arms that this instruction's encoding never takes, which is
+	// most of them: the lifted IR for common reg-reg/reg-imm forms ends up a fraction of the size it
+	// would be if the dead shapes were carried until the optimization pipeline runs.
+	const DataLayout& dl = targetModule.getDataLayout();
+	for (bool changed = true; changed; )
+	{
+		changed = false;
+		for (BasicBlock* block : newBlocks)
+		{
+			for (auto instIter = block->begin(); instIter != block->end(); )
+			{
+				Instruction& inst = *instIter;
+				++instIter;
+				if (Constant* folded = ConstantFoldInstruction(&inst, dl))
+				{
+					inst.replaceAllUsesWith(folded);
+					inst.eraseFromParent();
+					changed = true;
+				}
+			}
+			changed |= ConstantFoldTerminator(block, true);
+		}
+
+		for (size_t i = 0; i < newBlocks.size(); )
+		{
+			BasicBlock* block = newBlocks[i];
+			if (pred_empty(block))
+			{
+				DeleteDeadBlock(block);
+				newBlocks.erase(newBlocks.begin() + static_cast<ptrdiff_t>(i));
+				changed = true;
+			}
+			else
+			{
+				++i;
+			}
+		}
+	}
+
 	resolveIntrinsics(*target, funcMap, blockMap);
+	return newBlocks.size() == 1 ? newBlocks.front() : nullptr;
 }
@@ -14,20 +14,59 @@
 #include "not_null.h"
 #include "translation_maps.h"
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Module.h>
 #include <llvm/Transforms/Utils/Cloning.h>
 
 #include <cstdint>
 #include <memory>
+#include <utility>
 #include <vector>
 
+// Memo of lifted instruction bodies. Obfuscated and unrolled binaries repeat identical instructions
+// thousands of times, and two occurrences lift to the same IR whenever their decoded operand
+// details match. When the folded body of an instruction turns out to be a single
+// position-independent block, it is remembered here keyed on (handler, operand constant), and later
+// occurrences are stamped out as a cheap block clone instead of re-cloning and re-folding the whole
+// generic handler. Exemplars reference function-local values, so a memo is only valid within the
+// function it was built for.
+class InlinedBodyMemo
+{
+	struct CachedBody
+	{
+		llvm::BasicBlock* exemplar; // detached block, not part of any function
+		llvm::BasicBlock* successor; // fall-through block the exemplar was stitched to
+	};
+
+	llvm::DenseMap<std::pair<llvm::Function*, llvm::Value*>, CachedBody> bodies;
+
+public:
+	~InlinedBodyMemo();
+
+	// Appends a clone of the body remembered for (handler, detail) to the end of target, chains the
+	// previous last block to it, and rewires the fall-through edge to nextBlock. Returns false when
+	// nothing is remembered for that key.
+	bool instantiate(llvm::Function* target, llvm::Function* handler, llvm::Value* detail, llvm::BasicBlock* nextBlock);
+
+	// Remembers body for (handler, detail) if it can be replayed at another address: it must end in
+	// a branch, have no φ node, and embed no copy of the instruction's own end address (calls push
+	// their return address, for instance, and those bodies are position-dependent).
+	void remember(llvm::Function* handler, llvm::Value* detail, llvm::BasicBlock* body, llvm::BasicBlock* fallthrough, uint64_t nextAddress);
+
+	// Deletes the detached exemplars. Call before anything inspects the use lists of values they
+	// reference.
+	void clear();
+};
+
 class CodeGenerator
 {
 	llvm::LLVMContext& ctx;
 	std::unique_ptr<llvm::Module> generatorModule;
 	std::vector<llvm::Function*> functionByOpcode;
-	
+	// Cached --outline-handlers decision per handler; see inlineFunction.
+	llvm::DenseMap<llvm::Function*, bool> outlineDecisions;
+
 protected:
 	CodeGenerator(llvm::LLVMContext& ctx);
 	
@@ -44,6 +83,10 @@ protected:
 	virtual bool init() = 0;
 	virtual void getModuleLevelValueChanges(llvm::ValueToValueMapTy& map, llvm::Module& targetModule) = 0;
 	virtual void resolveIntrinsics(llvm::Function& targetFunction, AddressToFunction& funcMap, AddressToBlock& blockMap) = 0;
+
+	// Whether this handler contains intrinsics that resolve against the per-call-site address maps,
+	// which forces it to be inlined at lift time regardless of size.
+	virtual bool mustInlineEagerly(llvm::Function& handler) = 0;
 	
 public:
 	virtual ~CodeGenerator() = default;
@@ -61,7 +104,9 @@ public:
 	virtual llvm::ArrayRef<llvm::Value*> getIpOffset() = 0;
 	virtual llvm::Constant* constantForDetail(const cs_detail& detail) = 0;
 	
-	void inlineFunction(llvm::Function *target, llvm::Function *toInline, llvm::ArrayRef<llvm::Value *> parameters, AddressToFunction& funcMap, AddressToBlock& blockMap, uint64_t nextAddress);
+	// Returns the lone cloned block when the inlined body folded down to a single block, so that
+	// callers can remember it for replay; returns null otherwise.
+	llvm::BasicBlock* inlineFunction(llvm::Function *target, llvm::Function *toInline, llvm::ArrayRef<llvm::Value *> parameters, AddressToFunction& funcMap, AddressToBlock& blockMap, uint64_t nextAddress);
 };
 
 #endif /* code_generator_hpp */
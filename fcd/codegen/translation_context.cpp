@@ -10,9 +10,12 @@
 #include "metadata.h"
 #include "not_null.h"
 #include "params_registry.h"
+#include "statistics.h"
 #include "translation_context.h"
 #include "x86_register_map.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
 #include <llvm/ADT/Triple.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/Verifier.h>
@@ -22,6 +25,10 @@
 #include <llvm/Transforms/Utils/Cloning.h>
 
 #include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
@@ -30,6 +37,97 @@ using namespace std;
 
 namespace
 {
+	StatCounter functionsLifted("lifter.functions.lifted");
+	StatCounter instructionsDecoded("lifter.instructions.decoded");
+	StatCounter instructionsLifted("lifter.instructions.lifted");
+	StatCounter asmFallbacks("lifter.instructions.asm_fallback");
+	StatCounter decodeAheadHits("lifter.decode_ahead.hits");
+	StatCounter decodeAheadMisses("lifter.decode_ahead.misses");
+	StatCounter instructionBodiesReused("lifter.instructions.bodies_reused");
+	StatCounter jumpTablesResolved("lifter.jump_tables.resolved");
+	StatCounter jumpTableTargets("lifter.jump_tables.targets");
+
+	// Speculative decode-ahead: while the emitter builds IR for the current run, the worker decodes
+	// the likely next run on its own capstone handle into a second pre-allocated batch. When the
+	// guess is right, the decoded instructions are ready the moment the emitter asks for them; when
+	// it's wrong, the buffer is dropped and decoding happens synchronously as before.
+	class DecodeAheadWorker
+	{
+		capstone_batch batch;
+		Executable& executable;
+		thread worker;
+		mutex lock;
+		condition_variable wake;
+		uint64_t address;
+		size_t decodedCount;
+		bool busy;
+		bool done;
+
+		void workLoop()
+		{
+			unique_lock<mutex> guard(lock);
+			for (;;)
+			{
+				wake.wait(guard, [&] { return busy || done; });
+				if (done)
+				{
+					return;
+				}
+
+				uint64_t target = address;
+				guard.unlock();
+				size_t count = 0;
+				if (const uint8_t* begin = executable.map(target))
+				{
+					count = batch.disassemble(begin, executable.end(), target);
+				}
+				guard.lock();
+				decodedCount = count;
+				busy = false;
+				wake.notify_all();
+			}
+		}
+
+	public:
+		DecodeAheadWorker(capstone& cs, Executable& executable, size_t batchSize)
+		: batch(cs.create_batch(batchSize)), executable(executable), address(0), decodedCount(0), busy(false), done(false)
+		{
+			worker = thread(&DecodeAheadWorker::workLoop, this);
+		}
+
+		~DecodeAheadWorker()
+		{
+			{
+				lock_guard<mutex> guard(lock);
+				done = true;
+			}
+			wake.notify_all();
+			worker.join();
+		}
+
+		void speculate(uint64_t nextAddress)
+		{
+			lock_guard<mutex> guard(lock);
+			assert(!busy);
+			address = nextAddress;
+			busy = true;
+			wake.notify_all();
+		}
+
+		// Returns the decoded batch if the speculated address matches and decoding succeeded,
+		// null otherwise. Always waits the worker out so that speculate can re-arm it.
+		capstone_batch* retrieve(uint64_t wantedAddress)
+		{
+			unique_lock<mutex> guard(lock);
+			wake.wait(guard, [&] { return !busy; });
+			if (address == wantedAddress && decodedCount != 0)
+			{
+				return &batch;
+			}
+			return nullptr;
+		}
+	};
+
 	cs_mode cs_size_mode(size_t address_size)
 	{
 		switch (address_size)
@@ -159,6 +257,301 @@ namespace
 			++i;
 		}
 	}
+
+	// Returns the field index accessed by `pointer` if it is a [0, constant] GEP on `flags`, -1 otherwise.
+	int64_t flagFieldIndex(Value* pointer, AllocaInst& flags)
+	{
+		if (auto gep = dyn_cast<GetElementPtrInst>(pointer))
+		if (gep->getPointerOperand() == &flags && gep->getNumIndices() == 2)
+		{
+			auto firstIndex = dyn_cast<ConstantInt>(gep->getOperand(1));
+			auto secondIndex = dyn_cast<ConstantInt>(gep->getOperand(2));
+			if (firstIndex != nullptr && firstIndex->isZero() && secondIndex != nullptr)
+			{
+				return secondIndex->getSExtValue();
+			}
+		}
+		return -1;
+	}
+
+	// Every arithmetic handler stores all six status flags, and most of those stores are overwritten
+	// before anything reads them; waiting for the module-wide optimizer means building and carrying that
+	// IR first. This block-local sweep runs right after a function is lifted and deletes flag stores that
+	// are provably dead: the flags object is an alloca, so once it is known not to escape, direct loads
+	// are its only readers and no call or unrelated memory access needs to be treated as a barrier.
+	void eraseDeadFlagStores(Function& fn, AllocaInst& flags)
+	{
+		const DataLayout& dl = fn.getParent()->getDataLayout();
+		uint64_t flagsSize = dl.getTypeStoreSize(flags.getAllocatedType());
+
+		// Check that the flags object doesn't escape: every use must be a field GEP used only as a
+		// load/store pointer, or a bitcast feeding a non-volatile memset of the whole object (the
+		// `memset(flags, 0, sizeof *flags)` that most handlers open with).
+		SmallVector<MemSetInst*, 8> fullClears;
+		for (User* user : flags.users())
+		{
+			if (auto gep = dyn_cast<GetElementPtrInst>(user))
+			{
+				if (flagFieldIndex(gep, flags) < 0)
+				{
+					return;
+				}
+				for (User* gepUser : gep->users())
+				{
+					if (isa<LoadInst>(gepUser))
+					{
+						continue;
+					}
+					auto store = dyn_cast<StoreInst>(gepUser);
+					if (store == nullptr || store->getValueOperand() == gep)
+					{
+						return;
+					}
+				}
+			}
+			else if (auto cast = dyn_cast<BitCastInst>(user))
+			{
+				for (User* castUser : cast->users())
+				{
+					auto clear = dyn_cast<MemSetInst>(castUser);
+					if (clear == nullptr || clear->getRawDest() != cast || clear->isVolatile())
+					{
+						return;
+					}
+					auto length = dyn_cast<ConstantInt>(clear->getLength());
+					if (length == nullptr || length->getLimitedValue() != flagsSize)
+					{
+						return;
+					}
+					fullClears.push_back(clear);
+				}
+			}
+			else
+			{
+				return;
+			}
+		}
+
+		SmallPtrSet<Instruction*, 8> fullClearSet(fullClears.begin(), fullClears.end());
+		SmallVector<StoreInst*, 32> deadStores;
+		for (BasicBlock& block : fn)
+		{
+			SmallDenseMap<int64_t, StoreInst*, 8> pendingStores;
+			for (Instruction& inst : block)
+			{
+				if (auto store = dyn_cast<StoreInst>(&inst))
+				{
+					int64_t field = flagFieldIndex(store->getPointerOperand(), flags);
+					if (field >= 0 && !store->isVolatile())
+					{
+						StoreInst*& pending = pendingStores[field];
+						if (pending != nullptr)
+						{
+							deadStores.push_back(pending);
+						}
+						pending = store;
+					}
+				}
+				else if (auto load = dyn_cast<LoadInst>(&inst))
+				{
+					int64_t field = flagFieldIndex(load->getPointerOperand(), flags);
+					if (field >= 0)
+					{
+						pendingStores.erase(field);
+					}
+				}
+				else if (fullClearSet.count(&inst) != 0)
+				{
+					// Clearing the whole object kills every store that nothing has read yet.
+					for (const auto& pair : pendingStores)
+					{
+						deadStores.push_back(pair.second);
+					}
+					pendingStores.clear();
+				}
+			}
+			// Stores still pending at the end of the block may be read by a successor; keep them.
+		}
+
+		for (StoreInst* store : deadStores)
+		{
+			store->eraseFromParent();
+		}
+	}
+
+	// Ceiling on jump table sizes. Tables this large don't occur in practice; the cap only exists so
+	// that a misidentified table can't make the resolver walk an entire segment.
+	constexpr size_t jumpTableMaxEntries = 0x1000;
+
+	// Accumulates `value` into a `constant + index * scale` decomposition: constants add into `base`,
+	// adds recurse, and the single non-constant term must be a multiplication or left shift by a
+	// constant. Anything else (several variable terms, a non-constant table base) fails the match.
+	bool addTableTerm(Value* value, uint64_t& base, Value*& index, uint64_t& scale)
+	{
+		if (auto constant = dyn_cast<ConstantInt>(value))
+		{
+			base += constant->getLimitedValue();
+			return true;
+		}
+		if (auto binOp = dyn_cast<BinaryOperator>(value))
+		{
+			if (binOp->getOpcode() == Instruction::Add)
+			{
+				return addTableTerm(binOp->getOperand(0), base, index, scale)
+					&& addTableTerm(binOp->getOperand(1), base, index, scale);
+			}
+			if (index == nullptr)
+			{
+				if (binOp->getOpcode() == Instruction::Mul)
+				{
+					for (unsigned i = 0; i < 2; ++i)
+					{
+						if (auto factor = dyn_cast<ConstantInt>(binOp->getOperand(i)))
+						{
+							index = binOp->getOperand(1 - i);
+							scale = factor->getLimitedValue();
+							return true;
+						}
+					}
+				}
+				else if (binOp->getOpcode() == Instruction::Shl)
+				{
+					if (auto amount = dyn_cast<ConstantInt>(binOp->getOperand(1)))
+					if (amount->getLimitedValue() < 64)
+					{
+						index = binOp->getOperand(0);
+						scale = uint64_t(1) << amount->getLimitedValue();
+						return true;
+					}
+				}
+			}
+		}
+		return false;
+	}
+
+	bool isCodeAddress(const vector<pair<uint64_t, uint64_t>>& codeRegions, uint64_t address)
+	{
+		for (const auto& region : codeRegions)
+		{
+			if (address >= region.first && address - region.first < region.second)
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Bounded value-set analysis for table-driven indirect jumps. Compilers lower dense switches to
+	// `jmp [table + index * entrySize]`; by the time the worklist drains, that shows up as a
+	// x86_jump_intrin call fed by a program-memory load at `constant + index * scale`. When the
+	// table lives in read-only, file-backed memory, its entries are the bytes the program will see
+	// at run time, so every entry that lands in executable code is a genuine target for its index
+	// and becomes a switch case. The rewrite is sound without knowing the exact bound: case i fires
+	// only when index == i, in which case table[i] really is where the jump goes. Undershooting
+	// falls through to the default block, which keeps the original intrinsic for the late indirect
+	// passes; overshooting adds cases that no in-bounds index selects.
+	bool resolveTableJumps(Executable& executable, Function& fn, AddressToBlock& blockMap, SmallPtrSetImpl<CallInst*>& alreadyResolved)
+	{
+		Function* jumpIntrin = fn.getParent()->getFunction("x86_jump_intrin");
+		if (jumpIntrin == nullptr)
+		{
+			return false;
+		}
+
+		SmallVector<CallInst*, 4> indirectJumps;
+		for (User* user : jumpIntrin->users())
+		{
+			if (auto call = dyn_cast<CallInst>(user))
+			if (call->getParent()->getParent() == &fn && alreadyResolved.count(call) == 0)
+			{
+				indirectJumps.push_back(call);
+			}
+		}
+		if (indirectJumps.empty())
+		{
+			return false;
+		}
+
+		const DataLayout& dl = fn.getParent()->getDataLayout();
+		auto codeRegions = executable.getExecutableRegions();
+		bool addedTargets = false;
+		for (CallInst* call : indirectJumps)
+		{
+			Value* destination = call->getOperand(2);
+			while (auto castInst = dyn_cast<CastInst>(destination))
+			{
+				destination = castInst->getOperand(0);
+			}
+
+			auto load = dyn_cast<LoadInst>(destination);
+			if (load == nullptr || !md::isProgramMemory(*load))
+			{
+				continue;
+			}
+			auto intToPtr = dyn_cast<IntToPtrInst>(load->getPointerOperand());
+			if (intToPtr == nullptr)
+			{
+				continue;
+			}
+
+			uint64_t tableBase = 0;
+			uint64_t scale = 0;
+			Value* index = nullptr;
+			if (!addTableTerm(intToPtr->getOperand(0), tableBase, index, scale))
+			{
+				continue;
+			}
+			if (index == nullptr || scale != dl.getTypeStoreSize(load->getType()) || (scale != 4 && scale != 8))
+			{
+				continue;
+			}
+
+			SmallVector<uint64_t, 16> targets;
+			for (size_t i = 0; i < jumpTableMaxEntries; ++i)
+			{
+				uint64_t entryAddress = tableBase + i * scale;
+				if (!executable.isReadOnlyRange(entryAddress, scale))
+				{
+					break;
+				}
+				const uint8_t* bytes = executable.map(entryAddress);
+				if (bytes == nullptr)
+				{
+					break;
+				}
+				uint64_t target = 0;
+				for (uint64_t byteIndex = 0; byteIndex < scale; ++byteIndex)
+				{
+					target |= static_cast<uint64_t>(bytes[byteIndex]) << (8 * byteIndex);
+				}
+				if (!isCodeAddress(codeRegions, target))
+				{
+					break;
+				}
+				targets.push_back(target);
+			}
+			if (targets.empty())
+			{
+				continue;
+			}
+
+			alreadyResolved.insert(call);
+			BasicBlock* parent = call->getParent();
+			BasicBlock* remainder = parent->splitBasicBlock(call);
+			auto terminator = parent->getTerminator();
+			auto dispatch = SwitchInst::Create(index, remainder, static_cast<unsigned>(targets.size()), terminator);
+			for (size_t i = 0; i < targets.size(); ++i)
+			{
+				dispatch->addCase(ConstantInt::get(cast<IntegerType>(index->getType()), i), blockMap.blockToInstruction(targets[i]));
+			}
+			terminator->eraseFromParent();
+
+			++jumpTablesResolved;
+			jumpTableTargets += targets.size();
+			addedTargets = true;
+		}
+		return addedTargets;
+	}
 }
 
 TranslationContext::TranslationContext(LLVMContext& context, Executable& executable, const x86_config& config, const std::string& module_name)
@@ -188,6 +581,16 @@ TranslationContext::TranslationContext(LLVMContext& context, Executable& executa
 		errs() << "couldn't open Capstone handle: " << csHandle.getError().message() << '\n';
 		abort();
 	}
+
+	if (auto csHandle = capstone::create(CS_ARCH_X86, options))
+	{
+		lookaheadCs.reset(new capstone(move(csHandle.get())));
+	}
+	else
+	{
+		errs() << "couldn't open Capstone handle: " << csHandle.getError().message() << '\n';
+		abort();
+	}
 	
 	resultFnTy = FunctionType::get(Type::getVoidTy(context), { irgen->getRegisterTy()->getPointerTo() }, false);
 	functionMap.reset(new AddressToFunction(*module, *resultFnTy));
@@ -254,7 +657,8 @@ void TranslationContext::setFunctionName(uint64_t address, const std::string &na
 Function* TranslationContext::createFunction(uint64_t baseAddress)
 {
 	PrettyStackTraceFormat creatingFunction("Creating function for code address 0x%" PRIx64, baseAddress);
-	
+	auto liftStart = chrono::steady_clock::now();
+
 	Function* fn = functionMap->createFunction(baseAddress);
 	assert(fn != nullptr);
 	
@@ -274,45 +678,127 @@ Function* TranslationContext::createFunction(uint64_t baseAddress)
 	
 	uint64_t addressToDisassemble;
 	auto end = executable.end();
-	auto inst = cs->alloc();
+	auto batch = cs->create_batch(16);
+	DecodeAheadWorker lookahead(*lookaheadCs, executable, 16);
+	InlinedBodyMemo liftedBodies;
 	SmallVector<Value*, 4> inliningParameters = { configVariable, nullptr, registers, flags };
-	while (blockMap.getOneStub(addressToDisassemble))
+
+	// Indirect jumps pause discovery until the worklist drains; at that point, try to resolve them
+	// as jump tables and feed the recovered targets back in as fresh stubs.
+	SmallPtrSet<CallInst*, 4> resolvedTableJumps;
+	auto getNextStub = [&](uint64_t& address)
+	{
+		if (blockMap.getOneStub(address))
+		{
+			return true;
+		}
+		return resolveTableJumps(executable, *fn, blockMap, resolvedTableJumps)
+			&& blockMap.getOneStub(address);
+	};
+
+	bool aborted = false;
+	while (!aborted && getNextStub(addressToDisassemble))
 	{
-		if (auto begin = executable.map(addressToDisassemble))
-		if (cs->disassemble(inst.get(), begin, end, addressToDisassemble))
-		if (BasicBlock* thisBlock = blockMap.implementInstruction(inst->address)) // already implemented?
+		// Decode a whole straight-line run at once so that decoding doesn't pay per-instruction
+		// overhead. If the decode-ahead worker already decoded this run while the previous one was
+		// being emitted, consume its buffer; otherwise decode synchronously.
+		size_t decodedCount;
+		capstone_batch* currentBatch = lookahead.retrieve(addressToDisassemble);
+		if (currentBatch != nullptr)
+		{
+			decodedCount = currentBatch->size();
+			++decodeAheadHits;
+		}
+		else
+		{
+			auto begin = executable.map(addressToDisassemble);
+			if (begin == nullptr)
+			{
+				break;
+			}
+
+			decodedCount = batch.disassemble(begin, end, addressToDisassemble);
+			currentBatch = &batch;
+			++decodeAheadMisses;
+		}
+		instructionsDecoded += decodedCount;
+		if (decodedCount == 0)
 		{
+			break;
+		}
+
+		// Guess that the worklist will ask for the run's fallthrough continuation next — true
+		// whenever a block outgrows the batch — and decode it while the IR below is built.
+		cs_insn& lastDecoded = (*currentBatch)[decodedCount - 1];
+		lookahead.speculate(lastDecoded.address + lastDecoded.size);
+
+		for (size_t i = 0; i < decodedCount; ++i)
+		{
+			cs_insn& inst = (*currentBatch)[i];
+			if (i > 0 && !blockMap.needsInstruction(inst.address))
+			{
+				break;
+			}
+
+			BasicBlock* thisBlock = blockMap.implementInstruction(inst.address); // already implemented?
+			if (thisBlock == nullptr)
+			{
+				aborted = i == 0;
+				break;
+			}
+
 			// store instruction pointer
 			// (this needs to be the IP of the next instruction)
-			auto nextInstAddress = inst->address + inst->size;
+			auto nextInstAddress = inst.address + inst.size;
 			auto ipValue = ConstantInt::get(ipType, nextInstAddress);
 			new StoreInst(ipValue, ipPointer, false, thisBlock);
-			
-			if (Function* implementation = irgen->implementationFor(inst->id))
+
+			if (Function* implementation = irgen->implementationFor(inst.id))
 			{
-				// We have an implementation: inline it
-				Constant* detailAsConstant = irgen->constantForDetail(*inst->detail);
-				inliningParameters[1] = new GlobalVariable(*module, detailAsConstant->getType(), true, GlobalValue::PrivateLinkage, detailAsConstant);
-				irgen->inlineFunction(fn, implementation, inliningParameters, *functionMap, blockMap, nextInstAddress);
+				// We have an implementation: inline it. Instructions that already went through
+				// inlining with the same operand details replay the remembered body instead.
+				Constant* detailAsConstant = irgen->constantForDetail(*inst.detail);
+				GlobalVariable*& detailGlobal = detailGlobals[detailAsConstant];
+				if (detailGlobal == nullptr)
+				{
+					detailGlobal = new GlobalVariable(*module, detailAsConstant->getType(), true, GlobalValue::PrivateLinkage, detailAsConstant);
+				}
+				inliningParameters[1] = detailGlobal;
+
+				if (liftedBodies.instantiate(fn, implementation, detailGlobal, blockMap.blockToInstruction(nextInstAddress)))
+				{
+					++instructionBodiesReused;
+				}
+				else if (BasicBlock* loneBody = irgen->inlineFunction(fn, implementation, inliningParameters, *functionMap, blockMap, nextInstAddress))
+				{
+					liftedBodies.remember(implementation, detailGlobal, loneBody, blockMap.blockToInstruction(nextInstAddress), nextInstAddress);
+				}
+				++instructionsLifted;
 			}
 			else
 			{
-				createAsmCall(*targetInfo, *inst, registers, *thisBlock);
+				createAsmCall(*targetInfo, inst, registers, *thisBlock);
 				BasicBlock* target = blockMap.blockToInstruction(nextInstAddress);
 				BranchInst::Create(target, thisBlock);
+				++asmFallbacks;
 			}
-			continue;
 		}
-		break;
 	}
-	
+
+	// Drop the detached exemplars before the flag-store sweep looks at use lists.
+	liftedBodies.clear();
+	eraseDeadFlagStores(*fn, *flags);
+	blockMap.assignBlockNames();
+	++functionsLifted;
+	auto liftTime = chrono::steady_clock::now() - liftStart;
+	md::addTimingNanoseconds(*fn, "lift", chrono::duration_cast<chrono::nanoseconds>(liftTime).count());
 	return fn;
 }
 
-std::unordered_set<uint64_t> TranslationContext::getDiscoveredEntryPoints() const
+std::unordered_set<uint64_t> TranslationContext::takeDiscoveredEntryPoints()
 {
 	std::unordered_set<uint64_t> entryPoints;
-	functionMap->getDiscoveredEntryPoints(entryPoints);
+	functionMap->takeDiscoveredEntryPoints(entryPoints);
 	return entryPoints;
 }
 
@@ -32,12 +32,20 @@ class TranslationContext
 	llvm::LLVMContext& context;
 	Executable& executable;
 	std::unique_ptr<capstone> cs;
+	// Second handle for the decode-ahead worker; capstone handles must not be shared across threads.
+	std::unique_ptr<capstone> lookaheadCs;
 	std::unique_ptr<CodeGenerator> irgen;
 	std::unique_ptr<llvm::Module> module;
 	std::unique_ptr<AddressToFunction> functionMap;
 	
 	llvm::FunctionType* resultFnTy;
 	llvm::GlobalVariable* configVariable;
+
+	// One private constant global per distinct operand detail. Detail constants are uniqued by the
+	// LLVM context, so repeated instructions land on the same entry instead of bloating the module
+	// with thousands of identical globals, and the shared global doubles as the memo key for
+	// replaying lifted instruction bodies.
+	std::unordered_map<llvm::Constant*, llvm::GlobalVariable*> detailGlobals;
 	
 	llvm::CastInst& getPointer(llvm::Value* intptr, size_t size);
 	std::string nameOf(uint64_t address) const;
@@ -48,7 +56,7 @@ public:
 	
 	void setFunctionName(uint64_t address, const std::string& name);
 	llvm::Function* createFunction(uint64_t base_address);
-	std::unordered_set<uint64_t> getDiscoveredEntryPoints() const;
+	std::unordered_set<uint64_t> takeDiscoveredEntryPoints();
 	
 	inline llvm::Module* operator->() { return &get(); }
 	llvm::Module& get() { return *module; }
@@ -8,11 +8,17 @@
 //
 
 #include "metadata.h"
+#include "statistics.h"
 #include "translation_maps.h"
 
 using namespace llvm;
 using namespace std;
 
+namespace
+{
+	StatCounter blocksCreated("lifter.blocks.created");
+}
+
 Function* AddressToFunction::insertFunction(uint64_t address)
 {
 	char defaultName[] = "func_0000000000000000";
@@ -25,27 +31,31 @@ Function* AddressToFunction::insertFunction(uint64_t address)
 	return fn;
 }
 
-size_t AddressToFunction::getDiscoveredEntryPoints(unordered_set<uint64_t> &entryPoints) const
+size_t AddressToFunction::takeDiscoveredEntryPoints(unordered_set<uint64_t> &entryPoints)
 {
 	size_t total = 0;
-	for (const auto& pair : functions)
+	for (uint64_t address : discoveredEntryPoints)
 	{
-		if (md::isPrototype(*pair.second))
+		// Queued targets can have been lifted since they were discovered; only still-unimplemented
+		// prototypes are worth reporting.
+		Function* fn = functions.lookup(address);
+		if (fn != nullptr && md::isPrototype(*fn) && entryPoints.insert(address).second)
 		{
-			entryPoints.insert(pair.first);
 			++total;
 		}
 	}
+	discoveredEntryPoints.clear();
 	return total;
 }
 
 Function* AddressToFunction::getCallTarget(uint64_t address)
 {
 	Function*& result = functions[address];
-	
+
 	if (result == nullptr)
 	{
 		result = insertFunction(address);
+		discoveredEntryPoints.push_back(address);
 	}
 	return result;
 }
@@ -71,6 +81,12 @@ Function* AddressToFunction::createFunction(uint64_t address)
 	return result;
 }
 
+bool AddressToBlock::needsInstruction(uint64_t address) const
+{
+	auto iter = stubs.find(address);
+	return iter != stubs.end() && iter->second->getNumUses() != 0;
+}
+
 bool AddressToBlock::getOneStub(uint64_t& address)
 {
 	auto iter = stubs.begin();
@@ -89,12 +105,11 @@ bool AddressToBlock::getOneStub(uint64_t& address)
 
 llvm::BasicBlock* AddressToBlock::blockToInstruction(uint64_t address)
 {
-	auto iter = blocks.find(address);
-	if (iter != blocks.end())
+	if (BasicBlock* implemented = blocks.lookup(address))
 	{
-		return iter->second;
+		return implemented;
 	}
-	
+
 	BasicBlock*& stub = stubs[address];
 	if (stub == nullptr)
 	{
@@ -113,15 +128,8 @@ llvm::BasicBlock* AddressToBlock::implementInstruction(uint64_t address)
 	}
 	
 	bodyBlock = BasicBlock::Create(insertInto.getContext(), "", &insertInto);
-	
-	auto leadingZeroes = static_cast<unsigned>(__builtin_clzll(address));
-	unsigned pointerSize = ((sizeof address * CHAR_BIT) - leadingZeroes + CHAR_BIT - 1) / CHAR_BIT * 2;
-	
-	// set block name (aesthetic reasons)
-	char blockName[] = "0000000000000000";
-	snprintf(blockName, sizeof blockName, "%0.*" PRIx64, pointerSize, address);
-	bodyBlock->setName(blockName);
-	
+	++blocksCreated;
+
 	auto iter = stubs.find(address);
 	if (iter != stubs.end())
 	{
@@ -131,3 +139,17 @@ llvm::BasicBlock* AddressToBlock::implementInstruction(uint64_t address)
 	}
 	return bodyBlock;
 }
+
+void AddressToBlock::assignBlockNames() const
+{
+	blocks.for_each([](uint64_t address, BasicBlock* block)
+	{
+		auto leadingZeroes = static_cast<unsigned>(__builtin_clzll(address));
+		unsigned pointerSize = ((sizeof address * CHAR_BIT) - leadingZeroes + CHAR_BIT - 1) / CHAR_BIT * 2;
+
+		// set block name (aesthetic reasons)
+		char blockName[] = "0000000000000000";
+		snprintf(blockName, sizeof blockName, "%0.*" PRIx64, pointerSize, address);
+		block->setName(blockName);
+	});
+}
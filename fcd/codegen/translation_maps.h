@@ -14,33 +14,111 @@
 #include <llvm/IR/Function.h>
 #include <llvm/IR/Module.h>
 
+#include <array>
+#include <memory>
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
+#include <vector>
+
+// Two-level address-indexed map: a sparse top level keyed on the upper bits of the address, with dense
+// fixed-size leaves below it. Code addresses cluster tightly, so lookups almost always land in the same
+// few leaves and cost a shift, one hash probe and an array index instead of hashing the full address and
+// walking a collision chain for every basic block.
+template<typename T>
+class AddressMap
+{
+	static constexpr size_t leafBits = 9;
+	static constexpr size_t leafSize = size_t(1) << leafBits;
+
+	struct Leaf
+	{
+		std::array<T, leafSize> entries;
+
+		Leaf()
+		{
+			entries.fill(T());
+		}
+	};
+
+	std::unordered_map<uint64_t, std::unique_ptr<Leaf>> leaves;
+
+public:
+	void clear()
+	{
+		leaves.clear();
+	}
+
+	// `addressRange` is a hint (typically the size of the text segment) used to size the top level
+	// ahead of time so that inserting every leaf doesn't rehash it over and over.
+	void reserve(uint64_t addressRange)
+	{
+		leaves.reserve(static_cast<size_t>(addressRange >> leafBits) + 1);
+	}
+
+	T& operator[](uint64_t address)
+	{
+		std::unique_ptr<Leaf>& leaf = leaves[address >> leafBits];
+		if (leaf == nullptr)
+		{
+			leaf.reset(new Leaf);
+		}
+		return leaf->entries[address & (leafSize - 1)];
+	}
+
+	T lookup(uint64_t address) const
+	{
+		auto iter = leaves.find(address >> leafBits);
+		if (iter == leaves.end())
+		{
+			return T();
+		}
+		return iter->second->entries[address & (leafSize - 1)];
+	}
+
+	template<typename TAction>
+	void for_each(TAction&& action) const
+	{
+		for (const auto& pair : leaves)
+		{
+			for (size_t i = 0; i < leafSize; ++i)
+			{
+				if (pair.second->entries[i] != T())
+				{
+					action((pair.first << leafBits) | i, pair.second->entries[i]);
+				}
+			}
+		}
+	}
+};
 
 class AddressToFunction
 {
 	llvm::Module& module;
 	llvm::FunctionType& fnType;
 	std::unordered_map<uint64_t, std::string> aliases;
-	std::unordered_map<uint64_t, llvm::Function*> functions;
-	
+	AddressMap<llvm::Function*> functions;
+	// Call targets that got a prototype since the last takeDiscoveredEntryPoints call, in discovery
+	// order. Keeping the queue here saves rescanning every known function after each lifting wave.
+	std::vector<uint64_t> discoveredEntryPoints;
+
 	llvm::Function* insertFunction(uint64_t address);
-	
+
 public:
 	AddressToFunction(llvm::Module& module, llvm::FunctionType& fnType)
 	: module(module), fnType(fnType)
 	{
 	}
-	
+
 	void clear()
 	{
 		aliases.clear();
 		functions.clear();
+		discoveredEntryPoints.clear();
 	}
-	
-	size_t getDiscoveredEntryPoints(std::unordered_set<uint64_t>& entryPoints) const;
-	
+
+	size_t takeDiscoveredEntryPoints(std::unordered_set<uint64_t>& entryPoints);
+
 	llvm::Function* getCallTarget(uint64_t address);
 	llvm::Function* createFunction(uint64_t address);
 };
@@ -48,7 +126,7 @@ public:
 class AddressToBlock
 {
 	llvm::Function& insertInto;
-	std::unordered_map<uint64_t, llvm::BasicBlock*> blocks;
+	AddressMap<llvm::BasicBlock*> blocks;
 	std::map<uint64_t, llvm::BasicBlock*> stubs;
 	
 public:
@@ -58,9 +136,15 @@ public:
 	}
 	
 	bool getOneStub(uint64_t& address);
-	
+	bool needsInstruction(uint64_t address) const;
+
 	llvm::BasicBlock* blockToInstruction(uint64_t address);
 	llvm::BasicBlock* implementInstruction(uint64_t address);
+
+	// Blocks are created unnamed: their address names are purely cosmetic, and formatting plus
+	// symbol table insertion has no business in the decode loop. Called once per function after
+	// lifting to label every implemented block in one sweep.
+	void assignBlockNames() const;
 };
 
 #endif /* translation_maps_hpp */
@@ -9,8 +9,12 @@
 
 #include "command_line.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/Support/ManagedStatic.h>
 
+#include <cstdlib>
 #include <cstring>
 #include <unordered_set>
 
@@ -19,6 +23,13 @@ using namespace llvm;
 namespace
 {
 	ManagedStatic<std::unordered_set<const cl::Option*>> optWhitelist;
+
+	struct PlannedOccurrence
+	{
+		cl::Option* option;
+		StringRef name;
+		StringRef value;
+	};
 }
 
 bool whitelist::isWhitelisted(const llvm::cl::Option &o)
@@ -26,6 +37,138 @@ bool whitelist::isWhitelisted(const llvm::cl::Option &o)
 	return o.ArgStr == "help" || o.ArgStr == "version" || optWhitelist->count(&o) != 0;
 }
 
+bool whitelist::parseFastPath(int argc, const char* const* argv)
+{
+	// Index fcd's own options by name. Working from the whitelist alone keeps LLVM's global
+	// registry — and every option statically registered by the linked LLVM and clang libraries —
+	// off the startup path.
+	StringMap<cl::Option*> byName;
+	cl::Option* positional = nullptr;
+	for (const cl::Option* registered : *optWhitelist)
+	{
+		auto option = const_cast<cl::Option*>(registered);
+		if (option->getFormattingFlag() == cl::Positional)
+		{
+			if (positional != nullptr)
+			{
+				// Matching several positionals needs their registration order, which the whitelist
+				// set doesn't preserve.
+				return false;
+			}
+			positional = option;
+		}
+		else if (option->getFormattingFlag() != cl::NormalFormatting || !option->hasArgStr())
+		{
+			return false;
+		}
+		else
+		{
+			byName[option->ArgStr] = option;
+		}
+	}
+
+	// Validate the whole command line before mutating any option, so that bailing out to the full
+	// parser never double-counts an occurrence.
+	SmallVector<PlannedOccurrence, 16> occurrences;
+	bool positionalsOnly = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		StringRef arg = argv[i];
+		if (arg.size() > 0 && arg[0] == '@')
+		{
+			// Response file
+			return false;
+		}
+		else if (!positionalsOnly && arg == "--")
+		{
+			positionalsOnly = true;
+		}
+		else if (!positionalsOnly && arg.size() > 1 && arg[0] == '-')
+		{
+			StringRef name = arg.drop_front(arg.startswith("--") ? 2 : 1);
+			StringRef value;
+			bool hasValue = false;
+			auto equals = name.find('=');
+			if (equals != StringRef::npos)
+			{
+				value = name.substr(equals + 1);
+				name = name.substr(0, equals);
+				hasValue = true;
+			}
+
+			auto iter = byName.find(name);
+			if (iter == byName.end())
+			{
+				// -help, -version, LLVM's own options, typos: all of these need the full registry,
+				// if only for the diagnostic.
+				return false;
+			}
+
+			cl::Option* option = iter->second;
+			if (!hasValue && option->getValueExpectedFlag() == cl::ValueRequired)
+			{
+				if (i + 1 == argc)
+				{
+					return false;
+				}
+				++i;
+				value = argv[i];
+			}
+			else if (hasValue && option->getValueExpectedFlag() == cl::ValueDisallowed)
+			{
+				return false;
+			}
+			occurrences.push_back({ option, name, value });
+		}
+		else
+		{
+			if (positional == nullptr)
+			{
+				return false;
+			}
+			occurrences.push_back({ positional, positional->ArgStr, arg });
+		}
+	}
+
+	// The full parser owns the occurrence-count diagnostics; punt to it when a count is off
+	// instead of reimplementing its error messages.
+	SmallDenseMap<const cl::Option*, unsigned, 16> counts;
+	for (const auto& occurrence : occurrences)
+	{
+		counts[occurrence.option]++;
+	}
+	for (const auto& pair : byName)
+	{
+		unsigned count = counts.lookup(pair.second);
+		switch (pair.second->getNumOccurrencesFlag())
+		{
+			case cl::Optional: if (count > 1) return false; break;
+			case cl::Required: if (count != 1) return false; break;
+			case cl::OneOrMore: if (count < 1) return false; break;
+			case cl::ZeroOrMore: break;
+			default: return false;
+		}
+	}
+	if (positional != nullptr && counts.lookup(positional) == 0)
+	if (positional->getNumOccurrencesFlag() == cl::Required || positional->getNumOccurrencesFlag() == cl::OneOrMore)
+	{
+		return false;
+	}
+
+	unsigned position = 0;
+	for (const auto& occurrence : occurrences)
+	{
+		++position;
+		if (occurrence.option->addOccurrence(position, occurrence.name, occurrence.value))
+		{
+			// The value didn't parse; the handler already printed the error. Mirror
+			// cl::ParseCommandLineOptions' exit.
+			exit(1);
+		}
+	}
+	return true;
+}
+
 void whitelist::apply(llvm::cl::Option &o) const
 {
 	optWhitelist->insert(&o);
@@ -15,7 +15,13 @@
 struct whitelist
 {
 	static bool isWhitelisted(const llvm::cl::Option& o);
-	
+
+	// Fast-path parser over fcd's own (whitelisted) options that leaves LLVM's global option
+	// registry untouched. Returns false without consuming anything when the command line needs the
+	// full parser (-help, LLVM options, anything malformed); the caller falls back to
+	// cl::ParseCommandLineOptions, which owns every diagnostic.
+	static bool parseFastPath(int argc, const char* const* argv);
+
 	void apply(llvm::cl::Option& o) const;
 };
 
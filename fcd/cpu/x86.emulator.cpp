@@ -501,34 +501,39 @@ static void x86_conditional_jump(CPTR(x86_config) config, PTR(x86_regs) regs, CP
 	}
 }
 
+template<typename Int>
 [[gnu::always_inline]]
-static bool x86_rep_condition(CPTR(x86_config) config, PTR(x86_regs) regs, CPTR(cs_x86) inst)
+static void x86_stos(CPTR(x86_config) config, PTR(x86_regs) regs, CPTR(x86_flags_reg) flags, CPTR(cs_x86) inst, const Int& writeValue)
 {
+	x86_reg addressRegister = config->address_size == 8 ? X86_REG_RDI : X86_REG_EDI;
+	uint64_t address = x86_read_reg(regs, addressRegister);
 	if (inst->prefix[0] == X86_PREFIX_REP)
 	{
-		x86_reg counter = config->address_size == 8 ? X86_REG_RCX : X86_REG_ECX;
-		uint64_t registerValue = x86_read_reg(regs, counter);
-		if (registerValue != 0)
+		x86_reg counterRegister = config->address_size == 8 ? X86_REG_RCX : X86_REG_ECX;
+		uint64_t count = x86_read_reg(regs, counterRegister);
+		if (flags->df)
+		{
+			// Descending fills are rare; those keep per-item semantics.
+			while (count != 0)
+			{
+				x86_write_mem(X86_REG_ES, address, sizeof writeValue, writeValue);
+				address -= sizeof writeValue;
+				count--;
+			}
+		}
+		else
 		{
-			x86_write_reg(regs, counter, registerValue - 1);
-			return true;
+			// The lifter lowers this to a bulk store instead of loop IR.
+			x86_write_mem_rep(X86_REG_ES, address, count, sizeof writeValue, writeValue);
+			address += count * sizeof writeValue;
 		}
+		x86_write_reg(regs, addressRegister, address);
+		x86_write_reg(regs, counterRegister, 0);
 	}
-	return false;
-}
-
-template<typename Int>
-[[gnu::always_inline]]
-static void x86_stos(CPTR(x86_config) config, PTR(x86_regs) regs, CPTR(x86_flags_reg) flags, CPTR(cs_x86) inst, const Int& writeValue)
-{
-	bool alwaysDoFirst = inst->prefix[0] != X86_PREFIX_REP;
-	while (alwaysDoFirst || x86_rep_condition(config, regs, inst))
+	else
 	{
-		x86_reg addressRegister = config->address_size == 8 ? X86_REG_RDI : X86_REG_EDI;
-		uint64_t address = x86_read_reg(regs, addressRegister);
-		x86_write_mem(X86_REG_ES, x86_read_reg(regs, addressRegister), sizeof writeValue, writeValue);
+		x86_write_mem(X86_REG_ES, address, sizeof writeValue, writeValue);
 		x86_write_reg(regs, addressRegister, address + (flags->df ? -1 : 1) * sizeof writeValue);
-		alwaysDoFirst = false;
 	}
 }
 
@@ -22,6 +22,7 @@ static_assert(X86_INS_ENDING == 1295, "Fcd requires Capstone 3.0.4.");
 
 #pragma mark - Intrinsic functions (handled by emulator)
 extern "C" void x86_write_mem(x86_reg segment, uint64_t address, size_t size, uint64_t value);
+extern "C" void x86_write_mem_rep(x86_reg segment, uint64_t address, uint64_t count, size_t size, uint64_t value);
 extern "C" uint64_t x86_read_mem(x86_reg segment, uint64_t address, size_t size);
 extern "C" void x86_call_intrin(CPTR(x86_config) config, PTR(x86_regs) regs, uint64_t target);
 NORETURN extern "C" void x86_jump_intrin(CPTR(x86_config) config, PTR(x86_regs) regs, uint64_t target);
@@ -8,153 +8,104 @@
 //
 
 
-#include <llvm/Support/raw_ostream.h>
-
-#include <algorithm>
-#include <cctype>
-#include <string>
 #include <vector>
 
 #include "x86_regs.h"
 #include "x86_register_map.h"
 
-using namespace llvm;
 using namespace std;
 
 namespace
 {
-	struct RegInfoBuilder
+	// Compile-time image of the register table that used to be assembled at static-init time: one
+	// entry per addressable register, sorted by offset into x86_regs, in read-only storage shared
+	// across processes. TargetRegisterInfo itself can't be a literal type (it holds a std::string
+	// and a SmallVector), so the vector is materialized from this table on first use; that single
+	// cheap pass is all the work a process ever does.
+	struct X86RegisterEntry
 	{
-		vector<TargetRegisterInfo> info;
-		size_t offset = 0;
-		unsigned fieldOffset = 0;
-		
-		inline void regInfo(size_t size, const string& name, x86_reg registerId)
-		{
-			if (registerId != X86_REG_INVALID)
-			{
-				TargetRegisterInfo result = { offset, 0, size, {fieldOffset, 0}, name, registerId };
-				info.push_back(result);
-			}
-		}
-		
-		inline void regInfo(size_t size, size_t off, const string& name, x86_reg registerId)
+		size_t offset;
+		size_t subOffset;
+		size_t size;
+		unsigned fieldOffset;
+		const char* name;
+		x86_reg registerId;
+	};
+
+// One part of the qword register at field index `field` of x86_regs.
+#define QWORD_PART(field, size, byteOffset, name, id) \
+	{ (field) * 8 + (byteOffset), (byteOffset), (size), (field), (name), (id) }
+
+#define ONE_LETTER_REG(field, letter, upper) \
+	QWORD_PART(field, 8, 0, "r" #letter "x", X86_REG_R##upper##X), \
+	QWORD_PART(field, 4, 0, "e" #letter "x", X86_REG_E##upper##X), \
+	QWORD_PART(field, 2, 0, #letter "x", X86_REG_##upper##X), \
+	QWORD_PART(field, 1, 0, #letter "l", X86_REG_##upper##L), \
+	QWORD_PART(field, 1, 1, #letter "h", X86_REG_##upper##H)
+
+#define TWO_LETTER_REG(field, letters, upper) \
+	QWORD_PART(field, 8, 0, "r" #letters, X86_REG_R##upper), \
+	QWORD_PART(field, 4, 0, "e" #letters, X86_REG_E##upper), \
+	QWORD_PART(field, 2, 0, #letters, X86_REG_##upper), \
+	QWORD_PART(field, 1, 0, #letters "l", X86_REG_##upper##L)
+
+#define EXTENDED_REG(field, num) \
+	QWORD_PART(field, 8, 0, "r" #num, X86_REG_R##num), \
+	QWORD_PART(field, 4, 0, "r" #num "d", X86_REG_R##num##D), \
+	QWORD_PART(field, 2, 0, "r" #num "w", X86_REG_R##num##W), \
+	QWORD_PART(field, 1, 0, "r" #num "b", X86_REG_R##num##B)
+
+	// Field indices follow the declaration order of x86_regs.
+	constexpr X86RegisterEntry x86RegisterTable[] = {
+		QWORD_PART(0, 8, 0, "rzx", X86_REG_RIZ),
+		QWORD_PART(0, 4, 0, "ezx", X86_REG_EIZ),
+		ONE_LETTER_REG(1, a, A),
+		ONE_LETTER_REG(2, b, B),
+		ONE_LETTER_REG(3, c, C),
+		ONE_LETTER_REG(4, d, D),
+		TWO_LETTER_REG(5, si, SI),
+		TWO_LETTER_REG(6, di, DI),
+		TWO_LETTER_REG(7, bp, BP),
+		TWO_LETTER_REG(8, sp, SP),
+		QWORD_PART(9, 8, 0, "rip", X86_REG_RIP),
+		QWORD_PART(9, 4, 0, "eip", X86_REG_EIP),
+		QWORD_PART(9, 2, 0, "ip", X86_REG_IP),
+		EXTENDED_REG(10, 8),
+		EXTENDED_REG(11, 9),
+		EXTENDED_REG(12, 10),
+		EXTENDED_REG(13, 11),
+		EXTENDED_REG(14, 12),
+		EXTENDED_REG(15, 13),
+		EXTENDED_REG(16, 14),
+		EXTENDED_REG(17, 15),
+		QWORD_PART(18, 8, 0, "cs", X86_REG_CS),
+		QWORD_PART(19, 8, 0, "ds", X86_REG_DS),
+		QWORD_PART(20, 8, 0, "es", X86_REG_ES),
+		QWORD_PART(21, 8, 0, "fs", X86_REG_FS),
+		QWORD_PART(22, 8, 0, "gs", X86_REG_GS),
+		QWORD_PART(23, 8, 0, "ss", X86_REG_SS),
+	};
+
+	const vector<TargetRegisterInfo>& x86RegisterInfo()
+	{
+		static const vector<TargetRegisterInfo> info = []()
 		{
-			if (registerId != X86_REG_INVALID)
+			vector<TargetRegisterInfo> result;
+			result.reserve(sizeof x86RegisterTable / sizeof x86RegisterTable[0]);
+			for (const X86RegisterEntry& entry : x86RegisterTable)
 			{
-				TargetRegisterInfo result = { off, off - this->offset, size, {fieldOffset, 0}, name, registerId };
-				info.push_back(result);
+				TargetRegisterInfo reg = { entry.offset, entry.subOffset, entry.size, {entry.fieldOffset, 0}, entry.name, entry.registerId };
+				result.push_back(reg);
 			}
-		}
-		
-		void singleLetterReg(char letter, x86_reg r64, x86_reg r32, x86_reg r16, x86_reg r8h, x86_reg r8l)
-		{
-			string name(1, letter);
-			string extended = name + "x";
-			regInfo(8, "r" + extended, r64);
-			regInfo(4, "e" + extended, r32);
-			regInfo(2, extended, r16);
-			regInfo(1, name + "l", r8l);
-			regInfo(1, offset + 1, name + "h", r8h);
-			offset += 8;
-			fieldOffset++;
-		}
-		
-		void twoLetterReg(char letter1, char letter2, x86_reg r64, x86_reg r32, x86_reg r16, x86_reg r8)
-		{
-			string name;
-			name.push_back(letter1);
-			name.push_back(letter2);
-			
-			regInfo(8, "r" + name, r64);
-			regInfo(4, "e" + name, r32);
-			regInfo(2, name, r16);
-			regInfo(1, name + "l", r8);
-			offset += 8;
-			fieldOffset++;
-		}
-		
-		void extendedReg(unsigned num, x86_reg r64, x86_reg r32, x86_reg r16, x86_reg r8)
-		{
-			string name;
-			raw_string_ostream(name) << 'r' << num;
-			regInfo(8, name, r64);
-			regInfo(4, name + "d", r32);
-			regInfo(2, name + "w", r16);
-			regInfo(1, name + "b", r8);
-			offset += 8;
-			fieldOffset++;
-		}
-		
-		void segmentReg(const string& name, x86_reg id)
-		{
-			regInfo(8, name, id);
-			offset += 8;
-			fieldOffset++;
-		}
-	};
-	
-#define ONE_LETTER_REG(letter) \
-	builder.singleLetterReg((char)tolower((#letter)[0]), \
-		X86_REG_R##letter##X, \
-		X86_REG_E##letter##X, \
-		X86_REG_##letter##X, \
-		X86_REG_##letter##H, \
-		X86_REG_##letter##L)
-	
-#define TWO_LETTER_REG(letters) \
-	builder.twoLetterReg((char)tolower((#letters)[0]), (char)tolower((#letters)[1]), \
-		X86_REG_R##letters, \
-		X86_REG_E##letters, \
-		X86_REG_##letters, \
-		X86_REG_##letters##L)
-	
-#define EXTENDED_REG(num) \
-	builder.extendedReg((num), \
-		X86_REG_R##num, X86_REG_R##num##D, X86_REG_R##num##W, X86_REG_R##num##B)
-	
-	std::vector<TargetRegisterInfo> x86RegisterInfo = []()
-	{
-		RegInfoBuilder builder;
-		builder.singleLetterReg('z', X86_REG_RIZ, X86_REG_EIZ, X86_REG_INVALID, X86_REG_INVALID, X86_REG_INVALID);
-		ONE_LETTER_REG(A);
-		ONE_LETTER_REG(B);
-		ONE_LETTER_REG(C);
-		ONE_LETTER_REG(D);
-		TWO_LETTER_REG(SI);
-		TWO_LETTER_REG(DI);
-		TWO_LETTER_REG(BP);
-		TWO_LETTER_REG(SP);
-		builder.twoLetterReg('i', 'p', X86_REG_RIP, X86_REG_EIP, X86_REG_IP, X86_REG_INVALID);
-		
-		EXTENDED_REG(8);
-		EXTENDED_REG(9);
-		EXTENDED_REG(10);
-		EXTENDED_REG(11);
-		EXTENDED_REG(12);
-		EXTENDED_REG(13);
-		EXTENDED_REG(14);
-		EXTENDED_REG(15);
-		
-		builder.segmentReg("cs", X86_REG_CS);
-		builder.segmentReg("ds", X86_REG_DS);
-		builder.segmentReg("es", X86_REG_ES);
-		builder.segmentReg("fs", X86_REG_FS);
-		builder.segmentReg("gs", X86_REG_GS);
-		builder.segmentReg("ss", X86_REG_SS);
-		return builder.info;
-	}();
+			return result;
+		}();
+		return info;
+	}
 }
 
 void x86TargetInfo(TargetInfo* info)
 {
 	info->targetName() = "x86_64";
-	info->setTargetRegisterInfo(x86RegisterInfo);
-	
-	auto rsp_iter = find_if(x86RegisterInfo.begin(), x86RegisterInfo.end(), [](const TargetRegisterInfo& info)
-	{
-		return info.name == "rsp";
-	});
-	
-	info->setStackPointer(*rsp_iter);
+	info->setTargetRegisterInfo(x86RegisterInfo());
+	info->setStackPointer(*info->registerNamed("rsp"));
 }
@@ -0,0 +1,45 @@
+//
+// cpu_affinity.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "cpu_affinity.h"
+
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/raw_ostream.h>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace llvm;
+
+namespace
+{
+	cl::list<unsigned> pinnedCpus("cpus", cl::desc("Comma-separated processor indices to pin worker threads to, assigned round-robin; keeps each worker and the memory it allocates on the same NUMA node"), cl::CommaSeparated, whitelist());
+}
+
+void pinWorkerThread(unsigned workerIndex)
+{
+	if (pinnedCpus.empty())
+	{
+		return;
+	}
+
+#ifdef __linux__
+	unsigned cpu = pinnedCpus[workerIndex % pinnedCpus.size()];
+	cpu_set_t cpuSet;
+	CPU_ZERO(&cpuSet);
+	CPU_SET(cpu, &cpuSet);
+	if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) != 0)
+	{
+		errs() << "fcd: could not pin worker thread to processor " << cpu << '\n';
+	}
+#endif
+}
@@ -0,0 +1,20 @@
+//
+// cpu_affinity.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__cpu_affinity_h
+#define fcd__cpu_affinity_h
+
+// Pins the calling worker thread to one of the processors named by --cpus, assigned round-robin by
+// worker index. With pinning in place, NUMA locality follows from the kernel's first-touch policy:
+// every worker allocates its own LLVMContext, module copy and AST pools on its own thread, so that
+// memory lands on the node that consumes it. No-op when --cpus is not given or the platform has no
+// thread affinity call.
+void pinWorkerThread(unsigned workerIndex);
+
+#endif /* fcd__cpu_affinity_h */
@@ -0,0 +1,39 @@
+//
+// dumb_allocator.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "dumb_allocator.h"
+
+#include <llvm/Support/CommandLine.h>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	cl::opt<unsigned> poolChunkSize("pool-chunk-size", cl::desc("Size of AST pool chunks in KiB; larger chunks mean fewer heap round-trips for big functions at the cost of per-function residency"), cl::init(16), whitelist());
+	cl::opt<unsigned> poolRecycleCap("pool-recycle-cap", cl::desc("Number of retired AST pool chunks kept on the shared freelist for reuse"), cl::init(1024), whitelist());
+}
+
+size_t DumbAllocator::chunkSize()
+{
+	// Sized once on first use, since every chunk on the shared freelist must be interchangeable.
+	// The 0x20 slack keeps chunk plus heap header within whole pages, and the clamp keeps the
+	// compile-time small/large allocation split valid.
+	static size_t size = [] {
+		size_t requested = size_t(poolChunkSize) * 1024;
+		return requested > DefaultChunkSize + 0x20 ? requested - 0x20 : size_t(DefaultChunkSize);
+	}();
+	return size;
+}
+
+size_t DumbAllocator::maxRecycledChunks()
+{
+	return poolRecycleCap;
+}
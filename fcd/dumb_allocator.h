@@ -19,6 +19,7 @@
 #include <iterator>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <type_traits>
 
 #include <iostream>
@@ -32,65 +33,136 @@ class DumbAllocator
 {
 	static constexpr size_t DefaultChunkSize = 0x4000 - 0x20;
 	static constexpr size_t HalfPageSize = DefaultChunkSize / 2;
-	
+
+	// Runtime pool sizing (see dumb_allocator.cpp): --pool-chunk-size and --pool-recycle-cap let
+	// big-module workloads trade residency for fewer heap round-trips without a rebuild. The chunk
+	// size is fixed at first use and never below DefaultChunkSize, so the compile-time small/large
+	// split above stays valid.
+	static size_t chunkSize();
+	static size_t maxRecycledChunks();
+
 	std::list<std::unique_ptr<char[]>> pool;
+	std::list<std::unique_ptr<char[]>> largePool;
 	size_t offset;
-	
+
+	static std::mutex& freelistLock()
+	{
+		static std::mutex lock;
+		return lock;
+	}
+
+	static std::list<std::unique_ptr<char[]>>& freelist()
+	{
+		static std::list<std::unique_ptr<char[]>> chunks;
+		return chunks;
+	}
+
+	// Retired chunks are kept on a process-wide freelist, so the next allocator (the next function's
+	// AST, typically) reuses them instead of growing the heap. The cap bounds how much of the peak
+	// stays resident. All freelisted chunks have chunkSize() bytes.
+	static std::unique_ptr<char[]> acquireChunk()
+	{
+		{
+			std::lock_guard<std::mutex> guard(freelistLock());
+			auto& chunks = freelist();
+			if (chunks.size() > 0)
+			{
+				auto chunk = std::move(chunks.back());
+				chunks.pop_back();
+				return chunk;
+			}
+		}
+		return std::unique_ptr<char[]>(new char[chunkSize()]);
+	}
+
+	inline void recycleChunks()
+	{
+		std::lock_guard<std::mutex> guard(freelistLock());
+		auto& chunks = freelist();
+		for (auto& chunk : pool)
+		{
+			if (chunk != nullptr && chunks.size() < maxRecycledChunks())
+			{
+				chunks.push_back(std::move(chunk));
+			}
+		}
+	}
+
+	// Bumps upward within the chunk, so the newest allocation ends exactly where the chunk's free
+	// space begins. That adjacency is what lets tryGrowDynamic extend the latest array without
+	// moving it.
 	inline char* allocateSmall(size_t size, size_t alignment)
 	{
-		auto& lastPage = pool.back();
-		uintptr_t endOffset = reinterpret_cast<uintptr_t>(&lastPage[offset]);
-		size_t realSize = size + ((endOffset - size) & (alignment - 1));
-		
-		if (offset < realSize)
+		char* base = pool.back().get();
+		if (base != nullptr)
 		{
-			char* bytes = new char[DefaultChunkSize];
-			pool.emplace_back(bytes);
-			offset = DefaultChunkSize;
-			
-			endOffset = reinterpret_cast<uintptr_t>(&bytes[offset]);
-			realSize = size + ((endOffset - size) & (alignment - 1));
-			assert(realSize <= offset);
+			size_t alignedOffset = offset + ((0 - reinterpret_cast<uintptr_t>(base + offset)) & (alignment - 1));
+			if (alignedOffset + size <= chunkSize())
+			{
+				offset = alignedOffset + size;
+				char* result = base + alignedOffset;
+				assert((reinterpret_cast<uintptr_t>(result) & (alignment - 1)) == 0);
+				return result;
+			}
 		}
-		
-		offset -= realSize;
-		char* result = &pool.back()[offset];
+
+		pool.emplace_back(acquireChunk());
+		base = pool.back().get();
+		size_t alignedOffset = (0 - reinterpret_cast<uintptr_t>(base)) & (alignment - 1);
+		offset = alignedOffset + size;
+		assert(offset <= chunkSize());
+		char* result = base + alignedOffset;
 		assert((reinterpret_cast<uintptr_t>(result) & (alignment - 1)) == 0);
 		return result;
 	}
-	
+
 	inline char* allocateLarge(size_t size, size_t alignment)
 	{
 		if (size == 0 || alignment == 0)
 		{
 			return nullptr;
 		}
-		
+
 		size_t requiredSize;
 		if (__builtin_add_overflow(size, alignment - 1, &requiredSize))
 		{
 			return nullptr;
 		}
-		
-		pool.emplace_front(new char[requiredSize]);
-		void* bytes = pool.front().get();
+
+		largePool.emplace_front(new char[requiredSize]);
+		void* bytes = largePool.front().get();
 		std::align(alignment, requiredSize, bytes, size);
 		return static_cast<char*>(bytes);
 	}
-	
+
 public:
 	inline DumbAllocator() : offset(0)
 	{
 		pool.push_back(nullptr);
 	}
-	
+
 	DumbAllocator(const DumbAllocator&) = delete;
-	
+
+	inline ~DumbAllocator()
+	{
+		recycleChunks();
+	}
+
 	inline void clear()
 	{
+		recycleChunks();
 		pool.clear();
+		largePool.clear();
+		pool.push_back(nullptr);
 		offset = 0;
 	}
+
+	// Returns every pool to the shared freelist; everything allocated so far is dead. This is what callers
+	// that recycle an allocator between functions should use.
+	inline void reset()
+	{
+		clear();
+	}
 	
 	template<typename T, typename... TParams>
 	typename std::enable_if<sizeof(T) < HalfPageSize && std::is_trivially_destructible<T>::value, T>::type*
@@ -124,7 +196,43 @@ public:
 		}
 		return new (allocateLarge(totalSize, alignment)) T[count];
 	}
-	
+
+	// In-place growth for the array most recently returned by allocateDynamic: when `allocation`
+	// still ends where the current chunk's free space begins and the extra elements fit in that
+	// chunk, the array grows where it stands — nothing is copied and no stranded copy of the old
+	// capacity is left behind in the arena. Returns false without changing anything when the
+	// array would have to move; callers then fall back to allocating fresh storage.
+	template<typename T>
+	bool tryGrowDynamic(T* allocation, size_t currentCount, size_t newCount)
+	{
+		static_assert(std::is_trivially_destructible<T>::value, "type must be trivially destructible");
+		assert(newCount >= currentCount);
+
+		char* chunkBegin = pool.back().get();
+		auto allocationBegin = reinterpret_cast<char*>(allocation);
+		auto allocationEnd = reinterpret_cast<char*>(allocation + currentCount);
+		if (chunkBegin == nullptr || allocationBegin < chunkBegin || allocationEnd != chunkBegin + offset)
+		{
+			return false;
+		}
+
+		size_t grownSize;
+		if (__builtin_umull_overflow(newCount, sizeof(T), &grownSize))
+		{
+			return false;
+		}
+
+		size_t allocationOffset = static_cast<size_t>(allocationBegin - chunkBegin);
+		if (grownSize > chunkSize() - allocationOffset)
+		{
+			return false;
+		}
+
+		offset = allocationOffset + grownSize;
+		new (allocationEnd) T[newCount - currentCount];
+		return true;
+	}
+
 	char* copyString(const char* begin, const char* end)
 	{
 		if (end >= begin)
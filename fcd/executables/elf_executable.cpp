@@ -10,19 +10,45 @@
 #include "elf_executable.h"
 #include "executable_errors.h"
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/Support/PrettyStackTrace.h>
 #include <llvm/Support/raw_ostream.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
 #include <cstdint>
 #include <deque>
-#include <unordered_map>
+#include <thread>
+
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace llvm;
 using namespace std;
 
 namespace
 {
+	// Purely advisory: when the executable is memory-mapped, tell the kernel that we're about to walk this
+	// table front to back so that it reads the pages ahead instead of faulting them in one at a time.
+	void adviseSequentialScan(const void* begin, size_t size)
+	{
+		if (begin == nullptr || size == 0)
+		{
+			return;
+		}
+
+		long pageSize = sysconf(_SC_PAGESIZE);
+		if (pageSize <= 0)
+		{
+			return;
+		}
+
+		auto address = reinterpret_cast<uintptr_t>(begin);
+		uintptr_t alignedAddress = address & ~static_cast<uintptr_t>(pageSize - 1);
+		posix_madvise(reinterpret_cast<void*>(alignedAddress), size + (address - alignedAddress), POSIX_MADV_WILLNEED);
+	}
+
 	template<typename T>
 	struct ptr_range
 	{
@@ -66,6 +92,44 @@ namespace
 		return ptr_range<T>(reinterpret_cast<const T*>(&begin[offset]), reinterpret_cast<const T*>(&begin[max]));
 	}
 
+	// Reads one DWARF-encoded value from an .eh_frame_hdr, advancing `offset`. Only the fixed-size
+	// formats that GCC and clang emit there are supported; anything fancier (LEB128, aligned)
+	// makes the caller skip .eh_frame ingestion rather than misparse it.
+	bool readEhFrameValue(const uint8_t* begin, const uint8_t* end, size_t& offset, uint8_t encoding, int64_t& value)
+	{
+		size_t size;
+		bool isSigned;
+		switch (encoding & 0x0f)
+		{
+			case 0x02: size = 2; isSigned = false; break;	// udata2
+			case 0x03: size = 4; isSigned = false; break;	// udata4
+			case 0x04: size = 8; isSigned = true; break;	// udata8 (sign distinction is moot)
+			case 0x0a: size = 2; isSigned = true; break;	// sdata2
+			case 0x0b: size = 4; isSigned = true; break;	// sdata4
+			case 0x0c: size = 8; isSigned = true; break;	// sdata8
+			default: return false;
+		}
+
+		auto bytes = bounded_cast<uint8_t>(begin, end, offset, size);
+		if (bytes.begin() == nullptr)
+		{
+			return false;
+		}
+
+		uint64_t raw = 0;
+		for (size_t i = 0; i < size; ++i)
+		{
+			raw |= static_cast<uint64_t>(bytes.begin()[i]) << (i * 8);
+		}
+		if (isSigned && size < 8 && (raw & (uint64_t(1) << (size * 8 - 1))) != 0)
+		{
+			raw |= ~uint64_t(0) << (size * 8);
+		}
+		value = static_cast<int64_t>(raw);
+		offset += size;
+		return true;
+	}
+
 	struct Elf32Types
 	{
 		static constexpr size_t bits = 32;
@@ -113,6 +177,13 @@ namespace
 	{
 		PT_LOAD = 1,
 		PT_DYNAMIC = 2,
+		PT_GNU_EH_FRAME = 0x6474e550,
+	};
+
+	enum ElfPhdrFlags
+	{
+		PF_X = 1,
+		PF_W = 2,
 	};
 
 	enum ElfShdrType
@@ -148,6 +219,7 @@ namespace
 		DT_PREINIT_ARRAY = 32,
 		DT_PREINIT_ARRAYSZ = 33,
 		DT_MAX = 34,
+		DT_GNU_HASH = 0x6ffffef5, // tracked outside of the dynEnt array
 	};
 
 	enum ElfMachine
@@ -357,6 +429,10 @@ namespace
 		uint64_t vbegin;
 		uint64_t vend;
 		const uint8_t* fbegin;
+		// Bytes actually present in the file; the rest of [vbegin, vend) is zero-fill.
+		uint64_t fsize;
+		bool isExecutable;
+		bool isWritable;
 	};
 
 	template<typename Types>
@@ -404,10 +480,21 @@ namespace
 			return reinterpret_cast<const Elf_Ehdr*>(begin());
 		}
 		
+		// Sorted by vbegin once parsing is done, so map() can binary-search. Never mutated after
+		// that, which is what lets the last-hit cache below hold a raw pointer into it.
 		vector<Segment> segments;
-		unordered_map<uint64_t, string> stubTargets;
+		// The lifter fetches through map() for essentially every instruction and fetch addresses
+		// are strongly local, so remembering the segment that served the last hit turns the common
+		// case into a single bounds compare. Relaxed atomicity: worker threads may overwrite each
+		// other's hint, but every value ever stored is a valid segment.
+		mutable std::atomic<const Segment*> lastMapHit;
+		// Same open-addressing treatment as the base class's tables; values are copied out on
+		// lookup, so rehashes can't invalidate anything a caller holds.
+		DenseMap<uint64_t, string> stubTargets;
 		
 	protected:
+		virtual void doMaterializeSymbolInfo() override;
+
 		virtual string doGetTargetTriple() const override
 		{
 			string arch;
@@ -504,7 +591,7 @@ namespace
 		static ErrorOr<unique_ptr<ElfExecutable<Types>>> parse(const uint8_t* begin, const uint8_t* end);
 		
 		ElfExecutable(const uint8_t* begin, const uint8_t* end)
-		: Executable(begin, end)
+		: Executable(begin, end), lastMapHit(nullptr)
 		{
 			assert(end - begin >= sizeof(Elf_Ehdr));
 		}
@@ -523,16 +610,62 @@ namespace
 		
 		virtual const uint8_t* map(uint64_t address) const override
 		{
-			for (auto iter = segments.rbegin(); iter != segments.rend(); iter++)
+			if (const Segment* hint = lastMapHit.load(std::memory_order_relaxed))
 			{
-				if (address >= iter->vbegin && address < iter->vend)
+				if (address >= hint->vbegin && address < hint->vend)
 				{
+					return hint->fbegin + (address - hint->vbegin);
+				}
+			}
+
+			// Binary search for the last segment starting at or before the address, then walk
+			// backwards: segments can overlap, and like the old reverse scan, the later program
+			// header wins. Well-formed images stop after one probe.
+			auto begin = segments.begin();
+			auto iter = upper_bound(begin, segments.end(), address, [](uint64_t address, const Segment& segment)
+			{
+				return address < segment.vbegin;
+			});
+			while (iter != begin)
+			{
+				--iter;
+				if (address < iter->vend)
+				{
+					lastMapHit.store(&*iter, std::memory_order_relaxed);
 					return iter->fbegin + (address - iter->vbegin);
 				}
 			}
 			return nullptr;
 		}
-		
+
+		virtual bool isReadOnlyRange(uint64_t address, uint64_t size) const override
+		{
+			for (auto iter = segments.rbegin(); iter != segments.rend(); iter++)
+			{
+				if (address >= iter->vbegin && address < iter->vend)
+				{
+					// Require the whole range to be file-backed: map() happily hands out pointers
+					// into the zero-fill tail, but those bytes aren't in the file.
+					return !iter->isWritable && address - iter->vbegin + size <= iter->fsize;
+				}
+			}
+			return false;
+		}
+
+		virtual vector<pair<uint64_t, uint64_t>> getExecutableRegions() const override
+		{
+			vector<pair<uint64_t, uint64_t>> result;
+			for (const auto& segment : segments)
+			{
+				if (segment.isExecutable)
+				{
+					// Only advertise the file-backed part; the zero-fill tail can't contain code.
+					result.emplace_back(segment.vbegin, min(segment.vend - segment.vbegin, segment.fsize));
+				}
+			}
+			return result;
+		}
+
 		virtual StubTargetQueryResult doGetStubTarget(uint64_t address, string& libraryName, string& into) const override
 		{
 			auto iter = stubTargets.find(address);
@@ -689,17 +822,16 @@ namespace
 		
 		using namespace std;
 		auto executable = std::make_unique<ElfExecutable<Types>>(begin, end);
-		
-		deque<const Elf_Phdr*> dynamics;
-		deque<const Elf_Shdr*> sections;
-		deque<const Elf_Shdr*> symtabs;
-		
-		// Walk header, identify PT_LOAD and PT_DYNAMIC segments, sections, and symbol tables.
+
+		// Walk the program headers and identify PT_LOAD segments, which map() needs. Everything else —
+		// sections, dynamic entries, relocations and symbol tables — is only parsed when symbol
+		// information is first queried, which partial disassemblies of large binaries may never do.
 		bool loadAtZero = false;
 		if (auto eh = bounded_cast<Elf_Ehdr>(begin, end, 0))
 		{
 			if (eh->phentsize == sizeof (Elf_Phdr))
 			{
+				adviseSequentialScan(bounded_cast<Elf_Phdr>(begin, end, eh->phoff), sizeof (Elf_Phdr) * eh->phnum);
 				for (const auto& ph : bounded_cast<Elf_Phdr>(begin, end, eh->phoff, eh->phnum))
 				{
 					if (ph.type == PT_LOAD)
@@ -714,20 +846,65 @@ namespace
 								seg.vbegin = ph.vaddr;
 								seg.vend = endAddress;
 								seg.fbegin = fileLoc.begin();
+								seg.fsize = ph.filesz;
+								seg.isExecutable = (ph.flags & PF_X) != 0;
+								seg.isWritable = (ph.flags & PF_W) != 0;
 								executable->segments.push_back(seg);
 								loadAtZero |= seg.vbegin == 0;
 							}
 						}
 					}
-					else if (ph.type == PT_DYNAMIC)
+				}
+			}
+
+			if (eh->entry != 0 || loadAtZero)
+			{
+				executable->getSymbol(eh->entry).virtualAddress = eh->entry;
+			}
+		}
+
+		// Sort once for map()'s binary search; the stable sort keeps program-header order between
+		// segments that start at the same address.
+		stable_sort(executable->segments.begin(), executable->segments.end(), [](const Segment& a, const Segment& b)
+		{
+			return a.vbegin < b.vbegin;
+		});
+
+		return move(executable);
+	}
+
+	template<typename Types>
+	void ElfExecutable<Types>::doMaterializeSymbolInfo()
+	{
+		const uint8_t* begin = this->begin();
+		const uint8_t* end = this->end();
+
+		deque<const Elf_Phdr*> dynamics;
+		deque<const Elf_Shdr*> sections;
+		deque<const Elf_Shdr*> symtabs;
+		const Elf_Phdr* ehFrameHeader = nullptr;
+
+		// Walk header again, this time for PT_DYNAMIC segments, sections, and symbol tables.
+		if (auto eh = bounded_cast<Elf_Ehdr>(begin, end, 0))
+		{
+			if (eh->phentsize == sizeof (Elf_Phdr))
+			{
+				for (const auto& ph : bounded_cast<Elf_Phdr>(begin, end, eh->phoff, eh->phnum))
+				{
+					if (ph.type == PT_DYNAMIC)
 					{
 						dynamics.push_back(&ph);
 					}
+					else if (ph.type == PT_GNU_EH_FRAME)
+					{
+						ehFrameHeader = &ph;
+					}
 				}
 			}
-			
+
 			if (eh->shentsize == sizeof (Elf_Shdr))
 			{
+				adviseSequentialScan(bounded_cast<Elf_Shdr>(begin, end, eh->shoff), sizeof (Elf_Shdr) * eh->shnum);
 				for (const auto& sh : bounded_cast<Elf_Shdr>(begin, end, eh->shoff, eh->shnum))
 				{
 					sections.push_back(&sh);
@@ -737,17 +914,13 @@ namespace
 					}
 				}
 			}
-			
-			if (eh->entry != 0 || loadAtZero)
-			{
-				executable->getSymbol(eh->entry).virtualAddress = eh->entry;
-			}
 		}
-		
+
 		// Walk dynamic segments.
 		array<const Elf_Dynamic*, DT_MAX> dynEnt;
 		dynEnt.fill(nullptr);
-		
+		const Elf_Dynamic* gnuHash = nullptr;
+
 		for (const auto* dynHeader : dynamics)
 		{
 			size_t numEnts = dynHeader->filesz / sizeof (Elf_Dynamic);
@@ -757,6 +930,10 @@ namespace
 				{
 					dynEnt[dyn.tag] = &dyn;
 				}
+				else if (dyn.tag == DT_GNU_HASH)
+				{
+					gnuHash = &dyn;
+				}
 			}
 		}
 		
@@ -775,15 +952,17 @@ namespace
 				const string& prefix = arrayData.name;
 				for (addr entry : bounded_cast<addr>(begin, end, arrayLocation->address, arraySize->address))
 				{
-					auto& symInfo = executable->getSymbol(entry);
+					auto& symInfo = getSymbol(entry);
 					symInfo.virtualAddress = entry;
-					raw_string_ostream(symInfo.name) << prefix << counter;
+					string synthesized;
+					raw_string_ostream(synthesized) << prefix << counter;
+					symInfo.name = internName(synthesized);
 					counter++;
 				}
 			}
 		}
 		
-		pair<ElfDynamicTag, string> initFini[] = {
+		pair<ElfDynamicTag, StringRef> initFini[] = {
 			{DT_INIT, "init"},
 			{DT_FINI, "fini"}
 		};
@@ -792,19 +971,84 @@ namespace
 			auto location = dynEnt[pair.first];
 			if (location != nullptr)
 			{
-				auto& symInfo = executable->getSymbol(location->address);
+				auto& symInfo = getSymbol(location->address);
 				symInfo.virtualAddress = location->address;
 				symInfo.name = pair.second;
 			}
 		}
 		
+		// The relocation tables, the hashed dynamic symbol table and each SHT_SYMTAB are
+		// independent of one another, so each one is decoded on its own thread into a staging
+		// vector of (address, name) pairs; the workers only read the mapped image. The merge at
+		// the end replays the staged entries in the order the serial code used, which keeps the
+		// property that SHT_SYMTAB data overrides dynamic segment info.
+		vector<pair<uint64_t, StringRef>> pltStubs;
+		vector<pair<uint64_t, StringRef>> relaStubs;
+		vector<pair<uint64_t, StringRef>> hashedFunctions;
+		vector<vector<pair<uint64_t, StringRef>>> tableFunctions(symtabs.size());
+		vector<uint64_t> fdeStarts;
+		vector<thread> workers;
+
+		// The .eh_frame_hdr search table lists the start of every function the compiler emitted
+		// unwind info for, which on GCC and clang builds is all of them. Registering each entry up
+		// front collapses the lifter's iterative discovery into a single wave with full coverage,
+		// instead of chasing call targets round after round and mis-lifting speculative ones.
+		if (ehFrameHeader != nullptr)
+		if (const uint8_t* hdrBase = map(ehFrameHeader->vaddr))
+		{
+			uint64_t hdrAddress = ehFrameHeader->vaddr;
+			workers.emplace_back([=, &fdeStarts]()
+			{
+				auto preamble = bounded_cast<uint8_t>(hdrBase, end, 0, 4);
+				if (preamble.begin() == nullptr || preamble.begin()[0] != 1)
+				{
+					return;
+				}
+
+				size_t offset = 4;
+				int64_t ehFramePtr;
+				int64_t fdeCount;
+				uint8_t tableEncoding = preamble.begin()[3];
+				uint8_t application = tableEncoding & 0x70;
+				if (!readEhFrameValue(hdrBase, end, offset, preamble.begin()[1], ehFramePtr)
+					|| !readEhFrameValue(hdrBase, end, offset, preamble.begin()[2], fdeCount)
+					|| fdeCount <= 0
+					|| (application != 0x00 && application != 0x10 && application != 0x30))
+				{
+					return;
+				}
+
+				fdeStarts.reserve(static_cast<size_t>(fdeCount));
+				for (int64_t i = 0; i < fdeCount; ++i)
+				{
+					size_t entryOffset = offset;
+					int64_t initialLocation;
+					int64_t fdePointer;
+					if (!readEhFrameValue(hdrBase, end, offset, tableEncoding, initialLocation)
+						|| !readEhFrameValue(hdrBase, end, offset, tableEncoding, fdePointer))
+					{
+						break;
+					}
+
+					uint64_t address;
+					switch (application)
+					{
+						case 0x10: address = hdrAddress + entryOffset + initialLocation; break;	// pcrel
+						case 0x30: address = hdrAddress + initialLocation; break;				// datarel
+						default: address = static_cast<uint64_t>(initialLocation); break;		// absolute
+					}
+					fdeStarts.push_back(address);
+				}
+			});
+		}
+
 		if (dynEnt[DT_STRTAB] && dynEnt[DT_SYMTAB])
-		if (const uint8_t* symtab = executable->map(dynEnt[DT_SYMTAB]->address))
-		if (const uint8_t* strtab = executable->map(dynEnt[DT_STRTAB]->address))
+		if (const uint8_t* symtab = map(dynEnt[DT_SYMTAB]->address))
+		if (const uint8_t* strtab = map(dynEnt[DT_STRTAB]->address))
 		{
 			// Check PLT relocations to put a name on relocated entries.
 			if (dynEnt[DT_JMPREL] && dynEnt[DT_PLTRELSZ] && dynEnt[DT_PLTREL])
-			if (const uint8_t* relocBase = executable->map(dynEnt[DT_JMPREL]->address))
+			if (const uint8_t* relocBase = map(dynEnt[DT_JMPREL]->address))
 			{
 				ElfDynamicTag relType = static_cast<ElfDynamicTag>(dynEnt[DT_PLTREL]->value);
 				if (relType == DT_REL || relType == DT_RELA)
@@ -812,48 +1056,119 @@ namespace
 					// Fortunately, Elf_Rela is merely an extension of Elf_Rel and we can treat both as Elf_Rel as long
 					// as we correctly increment the pointer.
 					uint64_t relocSize = relType == DT_REL ? sizeof (Elf_Rel) : sizeof (Elf_Rela);
-					for (uint64_t relocIter = 0; relocIter < dynEnt[DT_PLTRELSZ]->value; relocIter += relocSize)
+					uint64_t relocBytes = dynEnt[DT_PLTRELSZ]->value;
+					workers.emplace_back([=, &pltStubs]()
+					{
+						pltStubs.reserve(relocBytes / relocSize);
+						for (uint64_t relocIter = 0; relocIter < relocBytes; relocIter += relocSize)
+						{
+							if (const auto* reloc = bounded_cast<Elf_Rel>(relocBase, end, relocIter))
+							if (const auto* symbol = bounded_cast<Elf_Sym>(symtab, end, sizeof (Elf_Sym) * reloc->symbol()))
+							if (const char* nameBegin = bounded_cast<char>(strtab, end, symbol->name))
+							if (isMappableKey(reloc->offset))
+							{
+								auto maxSize = static_cast<size_t>(end - reinterpret_cast<const uint8_t*>(nameBegin));
+								size_t length = strnlen(nameBegin, maxSize);
+								pltStubs.emplace_back(reloc->offset, StringRef(nameBegin, length));
+							}
+						}
+					});
+				}
+			}
+
+			// Also check RELA table. This is important especially on position-independent executables, which don't have
+			// a PLT.
+			if (dynEnt[DT_RELA] && dynEnt[DT_RELASZ] && dynEnt[DT_RELAENT] && dynEnt[DT_RELAENT]->value == sizeof (Elf_Rela))
+			if (const uint8_t* relocBase = map(dynEnt[DT_RELA]->address))
+			{
+				uint64_t relocBytes = dynEnt[DT_RELASZ]->value;
+				workers.emplace_back([=, &relaStubs]()
+				{
+					relaStubs.reserve(relocBytes / sizeof (Elf_Rela));
+					for (uint64_t relocIter = 0; relocIter < relocBytes; relocIter += sizeof (Elf_Rela))
 					{
 						if (const auto* reloc = bounded_cast<Elf_Rel>(relocBase, end, relocIter))
 						if (const auto* symbol = bounded_cast<Elf_Sym>(symtab, end, sizeof (Elf_Sym) * reloc->symbol()))
 						if (const char* nameBegin = bounded_cast<char>(strtab, end, symbol->name))
+						if (isMappableKey(reloc->offset))
 						{
 							auto maxSize = static_cast<size_t>(end - reinterpret_cast<const uint8_t*>(nameBegin));
-							const char* nameEnd = nameBegin + strnlen(nameBegin, maxSize);
-							executable->stubTargets[reloc->offset] = string(nameBegin, nameEnd);
+							size_t length = strnlen(nameBegin, maxSize);
+							relaStubs.emplace_back(reloc->offset, StringRef(nameBegin, length));
 						}
 					}
-				}
+				});
 			}
-			
-			// Also check RELA table. This is important especially on position-independent executables, which don't have
-			// a PLT.
-			if (dynEnt[DT_RELA] && dynEnt[DT_RELASZ] && dynEnt[DT_RELAENT] && dynEnt[DT_RELAENT]->value == sizeof (Elf_Rela))
-			if (const uint8_t* relocBase = executable->map(dynEnt[DT_RELA]->address))
+
+			// The dynamic symbol table advertises no size of its own, but DT_GNU_HASH lets us recover
+			// the index of its last hashed symbol: the largest bucket value starts a chain that ends at
+			// an entry with its low bit set. With the extent known, exported functions can be named even
+			// in stripped binaries that carry no SHT_SYMTAB.
+			if (gnuHash != nullptr)
+			if (const uint8_t* hashBase = map(gnuHash->address))
 			{
-				for (uint64_t relocIter = 0; relocIter < dynEnt[DT_RELASZ]->value; relocIter += sizeof (Elf_Rela))
+				workers.emplace_back([=, &hashedFunctions]()
 				{
-					if (const auto* reloc = bounded_cast<Elf_Rel>(relocBase, end, relocIter))
-					if (const auto* symbol = bounded_cast<Elf_Sym>(symtab, end, sizeof (Elf_Sym) * reloc->symbol()))
-					if (const char* nameBegin = bounded_cast<char>(strtab, end, symbol->name))
+					auto header = bounded_cast<word>(hashBase, end, 0, 4);
+					if (header.begin() == header.end())
 					{
-						auto maxSize = static_cast<size_t>(end - reinterpret_cast<const uint8_t*>(nameBegin));
-						const char* nameEnd = nameBegin + strnlen(nameBegin, maxSize);
-						executable->stubTargets[reloc->offset] = string(nameBegin, nameEnd);
+						return;
 					}
-				}
+
+					word numBuckets = header.begin()[0];
+					word firstHashedSymbol = header.begin()[1];
+					word bloomWordCount = header.begin()[2];
+					size_t bucketsOffset = sizeof (word) * 4 + sizeof (addr) * bloomWordCount;
+					word lastSymbol = 0;
+					for (word bucket : bounded_cast<word>(hashBase, end, bucketsOffset, numBuckets))
+					{
+						if (bucket > lastSymbol)
+						{
+							lastSymbol = bucket;
+						}
+					}
+
+					if (lastSymbol >= firstHashedSymbol)
+					{
+						size_t chainsOffset = bucketsOffset + sizeof (word) * numBuckets;
+						while (const auto* chainEntry = bounded_cast<word>(hashBase, end, chainsOffset + sizeof (word) * (lastSymbol - firstHashedSymbol)))
+						{
+							if ((*chainEntry & 1) != 0)
+							{
+								break;
+							}
+							++lastSymbol;
+						}
+
+						for (const auto& sym : bounded_cast<Elf_Sym>(symtab, end, 0, lastSymbol + 1))
+						{
+							// Exclude non-function symbols and undefined imports.
+							if ((sym.info & 0xf) != STT_FUNC || sym.value == 0)
+							{
+								continue;
+							}
+
+							if (const char* nameBegin = bounded_cast<char>(strtab, end, sym.name))
+							{
+								auto maxSize = static_cast<size_t>(reinterpret_cast<const char*>(end) - nameBegin);
+								size_t length = strnlen(nameBegin, maxSize);
+								hashedFunctions.emplace_back(sym.value, StringRef(nameBegin, length));
+							}
+						}
+					}
+				});
 			}
 		}
-		
+
 		// Walk symbol tables and identify function symbols.
-		// This can override dynamic segment info, and it's fine.
-		for (const auto* sth : symtabs)
+		for (size_t tableIndex = 0; tableIndex < symtabs.size(); ++tableIndex)
 		{
+			const auto* sth = symtabs[tableIndex];
 			if (sth->entsize != 0 && sth->entsize != sizeof (Elf_Sym))
 			{
 				continue;
 			}
-			
+
 			const uint8_t* strtab = nullptr;
 			if (sth->link != 0 && sth->link < sections.size())
 			{
@@ -863,45 +1178,95 @@ namespace
 					strtab = bounded_cast<uint8_t>(begin, end, strtabHeader->offset);
 				}
 			}
-			
+
 			size_t numEnts = sth->size / sizeof (Elf_Sym);
-			for (const auto& sym : bounded_cast<Elf_Sym>(begin, end, sth->offset, numEnts))
+			workers.emplace_back([=, &staging = tableFunctions[tableIndex]]()
 			{
-				// Exclude non-function symbols.
-				if ((sym.info & 0xf) != STT_FUNC)
-				{
-					continue;
-				}
-				
-				const char* nameBegin = nullptr;
-				if (sym.name != 0)
+				for (const auto& sym : bounded_cast<Elf_Sym>(begin, end, sth->offset, numEnts))
 				{
-					nameBegin = bounded_cast<char>(strtab, end, sym.name);
-				}
-				
-				const char* nameEnd = nameBegin;
-				if (nameBegin != nullptr)
-				{
-					auto maxSize = static_cast<size_t>(reinterpret_cast<const char*>(end) - nameBegin);
-					nameEnd = nameBegin + strnlen(nameBegin, maxSize);
+					// Exclude non-function symbols.
+					if ((sym.info & 0xf) != STT_FUNC)
+					{
+						continue;
+					}
+
+					const char* nameBegin = nullptr;
+					if (sym.name != 0)
+					{
+						nameBegin = bounded_cast<char>(strtab, end, sym.name);
+					}
+
+					size_t length = 0;
+					if (nameBegin != nullptr)
+					{
+						auto maxSize = static_cast<size_t>(reinterpret_cast<const char*>(end) - nameBegin);
+						length = strnlen(nameBegin, maxSize);
+					}
+
+					staging.emplace_back(sym.value, nameBegin == nullptr ? StringRef() : StringRef(nameBegin, length));
 				}
-				
-				auto& symInfo = executable->getSymbol(sym.value);
-				symInfo.virtualAddress = sym.value;
-				symInfo.name = string(nameBegin, nameEnd);
+			});
+		}
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		// At most one stub per relocation; size the table in one go.
+		stubTargets.reserve(stubTargets.size() + pltStubs.size() + relaStubs.size());
+		for (const auto& stub : pltStubs)
+		{
+			stubTargets[stub.first] = stub.second.str();
+		}
+		for (const auto& stub : relaStubs)
+		{
+			stubTargets[stub.first] = stub.second.str();
+		}
+
+		// Count the insertions first so the symbol table allocates once.
+		size_t functionCount = fdeStarts.size() + hashedFunctions.size();
+		for (const auto& staged : tableFunctions)
+		{
+			functionCount += staged.size();
+		}
+		reserveSymbols(functionCount);
+
+		// FDE starts carry no name, so they go in first and only claim the address; the symbol
+		// tables below add names to whichever of these functions they also mention.
+		for (uint64_t address : fdeStarts)
+		{
+			getSymbol(address).virtualAddress = address;
+		}
+
+		for (const auto& function : hashedFunctions)
+		{
+			auto& symInfo = getSymbol(function.first);
+			symInfo.virtualAddress = function.first;
+			// The string table is part of the mapped image, which outlives the
+			// executable object; reference the name in place instead of copying.
+			symInfo.name = function.second;
+		}
+
+		// SHT_SYMTAB entries land last: this can override dynamic segment info, and it's fine.
+		for (const auto& staged : tableFunctions)
+		{
+			for (const auto& function : staged)
+			{
+				auto& symInfo = getSymbol(function.first);
+				symInfo.virtualAddress = function.first;
+				symInfo.name = function.second;
 			}
 		}
 		
 		// Figure out file offset for symbols, remove those that don't have one.
-		for (auto entryPoint : executable->getVisibleEntryPoints())
+		for (auto entryPoint : getVisibleEntryPoints())
 		{
-			if (executable->map(entryPoint) == nullptr)
+			if (map(entryPoint) == nullptr)
 			{
-				executable->eraseSymbol(entryPoint);
+				eraseSymbol(entryPoint);
 			}
 		}
-		
-		return move(executable);
 	}
 }
 
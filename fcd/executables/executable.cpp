@@ -15,6 +15,8 @@
 #include "python_executable.h"
 
 #include <ctype.h>
+#include <sys/mman.h>
+#include <unistd.h>
 
 using namespace llvm;
 using namespace std;
@@ -194,10 +196,11 @@ string Executable::getTargetTriple() const
 
 vector<uint64_t> Executable::getVisibleEntryPoints() const
 {
+	materializeSymbolInfo();
 	vector<uint64_t> result;
 	for (const auto& pair : symbols)
 	{
-		result.push_back(pair.second.virtualAddress);
+		result.push_back(pair.second->virtualAddress);
 	}
 	sort(result.begin(), result.end());
 	return result;
@@ -205,54 +208,99 @@ vector<uint64_t> Executable::getVisibleEntryPoints() const
 
 const SymbolInfo* Executable::getInfo(uint64_t address) const
 {
+	if (!isMappableKey(address))
+	{
+		return nullptr;
+	}
+
+	materializeSymbolInfo();
 	auto iter = symbols.find(address);
 	if (iter != symbols.end())
 	{
-		return &iter->second;
+		return iter->second.get();
 	}
 	else if (map(address) != nullptr)
 	{
-		SymbolInfo& info = symbols[address];
-		info.virtualAddress = address;
-		return &info;
+		auto& slot = symbols[address];
+		slot.reset(new SymbolInfo);
+		slot->virtualAddress = address;
+		return slot.get();
 	}
 	return nullptr;
 }
 
 const StubInfo* Executable::getStubTarget(uint64_t address) const
 {
+	if (!isMappableKey(address))
+	{
+		return nullptr;
+	}
+
+	materializeSymbolInfo();
 	auto iter = stubTargets.find(address);
 	if (iter != stubTargets.end())
 	{
-		return &iter->second;
+		return iter->second.get();
 	}
-	
+
+	if (unresolvedStubTargets.count(address) != 0)
+	{
+		return nullptr;
+	}
+
 	string libraryName;
 	string targetName;
 	switch (doGetStubTarget(address, libraryName, targetName))
 	{
 		case ResolvedInFlatNamespace:
 		{
-			StubInfo& stub = stubTargets[address];
-			stub.sharedObject = nullptr;
-			stub.name = move(targetName);
-			return &stub;
+			auto& stub = stubTargets[address];
+			stub.reset(new StubInfo);
+			stub->sharedObject = nullptr;
+			stub->name = internName(targetName);
+			return stub.get();
 		}
 		case ResolvedInTwoLevelNamespace:
 		{
 			auto libIter = libraries.insert(libraryName).first;
-			StubInfo& stub = stubTargets[address];
-			stub.sharedObject = &*libIter;
-			stub.name = move(targetName);
-			return &stub;
+			auto& stub = stubTargets[address];
+			stub.reset(new StubInfo);
+			stub->sharedObject = &*libIter;
+			stub->name = internName(targetName);
+			return stub.get();
 		}
 		case Unresolved:
+			unresolvedStubTargets.insert(address);
 			return nullptr;
 		default:
 			llvm_unreachable("Unknown stub target resolution type!");
 	}
 }
 
+void Executable::adviseWillNeed(uint64_t address) const
+{
+	const uint8_t* mapped = map(address);
+	if (mapped == nullptr || mapped < dataBegin || mapped >= dataEnd)
+	{
+		return;
+	}
+
+	long pageSize = sysconf(_SC_PAGESIZE);
+	if (pageSize <= 0)
+	{
+		return;
+	}
+
+	// Symbols carry no size here, so a fixed window bounds the hint. 64 KiB covers the hot part of
+	// most functions, and being advisory, over- or undershooting only changes how much is prefetched.
+	constexpr size_t readaheadWindow = 0x10000;
+	size_t size = min<size_t>(readaheadWindow, static_cast<size_t>(dataEnd - mapped));
+
+	auto raw = reinterpret_cast<uintptr_t>(mapped);
+	uintptr_t aligned = raw & ~static_cast<uintptr_t>(pageSize - 1);
+	posix_madvise(reinterpret_cast<void*>(aligned), size + (raw - aligned), POSIX_MADV_WILLNEED);
+}
+
 ErrorOr<unique_ptr<Executable>> Executable::parse(const uint8_t* begin, const uint8_t* end)
 {
 	return executableFactory->parse(begin, end);
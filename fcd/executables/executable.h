@@ -12,18 +12,23 @@
 
 #include "entry_points.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/DenseSet.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/ErrorOr.h>
 
+#include <limits>
 #include <memory>
 #include <set>
 #include <string>
-#include <unordered_map>
 #include <vector>
 
 struct StubInfo
 {
 	const std::string* sharedObject;
-	std::string name;
+	// Interned in the owning executable's name arena; see SymbolInfo::name.
+	llvm::StringRef name;
 };
 
 class ExecutableFactory;
@@ -32,10 +37,35 @@ class Executable : public EntryPointProvider
 {
 	const uint8_t* dataBegin;
 	const uint8_t* dataEnd;
-	mutable std::unordered_map<uint64_t, SymbolInfo> symbols;
-	mutable std::unordered_map<uint64_t, StubInfo> stubTargets;
+	// Open-addressing tables keyed by address: probes stay on a flat array instead of walking
+	// collision chains, which matters when the lifter queries them for every call site. The
+	// entries live behind unique_ptrs because getInfo and getStubTarget hand out pointers that
+	// must survive later insertions and rehashes.
+	mutable llvm::DenseMap<uint64_t, std::unique_ptr<SymbolInfo>> symbols;
+	mutable llvm::DenseMap<uint64_t, std::unique_ptr<StubInfo>> stubTargets;
+	// Negative cache: the lifter probes the same unresolvable call sites over and over, and formats
+	// may answer Unresolved at a nontrivial cost.
+	mutable llvm::DenseSet<uint64_t> unresolvedStubTargets;
 	mutable std::set<std::string> libraries;
-	
+	// Backing storage for names that don't live in the mapped image: synthesized entry point names
+	// and stub targets. Interning deduplicates them, so stubs that resolve to the same import cost
+	// one copy of the name instead of one per call site.
+	mutable llvm::BumpPtrAllocator nameArena;
+	mutable llvm::StringMap<char, llvm::BumpPtrAllocator&> internedNames;
+	mutable bool symbolInfoMaterialized;
+	// Junk addresses that collide with the maps' reserved keys land here; see isMappableKey.
+	SymbolInfo scratchSymbol;
+
+	void materializeSymbolInfo() const
+	{
+		if (!symbolInfoMaterialized)
+		{
+			symbolInfoMaterialized = true;
+			// Materialization only fills the mutable symbol and stub tables, so it is logically const.
+			const_cast<Executable*>(this)->doMaterializeSymbolInfo();
+		}
+	}
+
 protected:
 	enum StubTargetQueryResult
 	{
@@ -45,13 +75,53 @@ protected:
 	};
 	
 	inline Executable(const uint8_t* begin, const uint8_t* end)
-	: dataBegin(begin), dataEnd(end)
+	: dataBegin(begin), dataEnd(end), internedNames(nameArena), symbolInfoMaterialized(false)
 	{
 	}
-	
-	SymbolInfo& getSymbol(uint64_t address) { return symbols[address]; }
-	void eraseSymbol(uint64_t address) { symbols.erase(address); }
-	
+
+	llvm::StringRef internName(llvm::StringRef name) const
+	{
+		return internedNames.insert(std::make_pair(name, '\0')).first->getKey();
+	}
+
+	// DenseMap reserves ~0 and ~0 - 1 as bucket markers. No real code lives at those addresses,
+	// but hostile symbol tables and lifted constants can mention them, so every keyed access
+	// checks first.
+	static bool isMappableKey(uint64_t address)
+	{
+		return address < std::numeric_limits<uint64_t>::max() - 1;
+	}
+
+	SymbolInfo& getSymbol(uint64_t address)
+	{
+		if (!isMappableKey(address))
+		{
+			return scratchSymbol;
+		}
+		auto& slot = symbols[address];
+		if (slot == nullptr)
+		{
+			slot.reset(new SymbolInfo);
+		}
+		return *slot;
+	}
+
+	void eraseSymbol(uint64_t address)
+	{
+		if (isMappableKey(address))
+		{
+			symbols.erase(address);
+		}
+	}
+
+	// Bulk-load support: parsers that can count their symbols up front call this before inserting
+	// so that the table allocates once instead of rehashing as it grows.
+	void reserveSymbols(size_t count) { symbols.reserve(symbols.size() + count); }
+
+	// Called before the first symbol or stub query. Formats with expensive symbol or relocation tables
+	// override this to discover them on demand instead of at load time.
+	virtual void doMaterializeSymbolInfo() {}
+
 	virtual StubTargetQueryResult doGetStubTarget(uint64_t address, std::string& sharedObject, std::string& symbolName) const = 0;
 	virtual std::string doGetTargetTriple() const = 0;
 	
@@ -65,7 +135,25 @@ public:
 	inline const uint8_t* end() const { return dataEnd; }
 	
 	virtual const uint8_t* map(uint64_t address) const = 0;
-	
+
+	// True when every byte of [address, address + size) is mapped read-only and actually present in
+	// the file, so the bytes that map() returns are the bytes the program would see at run time.
+	// Zero-fill tails don't qualify even inside a read-only segment: map() reaches past the file
+	// there. The default is conservative; formats that don't track segment protection report nothing
+	// as read-only.
+	virtual bool isReadOnlyRange(uint64_t address, uint64_t size) const { return false; }
+
+	// Purely advisory: asks the kernel to start reading the pages behind `address` so that a
+	// subsequent decode walks resident memory instead of faulting pages in one at a time. Callers
+	// hint the next queued entry point while the current one lifts, overlapping I/O with decoding.
+	void adviseWillNeed(uint64_t address) const;
+
+	// Contiguous ranges of mapped memory that hold code, as (virtual address, size) pairs, for
+	// consumers that scan memory instead of following references (see PrologueScanner). Every byte
+	// of a returned range is file-backed: map(range start) is valid for the whole size. Formats
+	// that cannot tell code from data return nothing.
+	virtual std::vector<std::pair<uint64_t, uint64_t>> getExecutableRegions() const { return {}; }
+
 	virtual std::vector<uint64_t> getVisibleEntryPoints() const override final;
 	virtual const SymbolInfo* getInfo(uint64_t address) const override final;
 	const StubInfo* getStubTarget(uint64_t address) const;
@@ -13,14 +13,20 @@
 
 #include <llvm/Support/PrettyStackTrace.h>
 
+#include <atomic>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
 using namespace llvm;
 using namespace std;
 
 namespace
 {
 	cl::opt<unsigned long long> flatOrigin("flat-org", cl::desc("Load address of binary (--format=flat)"), whitelist());
-	
-	class FlatBinary final : public Executable
+	cl::opt<unsigned> flatWindow("flat-window", cl::desc("Keep only about this many mebibytes of a flat binary resident, prefetching ahead of the most recent accesses; useful for images that dwarf available memory (0 = whole image)"), cl::init(0), whitelist());
+
+	class FlatBinary : public Executable
 	{
 		uint64_t baseAddress;
 		
@@ -51,12 +57,79 @@ namespace
 			}
 			return nullptr;
 		}
+
+		virtual vector<pair<uint64_t, uint64_t>> getExecutableRegions() const override
+		{
+			// There are no headers to tell code from data: the whole image is fair game.
+			return {{baseAddress, static_cast<uint64_t>(end() - begin())}};
+		}
 		
 		virtual StubTargetQueryResult doGetStubTarget(uint64_t address, string& libraryName, string& into) const override
 		{
 			return Unresolved;
 		}
 	};
+
+	// Keeps only a sliding window of a huge image resident. The image stays memory-mapped in full,
+	// so map() remains a pointer computation and callers see no difference; residency is steered
+	// with madvise, prefetching the chunk ahead of the most recent access and dropping chunks that
+	// the window has slid past. Hints are purely advisory, so random accesses and concurrent
+	// lifter threads only cost extra page faults, never correctness.
+	class WindowedFlatBinary final : public FlatBinary
+	{
+		uint64_t chunkSize;
+		mutable std::atomic<uint64_t> currentChunk;
+
+		void advise(uint64_t chunk, int advice) const
+		{
+			auto imageSize = static_cast<uint64_t>(end() - begin());
+			uint64_t chunkBegin = chunk * chunkSize;
+			if (chunkBegin < imageSize)
+			{
+				// begin() comes from a page-aligned file mapping and chunkSize is a multiple of the
+				// page size, so this address satisfies madvise's alignment requirement.
+				auto length = static_cast<size_t>(min(chunkSize, imageSize - chunkBegin));
+				madvise(const_cast<uint8_t*>(begin()) + chunkBegin, length, advice);
+			}
+		}
+
+	public:
+		WindowedFlatBinary(const uint8_t* begin, const uint8_t* end, uint64_t baseAddress, uint64_t windowSize)
+		: FlatBinary(begin, end, baseAddress), currentChunk(0)
+		{
+			// The window is two chunks: the one being lifted and the one prefetched ahead of it.
+			uint64_t pageSize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+			chunkSize = ((windowSize / 2 + pageSize - 1) / pageSize) * pageSize;
+			if (chunkSize == 0)
+			{
+				chunkSize = pageSize;
+			}
+			advise(0, MADV_WILLNEED);
+			advise(1, MADV_WILLNEED);
+		}
+
+		virtual const uint8_t* map(uint64_t address) const override
+		{
+			const uint8_t* result = FlatBinary::map(address);
+			if (result != nullptr)
+			{
+				uint64_t chunk = static_cast<uint64_t>(result - begin()) / chunkSize;
+				uint64_t previous = currentChunk.exchange(chunk, std::memory_order_relaxed);
+				if (chunk != previous)
+				{
+					advise(chunk, MADV_WILLNEED);
+					advise(chunk + 1, MADV_WILLNEED);
+					// Pages of a read-only file mapping refault cleanly from disk, so dropping a
+					// chunk we jump back into later is slow, not wrong.
+					if (previous + 1 < chunk || previous > chunk + 1)
+					{
+						advise(previous, MADV_DONTNEED);
+					}
+				}
+			}
+			return result;
+		}
+	};
 }
 
 FlatBinaryExecutableFactory::FlatBinaryExecutableFactory()
@@ -67,6 +140,14 @@ FlatBinaryExecutableFactory::FlatBinaryExecutableFactory()
 ErrorOr<unique_ptr<Executable>> FlatBinaryExecutableFactory::parse(const uint8_t* begin, const uint8_t* end)
 {
 	PrettyStackTraceString frameInfo("Parsing executable as flat binary");
-	auto executable = std::make_unique<FlatBinary>(begin, end, flatOrigin);
+	unique_ptr<Executable> executable;
+	if (flatWindow == 0)
+	{
+		executable = std::make_unique<FlatBinary>(begin, end, flatOrigin);
+	}
+	else
+	{
+		executable = std::make_unique<WindowedFlatBinary>(begin, end, flatOrigin, uint64_t(flatWindow) * 0x100000);
+	}
 	return move(executable);
 }
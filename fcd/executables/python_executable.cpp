@@ -8,14 +8,14 @@
 //
 
 #include "errors.h"
+#include "python_context.h"
 #include "python_executable.h"
 #include "python_helpers.h"
 
+#include <llvm/ADT/DenseMap.h>
 #include <llvm/Support/PrettyStackTrace.h>
 #include <llvm/Support/raw_ostream.h>
 
-#include <unordered_map>
-
 // We assume here that Python has already been initialized (most likely with a PythonContext).
 
 using namespace llvm;
@@ -23,16 +23,41 @@ using namespace std;
 
 namespace
 {
+	// Crossing into Python for every query is the dominant cost of script-loaded executables, so
+	// scripts may expose bulk `segments` and `stubTargets` attributes next to the existing
+	// `entryPoints`. These are materialized once into the same kind of native tables that
+	// ElfExecutable uses; per-call mapAddress/getStubTarget only runs for addresses the bulk data
+	// doesn't cover, and mapAddress answers are memoized.
 	class PythonParsedExecutable final : public Executable
 	{
+		struct Segment
+		{
+			uint64_t vbegin;
+			uint64_t vend;
+			const uint8_t* fbegin;
+		};
+
+		struct CachedStubTarget
+		{
+			bool twoLevel;
+			string library;
+			string name;
+		};
+
 		string path;
 		string executableType;
 		string targetTriple;
-		
+
+		vector<Segment> segments;
+		// Values are copied out on lookup, so rehashes can't invalidate anything a caller holds.
+		DenseMap<uint64_t, CachedStubTarget> bulkStubTargets;
+		// Memoized mapAddress fallbacks; -1 means the script answered "not mapped".
+		mutable DenseMap<uint64_t, int64_t> fallbackOffsets;
+
 		AutoPyObject module;
 		AutoPyObject getStubTarget;
 		AutoPyObject mapAddress;
-		
+
 		static bool getString(AutoPyObject&& object, string& output)
 		{
 			if (object)
@@ -47,7 +72,24 @@ namespace
 			}
 			return false;
 		}
-		
+
+		static bool getUnsignedInt(AutoPyObject&& object, unsigned long long& output)
+		{
+			if (object)
+			{
+				auto longObject = callObject(ADDREF reinterpret_cast<PyObject*>(&PyLong_Type), object);
+				if (!PyErr_Occurred())
+				{
+					output = PyLong_AsUnsignedLongLong(longObject.get());
+					if (!PyErr_Occurred())
+					{
+						return true;
+					}
+				}
+			}
+			return false;
+		}
+
 		PythonParsedExecutable(string path, const uint8_t* begin, const uint8_t* end)
 		: Executable(begin, end), path(move(path))
 		{
@@ -145,7 +187,7 @@ namespace
 					}
 					
 					auto& symbol = getSymbol(address);
-					symbol.name = move(symbolName);
+					symbol.name = internName(symbolName);
 					symbol.virtualAddress = address;
 				}
 				return true;
@@ -154,7 +196,104 @@ namespace
 			errs() << "Script " << path << " does not expose a sequence-typed entryPoints!\n";
 			return false;
 		}
-		
+
+		bool cacheSegments()
+		{
+			PyErrClearAtEnd clearPyErrAtEndOfFunction;
+
+			auto segmentList = TAKEREF PyObject_GetAttrString(module.get(), "segments");
+			if (!segmentList)
+			{
+				// Optional: scripts without a segment table answer every map() through mapAddress.
+				return true;
+			}
+
+			if (auto sequence = TAKEREF PySequence_Fast(segmentList.get(), nullptr))
+			{
+				auto imageSize = static_cast<unsigned long long>(end() - begin());
+				Py_ssize_t len = PySequence_Length(sequence.get());
+				for (Py_ssize_t i = 0; i < len; ++i)
+				{
+					auto element = TAKEREF PySequence_Fast(PySequence_Fast_GET_ITEM(sequence.get(), i), nullptr);
+					if (!element || PySequence_Length(element.get()) != 3)
+					{
+						errs() << "Segment entry " << i << " does not follow format (address, offset, size)!\n";
+						return false;
+					}
+
+					unsigned long long address, offset, size;
+					if (!getUnsignedInt(ADDREF PySequence_Fast_GET_ITEM(element.get(), 0), address)
+						|| !getUnsignedInt(ADDREF PySequence_Fast_GET_ITEM(element.get(), 1), offset)
+						|| !getUnsignedInt(ADDREF PySequence_Fast_GET_ITEM(element.get(), 2), size))
+					{
+						errs() << "Segment entry " << i << " does not follow format (address, offset, size)!\n";
+						return false;
+					}
+
+					if (offset > imageSize || size > imageSize - offset)
+					{
+						errs() << "Segment entry " << i << " does not fit inside the executable!\n";
+						return false;
+					}
+
+					Segment seg = { .vbegin = address, .vend = address + size, .fbegin = begin() + offset };
+					segments.push_back(seg);
+				}
+				return true;
+			}
+
+			errs() << "Script " << path << "'s segments is not a sequence!\n";
+			return false;
+		}
+
+		bool cacheStubTargets()
+		{
+			PyErrClearAtEnd clearPyErrAtEndOfFunction;
+
+			auto stubList = TAKEREF PyObject_GetAttrString(module.get(), "stubTargets");
+			if (!stubList)
+			{
+				// Optional: scripts without a stub table answer every query through getStubTarget.
+				return true;
+			}
+
+			if (auto sequence = TAKEREF PySequence_Fast(stubList.get(), nullptr))
+			{
+				Py_ssize_t len = PySequence_Length(sequence.get());
+				bulkStubTargets.reserve(static_cast<size_t>(len));
+				for (Py_ssize_t i = 0; i < len; ++i)
+				{
+					auto element = TAKEREF PySequence_Fast(PySequence_Fast_GET_ITEM(sequence.get(), i), nullptr);
+					if (!element || PySequence_Length(element.get()) != 3)
+					{
+						errs() << "Stub entry " << i << " does not follow format (address, library, name)!\n";
+						return false;
+					}
+
+					unsigned long long address;
+					CachedStubTarget target;
+					PyObject* library = PySequence_Fast_GET_ITEM(element.get(), 1);
+					target.twoLevel = library != Py_None;
+					if (!getUnsignedInt(ADDREF PySequence_Fast_GET_ITEM(element.get(), 0), address)
+						|| (target.twoLevel && !getString(ADDREF library, target.library))
+						|| !getString(ADDREF PySequence_Fast_GET_ITEM(element.get(), 2), target.name))
+					{
+						errs() << "Stub entry " << i << " does not follow format (address, library, name)!\n";
+						return false;
+					}
+
+					if (isMappableKey(address))
+					{
+						bulkStubTargets[address] = move(target);
+					}
+				}
+				return true;
+			}
+
+			errs() << "Script " << path << "'s stubTargets is not a sequence!\n";
+			return false;
+		}
+
 		AutoPyObject getCallable(const string& name)
 		{
 			PyErrClearAtEnd clearPyErrAtEndOfFunction;
@@ -178,6 +317,20 @@ namespace
 	protected:
 		virtual StubTargetQueryResult doGetStubTarget(uint64_t address, string& library, string& symbolName) const override
 		{
+			auto bulkIter = bulkStubTargets.find(address);
+			if (bulkIter != bulkStubTargets.end())
+			{
+				const CachedStubTarget& target = bulkIter->second;
+				symbolName = target.name;
+				if (target.twoLevel)
+				{
+					library = target.library;
+					return ResolvedInTwoLevelNamespace;
+				}
+				return ResolvedInFlatNamespace;
+			}
+
+			PyGILLock gil;
 			PyErrClearAtEnd clearPyErrAtEndOfFunction;
 			AutoPyObject& stubTargetFunc = const_cast<PythonParsedExecutable*>(this)->getStubTarget;
 			auto resultTuple = callObject(stubTargetFunc, TAKEREF PyLong_FromUnsignedLong(address));
@@ -246,6 +399,8 @@ namespace
 	public:
 		static ErrorOr<unique_ptr<PythonParsedExecutable>> create(string path, const uint8_t* begin, const uint8_t* end)
 		{
+			PythonContext::ensureInterpreter();
+			PyGILLock gil;
 			auto moduleOrError = loadModule(path);
 			if (!moduleOrError)
 			{
@@ -286,6 +441,17 @@ namespace
 				return make_error_code(FcdError::Python_ExecutableScriptInitializationError);
 			}
 			
+			// Bulk tables come before the entry points, whose validation maps every address.
+			if (!parsedExecutable->cacheSegments())
+			{
+				return make_error_code(FcdError::Python_ExecutableScriptInitializationError);
+			}
+
+			if (!parsedExecutable->cacheStubTargets())
+			{
+				return make_error_code(FcdError::Python_ExecutableScriptInitializationError);
+			}
+
 			if (!parsedExecutable->cacheEntryPoints())
 			{
 				return make_error_code(FcdError::Python_ExecutableScriptInitializationError);
@@ -301,6 +467,33 @@ namespace
 		
 		virtual const uint8_t* map(uint64_t address) const override
 		{
+			for (auto iter = segments.rbegin(); iter != segments.rend(); iter++)
+			{
+				if (address >= iter->vbegin && address < iter->vend)
+				{
+					return iter->fbegin + (address - iter->vbegin);
+				}
+			}
+
+			if (!isMappableKey(address))
+			{
+				return mapThroughScript(address);
+			}
+
+			auto memoized = fallbackOffsets.find(address);
+			if (memoized != fallbackOffsets.end())
+			{
+				return memoized->second < 0 ? nullptr : begin() + memoized->second;
+			}
+
+			const uint8_t* result = mapThroughScript(address);
+			fallbackOffsets[address] = result == nullptr ? -1 : result - begin();
+			return result;
+		}
+
+		const uint8_t* mapThroughScript(uint64_t address) const
+		{
+			PyGILLock gil;
 			PyErrClearAtEnd clearPyErrAtEndOfFunction;
 			AutoPyObject& mapAddressFunc = const_cast<PythonParsedExecutable*>(this)->mapAddress;
 			auto offset = callObject(mapAddressFunc, TAKEREF PyLong_FromUnsignedLong(address));
@@ -334,7 +527,14 @@ namespace
 			return begin() + intOffset;
 		}
 		
-		virtual ~PythonParsedExecutable() = default;
+		virtual ~PythonParsedExecutable()
+		{
+			// Dropping the last references to the script's objects re-enters the interpreter.
+			PyGILLock gil;
+			mapAddress.reset();
+			getStubTarget.reset();
+			module.reset();
+		}
 	};
 }
 
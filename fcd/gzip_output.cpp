@@ -0,0 +1,130 @@
+//
+// gzip_output.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "gzip_output.h"
+#include "statistics.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Compression.h>
+#include <llvm/Support/Endian.h>
+#include <llvm/Support/Error.h>
+
+#include <cassert>
+#include <cstdlib>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	StatCounter gzipBytesIn("output.gzip.bytes_in");
+	StatCounter gzipBytesOut("output.gzip.bytes_out");
+
+	// Keep at most this many chunks in flight so that a slow disk applies backpressure to the
+	// printer instead of the queue buffering the entire output.
+	const size_t maxQueuedChunks = 16;
+
+	// Writes one complete gzip member holding `chunk`.
+	void writeGzipMember(raw_ostream& os, const string& chunk)
+	{
+		SmallVector<char, 0> zlibData;
+		if (auto error = zlib::compress(StringRef(chunk.data(), chunk.size()), zlibData))
+		{
+			// Deflating into a growable buffer only fails when memory runs out.
+			errs() << "fcd: output compression failed: " << toString(move(error)) << '\n';
+			abort();
+		}
+
+		// zlib::compress produces a zlib stream: a 2-byte header, the raw deflate data that gzip
+		// wants, and a 4-byte Adler-32 trailer. Strip the framing and re-wrap the deflate data
+		// with a gzip header and CRC-32/length trailer.
+		assert(zlibData.size() >= 6);
+		StringRef deflateData(zlibData.data() + 2, zlibData.size() - 6);
+
+		const char header[10] = {'\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, '\xff'};
+		char trailer[8];
+		support::endian::write32le(&trailer[0], zlib::crc32(StringRef(chunk.data(), chunk.size())));
+		support::endian::write32le(&trailer[4], static_cast<uint32_t>(chunk.size()));
+
+		os.write(header, sizeof header);
+		os.write(deflateData.data(), deflateData.size());
+		os.write(trailer, sizeof trailer);
+		gzipBytesIn += chunk.size();
+		gzipBytesOut += sizeof header + deflateData.size() + sizeof trailer;
+	}
+}
+
+bool GzipOutputStream::isAvailable()
+{
+	return zlib::isAvailable();
+}
+
+GzipOutputStream::GzipOutputStream(unique_ptr<raw_ostream> sink, size_t chunkSize)
+: sink(move(sink)), chunkSize(chunkSize), bytesWritten(0), doneWriting(false)
+{
+	// Buffering in the base class would only copy each write once more before it reaches
+	// write_impl; the pending chunk is the buffer.
+	SetUnbuffered();
+	compressor = thread(&GzipOutputStream::compressLoop, this);
+}
+
+GzipOutputStream::~GzipOutputStream()
+{
+	{
+		lock_guard<mutex> lock(queueLock);
+		if (!pendingChunk.empty())
+		{
+			chunkQueue.push_back(move(pendingChunk));
+		}
+		doneWriting = true;
+	}
+	queuePush.notify_one();
+	compressor.join();
+	sink->flush();
+}
+
+void GzipOutputStream::write_impl(const char* buffer, size_t size)
+{
+	pendingChunk.append(buffer, size);
+	bytesWritten += size;
+	if (pendingChunk.size() >= chunkSize)
+	{
+		enqueueChunk();
+	}
+}
+
+void GzipOutputStream::enqueueChunk()
+{
+	unique_lock<mutex> lock(queueLock);
+	queuePop.wait(lock, [&] { return chunkQueue.size() < maxQueuedChunks; });
+	chunkQueue.push_back(move(pendingChunk));
+	pendingChunk.clear();
+	lock.unlock();
+	queuePush.notify_one();
+}
+
+void GzipOutputStream::compressLoop()
+{
+	while (true)
+	{
+		string chunk;
+		{
+			unique_lock<mutex> lock(queueLock);
+			queuePush.wait(lock, [&] { return !chunkQueue.empty() || doneWriting; });
+			if (chunkQueue.empty())
+			{
+				return;
+			}
+			chunk = move(chunkQueue.front());
+			chunkQueue.pop_front();
+		}
+		queuePop.notify_one();
+		writeGzipMember(*sink, chunk);
+	}
+}
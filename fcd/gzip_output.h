@@ -0,0 +1,57 @@
+//
+// gzip_output.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__gzip_output_h
+#define fcd__gzip_output_h
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Wraps an output stream and gzip-compresses everything written to it on a background thread, so
+// that compression overlaps lifting and structuring instead of serializing behind them the way
+// piping through an external compressor does. Writes accumulate into fixed-size chunks that are
+// each emitted as an independent gzip member; concatenated members form a valid gzip file, so the
+// result reads back with zcat. The destructor drains the queue and joins the worker, which makes
+// the stream safe to finish by simply destroying it.
+class GzipOutputStream final : public llvm::raw_ostream
+{
+	std::unique_ptr<llvm::raw_ostream> sink;
+	size_t chunkSize;
+	std::string pendingChunk;
+	uint64_t bytesWritten;
+
+	std::thread compressor;
+	std::mutex queueLock;
+	std::condition_variable queuePush;
+	std::condition_variable queuePop;
+	std::deque<std::string> chunkQueue;
+	bool doneWriting;
+
+	void enqueueChunk();
+	void compressLoop();
+
+	virtual void write_impl(const char* buffer, size_t size) override;
+	virtual uint64_t current_pos() const override { return bytesWritten; }
+
+public:
+	// False when LLVM was built without zlib, in which case the stream cannot be constructed.
+	static bool isAvailable();
+
+	GzipOutputStream(std::unique_ptr<llvm::raw_ostream> sink, size_t chunkSize = 1 << 20);
+	virtual ~GzipOutputStream() override;
+};
+
+#endif /* fcd__gzip_output_h */
@@ -7,6 +7,7 @@
 // license. See LICENSE.md for details.
 //
 
+#include "command_line.h"
 #include "header_decls.h"
 
 #include "CodeGenTypes.h"
@@ -14,6 +15,7 @@
 #include <clang-c/Index.h>
 #include <clang/AST/GlobalDecl.h>
 #include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/Diagnostic.h>
 #include <clang/Basic/Version.h>
 #include <clang/CodeGen/ModuleBuilder.h>
 #include <clang/Frontend/ASTUnit.h>
@@ -23,15 +25,30 @@
 #include <clang/Index/CodegenNameGenerator.h>
 #include <llvm/IR/CallingConv.h>
 #include <llvm/IR/Function.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
 #include <llvm/Support/Path.h>
 #include <llvm/Support/PrettyStackTrace.h>
 
+#include <atomic>
 #include <dlfcn.h>
+#include <thread>
 
 using namespace clang;
 using namespace llvm;
 using namespace std;
 
+// Everything tied to one parsed translation unit. The invocation and diagnostics stick around
+// because the code generator is only created once all units are back on the main thread.
+struct HeaderDeclarations::ParsedUnit
+{
+	std::shared_ptr<CompilerInvocation> invocation;
+	IntrusiveRefCntPtr<DiagnosticsEngine> diags;
+	std::unique_ptr<ASTUnit> tu;
+	std::unique_ptr<CodeGenerator> codeGenerator;
+	std::unique_ptr<CodeGen::CodeGenTypes> typeLowering;
+};
+
 // Default include paths are handled by drivers, so we run a nasty pre-build script to get them.
 extern "C" {
 	extern const char* defaultHeaderSearchPathList[];
@@ -40,6 +57,9 @@ extern "C" {
 
 namespace
 {
+	cl::opt<string> headerCacheDirectory("header-cache", cl::desc("Cache parsed header declarations as AST files in this directory"), cl::value_desc("directory"), whitelist());
+	cl::opt<bool> parallelHeaders("parallel-headers", cl::desc("Parse each header in its own translation unit on worker threads. Use for header sets that cannot be combined into one translation unit"), whitelist());
+
 #define CC_LOOKUP(CLANG_CC, LLVM_CC) [static_cast<size_t>(CLANG_CC)] = llvm::CallingConv::LLVM_CC
 	constexpr llvm::CallingConv::ID ccLookupTable[] = {
 		CC_LOOKUP(CC_C, C),
@@ -93,16 +113,80 @@ namespace
 		}
 		return info.dli_fname;
 	}
+
+	// The cache key covers everything that shapes the parse: the target triple, the search paths and
+	// framework set, the synthesized includer (which embeds the header list and order), and the bytes of
+	// every header that we can resolve directly. Transitively-included files aren't hashed; a stale entry
+	// on that account fails AST validation when it is loaded back and we fall back to parsing.
+	string pathForCachedHeaders(StringRef triple, StringRef includeContent, const vector<string>& searchPath, const vector<string>& headers, const vector<string>& frameworks)
+	{
+		MD5 hash;
+		auto addString = [&](StringRef string)
+		{
+			hash.update(string);
+			uint8_t separator = 0;
+			hash.update(makeArrayRef(&separator, 1));
+		};
+
+		addString(triple);
+		addString(includeContent);
+		for (const auto& dir : searchPath)
+		{
+			addString(dir);
+		}
+		for (const auto& framework : frameworks)
+		{
+			addString(framework);
+		}
+		for (const auto& header : headers)
+		{
+			bool hashed = false;
+			if (auto buffer = MemoryBuffer::getFile(header))
+			{
+				addString((*buffer)->getBuffer());
+				hashed = true;
+			}
+			else
+			{
+				for (const auto& dir : searchPath)
+				{
+					SmallString<128> headerPath(dir);
+					sys::path::append(headerPath, header);
+					if (auto buffer = MemoryBuffer::getFile(headerPath))
+					{
+						addString((*buffer)->getBuffer());
+						hashed = true;
+						break;
+					}
+				}
+			}
+			if (!hashed)
+			{
+				addString(header);
+			}
+		}
+
+		MD5::MD5Result result;
+		hash.final(result);
+		SmallString<32> hashString;
+		MD5::stringifyResult(result, hashString);
+
+		SmallString<128> path(headerCacheDirectory);
+		sys::path::append(path, Twine(hashString) + ".ast");
+		return path.str().str();
+	}
 	
 	class FunctionDeclarationFinder : public RecursiveASTVisitor<FunctionDeclarationFinder>
 	{
 		index::CodegenNameGenerator& mangler;
-		unordered_map<string, FunctionDecl*>& knownImports;
+		HeaderDeclarations::ParsedUnit& unit;
+		unordered_map<string, HeaderDeclarations::Import>& knownImports;
 		unordered_map<uint64_t, HeaderDeclarations::Export>& knownExports;
-		
+		StringSaver& nameSaver;
+
 	public:
-		FunctionDeclarationFinder(index::CodegenNameGenerator& mangler, unordered_map<string, FunctionDecl*>& knownImports, unordered_map<uint64_t, HeaderDeclarations::Export>& knownExports)
-		: mangler(mangler), knownImports(knownImports), knownExports(knownExports)
+		FunctionDeclarationFinder(index::CodegenNameGenerator& mangler, HeaderDeclarations::ParsedUnit& unit, unordered_map<string, HeaderDeclarations::Import>& knownImports, unordered_map<uint64_t, HeaderDeclarations::Export>& knownExports, StringSaver& nameSaver)
+		: mangler(mangler), unit(unit), knownImports(knownImports), knownExports(knownExports), nameSaver(nameSaver)
 		{
 		}
 		
@@ -135,9 +219,10 @@ namespace
 							errs().write_hex(address);
 							errs() << '\n';
 						}
-						exported.name = mangledName;
+						exported.name = nameSaver.save(mangledName);
 						exported.virtualAddress = address;
 						exported.decl = fn;
+						exported.unit = &unit;
 					}
 				}
 				else if (value.startswith(fcdPrefix))
@@ -148,44 +233,38 @@ namespace
 			
 			if (!foundAddress)
 			{
-				knownImports[mangledName] = fn;
+				knownImports[mangledName] = { fn, &unit };
 			}
 			return true;
 		}
 	};
-}
 
-HeaderDeclarations::HeaderDeclarations(llvm::Module& module, unique_ptr<ASTUnit> tu, vector<string> includedFiles)
-: module(module), tu(move(tu)), includedFiles(move(includedFiles))
-{
-}
-
-unique_ptr<HeaderDeclarations> HeaderDeclarations::create(llvm::Module& module, const vector<string>& searchPath, vector<string> headers, const vector<string>& frameworks, raw_ostream& errors)
-{
-	if (headers.size() == 0)
-	{
-		// No headers? No problem.
-		return unique_ptr<HeaderDeclarations>(new HeaderDeclarations(module, nullptr, move(headers)));
-	}
-	
-	PrettyStackTraceString parsingHeaders("Parsing header files");
-	
-	string includeContent;
-	raw_string_ostream includer(includeContent);
-	includer << "#define FCD_ADDRESS(x) __attribute__((annotate(\"fcd.virtualaddress:\" #x)))\n";
-	for (const auto& header : headers)
-	{
-		includer << "#include \"" << header << "\"\n";
-	}
-	includer.flush();
-	
-	if (auto includeBuffer = MemoryBuffer::getMemBuffer(includeContent, "<fcd>"))
+	// Parses one group of headers into its own translation unit. This is safe to run on a worker
+	// thread as long as each call gets its own diagnostics and result; nothing here touches the
+	// output module besides reading its target triple.
+	bool parseHeaderGroup(llvm::Module& module, const vector<string>& searchPath, const vector<string>& headers, const vector<string>& frameworks, raw_ostream& errors, HeaderDeclarations::ParsedUnit& result)
 	{
+		string includeContent;
+		raw_string_ostream includer(includeContent);
+		includer << "#define FCD_ADDRESS(x) __attribute__((annotate(\"fcd.virtualaddress:\" #x)))\n";
+		for (const auto& header : headers)
+		{
+			includer << "#include \"" << header << "\"\n";
+		}
+		includer.flush();
+
+		auto includeBuffer = MemoryBuffer::getMemBuffer(includeContent, "<fcd>");
+		if (!includeBuffer)
+		{
+			errors << "Couldn't create memory buffer from list of includes!\n";
+			return false;
+		}
+
 		auto diagOpts = std::make_unique<DiagnosticOptions>();
 		diagOpts->TabStop = 4;
 		auto diagPrinter = new TextDiagnosticPrinter(errors, diagOpts.get());
 		auto diags = CompilerInstance::createDiagnostics(diagOpts.release(), diagPrinter);
-		
+
 		shared_ptr<CompilerInvocation> clang;
 		{
 			// It might seem lazy to use CreateFromArgs to specify frameworks, but no one has been able to tell me how to
@@ -196,99 +275,223 @@ unique_ptr<HeaderDeclarations> HeaderDeclarations::create(llvm::Module& module,
 				invocationArgs.emplace_back();
 				raw_string_ostream(invocationArgs.back()) << "-F" << *includePathIter;
 			}
-			
+
 			for (const auto& framework : frameworks)
 			{
 				invocationArgs.push_back("-framework");
 				invocationArgs.push_back(framework);
 			}
-			
+
 			invocationArgs.push_back("<fcd>");
-			
+
 			vector<const char*> cInvocationArgs;
 			for (const auto& arg : invocationArgs)
 			{
 				cInvocationArgs.push_back(arg.c_str());
 			}
-			
+
 			auto frameworkArgsArrayRef = makeArrayRef(&*cInvocationArgs.begin(), &*cInvocationArgs.end());
 			clang = createInvocationFromCommandLine(frameworkArgsArrayRef, diags);
 		}
-		
-		if (clang)
+
+		if (!clang)
 		{
-			clang->getLangOpts()->SpellChecking = false;
-			clang->getTargetOpts().Triple = module.getTargetTriple();
-			
-			auto& searchOpts = clang->getHeaderSearchOpts();
-			searchOpts.ResourceDir = getClangResourcesPath();
-			
-			// Search user directories first.
-			for (const auto& includeDir : searchPath)
-			{
-				// FIXME: we're adding the search paths as System, but we really mean to add them to Quoted and disable
-				// diagnostics.
-				searchOpts.AddPath(includeDir, frontend::System, false, true);
-			}
-			
-			// Add system-default search paths.
-			for (const char** includePathIter = defaultHeaderSearchPathList; *includePathIter != nullptr; ++includePathIter)
+			errors << "Couldn't create compiler instance with provided framework arguments!\n";
+			return false;
+		}
+
+		clang->getLangOpts()->SpellChecking = false;
+		clang->getTargetOpts().Triple = module.getTargetTriple();
+
+		auto& searchOpts = clang->getHeaderSearchOpts();
+		searchOpts.ResourceDir = getClangResourcesPath();
+
+		// Search user directories first.
+		for (const auto& includeDir : searchPath)
+		{
+			// FIXME: we're adding the search paths as System, but we really mean to add them to Quoted and disable
+			// diagnostics.
+			searchOpts.AddPath(includeDir, frontend::System, false, true);
+		}
+
+		// Add system-default search paths.
+		for (const char** includePathIter = defaultHeaderSearchPathList; *includePathIter != nullptr; ++includePathIter)
+		{
+			searchOpts.AddPath(*includePathIter, frontend::System, false, true);
+		}
+
+		// Add current directory last.
+		searchOpts.AddPath(".", frontend::System, false, true);
+
+		auto& preprocessorOpts = clang->getPreprocessorOpts();
+		preprocessorOpts.addRemappedFile("<fcd>", includeBuffer.release());
+
+		auto pch = std::make_shared<PCHContainerOperations>();
+
+		unique_ptr<ASTUnit> tu;
+		string cachePath;
+		if (!headerCacheDirectory.empty())
+		{
+			cachePath = pathForCachedHeaders(module.getTargetTriple(), includeContent, searchPath, headers, frameworks);
+			if (sys::fs::exists(cachePath))
 			{
-				searchOpts.AddPath(*includePathIter, frontend::System, false, true);
+				// Deserializing must not pollute the main diagnostics engine: a stale cache entry
+				// fails validation with errors, and we just parse the headers again.
+				IntrusiveRefCntPtr<DiagnosticsEngine> quietDiags = CompilerInstance::createDiagnostics(new DiagnosticOptions, new IgnoringDiagConsumer, true);
+				tu = ASTUnit::LoadFromASTFile(cachePath, pch->getRawReader(), quietDiags, FileSystemOptions());
 			}
-			
-			// Add current directory last.
-			searchOpts.AddPath(".", frontend::System, false, true);
-			
-			auto& preprocessorOpts = clang->getPreprocessorOpts();
-			preprocessorOpts.addRemappedFile("<fcd>", includeBuffer.release());
-			
-			auto pch = std::make_shared<PCHContainerOperations>();
-			auto tu = ASTUnit::LoadFromCompilerInvocation(clang, pch, diags, new FileManager(FileSystemOptions()), true);
-			if (diagPrinter->getNumErrors() == 0)
+		}
+
+		if (!tu)
+		{
+			tu = ASTUnit::LoadFromCompilerInvocation(clang, pch, diags, new FileManager(FileSystemOptions()), true);
+			if (tu && diagPrinter->getNumErrors() == 0 && !cachePath.empty())
 			{
-				if (tu)
+				if (sys::fs::create_directories(headerCacheDirectory))
 				{
-					unique_ptr<HeaderDeclarations> result(new HeaderDeclarations(module, move(tu), move(headers)));
-					if (CodeGenerator* codegen = CreateLLVMCodeGen(*diags, "fcd-headers", clang->getHeaderSearchOpts(), preprocessorOpts, clang->getCodeGenOpts(), module.getContext()))
-					{
-						codegen->Initialize(result->tu->getASTContext());
-						result->codeGenerator.reset(codegen);
-						result->typeLowering.reset(new CodeGen::CodeGenTypes(codegen->CGM()));
-						index::CodegenNameGenerator mangler(result->tu->getASTContext());
-						FunctionDeclarationFinder visitor(mangler, result->knownImports, result->knownExports);
-						visitor.TraverseDecl(result->tu->getASTContext().getTranslationUnitDecl());
-						return result;
-					}
-					else
-					{
-						errors << "Couldn't create Clang code generator!\n";
-					}
+					errors << "Couldn't create header cache directory " << headerCacheDirectory << "!\n";
 				}
-				else
+				else if (tu->Save(cachePath))
 				{
-					errors << "Couldn't parse header files!\n";
-					return nullptr;
+					errors << "Couldn't save parsed headers to " << cachePath << "!\n";
 				}
 			}
-			// no else: we've already printed the reason that we won't parse headers.
 		}
-		else
+
+		if (diagPrinter->getNumErrors() != 0)
 		{
-			errors << "Couldn't create compiler instance with provided framework arguments!\n";
+			// The diagnostics have already explained what went wrong.
+			return false;
+		}
+
+		if (!tu)
+		{
+			errors << "Couldn't parse header files!\n";
+			return false;
+		}
+
+		result.invocation = move(clang);
+		result.diags = diags;
+		result.tu = move(tu);
+		return true;
+	}
+}
+
+HeaderDeclarations::HeaderDeclarations(llvm::Module& module, vector<string> includedFiles)
+: module(module), includedFiles(move(includedFiles)), nameSaver(nameArena)
+{
+}
+
+unique_ptr<HeaderDeclarations> HeaderDeclarations::create(llvm::Module& module, const vector<string>& searchPath, vector<string> headers, const vector<string>& frameworks, raw_ostream& errors)
+{
+	if (headers.size() == 0)
+	{
+		// No headers? No problem.
+		return unique_ptr<HeaderDeclarations>(new HeaderDeclarations(module, move(headers)));
+	}
+
+	PrettyStackTraceString parsingHeaders("Parsing header files");
+
+	// One combined translation unit by default; with --parallel-headers, one per header, parsed on
+	// worker threads. The latter also serves header sets that cannot be merged into a single
+	// translation unit because of macro conflicts.
+	vector<vector<string>> groups;
+	if (parallelHeaders && headers.size() > 1)
+	{
+		for (const auto& header : headers)
+		{
+			groups.push_back({header});
 		}
 	}
 	else
 	{
-		errors << "Couldn't create memory buffer from list of includes!\n";
+		groups.push_back(headers);
 	}
-	return nullptr;
+
+	unique_ptr<HeaderDeclarations> result(new HeaderDeclarations(module, move(headers)));
+	for (size_t i = 0; i < groups.size(); ++i)
+	{
+		result->units.push_back(std::make_unique<ParsedUnit>());
+	}
+
+	bool parsedEverything = true;
+	if (groups.size() == 1)
+	{
+		parsedEverything = parseHeaderGroup(module, searchPath, groups.front(), frameworks, errors, *result->units.front());
+	}
+	else
+	{
+		// Each worker claims the next unparsed group and buffers its diagnostics, so that output
+		// from concurrent parses doesn't interleave.
+		vector<string> workerErrors(groups.size());
+		vector<char> groupParsed(groups.size(), 0);
+		atomic<size_t> nextGroup(0);
+		unsigned jobCount = static_cast<unsigned>(min<size_t>(max(1u, thread::hardware_concurrency()), groups.size()));
+
+		vector<thread> workers;
+		for (unsigned i = 0; i < jobCount; ++i)
+		{
+			workers.emplace_back([&]
+			{
+				for (size_t index = nextGroup++; index < groups.size(); index = nextGroup++)
+				{
+					raw_string_ostream errorStream(workerErrors[index]);
+					groupParsed[index] = parseHeaderGroup(module, searchPath, groups[index], frameworks, errorStream, *result->units[index]);
+					errorStream.flush();
+				}
+			});
+		}
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+
+		for (size_t i = 0; i < groups.size(); ++i)
+		{
+			errors << workerErrors[i];
+			parsedEverything &= groupParsed[i] != 0;
+		}
+	}
+
+	if (!parsedEverything)
+	{
+		return nullptr;
+	}
+
+	// Code generation state is tied to the output module's LLVMContext, which isn't thread-safe;
+	// this part stays on the calling thread.
+	for (auto& unitPointer : result->units)
+	{
+		ParsedUnit& unit = *unitPointer;
+		CodeGenerator* codegen = CreateLLVMCodeGen(*unit.diags, "fcd-headers", unit.invocation->getHeaderSearchOpts(), unit.invocation->getPreprocessorOpts(), unit.invocation->getCodeGenOpts(), module.getContext());
+		if (codegen == nullptr)
+		{
+			errors << "Couldn't create Clang code generator!\n";
+			return nullptr;
+		}
+		codegen->Initialize(unit.tu->getASTContext());
+		unit.codeGenerator.reset(codegen);
+		unit.typeLowering.reset(new CodeGen::CodeGenTypes(codegen->CGM()));
+		index::CodegenNameGenerator mangler(unit.tu->getASTContext());
+		FunctionDeclarationFinder visitor(mangler, unit, result->knownImports, result->knownExports, result->nameSaver);
+		visitor.TraverseDecl(unit.tu->getASTContext().getTranslationUnitDecl());
+	}
+	return result;
 }
 
-Function* HeaderDeclarations::prototypeForDeclaration(FunctionDecl& decl)
+Function* HeaderDeclarations::prototypeForDeclaration(ParsedUnit& unit, FunctionDecl& decl)
 {
-	llvm::FunctionType* functionType = typeLowering->GetFunctionType(GlobalDecl(&decl));
-	
+	// Canonical types are uniqued per ASTContext, so the canonical signature pointer identifies the
+	// lowered type. Binaries tend to import the same few hundred libc signatures across tens of
+	// thousands of call sites; pay for CodeGenTypes conversion once per distinct signature.
+	const clang::Type* signature = decl.getType().getCanonicalType().getTypePtr();
+	llvm::FunctionType*& functionType = signatureTypes[signature];
+	if (functionType == nullptr)
+	{
+		functionType = unit.typeLowering->GetFunctionType(GlobalDecl(&decl));
+	}
+
 	// Cheating and bringing in CodeGenTypes is fairly cheap and reliable. Unfortunately, CodeGenModules, which is
 	// responsible for attribute translation, is a pretty big class with lots of dependencies.
 	// That said, while most attributes have a lot of value for compilation, they don't bring that much in for
@@ -342,8 +545,8 @@ Function* HeaderDeclarations::prototypeForImportName(const string& importName)
 	{
 		return nullptr;
 	}
-	
-	return prototypeForDeclaration(*iter->second);
+
+	return prototypeForDeclaration(*iter->second.unit, *iter->second.decl);
 }
 
 Function* HeaderDeclarations::prototypeForAddress(uint64_t address)
@@ -353,8 +556,8 @@ Function* HeaderDeclarations::prototypeForAddress(uint64_t address)
 	{
 		return nullptr;
 	}
-	
-	return prototypeForDeclaration(*iter->second.decl);
+
+	return prototypeForDeclaration(*iter->second.unit, *iter->second.decl);
 }
 
 vector<uint64_t> HeaderDeclarations::getVisibleEntryPoints() const
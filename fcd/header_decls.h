@@ -16,7 +16,9 @@
 #include <llvm/IR/Module.h>
 #include <llvm/IR/Type.h>
 #include <llvm/Pass.h>
+#include <llvm/Support/Allocator.h>
 #include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/StringSaver.h>
 
 #include <memory>
 #include <string>
@@ -25,37 +27,52 @@
 
 namespace clang
 {
-	class ASTUnit;
-	class CodeGenerator;
-	namespace CodeGen
-	{
-		// Header for CodeGenTypes pulled from Clang source (nasty!)
-		class CodeGenTypes;
-	}
 	class FunctionDecl;
+	class Type;
+}
+
+namespace llvm
+{
+	class FunctionType;
 }
 
 class HeaderDeclarations : public EntryPointProvider
 {
 public:
+	// One parsed translation unit along with its code generation state. There is normally a single
+	// combined unit for every header; --parallel-headers parses one unit per header instead.
+	struct ParsedUnit;
+
 	struct Export : public SymbolInfo
 	{
 		clang::FunctionDecl* decl;
+		ParsedUnit* unit;
 	};
-	
+
+	struct Import
+	{
+		clang::FunctionDecl* decl;
+		ParsedUnit* unit;
+	};
+
 private:
 	llvm::Module& module;
-	std::unique_ptr<clang::ASTUnit> tu;
-	std::unique_ptr<clang::CodeGenerator> codeGenerator;
-	std::unique_ptr<clang::CodeGen::CodeGenTypes> typeLowering;
-	
+	std::vector<std::unique_ptr<ParsedUnit>> units;
+
 	std::vector<std::string> includedFiles;
-	std::unordered_map<std::string, clang::FunctionDecl*> knownImports;
+	std::unordered_map<std::string, Import> knownImports;
 	std::unordered_map<uint64_t, Export> knownExports;
-	
-	HeaderDeclarations(llvm::Module& module, std::unique_ptr<clang::ASTUnit> tu, std::vector<std::string> includedFiles);
-	
-	llvm::Function* prototypeForDeclaration(clang::FunctionDecl& decl);
+	// Owns the bytes behind Export::name, since SymbolInfo names are non-owning views.
+	llvm::BumpPtrAllocator nameArena;
+	llvm::StringSaver nameSaver;
+	// Lowered LLVM type for each distinct canonical signature, so that repeated prototype queries
+	// don't re-run CodeGenTypes conversion. (Canonical types from different units never share an
+	// address, so entries from multiple ASTContexts can live in the same map.)
+	std::unordered_map<const clang::Type*, llvm::FunctionType*> signatureTypes;
+
+	HeaderDeclarations(llvm::Module& module, std::vector<std::string> includedFiles);
+
+	llvm::Function* prototypeForDeclaration(ParsedUnit& unit, clang::FunctionDecl& decl);
 	
 public:
 	static std::unique_ptr<HeaderDeclarations> create(llvm::Module& module, const std::vector<std::string>& searchPath, std::vector<std::string> headers, const std::vector<std::string>& frameworks, llvm::raw_ostream& errors);
@@ -9,26 +9,39 @@
 
 #include "ast_passes.h"
 #include "command_line.h"
+#include "cpu_affinity.h"
 #include "errors.h"
 #include "executable.h"
+#include "gzip_output.h"
 #include "header_decls.h"
 #include "main.h"
 #include "metadata.h"
 #include "passes.h"
 #include "params_registry.h"
+#include "phase_timing.h"
+#include "prologue_scanner.h"
 #include "python_context.h"
+#include "statistics.h"
 #include "translation_context.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallPtrSet.h>
+#include <llvm/ADT/StringMap.h>
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/BasicAliasAnalysis.h>
 #include <llvm/Analysis/Passes.h>
 #include <llvm/Analysis/ScopedNoAliasAA.h>
 #include <llvm/Analysis/TypeBasedAliasAnalysis.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/IR/Constants.h>
 #include <llvm/IR/Instructions.h>
 #include <llvm/IR/LegacyPassManager.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Verifier.h>
 #include <llvm/IRReader/IRReader.h>
+#include <llvm/Linker/Linker.h>
+#include <llvm/Support/MD5.h>
 #include <llvm/Support/FileSystem.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/Path.h>
@@ -38,19 +51,32 @@
 #include <llvm/Support/Signals.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
 #include <llvm/Transforms/Scalar.h>
 #include <llvm/Transforms/Scalar/GVN.h>
+#include <llvm/Transforms/Utils/FunctionComparator.h>
 
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <list>
 #include <map>
 #include <memory>
+#include <thread>
 #include <unordered_map>
 #include <sstream>
 #include <string>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
 using namespace llvm;
 using namespace std;
 
@@ -64,19 +90,59 @@ raw_ostream& llvm_errs()
 
 namespace
 {
-	cl::opt<string> inputFile(cl::Positional, cl::desc("<input program>"), cl::Required, whitelist());
+	cl::opt<string> inputFile(cl::Positional, cl::desc("<input program>"), whitelist());
 	cl::list<unsigned long long> additionalEntryPoints("other-entry", cl::desc("Add entry point from virtual address (can be used multiple times)"), cl::CommaSeparated, whitelist());
+	cl::opt<string> entryPointFile("entry-list", cl::desc("File of entry point virtual addresses (hex or decimal), one per line; same effect as --other-entry for each, without going through option parsing"), cl::value_desc("filename"), whitelist());
 	cl::list<bool> partialDisassembly("partial", cl::desc("Only decompile functions specified with --other-entry"), whitelist());
 	cl::list<bool> inputIsModule("module-in", cl::desc("Input file is a LLVM module"), whitelist());
 	cl::list<bool> outputIsModule("module-out", cl::desc("Output LLVM module"), whitelist());
-	
+	cl::opt<bool> emitBitcode("emit-bc", cl::desc("Write --module-out output as LLVM bitcode instead of textual IR; --module-in accepts both"), whitelist());
+
+	cl::opt<unsigned> jobCount("jobs", cl::desc("Number of worker threads used for function-parallel phases (0 = one per hardware thread)"), cl::init(1), whitelist());
+	cl::opt<string> hotnessProfile("hotness-profile", cl::desc("File of \"address weight\" lines (addresses in hex or decimal); lift the heaviest functions first"), cl::value_desc("filename"), whitelist());
+	cl::opt<unsigned> liftBudget("budget", cl::desc("Stop chasing newly discovered functions after this many seconds and emit what is done (0 = no limit)"), cl::init(0), whitelist());
+	cl::opt<unsigned> shardCount("shards", cl::desc("Partition the lifted call graph into this many modules, optimized and printed independently in parallel; calls that cross a shard lose some analysis precision (0 = disabled)"), cl::init(0), whitelist());
+	cl::opt<string> irCacheDirectory("ir-cache", cl::desc("Cache annotated and optimized modules in this directory, keyed by everything they depend on, and reuse them on later runs"), cl::value_desc("directory"), whitelist());
+	cl::opt<string> resumeDirectory("resume", cl::desc("Checkpoint the module in this directory after each pipeline phase and, when rerun, continue from the last completed phase"), cl::value_desc("directory"), whitelist());
+	cl::opt<string> prototypeCacheFile("prototype-cache", cl::desc("Header file used as a recovered-prototype cache: parsed like a --header file when present, rewritten after optimization with the prototypes this run recovered"), cl::value_desc("filename"), whitelist());
+
+	enum VerifyMode
+	{
+		VerifyDefault,
+		VerifyNone,
+		VerifyChanged,
+		VerifyFull,
+	};
+
+	cl::opt<VerifyMode> verifyMode("verify", cl::desc("Module verification after the optimization pipeline (defaults to full in debug builds, none otherwise)"), cl::values(
+		clEnumValN(VerifyNone, "none", "no verification"),
+		clEnumValN(VerifyChanged, "changed", "verify only functions the pipeline appears to have changed"),
+		clEnumValN(VerifyFull, "full", "verify the whole module")), cl::init(VerifyDefault), whitelist());
+	cl::opt<string> outputFile("o", cl::desc("Write output to this file instead of standard output"), cl::value_desc("filename"), whitelist());
+	cl::opt<string> emitAst("emit-ast", cl::desc("Also write a compact binary serialization of the final AST to this file, so tools can consume the structure without re-parsing the pseudocode"), cl::value_desc("filename"), whitelist());
+	cl::opt<bool> prototypesFirst("prototypes-first", cl::desc("Emit the includes and every function prototype before structuring the first body, so consumers that only need declarations can stop reading early"), whitelist());
+	cl::opt<unsigned> outputBufferSize("output-buffer-size", cl::desc("Buffer size for the output file, in KiB (0 = stream default)"), cl::init(4096), whitelist());
+	cl::opt<bool> compressOutput("gzip", cl::desc("Compress the output file with gzip on a background thread; requires -o"), whitelist());
+	cl::opt<bool> batchMode("batch", cl::desc("Treat <input program> as a text file listing executables to decompile in a single process, one path per line"), whitelist());
+	cl::opt<bool> daemonMode("daemon", cl::desc("Stay resident and serve \"<path> [entry address...]\" decompile requests from standard input"), whitelist());
+	cl::opt<unsigned> daemonCacheSize("daemon-cache-size", cl::desc("Number of recently used binaries that daemon mode keeps warm"), cl::init(16), whitelist());
+	cl::opt<bool> isolateInputs("isolate", cl::desc("In batch mode, decompile each input in a forked worker process so that a crash or hang only skips that input"), whitelist());
+	cl::opt<unsigned> isolateTimeout("isolate-timeout", cl::desc("Seconds an isolated worker may run before it is killed and its input skipped (0 = no limit)"), cl::init(900), whitelist());
+
 	cl::list<string> additionalPasses("opt", cl::desc("Insert LLVM optimization pass; a pass name ending in .py is interpreted as a Python script. Requires default pass pipeline."), whitelist());
 	cl::opt<string> customPassPipeline("opt-pipeline", cl::desc("Customize pass pipeline. Empty string lets you order passes through $EDITOR; otherwise, must be a whitespace-separated list of passes."), cl::init("default"), whitelist());
+	cl::opt<string> pipelinePreset("pipeline", cl::desc("Pipeline preset: \"fast\" skips the most expensive optimization and structuring stages for quick triage; \"default\" and \"thorough\" are today's full pipeline. Only applies to the default pass pipeline."), cl::init("default"), whitelist());
+
+	bool isFastPipeline()
+	{
+		return pipelinePreset == "fast";
+	}
 	
 	cl::list<string> headers("header", cl::desc("Path of a header file to parse for function declarations. Can be specified multiple times"), whitelist());
 	cl::list<string> frameworks("framework", cl::desc("Path of an Apple framework that fcd should use for declarations. Can be specified multiple times"), whitelist());
 	cl::list<string> headerSearchPath("I", cl::desc("Additional directory to search headers in. Can be specified multiple times"), whitelist());
 	
+	cl::alias jobCountAlias("j", cl::desc("Alias for --jobs"), cl::aliasopt(jobCount), whitelist());
 	cl::alias additionalEntryPointsAlias("e", cl::desc("Alias for --other-entry"), cl::aliasopt(additionalEntryPoints), whitelist());
 	cl::alias partialDisassemblyAlias("p", cl::desc("Alias for --partial"), cl::aliasopt(partialDisassembly), whitelist());
 	cl::alias additionalPassesAlias("O", cl::desc("Alias for --opt"), cl::aliasopt(additionalPasses), whitelist());
@@ -114,529 +180,2289 @@ namespace
 		return optCount<moduleOutCount>(outputIsModule);
 	}
 	
-	void pruneOptionList(StringMap<cl::Option*>& list)
+	inline unsigned effectiveJobCount()
 	{
-		for (auto& pair : list)
+		unsigned jobs = jobCount;
+		if (jobs == 0)
 		{
-			if (!whitelist::isWhitelisted(*pair.second))
-			{
-				pair.second->setHiddenFlag(cl::ReallyHidden);
-			}
+			jobs = thread::hardware_concurrency();
 		}
+		return jobs == 0 ? 1 : jobs;
 	}
-	
-	template<typename T>
-	string errorOf(const ErrorOr<T>& error)
+
+	// Entry lists scraped from symbol tables can reach tens of thousands of addresses, and
+	// isEntryPoint is consulted for every function discovered during lifting; keep the entries
+	// in a sorted index instead of scanning the cl::list every time. Rebuilt whenever the entry
+	// set changes (daemon requests repopulate it per line).
+	vector<uint64_t> entryPointIndex;
+
+	void rebuildEntryPointIndex()
 	{
-		return error.getError().message();
+		entryPointIndex.assign(additionalEntryPoints.begin(), additionalEntryPoints.end());
+		sort(entryPointIndex.begin(), entryPointIndex.end());
+		entryPointIndex.erase(unique(entryPointIndex.begin(), entryPointIndex.end()), entryPointIndex.end());
 	}
-	
-	template<typename TAction>
-	size_t forEachCall(Function* callee, unsigned stringArgumentIndex, TAction&& action)
+
+	bool loadEntryPointFile(const string& program)
 	{
-		size_t count = 0;
-		for (Use& use : callee->uses())
+		if (entryPointFile.getNumOccurrences() > 0)
 		{
-			if (auto call = dyn_cast<CallInst>(use.getUser()))
+			ifstream entries(entryPointFile);
+			if (!entries)
 			{
-				unique_ptr<Instruction> eraseIfNecessary;
-				Value* operand = call->getOperand(stringArgumentIndex);
-				if (auto constant = dyn_cast<ConstantExpr>(operand))
+				cerr << program << ": can't read entry list " << entryPointFile << endl;
+				return false;
+			}
+
+			string token;
+			while (entries >> token)
+			{
+				if (token[0] == '#')
 				{
-					eraseIfNecessary.reset(constant->getAsInstruction());
-					operand = eraseIfNecessary.get();
+					getline(entries, token);
+					continue;
 				}
-				
-				if (auto gep = dyn_cast<GetElementPtrInst>(operand))
-				if (auto global = dyn_cast<GlobalVariable>(gep->getOperand(0)))
-				if (auto dataArray = dyn_cast<ConstantDataArray>(global->getInitializer()))
+
+				char* addressEnd = nullptr;
+				unsigned long long address = strtoull(token.c_str(), &addressEnd, 0);
+				if (addressEnd == token.c_str() || *addressEnd != '\0')
 				{
-					action(dataArray->getAsString().str());
-					count++;
+					cerr << program << ": bad entry address in " << entryPointFile << ": " << token << endl;
+					return false;
 				}
+				additionalEntryPoints.push_back(address);
 			}
 		}
-		return count;
+		return true;
 	}
-	
-	bool refillEntryPoints(const TranslationContext& transl, const EntryPointRepository& entryPoints, map<uint64_t, SymbolInfo>& toVisit, size_t iterations)
+
+	StatCounter stubsResolved("lifter.stubs.resolved");
+
+	string defaultFunctionName(uint64_t address)
+	{
+		char defaultName[] = "func_0000000000000000";
+		snprintf(defaultName, sizeof defaultName, "func_%" PRIx64, address);
+		return defaultName;
+	}
+
+	// Renders the LLVM types that argument recovery produces (integers, pointers, void) as C type
+	// names. Anything fancier fails the render and keeps its function out of the prototype cache.
+	bool renderCTypeName(Type* type, string& into)
+	{
+		if (type->isVoidTy())
+		{
+			into = "void";
+			return true;
+		}
+		if (type->isPointerTy())
+		{
+			into = "void*";
+			return true;
+		}
+		if (auto intType = dyn_cast<IntegerType>(type))
+		{
+			unsigned width = intType->getBitWidth();
+			if (width == 1 || width == 8 || width == 16 || width == 32 || width == 64)
+			{
+				raw_string_ostream(into) << "uint" << max(width, 8u) << "_t";
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool isCIdentifier(StringRef name)
 	{
-		if (isExclusiveDisassembly() || (isPartialDisassembly() && iterations > 1))
+		if (name.empty() || (!isalpha(name[0]) && name[0] != '_'))
 		{
 			return false;
 		}
-		
-		for (uint64_t entryPoint : transl.getDiscoveredEntryPoints())
+		for (char c : name)
 		{
-			if (auto symbolInfo = entryPoints.getInfo(entryPoint))
+			if (!isalnum(c) && c != '_')
 			{
-				toVisit.insert({entryPoint, *symbolInfo});
+				return false;
 			}
 		}
-		return !toVisit.empty();
+		return true;
 	}
-	
-	class Main
+
+	// Rewrites the --prototype-cache header with the prototypes that parameter recovery settled on.
+	// FCD_ADDRESS binds each declaration to its virtual address, so the next run's header pass turns
+	// parameter recovery for these functions into a lookup.
+	void exportRecoveredPrototypes(Module& module, const string& path)
 	{
-		int argc;
-		char** argv;
-	
-		LLVMContext llvm;
-		PythonContext python;
-		vector<Pass*> optimizeAndTransformPasses;
-		
-		static void aliasAnalysisHooks(Pass& pass, Function& fn, AAResults& aar)
+		error_code error;
+		raw_fd_ostream out(path, error, sys::fs::F_None);
+		if (error)
 		{
-			if (auto prgmem = pass.getAnalysisIfAvailable<ProgramMemoryAAWrapperPass>())
+			errs() << "couldn't write prototype cache " << path << ": " << error.message() << '\n';
+			return;
+		}
+
+		out << "// Recovered prototype cache generated by fcd; reparsed as a header on the next run.\n";
+		out << "#include <stdint.h>\n\n";
+		for (Function& fn : module)
+		{
+			ConstantInt* virtualAddress = md::getVirtualAddress(fn);
+			if (fn.isDeclaration() || md::isStub(fn) || virtualAddress == nullptr)
 			{
-				aar.addAAResult(prgmem->getResult());
+				continue;
 			}
-			if (auto params = pass.getAnalysisIfAvailable<ParameterRegistry>())
+
+			FunctionType* fnType = fn.getFunctionType();
+			string returnType;
+			if (fnType->isVarArg() || !isCIdentifier(fn.getName()) || !renderCTypeName(fnType->getReturnType(), returnType))
 			{
-				aar.addAAResult(params->getAAResult());
+				continue;
+			}
+
+			string parameters;
+			bool renderable = true;
+			for (Type* paramType : fnType->params())
+			{
+				string parameter;
+				renderable &= renderCTypeName(paramType, parameter);
+				if (!renderable)
+				{
+					break;
+				}
+				if (!parameters.empty())
+				{
+					parameters += ", ";
+				}
+				parameters += parameter;
+			}
+			if (!renderable)
+			{
+				continue;
 			}
+
+			out << "FCD_ADDRESS(0x";
+			out.write_hex(virtualAddress->getLimitedValue());
+			out << ") " << returnType << ' ' << fn.getName() << '(' << (parameters.empty() ? "void" : parameters) << ");\n";
 		}
-	
-		static legacy::PassManager createBasePassManager()
+	}
+
+	// Serializes --module-out output. Bitcode and textual IR carry the same information,
+	// including the fcd.* metadata, but multi-gigabyte modules write and re-parse much faster
+	// as bitcode; parseIRFile on the --module-in side accepts either format.
+	void writeModuleOutput(Module& module, raw_ostream& output)
+	{
+		if (emitBitcode)
 		{
-			legacy::PassManager pm;
-			pm.add(createTypeBasedAAWrapperPass());
-			pm.add(createScopedNoAliasAAWrapperPass());
-			pm.add(createBasicAAWrapperPass());
-			pm.add(createProgramMemoryAliasAnalysis());
-			return pm;
+			WriteBitcodeToFile(&module, output);
 		}
-		
-		vector<Pass*> createPassesFromList(const vector<string>& passNames)
+		else
 		{
-			vector<Pass*> result;
-			PassRegistry* pr = PassRegistry::getPassRegistry();
-			for (string passName : passNames)
+			module.print(output, nullptr);
+		}
+	}
+
+	// Parses the --hotness-profile file ("address weight" per line) the first time it's needed.
+	// Repeated addresses accumulate, so raw perf sample dumps work without preprocessing.
+	const unordered_map<uint64_t, double>& hotnessWeights()
+	{
+		static unordered_map<uint64_t, double> weights;
+		static bool loaded = false;
+		if (!loaded)
+		{
+			loaded = true;
+			if (hotnessProfile.getNumOccurrences() > 0)
 			{
-				auto begin = passName.begin();
-				while (begin != passName.end())
-				{
-					if (isspace(*begin))
-					{
-						++begin;
-					}
-					else
-					{
-						break;
-					}
-				}
-				passName.erase(passName.begin(), begin);
-				
-				auto rbegin = passName.rbegin();
-				while (rbegin != passName.rend())
+				ifstream profile(hotnessProfile);
+				string addressText;
+				double weight;
+				while (profile >> addressText >> weight)
 				{
-					if (isspace(*rbegin))
-					{
-						++rbegin;
-					}
-					else
-					{
-						break;
-					}
+					weights[strtoull(addressText.c_str(), nullptr, 0)] += weight;
 				}
-				passName.erase(rbegin.base(), passName.end());
-				
-				if (passName.size() > 0 && passName[0] != '#')
+			}
+		}
+		return weights;
+	}
+
+	double hotnessOf(uint64_t address)
+	{
+		const auto& weights = hotnessWeights();
+		auto iter = weights.find(address);
+		return iter == weights.end() ? 0 : iter->second;
+	}
+
+	// Drains `toVisit` into a vector ordered hottest-first. Without a profile, the map's
+	// ascending address order is kept as-is; ties keep it too, since the sort is stable.
+	vector<pair<uint64_t, SymbolInfo>> takeByDescendingHotness(map<uint64_t, SymbolInfo>& toVisit)
+	{
+		vector<pair<uint64_t, SymbolInfo>> batch(toVisit.begin(), toVisit.end());
+		toVisit.clear();
+		if (!hotnessWeights().empty())
+		{
+			stable_sort(batch.begin(), batch.end(), [](const pair<uint64_t, SymbolInfo>& a, const pair<uint64_t, SymbolInfo>& b) {
+				return hotnessOf(a.first) > hotnessOf(b.first);
+			});
+		}
+		return batch;
+	}
+
+	// True when --budget is set and exhausted. Lifting then stops chasing newly discovered
+	// callees, but everything explicitly requested or already lifted still goes through the
+	// rest of the pipeline.
+	bool liftingBudgetExpired(chrono::steady_clock::time_point liftingStart)
+	{
+		if (liftBudget == 0)
+		{
+			return false;
+		}
+		return chrono::steady_clock::now() - liftingStart >= chrono::seconds(liftBudget);
+	}
+
+	// Structural fingerprint for --verify=changed: hashes opcodes, operand counts and the local
+	// def-use shape of a function, using only context-independent data so that fingerprints
+	// survive the bitcode round-trips of the parallel pipeline. A pipeline bug that reproduces
+	// this structure exactly goes unnoticed, which is the documented trade of the fast mode;
+	// --verify=full remains the thorough one.
+	uint64_t functionFingerprint(const Function& fn)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;
+		auto mix = [&](uint64_t value)
+		{
+			hash = (hash ^ value) * 0x100000001b3ull;
+		};
+
+		DenseMap<const Value*, uint64_t> localIndex;
+		uint64_t nextIndex = 0;
+		for (const Argument& arg : fn.args())
+		{
+			localIndex[&arg] = nextIndex;
+			nextIndex++;
+		}
+		for (const BasicBlock& bb : fn)
+		{
+			for (const Instruction& inst : bb)
+			{
+				localIndex[&inst] = nextIndex;
+				nextIndex++;
+			}
+		}
+
+		for (const BasicBlock& bb : fn)
+		{
+			mix(bb.size());
+			for (const Instruction& inst : bb)
+			{
+				mix(inst.getOpcode());
+				mix(inst.getNumOperands());
+				for (const Value* operand : inst.operands())
 				{
-					auto ext = sys::path::extension(passName);
-					if (ext == ".py" || ext == ".pyc" || ext == ".pyo")
+					auto iter = localIndex.find(operand);
+					if (iter != localIndex.end())
 					{
-						if (auto passOrError = python.createPass(passName))
-						{
-							result.push_back(passOrError.get());
-						}
-						else
-						{
-							cerr << getProgramName() << ": couldn't load " << passName << ": " << errorOf(passOrError) << endl;
-							return vector<Pass*>();
-						}
+						mix(iter->second);
 					}
-					else if (const PassInfo* pi = pr->getPassInfo(passName))
+					else if (auto constant = dyn_cast<ConstantInt>(operand))
 					{
-						result.push_back(pi->createPass());
+						mix(constant->getLimitedValue());
 					}
 					else
 					{
-						cerr << getProgramName() << ": couldn't identify pass " << passName << endl;
-						return vector<Pass*>();
+						mix(operand->getValueID());
 					}
 				}
 			}
-			
-			if (result.size() == 0)
+		}
+		return hash;
+	}
+
+	// Splits the module's defined functions into `shards` groups of roughly equal instruction
+	// counts for --shards. Functions linked by direct calls stay together when possible: connected
+	// components of the direct call graph go heaviest-first onto the lightest shard so far, and
+	// only components too big for their fair share of the module are broken apart, since keeping
+	// those whole would defeat the balancing. Returns one shard index per defined function, in
+	// module order (which bitcode round-trips preserve).
+	vector<unsigned> partitionIntoShards(Module& module, unsigned shards)
+	{
+		vector<Function*> defined;
+		unordered_map<const Function*, size_t> indexOf;
+		for (Function& fn : module)
+		{
+			if (!fn.isDeclaration())
 			{
-				errs() << getProgramName() << ": empty pass list\n";
+				indexOf[&fn] = defined.size();
+				defined.push_back(&fn);
 			}
-			return result;
 		}
-	
-		vector<Pass*> interactivelyEditPassPipeline(const string& editor, const vector<string>& basePasses)
+
+		vector<size_t> leader(defined.size());
+		for (size_t i = 0; i < leader.size(); ++i)
 		{
-			int fd;
-			SmallVector<char, 100> path;
-			if (auto errorCode = sys::fs::createTemporaryFile("fcd-pass-pipeline", "txt", fd, path))
+			leader[i] = i;
+		}
+		auto findLeader = [&](size_t index)
+		{
+			while (leader[index] != index)
 			{
-				errs() << getProgramName() << ": can't open temporary file for editing: " << errorCode.message() << "\n";
-				return vector<Pass*>();
+				leader[index] = leader[leader[index]];
+				index = leader[index];
 			}
-			
-			raw_fd_ostream passListOs(fd, true);
-			passListOs << "# Enter the name of the LLVM or fcd passes that you want to run on the module.\n";
-			passListOs << "# Files starting with a # symbol are ignored.\n";
-			passListOs << "# Names ending with .py are assumed to be Python scripts implementing passes.\n";
-			for (const string& passName : basePasses)
+			return index;
+		};
+
+		vector<size_t> weight(defined.size());
+		for (size_t i = 0; i < defined.size(); ++i)
+		{
+			for (BasicBlock& bb : *defined[i])
 			{
-				passListOs << passName << '\n';
+				weight[i] += bb.size();
+				for (Instruction& inst : bb)
+				{
+					if (auto call = dyn_cast<CallInst>(&inst))
+					if (Function* callee = call->getCalledFunction())
+					{
+						auto calleeIter = indexOf.find(callee);
+						if (calleeIter != indexOf.end())
+						{
+							leader[findLeader(i)] = findLeader(calleeIter->second);
+						}
+					}
+				}
 			}
-			passListOs.flush();
-			
-			// shell escape temporary path
-			string escapedPath;
-			escapedPath.reserve(path.size());
-			for (char c : path)
+		}
+
+		// Keyed by leader index rather than hash so that the grouping is deterministic.
+		size_t totalWeight = 0;
+		map<size_t, vector<size_t>> components;
+		for (size_t i = 0; i < defined.size(); ++i)
+		{
+			totalWeight += weight[i];
+			components[findLeader(i)].push_back(i);
+		}
+
+		size_t fairShare = totalWeight / shards + 1;
+		vector<pair<size_t, vector<size_t>>> groups;
+		for (auto& component : components)
+		{
+			size_t componentWeight = 0;
+			for (size_t member : component.second)
 			{
-				if (c == '\'' || c == '\\')
+				componentWeight += weight[member];
+			}
+			if (componentWeight > fairShare)
+			{
+				for (size_t member : component.second)
 				{
-					escapedPath.push_back('\\');
+					groups.emplace_back(weight[member], vector<size_t>(1, member));
 				}
-				escapedPath.push_back(c);
 			}
-			
-			string editCommand;
-			raw_string_ostream(editCommand) << editor << " '" << escapedPath << "'";
-			if (int errorCode = system(editCommand.c_str()))
+			else
 			{
-				errs() << getProgramName() << ": interactive pass pipeline: editor returned status code " << errorCode << '\n';
-				return vector<Pass*>();
+				groups.emplace_back(componentWeight, move(component.second));
+			}
+		}
+		stable_sort(groups.begin(), groups.end(), [](const pair<size_t, vector<size_t>>& a, const pair<size_t, vector<size_t>>& b) {
+			return a.first > b.first;
+		});
+
+		vector<size_t> shardWeight(shards);
+		vector<unsigned> shardOfDefined(defined.size());
+		for (const auto& group : groups)
+		{
+			unsigned lightest = 0;
+			for (unsigned i = 1; i < shards; ++i)
+			{
+				if (shardWeight[i] < shardWeight[lightest])
+				{
+					lightest = i;
+				}
+			}
+			shardWeight[lightest] += group.first;
+			for (size_t member : group.second)
+			{
+				shardOfDefined[member] = lightest;
+			}
+		}
+		return shardOfDefined;
+	}
+
+	// The lifting cache key covers everything that influences the annotated module: the input bytes, the
+	// requested entry points, and the partial/exclusive disassembly mode. Anything else (passes, headers)
+	// only affects later phases.
+	void hashLiftingInputs(MD5& hasher, const uint8_t* begin, const uint8_t* end)
+	{
+		hasher.update(makeArrayRef(begin, end));
+
+		vector<uint64_t> entries(entryPointIndex);
+		entries.push_back(static_cast<uint64_t>(partialOptCount()));
+		for (uint64_t entry : entries)
+		{
+			uint8_t bytes[sizeof entry];
+			memcpy(bytes, &entry, sizeof entry);
+			hasher.update(bytes);
+		}
+	}
+
+	string irCachePathWithExtension(MD5& hasher, const Twine& extension)
+	{
+		MD5::MD5Result result;
+		hasher.final(result);
+		SmallString<32> hash;
+		MD5::stringifyResult(result, hash);
+
+		SmallString<128> path(irCacheDirectory);
+		sys::path::append(path, Twine(hash) + extension);
+		return path.str().str();
+	}
+
+	string irCachePathForInput(const uint8_t* begin, const uint8_t* end)
+	{
+		MD5 hasher;
+		hashLiftingInputs(hasher, begin, end);
+		return irCachePathWithExtension(hasher, ".bc");
+	}
+
+	// Checkpoint file for one phase of one input in the --resume directory. Unlike the IR cache,
+	// names are human-visible and not keyed by the inputs: the checkpoints exist to survive a
+	// crashed or preempted run of the same job, and it's the user's job to clear them when the
+	// binary or the options change.
+	string resumePathForPhase(const string& moduleName, const char* phase)
+	{
+		SmallString<128> path(resumeDirectory);
+		sys::path::append(path, moduleName + "." + phase + ".bc");
+		return path.str().str();
+	}
+
+	// Second cache tier: the optimized module. On top of the lifting inputs, the key covers everything
+	// that influences the optimization phases - header declarations (hashed by content, so editing a
+	// header invalidates the artifact), framework and include paths, and the pass pipeline including
+	// Python passes. Invalidation is per-module rather than per-function: the pipeline and the parameter
+	// registry are interprocedural, so a stale callee summary could poison any caller.
+	string optimizedIrCachePathForInput(const uint8_t* begin, const uint8_t* end)
+	{
+		MD5 hasher;
+		hashLiftingInputs(hasher, begin, end);
+
+		for (const string& path : headerSearchPath)
+		{
+			hasher.update(path);
+		}
+		for (const string& path : frameworks)
+		{
+			hasher.update(path);
+		}
+		for (const string& path : headers)
+		{
+			hasher.update(path);
+			if (auto buffer = MemoryBuffer::getFile(path, -1, false))
+			{
+				hasher.update(buffer.get()->getBuffer());
+			}
+		}
+		if (prototypeCacheFile.getNumOccurrences() > 0)
+		{
+			hasher.update(prototypeCacheFile);
+			if (auto buffer = MemoryBuffer::getFile(prototypeCacheFile, -1, false))
+			{
+				hasher.update(buffer.get()->getBuffer());
+			}
+		}
+
+		hasher.update(customPassPipeline);
+		hasher.update(pipelinePreset);
+		hasher.update(to_string(sizeGateInstructionLimit()));
+		for (const string& passName : additionalPasses)
+		{
+			hasher.update(passName);
+			if (StringRef(passName).endswith(".py"))
+			{
+				if (auto buffer = MemoryBuffer::getFile(passName, -1, false))
+				{
+					hasher.update(buffer.get()->getBuffer());
+				}
+			}
+		}
+
+		return irCachePathWithExtension(hasher, ".opt.bc");
+	}
+
+	void pruneOptionList(StringMap<cl::Option*>& list)
+	{
+		for (auto& pair : list)
+		{
+			if (!whitelist::isWhitelisted(*pair.second))
+			{
+				pair.second->setHiddenFlag(cl::ReallyHidden);
+			}
+		}
+	}
+	
+	template<typename T>
+	string errorOf(const ErrorOr<T>& error)
+	{
+		return error.getError().message();
+	}
+	
+	template<typename TAction>
+	size_t forEachCall(Function* callee, unsigned stringArgumentIndex, TAction&& action)
+	{
+		size_t count = 0;
+		for (Use& use : callee->uses())
+		{
+			if (auto call = dyn_cast<CallInst>(use.getUser()))
+			{
+				unique_ptr<Instruction> eraseIfNecessary;
+				Value* operand = call->getOperand(stringArgumentIndex);
+				if (auto constant = dyn_cast<ConstantExpr>(operand))
+				{
+					eraseIfNecessary.reset(constant->getAsInstruction());
+					operand = eraseIfNecessary.get();
+				}
+				
+				if (auto gep = dyn_cast<GetElementPtrInst>(operand))
+				if (auto global = dyn_cast<GlobalVariable>(gep->getOperand(0)))
+				if (auto dataArray = dyn_cast<ConstantDataArray>(global->getInitializer()))
+				{
+					action(dataArray->getAsString().str());
+					count++;
+				}
+			}
+		}
+		return count;
+	}
+	
+	StatCounter functionsPruned("lifter.functions.pruned");
+
+	// Erases functions that won't appear in the output and aren't referenced by anything that will:
+	// unreferenced stubs, emulator helpers, and prototypes left over from abandoned speculative
+	// entries. The middle pipeline is by far the most expensive part of a run and globaldce only
+	// prunes these at the end of it, so do it as soon as lifting is done.
+	void pruneUnreachableFunctions(Module& module)
+	{
+		SmallPtrSet<const Function*, 32> reachable;
+		SmallVector<Function*, 32> worklist;
+		auto markReachable = [&](Function* fn)
+		{
+			if (reachable.insert(fn).second)
+			{
+				worklist.push_back(fn);
+			}
+		};
+
+		// Constants (aggregate initializers, casts of function pointers) can bury function
+		// references arbitrarily deep.
+		SmallPtrSet<const Constant*, 32> visitedConstants;
+		auto markConstant = [&](Constant& root)
+		{
+			SmallVector<Constant*, 8> constants(1, &root);
+			while (!constants.empty())
+			{
+				Constant* constant = constants.pop_back_val();
+				if (auto fn = dyn_cast<Function>(constant))
+				{
+					markReachable(fn);
+				}
+				else if (!isa<GlobalValue>(constant) && visitedConstants.insert(constant).second)
+				{
+					for (Value* operand : constant->operand_values())
+					{
+						constants.push_back(cast<Constant>(operand));
+					}
+				}
+			}
+		};
+
+		// Roots: everything the AST back-end will print, plus explicitly requested entries (which
+		// can be left as prototypes when the lifting budget expires, but were still asked for).
+		for (Function& fn : module)
+		{
+			if (!md::isPrototype(fn))
+			{
+				markReachable(&fn);
+			}
+			else if (auto address = md::getVirtualAddress(fn))
+			{
+				if (isEntryPoint(address->getLimitedValue()))
+				{
+					markReachable(&fn);
+				}
+			}
+		}
+		for (GlobalVariable& global : module.globals())
+		{
+			if (global.hasInitializer())
+			{
+				markConstant(*global.getInitializer());
+			}
+		}
+
+		while (!worklist.empty())
+		{
+			Function* fn = worklist.pop_back_val();
+			for (BasicBlock& bb : *fn)
+			{
+				for (Instruction& inst : bb)
+				{
+					for (Value* operand : inst.operand_values())
+					{
+						if (auto constant = dyn_cast<Constant>(operand))
+						{
+							markConstant(*constant);
+						}
+					}
+				}
+			}
+		}
+
+		vector<Function*> toErase;
+		for (Function& fn : module)
+		{
+			if (reachable.count(&fn) == 0)
+			{
+				toErase.push_back(&fn);
+			}
+		}
+
+		// Unreachable functions can still reference each other; drop every body first so that the
+		// erases see no remaining uses.
+		for (Function* fn : toErase)
+		{
+			fn->dropAllReferences();
+		}
+		for (Function* fn : toErase)
+		{
+			// Cast expressions over the function can outlive the bodies that used them.
+			fn->removeDeadConstantUsers();
+			fn->eraseFromParent();
+			++functionsPruned;
+		}
+	}
+
+	StatCounter functionsFolded("lifter.functions.folded");
+
+	// Template-instantiation-heavy binaries lift thousands of byte-identical functions, and every
+	// copy would get optimized, structured and printed on its own. Fold them right after lifting:
+	// calls to a duplicate are redirected to one representative, and the duplicate keeps only its
+	// address and a fcd.duplicate link so the AST back-end can print it as an alias. Folding a
+	// caller can make its callers identical in turn, so iterating in module order picks those up
+	// when callees precede their callers.
+	void foldDuplicateFunctions(Module& module)
+	{
+		GlobalNumberState globalNumbers;
+		DenseMap<FunctionComparator::FunctionHash, SmallVector<Function*, 2>> representatives;
+		for (Function& fn : module)
+		{
+			if (md::isPrototype(fn))
+			{
+				continue;
+			}
+
+			auto& bucket = representatives[FunctionComparator::functionHash(fn)];
+			Function* original = nullptr;
+			for (Function* candidate : bucket)
+			{
+				// The hash ignores callees and constants; let the comparator have the final word.
+				if (FunctionComparator(candidate, &fn, &globalNumbers).compare() == 0)
+				{
+					original = candidate;
+					break;
+				}
+			}
+
+			if (original == nullptr)
+			{
+				bucket.push_back(&fn);
+				continue;
+			}
+
+			auto virtualAddress = md::getVirtualAddress(fn);
+			fn.replaceAllUsesWith(original);
+			fn.deleteBody(); // also drops the fcd.* metadata
+			if (virtualAddress != nullptr)
+			{
+				md::setVirtualAddress(fn, virtualAddress->getLimitedValue());
+			}
+			md::setDuplicateOf(fn, *original);
+			++functionsFolded;
+		}
+	}
+
+	bool refillEntryPoints(TranslationContext& transl, const EntryPointRepository& entryPoints, map<uint64_t, SymbolInfo>& toVisit, size_t iterations, bool budgetExpired)
+	{
+		if (budgetExpired || isExclusiveDisassembly() || (isPartialDisassembly() && iterations > 1))
+		{
+			return false;
+		}
+
+		for (uint64_t entryPoint : transl.takeDiscoveredEntryPoints())
+		{
+			if (auto symbolInfo = entryPoints.getInfo(entryPoint))
+			{
+				toVisit.insert({entryPoint, *symbolInfo});
+			}
+		}
+		return !toVisit.empty();
+	}
+	
+	class Main
+	{
+		int argc;
+		char** argv;
+	
+		LLVMContext llvm;
+		PythonContext python;
+		vector<Pass*> optimizeAndTransformPasses;
+		
+		static void aliasAnalysisHooks(Pass& pass, Function& fn, AAResults& aar)
+		{
+			if (auto prgmem = pass.getAnalysisIfAvailable<ProgramMemoryAAWrapperPass>())
+			{
+				aar.addAAResult(prgmem->getResult());
+			}
+			if (auto params = pass.getAnalysisIfAvailable<ParameterRegistry>())
+			{
+				aar.addAAResult(params->getAAResult());
+			}
+		}
+	
+		// Lifts every function of `batch` using `jobs` worker threads, each with its own LLVMContext and
+		// TranslationContext (and therefore its own Capstone handle), then links the partial modules into `into`.
+		// Functions keep their default address-derived name so that the linker can unify cross-references;
+		// symbol names and prototypes are applied by the caller once everything lives in the main module.
+		bool liftBatchInParallel(Executable& executable, const x86_config& config, const string& moduleName, Module& into, const vector<pair<uint64_t, SymbolInfo>>& batch, unsigned jobs, unordered_set<uint64_t>& discovered)
+		{
+			jobs = static_cast<unsigned>(min<size_t>(jobs, batch.size()));
+			// Kick off readahead for the whole batch before the workers start decoding, so that page
+			// faults overlap with lifting instead of stalling it.
+			for (const auto& pair : batch)
+			{
+				executable.adviseWillNeed(pair.first);
+			}
+			vector<SmallVector<char, 0>> partialModules(jobs);
+			vector<unordered_set<uint64_t>> partialDiscoveries(jobs);
+			atomic<bool> anyFailure(false);
+
+			vector<thread> workers;
+			for (unsigned workerIndex = 0; workerIndex < jobs; ++workerIndex)
+			{
+				workers.emplace_back([&, workerIndex]()
+				{
+					pinWorkerThread(workerIndex);
+					LLVMContext workerContext;
+					TranslationContext workerTransl(workerContext, executable, config, moduleName);
+					for (size_t i = workerIndex; i < batch.size(); i += jobs)
+					{
+						if (anyFailure)
+						{
+							return;
+						}
+						if (workerTransl.createFunction(batch[i].first) == nullptr)
+						{
+							anyFailure = true;
+							return;
+						}
+					}
+					partialDiscoveries[workerIndex] = workerTransl.takeDiscoveredEntryPoints();
+					raw_svector_ostream os(partialModules[workerIndex]);
+					WriteBitcodeToFile(&workerTransl.get(), os);
+				});
+			}
+
+			for (thread& worker : workers)
+			{
+				worker.join();
+			}
+
+			if (anyFailure)
+			{
+				return false;
+			}
+
+			for (unsigned workerIndex = 0; workerIndex < jobs; ++workerIndex)
+			{
+				const auto& buffer = partialModules[workerIndex];
+				MemoryBufferRef bufferRef(StringRef(buffer.data(), buffer.size()), "fcd-lift-worker");
+				auto partialModule = parseBitcodeFile(bufferRef, into.getContext());
+				if (!partialModule)
+				{
+					consumeError(partialModule.takeError());
+					return false;
+				}
+				if (Linker::linkModules(into, move(partialModule.get())))
+				{
+					return false;
+				}
+				discovered.insert(partialDiscoveries[workerIndex].begin(), partialDiscoveries[workerIndex].end());
+			}
+			return true;
+		}
+
+		static legacy::PassManager createBasePassManager()
+		{
+			legacy::PassManager pm;
+			pm.add(createTypeBasedAAWrapperPass());
+			pm.add(createScopedNoAliasAAWrapperPass());
+			pm.add(createBasicAAWrapperPass());
+			pm.add(createProgramMemoryAliasAnalysis());
+			return pm;
+		}
+		
+		vector<Pass*> createPassesFromList(const vector<string>& passNames)
+		{
+			vector<Pass*> result;
+			PassRegistry* pr = PassRegistry::getPassRegistry();
+			for (string passName : passNames)
+			{
+				auto begin = passName.begin();
+				while (begin != passName.end())
+				{
+					if (isspace(*begin))
+					{
+						++begin;
+					}
+					else
+					{
+						break;
+					}
+				}
+				passName.erase(passName.begin(), begin);
+				
+				auto rbegin = passName.rbegin();
+				while (rbegin != passName.rend())
+				{
+					if (isspace(*rbegin))
+					{
+						++rbegin;
+					}
+					else
+					{
+						break;
+					}
+				}
+				passName.erase(rbegin.base(), passName.end());
+				
+				if (passName.size() > 0 && passName[0] != '#')
+				{
+					auto ext = sys::path::extension(passName);
+					if (ext == ".py" || ext == ".pyc" || ext == ".pyo")
+					{
+						if (auto passOrError = python.createPass(passName))
+						{
+							result.push_back(passOrError.get());
+						}
+						else
+						{
+							cerr << getProgramName() << ": couldn't load " << passName << ": " << errorOf(passOrError) << endl;
+							return vector<Pass*>();
+						}
+					}
+					else if (const PassInfo* pi = pr->getPassInfo(passName))
+					{
+						result.push_back(pi->createPass());
+					}
+					else
+					{
+						cerr << getProgramName() << ": couldn't identify pass " << passName << endl;
+						return vector<Pass*>();
+					}
+				}
+			}
+			
+			if (result.size() == 0)
+			{
+				errs() << getProgramName() << ": empty pass list\n";
+			}
+			return result;
+		}
+	
+		vector<Pass*> interactivelyEditPassPipeline(const string& editor, const vector<string>& basePasses)
+		{
+			int fd;
+			SmallVector<char, 100> path;
+			if (auto errorCode = sys::fs::createTemporaryFile("fcd-pass-pipeline", "txt", fd, path))
+			{
+				errs() << getProgramName() << ": can't open temporary file for editing: " << errorCode.message() << "\n";
+				return vector<Pass*>();
 			}
 			
-			ifstream passListIs(path.data());
-			assert(static_cast<bool>(passListIs));
-			
+			raw_fd_ostream passListOs(fd, true);
+			passListOs << "# Enter the name of the LLVM or fcd passes that you want to run on the module.\n";
+			passListOs << "# Files starting with a # symbol are ignored.\n";
+			passListOs << "# Names ending with .py are assumed to be Python scripts implementing passes.\n";
+			for (const string& passName : basePasses)
+			{
+				passListOs << passName << '\n';
+			}
+			passListOs.flush();
+			
+			// shell escape temporary path
+			string escapedPath;
+			escapedPath.reserve(path.size());
+			for (char c : path)
+			{
+				if (c == '\'' || c == '\\')
+				{
+					escapedPath.push_back('\\');
+				}
+				escapedPath.push_back(c);
+			}
+			
+			string editCommand;
+			raw_string_ostream(editCommand) << editor << " '" << escapedPath << "'";
+			if (int errorCode = system(editCommand.c_str()))
+			{
+				errs() << getProgramName() << ": interactive pass pipeline: editor returned status code " << errorCode << '\n';
+				return vector<Pass*>();
+			}
+			
+			ifstream passListIs(path.data());
+			assert(static_cast<bool>(passListIs));
+			
 			string inputLine;
 			vector<string> lines;
 			while (getline(passListIs, inputLine))
 			{
-				lines.push_back(inputLine);
-				inputLine.clear();
+				lines.push_back(inputLine);
+				inputLine.clear();
+			}
+			if (inputLine.size() != 0)
+			{
+				lines.push_back(inputLine);
+			}
+			
+			return createPassesFromList(lines);
+		}
+		
+		vector<Pass*> readPassPipelineFromString(const string& argString)
+		{
+			stringstream ss(argString, ios::in);
+			vector<string> passes;
+			while (ss)
+			{
+				passes.emplace_back();
+				string& passName = passes.back();
+				ss >> passName;
+				if (passName.size() == 0 || passName[0] == '#')
+				{
+					passes.pop_back();
+				}
+			}
+			auto result = createPassesFromList(passes);
+			if (result.size() == 0)
+			{
+				errs() << getProgramName() << ": empty custom pass list\n";
+			}
+			return result;
+		}
+	
+	public:
+		Main(int argc, char** argv)
+		: argc(argc), argv(argv), python(argv[0])
+		{
+			(void) argc;
+			(void) this->argc;
+		}
+	
+		string getProgramName() { return sys::path::stem(argv[0]); }
+		LLVMContext& getContext() { return llvm; }
+	
+		ErrorOr<unique_ptr<Executable>> parseExecutable(const uint8_t* begin, const uint8_t* end)
+		{
+			PhaseTimingScope timing("executable parsing");
+			return Executable::parse(begin, end);
+		}
+		
+		ErrorOr<unique_ptr<Module>> generateAnnotatedModule(Executable& executable, const string& moduleName = "fcd-out")
+		{
+			PhaseTimingScope timing("lifting");
+			x86_config config64 = { x86_isa64, 8, X86_REG_RIP, X86_REG_RSP, X86_REG_RBP };
+			TranslationContext transl(llvm, executable, config64, moduleName);
+			
+			// Load headers here, since this is the earliest point where we have an executable and a module.
+			// Prototypes recovered by an earlier run come back through the same door as user headers, so
+			// parameter recovery sees them as authoritative declarations.
+			vector<string> headerPaths(headers.begin(), headers.end());
+			if (prototypeCacheFile.getNumOccurrences() > 0 && sys::fs::exists(prototypeCacheFile))
+			{
+				headerPaths.push_back(prototypeCacheFile);
+			}
+			auto cDecls = HeaderDeclarations::create(
+				transl.get(),
+				headerSearchPath.begin(),
+				headerSearchPath.end(),
+				headerPaths.begin(),
+				headerPaths.end(),
+				frameworks.begin(),
+				frameworks.end(),
+				errs());
+			if (!cDecls)
+			{
+				return make_error_code(FcdError::Main_HeaderParsingError);
+			}
+			
+			EntryPointRepository entryPoints;
+			// Lowest priority first: anything with a real name shadows an anonymous scanned candidate.
+			PrologueScanner prologueScanner(executable);
+			if (PrologueScanner::isEnabled())
+			{
+				entryPoints.addProvider(prologueScanner);
+			}
+			entryPoints.addProvider(executable);
+			entryPoints.addProvider(*cDecls);
+			
+			md::addIncludedFiles(transl.get(), cDecls->getIncludedFiles());
+	
+			map<uint64_t, SymbolInfo> toVisit;
+			if (isFullDisassembly())
+			{
+				for (uint64_t address : entryPoints.getVisibleEntryPoints())
+				{
+					auto symbolInfo = entryPoints.getInfo(address);
+					assert(symbolInfo != nullptr);
+					toVisit.insert({symbolInfo->virtualAddress, *symbolInfo});
+				}
+			}
+	
+			for (uint64_t address : entryPointIndex)
+			{
+				if (auto symbolInfo = entryPoints.getInfo(address))
+				{
+					toVisit.insert({symbolInfo->virtualAddress, *symbolInfo});
+				}
+				else
+				{
+					return make_error_code(FcdError::Main_EntryPointOutOfMappedMemory);
+				}
+			}
+	
+			if (toVisit.size() == 0)
+			{
+				return make_error_code(FcdError::Main_NoEntryPoint);
+			}
+	
+			size_t iterations = 0;
+			auto liftingStart = chrono::steady_clock::now();
+			unsigned jobs = effectiveJobCount();
+			if (jobs > 1)
+			{
+				unordered_set<uint64_t> lifted;
+				vector<pair<uint64_t, SymbolInfo>> liftedSymbols;
+				while (toVisit.size() > 0)
+				{
+					vector<pair<uint64_t, SymbolInfo>> batch = takeByDescendingHotness(toVisit);
+					for (const auto& pair : batch)
+					{
+						lifted.insert(pair.first);
+					}
+
+					unordered_set<uint64_t> discovered;
+					if (!liftBatchInParallel(executable, config64, moduleName, transl.get(), batch, jobs, discovered))
+					{
+						return make_error_code(FcdError::Main_DecompilationError);
+					}
+					liftedSymbols.insert(liftedSymbols.end(), batch.begin(), batch.end());
+
+					iterations++;
+					if (liftingBudgetExpired(liftingStart) || isExclusiveDisassembly() || (isPartialDisassembly() && iterations > 1))
+					{
+						continue;
+					}
+					for (uint64_t entryPoint : discovered)
+					{
+						if (lifted.count(entryPoint) == 0)
+						{
+							if (auto symbolInfo = entryPoints.getInfo(entryPoint))
+							{
+								toVisit.insert({entryPoint, *symbolInfo});
+							}
+						}
+					}
+				}
+
+				// Later batches' worker modules only know already-lifted functions by their
+				// address-derived names, so renaming between batches would leave cross-batch calls
+				// pointing at phantom declarations after linking. Apply symbol names and final
+				// prototypes in one sweep once the worklist has drained.
+				for (const auto& pair : liftedSymbols)
+				{
+					if (Function* fn = transl->getFunction(defaultFunctionName(pair.first)))
+					{
+						if (pair.second.name.size() > 0)
+						{
+							fn->setName(pair.second.name);
+						}
+						if (Function* cFunction = cDecls->prototypeForAddress(pair.first))
+						{
+							md::setFinalPrototype(*fn, *cFunction);
+						}
+					}
+				}
+			}
+			else
+			do
+			{
+				vector<pair<uint64_t, SymbolInfo>> batch = takeByDescendingHotness(toVisit);
+				if (batch.size() > 0)
+				{
+					executable.adviseWillNeed(batch[0].first);
+				}
+				for (size_t batchIndex = 0; batchIndex < batch.size(); ++batchIndex)
+				{
+					// Hint the next function's bytes now so they page in while this one lifts.
+					if (batchIndex + 1 < batch.size())
+					{
+						executable.adviseWillNeed(batch[batchIndex + 1].first);
+					}
+					const SymbolInfo& functionInfo = batch[batchIndex].second;
+
+					if (functionInfo.name.size() > 0)
+					{
+						transl.setFunctionName(functionInfo.virtualAddress, functionInfo.name.str());
+					}
+					
+					if (Function* fn = transl.createFunction(functionInfo.virtualAddress))
+					{
+						if (Function* cFunction = cDecls->prototypeForAddress(functionInfo.virtualAddress))
+						{
+							md::setFinalPrototype(*fn, *cFunction);
+						}
+					}
+					else
+					{
+						// Couldn't decompile, abort
+						return make_error_code(FcdError::Main_DecompilationError);
+					}
+				}
+				iterations++;
 			}
-			if (inputLine.size() != 0)
+			while (refillEntryPoints(transl, entryPoints, toVisit, iterations, liftingBudgetExpired(liftingStart)));
+	
+			// Perform early optimizations to make the module suitable for analysis
+			auto module = transl.take();
+			legacy::PassManager phaseOne = createBasePassManager();
+			phaseOne.add(new ExecutableWrapper(&executable));
+			phaseOne.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
+			phaseOne.add(createDeadCodeEliminationPass());
+			phaseOne.add(createInstructionCombiningPass());
+			// Runs after instcombine so that address arithmetic has folded into constants, and
+			// before GVN so that the loads it resolves never feed value numbering at all.
+			phaseOne.add(createRodataFoldingPass());
+			phaseOne.add(createRegisterPointerPromotionPass());
+			phaseOne.add(createGVNPass());
+			phaseOne.add(createDeadStoreEliminationPass());
+			// Handlers kept as calls by --outline-handlers rejoin their call sites here, after the
+			// expensive passes above have run on the small IR; the cleanup below and GlobalDCE then
+			// flatten and discard the outlined copies.
+			phaseOne.add(createAlwaysInlinerLegacyPass());
+			phaseOne.add(createInstructionCombiningPass());
+			phaseOne.add(createGlobalDCEPass());
+			phaseOne.run(*module);
+	
+			// Annotate stubs before returning module
+			Function* jumpIntrin = module->getFunction("x86_jump_intrin");
+			vector<Function*> functions;
+			for (Function& fn : module->getFunctionList())
 			{
-				lines.push_back(inputLine);
+				if (md::isPrototype(fn))
+				{
+					continue;
+				}
+				
+				BasicBlock& entry = fn.getEntryBlock();
+				auto terminator = entry.getTerminator();
+				if (isa<UnreachableInst>(terminator))
+				{
+					if (auto prev = dyn_cast<CallInst>(terminator->getPrevNode()))
+					if (prev->getCalledFunction() == jumpIntrin)
+					if (auto load = dyn_cast<LoadInst>(prev->getOperand(2)))
+					if (auto constantExpr = dyn_cast<ConstantExpr>(load->getPointerOperand()))
+					{
+						unique_ptr<Instruction> inst(constantExpr->getAsInstruction());
+						if (auto int2ptr = dyn_cast<IntToPtrInst>(inst.get()))
+						{
+							auto value = cast<ConstantInt>(int2ptr->getOperand(0));
+							if (const StubInfo* stubTarget = executable.getStubTarget(value->getLimitedValue()))
+							{
+								++stubsResolved;
+								if (Function* cFunction = cDecls->prototypeForImportName(stubTarget->name.str()))
+								{
+									md::setIsStub(fn);
+									md::setFinalPrototype(fn, *cFunction);
+								}
+								
+								// If we identified no function from the header file, this gives the import its real
+								// name. Otherwise, it'll prefix the name with some number.
+								fn.setName(stubTarget->name);
+							}
+						}
+					}
+				}
 			}
-			
-			return createPassesFromList(lines);
+
+			pruneUnreachableFunctions(*module);
+			foldDuplicateFunctions(*module);
+			return move(module);
 		}
 		
-		vector<Pass*> readPassPipelineFromString(const string& argString)
+		// Runs `segment` (function passes only, recreated per worker from the pass registry) over the module
+		// using `jobs` threads. Functions are partitioned round-robin; each worker parses the module into its
+		// own LLVMContext, drops the bodies it doesn't own, optimizes its share and the results are linked
+		// back together. Duplicated private globals produced by the link are cleaned up by the globaldce runs
+		// that the pipeline already contains.
+		bool runFunctionPassSegmentInParallel(unique_ptr<Module>& module, const vector<Pass*>& segment, unsigned jobs)
 		{
-			stringstream ss(argString, ios::in);
-			vector<string> passes;
-			while (ss)
+			SmallVector<char, 0> moduleBits;
+			raw_svector_ostream moduleOs(moduleBits);
+			WriteBitcodeToFile(module.get(), moduleOs);
+
+			vector<const PassInfo*> segmentInfo;
+			PassRegistry* pr = PassRegistry::getPassRegistry();
+			for (Pass* pass : segment)
+			{
+				segmentInfo.push_back(pr->getPassInfo(pass->getPassID()));
+			}
+
+			vector<SmallVector<char, 0>> partialModules(jobs);
+			atomic<bool> anyFailure(false);
+			vector<thread> workers;
+			for (unsigned workerIndex = 0; workerIndex < jobs; ++workerIndex)
+			{
+				workers.emplace_back([&, workerIndex]()
+				{
+					pinWorkerThread(workerIndex);
+					LLVMContext workerContext;
+					MemoryBufferRef bufferRef(StringRef(moduleBits.data(), moduleBits.size()), "fcd-opt-worker");
+					auto workerModule = parseBitcodeFile(bufferRef, workerContext);
+					if (!workerModule)
+					{
+						consumeError(workerModule.takeError());
+						anyFailure = true;
+						return;
+					}
+
+					size_t functionIndex = 0;
+					vector<Function*> partition;
+					for (Function& fn : **workerModule)
+					{
+						if (fn.isDeclaration())
+						{
+							continue;
+						}
+						if (functionIndex % jobs == workerIndex)
+						{
+							partition.push_back(&fn);
+						}
+						else
+						{
+							fn.deleteBody();
+						}
+						functionIndex++;
+					}
+
+					legacy::FunctionPassManager fpm(workerModule->get());
+					fpm.add(createTypeBasedAAWrapperPass());
+					fpm.add(createScopedNoAliasAAWrapperPass());
+					fpm.add(createBasicAAWrapperPass());
+					fpm.add(createProgramMemoryAliasAnalysis());
+					fpm.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
+					for (const PassInfo* info : segmentInfo)
+					{
+						fpm.add(info->createPass());
+					}
+					fpm.doInitialization();
+					for (Function* fn : partition)
+					{
+						fpm.run(*fn);
+					}
+					fpm.doFinalization();
+
+					raw_svector_ostream os(partialModules[workerIndex]);
+					WriteBitcodeToFile(workerModule->get(), os);
+				});
+			}
+
+			for (thread& worker : workers)
+			{
+				worker.join();
+			}
+
+			if (anyFailure)
+			{
+				return false;
+			}
+
+			auto merged = std::make_unique<Module>(module->getModuleIdentifier(), module->getContext());
+			for (const auto& buffer : partialModules)
+			{
+				MemoryBufferRef bufferRef(StringRef(buffer.data(), buffer.size()), "fcd-opt-worker");
+				auto partialModule = parseBitcodeFile(bufferRef, merged->getContext());
+				if (!partialModule)
+				{
+					consumeError(partialModule.takeError());
+					return false;
+				}
+				if (Linker::linkModules(*merged, move(partialModule.get())))
+				{
+					return false;
+				}
+			}
+			module = move(merged);
+			return true;
+		}
+
+		bool optimizeAndTransformModule(unique_ptr<Module>& module, raw_ostream& errorOutput, Executable* executable = nullptr)
+		{
+			PrettyStackTraceString optimize("Optimizing LLVM IR");
+			PhaseTimingScope timing("optimization");
+
+			VerifyMode verification = verifyMode;
+			if (verification == VerifyDefault)
+			{
+#ifdef FCD_DEBUG
+				verification = VerifyFull;
+#else
+				verification = VerifyNone;
+#endif
+			}
+
+			// Keyed by name rather than pointer: the parallel segments rebuild the module, but
+			// names are stable across the round-trip.
+			StringMap<uint64_t> fingerprints;
+			if (verification == VerifyChanged)
+			{
+				for (Function& fn : *module)
+				{
+					if (!fn.isDeclaration())
+					{
+						fingerprints[fn.getName()] = functionFingerprint(fn);
+					}
+				}
+			}
+
+			unsigned jobs = effectiveJobCount();
+			PassRegistry* pr = PassRegistry::getPassRegistry();
+
+			// Phase 3: make into functions with arguments, run codegen. Module-level passes (and passes we
+			// can't recreate from the registry, like Python scripts) act as serial barriers; maximal runs of
+			// plain function passes in between are farmed out to worker threads when --jobs allows it.
+			auto runSerialSegment = [&](const vector<Pass*>& segment)
+			{
+				auto passManager = createBasePassManager();
+				passManager.add(new ExecutableWrapper(executable));
+				passManager.add(createParameterRegistryPass());
+				passManager.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
+				for (Pass* pass : segment)
+				{
+					passManager.add(pass);
+				}
+				passManager.run(*module);
+			};
+
+			if (jobs > 1)
+			{
+				vector<Pass*> serialSegment;
+				vector<Pass*> functionSegment;
+				auto flushFunctionSegment = [&]() -> bool
+				{
+					if (functionSegment.size() > 0)
+					{
+						if (!runFunctionPassSegmentInParallel(module, functionSegment, jobs))
+						{
+							return false;
+						}
+						for (Pass* pass : functionSegment)
+						{
+							delete pass;
+						}
+						functionSegment.clear();
+					}
+					return true;
+				};
+
+				for (Pass* pass : optimizeAndTransformPasses)
+				{
+					if (pass->getPassKind() == PT_Function && pr->getPassInfo(pass->getPassID()) != nullptr)
+					{
+						functionSegment.push_back(pass);
+					}
+					else
+					{
+						if (!flushFunctionSegment())
+						{
+							return false;
+						}
+						serialSegment.push_back(pass);
+						runSerialSegment(serialSegment);
+						serialSegment.clear();
+					}
+				}
+				if (!flushFunctionSegment())
+				{
+					return false;
+				}
+			}
+			else
+			{
+				runSerialSegment(optimizeAndTransformPasses);
+			}
+
+			if (verification == VerifyFull)
+			{
+				if (verifyModule(*module, &errorOutput))
+				{
+					// errors!
+					return false;
+				}
+			}
+			else if (verification == VerifyChanged)
+			{
+				// Only walk functions whose structure moved since the snapshot; on large modules
+				// this replaces a whole-module verification with a cheap hash sweep plus a handful
+				// of per-function checks.
+				for (Function& fn : *module)
+				{
+					if (fn.isDeclaration())
+					{
+						continue;
+					}
+					auto iter = fingerprints.find(fn.getName());
+					if (iter == fingerprints.end() || iter->second != functionFingerprint(fn))
+					{
+						if (verifyFunction(fn, &errorOutput))
+						{
+							return false;
+						}
+					}
+				}
+			}
+			return true;
+		}
+
+		// Sharding recreates the pass pipeline from the registry in every shard, which rules out
+		// passes that only exist as objects in this process, i.e. Python scripts.
+		bool canShardPipeline()
+		{
+			PassRegistry* pr = PassRegistry::getPassRegistry();
+			for (Pass* pass : optimizeAndTransformPasses)
+			{
+				if (pr->getPassInfo(pass->getPassID()) == nullptr)
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+
+		// Shard-parallel mode for --shards: partitions the call graph into separate modules in
+		// separate contexts, runs the whole optimization pipeline and the AST backend on each
+		// independently, and concatenates the pseudocode. Module-level passes and LLVMContext
+		// uniquing tables then scale with the shard instead of the whole program. Cross-shard
+		// callees appear as bodyless declarations, so parameter recovery at shard boundaries falls
+		// back to its declaration-based heuristics; that is the precision cost of the scaling.
+		bool optimizeAndPrintShards(unique_ptr<Module>& module, raw_ostream& output, Executable* executable)
+		{
+			PrettyStackTraceString optimize("Optimizing and printing module shards");
+			PhaseTimingScope timing("sharded pipeline");
+
+			unsigned shards = shardCount;
+			vector<unsigned> assignment = partitionIntoShards(*module, shards);
+
+			// The pipeline's pass objects only serve to identify it here; each shard builds its
+			// own instances from the registry.
+			vector<const PassInfo*> pipelineInfo;
+			PassRegistry* pr = PassRegistry::getPassRegistry();
+			for (Pass* pass : optimizeAndTransformPasses)
+			{
+				pipelineInfo.push_back(pr->getPassInfo(pass->getPassID()));
+				delete pass;
+			}
+			optimizeAndTransformPasses.clear();
+
+			SmallVector<char, 0> moduleBits;
+			raw_svector_ostream moduleOs(moduleBits);
+			WriteBitcodeToFile(module.get(), moduleOs);
+
+			vector<string> shardOutputs(shards);
+			atomic<bool> anyFailure(false);
+			vector<thread> workers;
+			for (unsigned shardIndex = 0; shardIndex < shards; ++shardIndex)
+			{
+				workers.emplace_back([&, shardIndex]()
+				{
+					pinWorkerThread(shardIndex);
+					LLVMContext shardContext;
+					MemoryBufferRef bufferRef(StringRef(moduleBits.data(), moduleBits.size()), "fcd-shard");
+					auto shardModule = parseBitcodeFile(bufferRef, shardContext);
+					if (!shardModule)
+					{
+						consumeError(shardModule.takeError());
+						anyFailure = true;
+						return;
+					}
+
+					size_t definedIndex = 0;
+					for (Function& fn : **shardModule)
+					{
+						if (fn.isDeclaration())
+						{
+							continue;
+						}
+						if (assignment[definedIndex] != shardIndex)
+						{
+							fn.deleteBody();
+						}
+						definedIndex++;
+					}
+
+					{
+						// Same setup as the serial pipeline. The executable is only read from at
+						// this point, so sharing it between workers is safe.
+						auto passManager = createBasePassManager();
+						passManager.add(new ExecutableWrapper(executable));
+						passManager.add(createParameterRegistryPass());
+						passManager.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
+						for (const PassInfo* info : pipelineInfo)
+						{
+							passManager.add(info->createPass());
+						}
+						passManager.run(**shardModule);
+					}
+
+					// The shards are the parallelism, so each AST backend runs serially, and only
+					// the first shard prints the #include prologue.
+					raw_string_ostream shardOs(shardOutputs[shardIndex]);
+					if (!generateEquivalentPseudocode(**shardModule, shardOs, 1, shardIndex == 0))
+					{
+						anyFailure = true;
+					}
+				});
+			}
+
+			for (thread& worker : workers)
+			{
+				worker.join();
+			}
+
+			if (anyFailure)
+			{
+				return false;
+			}
+
+			for (const string& shardOutput : shardOutputs)
+			{
+				output << shardOutput;
+			}
+			return true;
+		}
+
+		bool generateEquivalentPseudocode(Module& module, raw_ostream& output, unsigned jobs = 0, bool printIncludes = true)
+		{
+			PrettyStackTraceString pseudocode("Generating pseudo-C output");
+			PhaseTimingScope timing("pseudocode output");
+
+			// Run that module through the output pass
+			// UnwrapReturns happens after value propagation because value propagation doesn't know that calls
+			// are generally not safe to reorder.
+			AstBackEnd* backend = createAstBackEnd();
+			backend->setParallelJobs(jobs == 0 ? effectiveJobCount() : jobs);
+			vector<string> includedFiles = printIncludes ? md::getIncludedFiles(module) : vector<string>();
+			if (prototypesFirst)
 			{
-				passes.emplace_back();
-				string& passName = passes.back();
-				ss >> passName;
-				if (passName.size() == 0 || passName[0] == '#')
+				// Two-stage emission: the includes and the whole declaration section go out now,
+				// before structuring starts, and AstPrint streams the bodies after them.
+				for (const string& file : includedFiles)
 				{
-					passes.pop_back();
+					output << "#include \"" << file << "\"\n";
 				}
+				if (includedFiles.size() > 0)
+				{
+					output << '\n';
+				}
+				includedFiles.clear();
+				backend->setPrototypeOutput(output);
 			}
-			auto result = createPassesFromList(passes);
-			if (result.size() == 0)
+			backend->addPass(new AstConsecutiveCombiner);
+			backend->addPass(new AstNestedCombiner);
+			backend->addPass(new AstConsecutiveCombiner);
+			backend->addPass(new AstSimplifyExpressions);
+			if (!isFastPipeline())
 			{
-				errs() << getProgramName() << ": empty custom pass list\n";
+				// The congruence merge and the combine round it enables are the most expensive
+				// part of structuring; the fast preset prints with redundant variables instead.
+				backend->addPass(new AstMergeCongruentVariables);
+				backend->addPass(new AstConsecutiveCombiner);
+				backend->addPass(new AstNestedCombiner);
+				backend->addPass(new AstConsecutiveCombiner);
 			}
-			return result;
-		}
-	
-	public:
-		Main(int argc, char** argv)
-		: argc(argc), argv(argv), python(argv[0])
-		{
-			(void) argc;
-			(void) this->argc;
+			backend->addPass(new AstPrint(output, move(includedFiles)));
+			if (!emitAst.empty())
+			{
+				// The export stream is opened once per process and shared by every backend (sharded
+				// runs get here once per shard, possibly concurrently); AstExport's records are
+				// self-contained and its writes serialized, so sharing the stream is safe.
+				static unique_ptr<raw_fd_ostream> exportStream = []() -> unique_ptr<raw_fd_ostream>
+				{
+					error_code error;
+					auto stream = std::make_unique<raw_fd_ostream>(emitAst, error, sys::fs::F_None);
+					if (error)
+					{
+						errs() << "couldn't open " << emitAst << ": " << error.message() << '\n';
+						stream.reset();
+					}
+					return stream;
+				}();
+
+				if (exportStream != nullptr)
+				{
+					backend->addPass(new AstExport(*exportStream));
+				}
+			}
+			backend->runOnModule(module);
+			return true;
 		}
 	
-		string getProgramName() { return sys::path::stem(argv[0]); }
-		LLVMContext& getContext() { return llvm; }
-	
-		ErrorOr<unique_ptr<Executable>> parseExecutable(MemoryBuffer& executableCode)
+		static void initializePasses()
 		{
-			auto start = reinterpret_cast<const uint8_t*>(executableCode.getBufferStart());
-			auto end = reinterpret_cast<const uint8_t*>(executableCode.getBufferEnd());
-			return Executable::parse(start, end);
+			auto& pr = *PassRegistry::getPassRegistry();
+			initializeCore(pr);
+			initializeVectorization(pr);
+			initializeIPO(pr);
+			initializeAnalysis(pr);
+			initializeTransformUtils(pr);
+			initializeInstCombine(pr);
+			initializeScalarOpts(pr);
+		
+			initializeParameterRegistryPass(pr);
+			initializeArgumentRecoveryPass(pr);
+			initializeFunctionAddressIndexWrapperPass(pr);
 		}
 		
-		ErrorOr<unique_ptr<Module>> generateAnnotatedModule(Executable& executable, const string& moduleName = "fcd-out")
+		bool prepareOptimizationPasses()
 		{
-			x86_config config64 = { x86_isa64, 8, X86_REG_RIP, X86_REG_RSP, X86_REG_RBP };
-			TranslationContext transl(llvm, executable, config64, moduleName);
-			
-			// Load headers here, since this is the earliest point where we have an executable and a module.
-			auto cDecls = HeaderDeclarations::create(
-				transl.get(),
-				headerSearchPath.begin(),
-				headerSearchPath.end(),
-				headers.begin(),
-				headers.end(),
-				frameworks.begin(),
-				frameworks.end(),
-				errs());
-			if (!cDecls)
+			if (pipelinePreset != "fast" && pipelinePreset != "default" && pipelinePreset != "thorough")
 			{
-				return make_error_code(FcdError::Main_HeaderParsingError);
+				errs() << getProgramName() << ": unknown pipeline preset \"" << pipelinePreset << "\"; expected fast, default or thorough\n";
+				return false;
 			}
-			
-			EntryPointRepository entryPoints;
-			entryPoints.addProvider(executable);
-			entryPoints.addProvider(*cDecls);
-			
-			md::addIncludedFiles(transl.get(), cDecls->getIncludedFiles());
-	
-			map<uint64_t, SymbolInfo> toVisit;
-			if (isFullDisassembly())
+
+			// Default passes
+			vector<string> passNames = {
+				"globaldce",
+				"fixindirects",
+				"argrec",
+				"sizegate",
+				"sroa",
+				"intnarrowing",
+				"peepholes",
+				"instcombine",
+				"peepholes",
+				"simplifyconditions",
+				// <-- custom passes go here with the default pass pipeline
+				"instcombine",
+				"gvn",
+				"simplifycfg",
+				"instcombine",
+				"gvn",
+				"recoverstackframe",
+				"dse",
+				"sccp",
+				"simplifycfg",
+				"peepholes",
+				"instcombine",
+				"memssadle",
+				"dse",
+				"instcombine",
+				"sroa",
+				"instcombine",
+				"globaldce",
+				"simplifycfg",
+			};
+
+			if (isFastPipeline())
 			{
-				for (uint64_t address : entryPoints.getVisibleEntryPoints())
+				// Triage mode: one cleanup round instead of the repeated instcombine/GVN fixpoint
+				// hunt. Recovery passes all stay — they make the output readable at all — and the
+				// cost is only polish, not correctness.
+				passNames = {
+					"globaldce",
+					"fixindirects",
+					"argrec",
+					"sizegate",
+					"sroa",
+					"intnarrowing",
+					"peepholes",
+					"instcombine",
+					"simplifyconditions",
+					// <-- custom passes go here with the default pass pipeline
+					"recoverstackframe",
+					"dse",
+					"sccp",
+					"simplifycfg",
+					"instcombine",
+					"globaldce",
+					"simplifycfg",
+				};
+			}
+
+			if (customPassPipeline == "default")
+			{
+				if (additionalPasses.size() > 0)
 				{
-					auto symbolInfo = entryPoints.getInfo(address);
-					assert(symbolInfo != nullptr);
-					toVisit.insert({symbolInfo->virtualAddress, *symbolInfo});
+					auto extensionPoint = find(passNames.begin(), passNames.end(), "simplifyconditions") + 1;
+					passNames.insert(extensionPoint, additionalPasses.begin(), additionalPasses.end());
 				}
+				optimizeAndTransformPasses = createPassesFromList(passNames);
 			}
-	
-			for (uint64_t address : unordered_set<uint64_t>(additionalEntryPoints.begin(), additionalEntryPoints.end()))
+			else if (customPassPipeline == "")
 			{
-				if (auto symbolInfo = entryPoints.getInfo(address))
+				if (auto editor = getenv("EDITOR"))
 				{
-					toVisit.insert({symbolInfo->virtualAddress, *symbolInfo});
+					optimizeAndTransformPasses = interactivelyEditPassPipeline(editor, passNames);
 				}
 				else
 				{
-					return make_error_code(FcdError::Main_EntryPointOutOfMappedMemory);
+					errs() << getProgramName() << ": environment has no EDITOR variable; pass pipeline can't be edited interactively\n";
+					return false;
 				}
 			}
-	
-			if (toVisit.size() == 0)
+			else
 			{
-				return make_error_code(FcdError::Main_NoEntryPoint);
+				optimizeAndTransformPasses = readPassPipelineFromString(customPassPipeline);
 			}
-	
-			size_t iterations = 0;
-			do
+			return optimizeAndTransformPasses.size() > 0;
+		}
+	};
+
+	// Decompiles one input through the full pipeline and writes the result to `output`. Everything
+	// per-input lives here so that batch mode can call it repeatedly from a warm process.
+	int processInput(Main& mainObj, char** argv, const string& inputPath, raw_ostream& output)
+	{
+		string program = mainObj.getProgramName();
+		unique_ptr<Executable> executable;
+		unique_ptr<Module> module;
+		string optimizedIrCachePath;
+		string resumeAnnotatedPath;
+		string resumeOptimizedPath;
+		bool moduleIsOptimized = false;
+
+		// step one: create annotated module from executable (or load it from .ll)
+		ErrorOr<unique_ptr<MemoryBuffer>> bufferOrError(nullptr);
+		unique_ptr<sys::fs::mapped_file_region> mappedInput;
+		if (moduleInCount())
+		{
+			PrettyStackTraceFormat parsingIR("Parsing IR from \"%s\"", inputPath.c_str());
+			
+			SMDiagnostic errors;
+			module = parseIRFile(inputPath, errors, mainObj.getContext());
+			if (!module)
 			{
-				while (toVisit.size() > 0)
+				errors.print(argv[0], errs());
+				return 1;
+			}
+		}
+		else
+		{
+			PrettyStackTraceFormat parsingIR("Parsing executable \"%s\"", inputPath.c_str());
+
+			// Map the input instead of reading it in: Executable::map calls then resolve straight into the
+			// page cache instead of a second in-memory copy, which matters for very large inputs.
+			const uint8_t* inputBegin = nullptr;
+			const uint8_t* inputEnd = nullptr;
+			int inputFD;
+			uint64_t inputSize;
+			if (!sys::fs::openFileForRead(inputPath, inputFD))
+			{
+				if (!sys::fs::file_size(inputPath, inputSize) && inputSize > 0)
+				{
+					error_code mapError;
+					auto region = std::make_unique<sys::fs::mapped_file_region>(inputFD, sys::fs::mapped_file_region::readonly, inputSize, 0, mapError);
+					if (!mapError)
+					{
+						mappedInput = move(region);
+						inputBegin = reinterpret_cast<const uint8_t*>(mappedInput->const_data());
+						inputEnd = inputBegin + mappedInput->size();
+					}
+				}
+				close(inputFD);
+			}
+
+			if (inputBegin == nullptr)
+			{
+				// Non-regular files (pipes, character devices) can't be mapped; fall back to reading them in.
+				bufferOrError = MemoryBuffer::getFile(inputPath, -1, false);
+				if (!bufferOrError)
 				{
-					auto iter = toVisit.begin();
-					auto functionInfo = iter->second;
-					toVisit.erase(iter);
+					cerr << program << ": can't open " << inputPath << ": " << errorOf(bufferOrError) << endl;
+					return 1;
+				}
+				inputBegin = reinterpret_cast<const uint8_t*>(bufferOrError.get()->getBufferStart());
+				inputEnd = reinterpret_cast<const uint8_t*>(bufferOrError.get()->getBufferEnd());
+			}
+
+			auto executableOrError = mainObj.parseExecutable(inputBegin, inputEnd);
+			if (!executableOrError)
+			{
+				cerr << program << ": couldn't parse " << inputPath << ": " << errorOf(executableOrError) << endl;
+				return 1;
+			}
 			
-					if (functionInfo.name.size() > 0)
+			executable = move(executableOrError.get());
+			string moduleName = sys::path::stem(inputPath);
+
+			// Resume checkpoints come first: they are the leftovers of this very job, so they beat
+			// the (keyed, shared) IR cache. The furthest completed phase wins. The parameter
+			// registry doesn't need separate state: everything it derived lives in the fcd.*
+			// metadata that rides the bitcode, and the rest is recomputed.
+			if (resumeDirectory.getNumOccurrences() > 0)
+			{
+				resumeAnnotatedPath = resumePathForPhase(moduleName, "annotated");
+				if (moduleOutCount() == 0 && shardCount < 2)
+				{
+					resumeOptimizedPath = resumePathForPhase(moduleName, "optimized");
+					if (auto checkpointBuffer = MemoryBuffer::getFile(resumeOptimizedPath, -1, false))
 					{
-						transl.setFunctionName(functionInfo.virtualAddress, functionInfo.name);
+						auto checkpointModule = parseBitcodeFile(checkpointBuffer.get()->getMemBufferRef(), mainObj.getContext());
+						if (checkpointModule)
+						{
+							module = move(checkpointModule.get());
+							moduleIsOptimized = true;
+						}
+						else
+						{
+							consumeError(checkpointModule.takeError());
+						}
 					}
-					
-					if (Function* fn = transl.createFunction(functionInfo.virtualAddress))
+				}
+				if (!module)
+				{
+					if (auto checkpointBuffer = MemoryBuffer::getFile(resumeAnnotatedPath, -1, false))
 					{
-						if (Function* cFunction = cDecls->prototypeForAddress(functionInfo.virtualAddress))
+						auto checkpointModule = parseBitcodeFile(checkpointBuffer.get()->getMemBufferRef(), mainObj.getContext());
+						if (checkpointModule)
 						{
-							md::setFinalPrototype(*fn, *cFunction);
+							module = move(checkpointModule.get());
 						}
+						else
+						{
+							// A truncated checkpoint means the phase didn't complete; redo it.
+							consumeError(checkpointModule.takeError());
+						}
+					}
+				}
+			}
+
+			// Try the optimized artifact first: a hit skips both lifting and optimization, which is
+			// what makes repeated partial decompilations of the same binary cheap. Module output
+			// modes want the intermediate forms, so they bypass this tier; so do sharded runs,
+			// which never produce a whole optimized module and should behave the same warm or cold.
+			if (irCacheDirectory.getNumOccurrences() > 0 && moduleOutCount() == 0 && shardCount < 2)
+			{
+				optimizedIrCachePath = optimizedIrCachePathForInput(inputBegin, inputEnd);
+				if (!module)
+				if (auto cachedBuffer = MemoryBuffer::getFile(optimizedIrCachePath, -1, false))
+				{
+					auto cachedModule = parseBitcodeFile(cachedBuffer.get()->getMemBufferRef(), mainObj.getContext());
+					if (cachedModule)
+					{
+						module = move(cachedModule.get());
+						moduleIsOptimized = true;
 					}
 					else
 					{
-						// Couldn't decompile, abort
-						return make_error_code(FcdError::Main_DecompilationError);
+						consumeError(cachedModule.takeError());
 					}
 				}
-				iterations++;
 			}
-			while (refillEntryPoints(transl, entryPoints, toVisit, iterations));
-	
-			// Perform early optimizations to make the module suitable for analysis
-			auto module = transl.take();
-			legacy::PassManager phaseOne = createBasePassManager();
-			phaseOne.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
-			phaseOne.add(createDeadCodeEliminationPass());
-			phaseOne.add(createInstructionCombiningPass());
-			phaseOne.add(createRegisterPointerPromotionPass());
-			phaseOne.add(createGVNPass());
-			phaseOne.add(createDeadStoreEliminationPass());
-			phaseOne.add(createInstructionCombiningPass());
-			phaseOne.add(createGlobalDCEPass());
-			phaseOne.run(*module);
-	
-			// Annotate stubs before returning module
-			Function* jumpIntrin = module->getFunction("x86_jump_intrin");
-			vector<Function*> functions;
-			for (Function& fn : module->getFunctionList())
+
+			string irCachePath;
+			if (!module && irCacheDirectory.getNumOccurrences() > 0)
 			{
-				if (md::isPrototype(fn))
+				irCachePath = irCachePathForInput(inputBegin, inputEnd);
+				if (auto cachedBuffer = MemoryBuffer::getFile(irCachePath, -1, false))
 				{
-					continue;
+					auto cachedModule = parseBitcodeFile(cachedBuffer.get()->getMemBufferRef(), mainObj.getContext());
+					if (cachedModule)
+					{
+						module = move(cachedModule.get());
+					}
+					else
+					{
+						// A stale or truncated cache entry isn't fatal; lift from scratch and overwrite it.
+						consumeError(cachedModule.takeError());
+					}
+				}
+			}
+
+			if (!module)
+			{
+				auto moduleOrError = mainObj.generateAnnotatedModule(*executable, moduleName);
+				if (!moduleOrError)
+				{
+					cerr << program << ": couldn't build LLVM module out of " << inputPath << ": " << errorOf(moduleOrError) << endl;
+					return 1;
+				}
+
+				module = move(moduleOrError.get());
+
+				// A budgeted run may have stopped early; don't let a truncated module poison the cache.
+				if (irCachePath.size() > 0 && liftBudget == 0 && !sys::fs::create_directories(irCacheDirectory))
+				{
+					error_code cacheError;
+					raw_fd_ostream cacheOut(irCachePath, cacheError, sys::fs::F_None);
+					if (!cacheError)
+					{
+						WriteBitcodeToFile(module.get(), cacheOut);
+					}
+				}
+
+				if (resumeAnnotatedPath.size() > 0 && liftBudget == 0 && !sys::fs::create_directories(resumeDirectory))
+				{
+					error_code checkpointError;
+					raw_fd_ostream checkpointOut(resumeAnnotatedPath, checkpointError, sys::fs::F_None);
+					if (!checkpointError)
+					{
+						WriteBitcodeToFile(module.get(), checkpointOut);
+					}
+				}
+			}
+		}
+		
+		// Make sure that the module is legal
+		size_t errorCount = 0;
+		if (Function* assertionFailure = module->getFunction("x86_assertion_failure"))
+		{
+			errorCount += forEachCall(assertionFailure, 0, [](const string& message) {
+				cerr << "translation assertion failure: " << message << endl;
+			});
+		}
+		
+		if (errorCount > 0)
+		{
+			cerr << "incorrect or missing translations; cannot decompile" << endl;
+			return 1;
+		}
+		
+		// if we want module output, this is where we stop
+		if (moduleOutCount() == 1)
+		{
+			writeModuleOutput(*module, output);
+			return 0;
+		}
+		
+		// Sharded mode replaces both remaining steps: each call graph shard is optimized and
+		// printed independently.
+		if (shardCount > 1 && moduleInCount() < 2 && moduleOutCount() == 0 && !moduleIsOptimized)
+		{
+			if (mainObj.canShardPipeline())
+			{
+				return mainObj.optimizeAndPrintShards(module, output, executable.get()) ? 0 : 1;
+			}
+			errs() << program << ": pass pipeline contains passes that only exist in this process (Python scripts?); ignoring --shards\n";
+		}
+
+		if (moduleInCount() < 2 && !moduleIsOptimized)
+		{
+			if (!mainObj.optimizeAndTransformModule(module, errs(), executable.get()))
+			{
+				return 1;
+			}
+
+			if (optimizedIrCachePath.size() > 0 && liftBudget == 0 && !sys::fs::create_directories(irCacheDirectory))
+			{
+				error_code cacheError;
+				raw_fd_ostream cacheOut(optimizedIrCachePath, cacheError, sys::fs::F_None);
+				if (!cacheError)
+				{
+					WriteBitcodeToFile(module.get(), cacheOut);
 				}
-				
-				BasicBlock& entry = fn.getEntryBlock();
-				auto terminator = entry.getTerminator();
-				if (isa<UnreachableInst>(terminator))
+			}
+
+			if (resumeOptimizedPath.size() > 0 && liftBudget == 0 && !sys::fs::create_directories(resumeDirectory))
+			{
+				error_code checkpointError;
+				raw_fd_ostream checkpointOut(resumeOptimizedPath, checkpointError, sys::fs::F_None);
+				if (!checkpointError)
 				{
-					if (auto prev = dyn_cast<CallInst>(terminator->getPrevNode()))
-					if (prev->getCalledFunction() == jumpIntrin)
-					if (auto load = dyn_cast<LoadInst>(prev->getOperand(2)))
-					if (auto constantExpr = dyn_cast<ConstantExpr>(load->getPointerOperand()))
-					{
-						unique_ptr<Instruction> inst(constantExpr->getAsInstruction());
-						if (auto int2ptr = dyn_cast<IntToPtrInst>(inst.get()))
-						{
-							auto value = cast<ConstantInt>(int2ptr->getOperand(0));
-							if (const StubInfo* stubTarget = executable.getStubTarget(value->getLimitedValue()))
-							{
-								if (Function* cFunction = cDecls->prototypeForImportName(stubTarget->name))
-								{
-									md::setIsStub(fn);
-									md::setFinalPrototype(fn, *cFunction);
-								}
-								
-								// If we identified no function from the header file, this gives the import its real
-								// name. Otherwise, it'll prefix the name with some number.
-								fn.setName(stubTarget->name);
-							}
-						}
-					}
+					WriteBitcodeToFile(module.get(), checkpointOut);
 				}
 			}
-			return move(module);
+
+			if (prototypeCacheFile.getNumOccurrences() > 0)
+			{
+				exportRecoveredPrototypes(*module, prototypeCacheFile);
+			}
 		}
 		
-		bool optimizeAndTransformModule(Module& module, raw_ostream& errorOutput, Executable* executable = nullptr)
+		if (moduleOutCount() > 1)
 		{
-			PrettyStackTraceString optimize("Optimizing LLVM IR");
-			
-			// Phase 3: make into functions with arguments, run codegen.
-			auto passManager = createBasePassManager();
-			passManager.add(new ExecutableWrapper(executable));
-			passManager.add(createParameterRegistryPass());
-			passManager.add(createExternalAAWrapperPass(&Main::aliasAnalysisHooks));
-			for (Pass* pass : optimizeAndTransformPasses)
+			writeModuleOutput(*module, output);
+			return 0;
+		}
+		
+		// step three (final step): emit pseudocode
+		return mainObj.generateEquivalentPseudocode(*module, output) ? 0 : 1;
+	}
+
+	StatCounter isolatedCompleted("batch.isolated.completed");
+	StatCounter isolatedFailed("batch.isolated.failed");
+	StatCounter isolatedCrashed("batch.isolated.crashed");
+	StatCounter isolatedTimedOut("batch.isolated.timed_out");
+
+	// Batch-mode supervisor: runs one input in a forked worker so that a capstone crash or a
+	// pathological binary only costs that input instead of the whole corpus run. The worker streams
+	// its pseudocode back over a pipe and the supervisor only copies it out on a clean exit, so a
+	// crashed or killed worker leaves no partial output behind.
+	int processInputIsolated(Main& mainObj, char** argv, const string& inputPath, raw_ostream& output)
+	{
+		string program = mainObj.getProgramName();
+		int pipeFds[2];
+		if (pipe(pipeFds) != 0)
+		{
+			cerr << program << ": can't create worker pipe: " << strerror(errno) << endl;
+			return 1;
+		}
+
+		pid_t worker = fork();
+		if (worker == -1)
+		{
+			cerr << program << ": can't fork worker: " << strerror(errno) << endl;
+			close(pipeFds[0]);
+			close(pipeFds[1]);
+			return 1;
+		}
+
+		if (worker == 0)
+		{
+			// Worker side. The watchdog is a plain alarm: if this input hangs, SIGALRM's default
+			// disposition kills the process and the supervisor sees a signaled exit. _exit skips
+			// atexit handlers, so workers don't each dump a --stats-json report.
+			close(pipeFds[0]);
+			if (isolateTimeout != 0)
 			{
-				passManager.add(pass);
+				alarm(isolateTimeout);
 			}
-			passManager.run(module);
-	
-#ifdef FCD_DEBUG
-			if (verifyModule(module, &errorOutput))
+			raw_fd_ostream workerOutput(pipeFds[1], true);
+			int result = processInput(mainObj, argv, inputPath, workerOutput);
+			workerOutput.flush();
+			_exit(result == 0 ? 0 : 1);
+		}
+
+		// Supervisor side: drain the pipe until the worker's exit closes the write end, then collect
+		// its status. Reading before waiting also means a worker can never deadlock against a full
+		// pipe buffer.
+		close(pipeFds[1]);
+		string workerBytes;
+		char buffer[1 << 16];
+		ssize_t bytesRead;
+		while ((bytesRead = read(pipeFds[0], buffer, sizeof buffer)) > 0 || (bytesRead == -1 && errno == EINTR))
+		{
+			if (bytesRead > 0)
 			{
-				// errors!
-				return false;
+				workerBytes.append(buffer, static_cast<size_t>(bytesRead));
 			}
-#endif
-			return true;
 		}
+		close(pipeFds[0]);
 
-		bool generateEquivalentPseudocode(Module& module, raw_ostream& output)
+		int status = 0;
+		while (waitpid(worker, &status, 0) == -1 && errno == EINTR)
 		{
-			PrettyStackTraceString pseudocode("Generating pseudo-C output");
-			
-			// Run that module through the output pass
-			// UnwrapReturns happens after value propagation because value propagation doesn't know that calls
-			// are generally not safe to reorder.
-			AstBackEnd* backend = createAstBackEnd();
-			backend->addPass(new AstRemoveUndef);
-			backend->addPass(new AstConsecutiveCombiner);
-			backend->addPass(new AstNestedCombiner);
-			backend->addPass(new AstConsecutiveCombiner);
-			backend->addPass(new AstSimplifyExpressions);
-			backend->addPass(new AstMergeCongruentVariables);
-			backend->addPass(new AstConsecutiveCombiner);
-			backend->addPass(new AstNestedCombiner);
-			backend->addPass(new AstConsecutiveCombiner);
-			backend->addPass(new AstPrint(output, md::getIncludedFiles(module)));
-			backend->runOnModule(module);
-			return true;
 		}
-	
-		static void initializePasses()
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
 		{
-			auto& pr = *PassRegistry::getPassRegistry();
-			initializeCore(pr);
-			initializeVectorization(pr);
-			initializeIPO(pr);
-			initializeAnalysis(pr);
-			initializeTransformUtils(pr);
-			initializeInstCombine(pr);
-			initializeScalarOpts(pr);
-		
-			initializeParameterRegistryPass(pr);
-			initializeArgumentRecoveryPass(pr);
+			++isolatedCompleted;
+			output << workerBytes;
+			return 0;
 		}
-		
-		bool prepareOptimizationPasses()
+
+		if (WIFSIGNALED(status) && WTERMSIG(status) == SIGALRM)
 		{
-			// Default passes
-			vector<string> passNames = {
-				"globaldce",
-				"fixindirects",
-				"argrec",
-				"sroa",
-				"intnarrowing",
-				"signext",
-				"instcombine",
-				"intops",
-				"simplifyconditions",
-				// <-- custom passes go here with the default pass pipeline
-				"instcombine",
-				"gvn",
-				"simplifycfg",
-				"instcombine",
-				"gvn",
-				"recoverstackframe",
-				"dse",
-				"sccp",
-				"simplifycfg",
-				"eliminatecasts",
-				"instcombine",
-				"memssadle",
-				"dse",
-				"instcombine",
-				"sroa",
-				"instcombine",
-				"globaldce",
-				"simplifycfg",
-			};
-			
-			if (customPassPipeline == "default")
+			++isolatedTimedOut;
+			cerr << program << ": " << inputPath << ": timed out after " << unsigned(isolateTimeout) << " seconds, skipping" << endl;
+		}
+		else if (WIFSIGNALED(status))
+		{
+			++isolatedCrashed;
+			cerr << program << ": " << inputPath << ": worker killed by signal " << WTERMSIG(status) << ", skipping" << endl;
+		}
+		else
+		{
+			++isolatedFailed;
+		}
+		output << "// fcd: skipped " << inputPath << '\n';
+		return 1;
+	}
+
+	// One warm binary in the daemon cache: the input bytes, the parsed executable, and the annotated
+	// (pre-optimization) module for every entry point set it has been lifted with. Annotated modules
+	// are kept as bitcode because optimization consumes the module it runs on.
+	struct DaemonCacheEntry
+	{
+		unique_ptr<MemoryBuffer> buffer;
+		unique_ptr<Executable> executable;
+		unordered_map<string, SmallVector<char, 0>> annotatedModules;
+	};
+
+	// Serves "<path> [entry address...]" requests from standard input, streaming pseudocode back
+	// followed by a "// fcd: end" line (or "// fcd: error: ..." on failure). Recently used binaries
+	// stay warm so that interactive tools asking for one function at a time don't pay executable
+	// parsing and lifting on every request.
+	int runDaemon(Main& mainObj, raw_ostream& output)
+	{
+		std::list<pair<string, DaemonCacheEntry>> cache; // most recently used first
+		bool firstRequest = true;
+
+		auto respondError = [&](const string& message)
+		{
+			output << "// fcd: error: " << message << '\n';
+			output.flush();
+		};
+
+		string line;
+		while (getline(cin, line))
+		{
+			if (line.size() == 0 || line[0] == '#')
 			{
-				if (additionalPasses.size() > 0)
+				continue;
+			}
+
+			istringstream request(line);
+			string path;
+			request >> path;
+
+			additionalEntryPoints.clear();
+			string token;
+			bool badAddress = false;
+			while (request >> token)
+			{
+				char* addressEnd = nullptr;
+				unsigned long long address = strtoull(token.c_str(), &addressEnd, 0);
+				if (addressEnd == token.c_str() || *addressEnd != '\0')
 				{
-					auto extensionPoint = find(passNames.begin(), passNames.end(), "simplifyconditions") + 1;
-					passNames.insert(extensionPoint, additionalPasses.begin(), additionalPasses.end());
+					respondError("bad entry address: " + token);
+					badAddress = true;
+					break;
 				}
-				optimizeAndTransformPasses = createPassesFromList(passNames);
+				additionalEntryPoints.push_back(address);
 			}
-			else if (customPassPipeline == "")
+			if (badAddress)
 			{
-				if (auto editor = getenv("EDITOR"))
+				continue;
+			}
+			rebuildEntryPointIndex();
+
+			// Look the binary up in the cache, loading and parsing it on a miss.
+			auto cacheIter = find_if(cache.begin(), cache.end(), [&](const pair<string, DaemonCacheEntry>& entry)
+			{
+				return entry.first == path;
+			});
+			if (cacheIter == cache.end())
+			{
+				auto bufferOrError = MemoryBuffer::getFile(path, -1, false);
+				if (!bufferOrError)
 				{
-					optimizeAndTransformPasses = interactivelyEditPassPipeline(editor, passNames);
+					respondError("can't open " + path + ": " + errorOf(bufferOrError));
+					continue;
 				}
-				else
+
+				auto buffer = move(bufferOrError.get());
+				auto begin = reinterpret_cast<const uint8_t*>(buffer->getBufferStart());
+				auto end = reinterpret_cast<const uint8_t*>(buffer->getBufferEnd());
+				auto executableOrError = mainObj.parseExecutable(begin, end);
+				if (!executableOrError)
 				{
-					errs() << getProgramName() << ": environment has no EDITOR variable; pass pipeline can't be edited interactively\n";
-					return false;
+					respondError("couldn't parse " + path + ": " + errorOf(executableOrError));
+					continue;
+				}
+
+				// Evict before inserting so the entry being served always survives; a cache size of
+				// zero effectively means one.
+				if (cache.size() >= daemonCacheSize && !cache.empty())
+				{
+					cache.pop_back();
 				}
+				cache.emplace_front(path, DaemonCacheEntry());
+				cacheIter = cache.begin();
+				cacheIter->second.buffer = move(buffer);
+				cacheIter->second.executable = move(executableOrError.get());
 			}
 			else
 			{
-				optimizeAndTransformPasses = readPassPipelineFromString(customPassPipeline);
+				cache.splice(cache.begin(), cache, cacheIter);
 			}
-			return optimizeAndTransformPasses.size() > 0;
+			DaemonCacheEntry& entry = cacheIter->second;
+
+			string entryKey;
+			for (uint64_t entryAddress : entryPointIndex)
+			{
+				raw_string_ostream(entryKey) << entryAddress << ',';
+			}
+
+			unique_ptr<Module> module;
+			SmallVector<char, 0>& annotatedBitcode = entry.annotatedModules[entryKey];
+			if (annotatedBitcode.size() > 0)
+			{
+				MemoryBufferRef bufferRef(StringRef(annotatedBitcode.data(), annotatedBitcode.size()), "fcd-daemon-cache");
+				auto cachedModule = parseBitcodeFile(bufferRef, mainObj.getContext());
+				if (cachedModule)
+				{
+					module = move(cachedModule.get());
+				}
+				else
+				{
+					consumeError(cachedModule.takeError());
+					annotatedBitcode.clear();
+				}
+			}
+
+			if (!module)
+			{
+				auto moduleOrError = mainObj.generateAnnotatedModule(*entry.executable, sys::path::stem(path));
+				if (!moduleOrError)
+				{
+					respondError("couldn't build LLVM module out of " + path + ": " + errorOf(moduleOrError));
+					continue;
+				}
+				module = move(moduleOrError.get());
+				raw_svector_ostream cacheOs(annotatedBitcode);
+				WriteBitcodeToFile(module.get(), cacheOs);
+			}
+
+			size_t errorCount = 0;
+			if (Function* assertionFailure = module->getFunction("x86_assertion_failure"))
+			{
+				errorCount += forEachCall(assertionFailure, 0, [&](const string& message) {
+					respondError("translation assertion failure: " + message);
+				});
+			}
+			if (errorCount > 0)
+			{
+				respondError("incorrect or missing translations; cannot decompile");
+				continue;
+			}
+
+			// Pass managers take ownership of the passes they run, so the pipeline prepared at startup is
+			// consumed by the first request and rebuilt for every later one.
+			if (!firstRequest && !mainObj.prepareOptimizationPasses())
+			{
+				respondError("couldn't prepare optimization passes");
+				continue;
+			}
+			firstRequest = false;
+
+			if (!mainObj.optimizeAndTransformModule(module, errs(), entry.executable.get()))
+			{
+				respondError("optimization failed");
+				continue;
+			}
+
+			if (!mainObj.generateEquivalentPseudocode(*module, output))
+			{
+				respondError("pseudocode generation failed");
+				continue;
+			}
+			output << "// fcd: end\n";
+			output.flush();
 		}
-	};
+		return 0;
+	}
 }
 
 bool isFullDisassembly()
@@ -656,10 +2482,7 @@ bool isExclusiveDisassembly()
 
 bool isEntryPoint(uint64_t vaddr)
 {
-	return any_of(additionalEntryPoints.begin(), additionalEntryPoints.end(), [&](uint64_t entryPoint)
-	{
-		return vaddr == entryPoint;
-	});
+	return binary_search(entryPointIndex.begin(), entryPointIndex.end(), vaddr);
 }
 
 int main(int argc, char** argv)
@@ -667,9 +2490,28 @@ int main(int argc, char** argv)
 	EnablePrettyStackTrace();
 	sys::PrintStackTraceOnErrorSignal(argv[0]);
 	
-	pruneOptionList(cl::getRegisteredOptions());
-	cl::ParseCommandLineOptions(argc, argv, "native program decompiler");
-	
+	// Try to parse fcd's own options without touching LLVM's global option registry, which links in
+	// thousands of options from LLVM and clang; fan-out deployments of sub-second jobs pay for the
+	// registry walk on every startup. Anything the fast path can't handle falls back to the full
+	// parser, which owns every diagnostic.
+	if (!whitelist::parseFastPath(argc, argv))
+	{
+		pruneOptionList(cl::getRegisteredOptions());
+		cl::ParseCommandLineOptions(argc, argv, "native program decompiler");
+	}
+
+	if (arePhaseTimingsEnabled())
+	{
+		// LLVM's own timers cover the per-pass half of the report.
+		TimePassesIsEnabled = true;
+	}
+
+	if (!daemonMode && inputFile.getNumOccurrences() == 0)
+	{
+		errs() << sys::path::filename(argv[0]) << ": no input file\n";
+		return 1;
+	}
+
 	if (customPassPipeline != "default" && additionalPasses.size() > 0)
 	{
 		errs() << sys::path::filename(argv[0]) << ": additional passes only accepted when using the default pipeline\n";
@@ -681,7 +2523,13 @@ int main(int argc, char** argv)
 	
 	Main mainObj(argc, argv);
 	string program = mainObj.getProgramName();
-	
+
+	if (!loadEntryPointFile(program))
+	{
+		return 1;
+	}
+	rebuildEntryPointIndex();
+
 	// step 0: before even attempting anything, prepare optimization passes
 	// (the user won't be happy if we work for 5 minutes only to discover that the optimization passes don't load)
 	if (!mainObj.prepareOptimizationPasses())
@@ -689,89 +2537,100 @@ int main(int argc, char** argv)
 		return 1;
 	}
 	
-	unique_ptr<Executable> executable;
-	unique_ptr<Module> module;
-	
-	// step one: create annotated module from executable (or load it from .ll)
-	ErrorOr<unique_ptr<MemoryBuffer>> bufferOrError(nullptr);
-	if (moduleInCount())
+	// Open the output stream up front so that a bad -o path fails before any real work, and so that
+	// pseudocode can stream to it function by function instead of accumulating in memory.
+	unique_ptr<raw_ostream> outputStream;
+	if (outputFile.getNumOccurrences() > 0)
 	{
-		PrettyStackTraceFormat parsingIR("Parsing IR from \"%s\"", inputFile.c_str());
-		
-		SMDiagnostic errors;
-		module = parseIRFile(inputFile, errors, mainObj.getContext());
-		if (!module)
+		int outputFd;
+		if (auto outputError = sys::fs::openFileForWrite(outputFile, outputFd, sys::fs::F_None))
 		{
-			errors.print(argv[0], errs());
+			cerr << program << ": can't write to " << outputFile << ": " << outputError.message() << endl;
 			return 1;
 		}
-	}
-	else
-	{
-		PrettyStackTraceFormat parsingIR("Parsing executable \"%s\"", inputFile.c_str());
-		
-		bufferOrError = MemoryBuffer::getFile(inputFile, -1, false);
-		if (!bufferOrError)
+#ifdef POSIX_FADV_SEQUENTIAL
+		// Multi-hundred-MB pseudocode dumps are strictly sequential; tell the kernel so it can
+		// drop written-back pages instead of keeping them warm.
+		posix_fadvise(outputFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+		auto fileStream = std::make_unique<raw_fd_ostream>(outputFd, true);
+		if (outputBufferSize != 0)
 		{
-			cerr << program << ": can't open " << inputFile << ": " << errorOf(bufferOrError) << endl;
-			return 1;
+			// A large buffer keeps the syscall count down, which matters when the output sits on
+			// network storage.
+			fileStream->SetBufferSize(size_t(outputBufferSize) * 1024);
 		}
-		
-		auto executableOrError = mainObj.parseExecutable(*bufferOrError.get());
-		if (!executableOrError)
+		if (compressOutput)
 		{
-			cerr << program << ": couldn't parse " << inputFile << ": " << errorOf(executableOrError) << endl;
-			return 1;
+			// The wrapper's compression thread consumes function-sized print buffers while later
+			// functions are still being structured, so the run ends when the last function prints
+			// instead of waiting on an external compressor to drain the whole dump.
+			if (!GzipOutputStream::isAvailable())
+			{
+				cerr << program << ": --gzip requires LLVM to be built with zlib support" << endl;
+				return 1;
+			}
+			outputStream = std::make_unique<GzipOutputStream>(move(fileStream));
 		}
-		
-		executable = move(executableOrError.get());
-		string moduleName = sys::path::stem(inputFile);
-		auto moduleOrError = mainObj.generateAnnotatedModule(*executable, moduleName);
-		if (!moduleOrError)
+		else
 		{
-			cerr << program << ": couldn't build LLVM module out of " << inputFile << ": " << errorOf(moduleOrError) << endl;
-			return 1;
+			outputStream = move(fileStream);
 		}
-		
-		module = move(moduleOrError.get());
-	}
-	
-	// Make sure that the module is legal
-	size_t errorCount = 0;
-	if (Function* assertionFailure = module->getFunction("x86_assertion_failure"))
-	{
-		errorCount += forEachCall(assertionFailure, 0, [](const string& message) {
-			cerr << "translation assertion failure: " << message << endl;
-		});
 	}
-	
-	if (errorCount > 0)
+	else if (compressOutput)
 	{
-		cerr << "incorrect or missing translations; cannot decompile" << endl;
+		cerr << program << ": --gzip requires -o" << endl;
 		return 1;
 	}
-	
-	// if we want module output, this is where we stop
-	if (moduleOutCount() == 1)
+	raw_ostream& output = outputStream ? *outputStream : outs();
+
+	if (daemonMode)
 	{
-		module->print(outs(), nullptr);
-		return 0;
+		return runDaemon(mainObj, output);
 	}
-	
-	if (moduleInCount() < 2)
+
+	int batchFailures = 0;
+	if (batchMode)
 	{
-		if (!mainObj.optimizeAndTransformModule(*module, errs(), executable.get()))
+		ifstream listFile(inputFile);
+		if (!listFile)
 		{
+			cerr << program << ": can't open " << inputFile << endl;
 			return 1;
 		}
+		
+		bool firstInput = true;
+		string line;
+		while (getline(listFile, line))
+		{
+			if (line.size() == 0 || line[0] == '#')
+			{
+				continue;
+			}
+			
+			// Pass managers take ownership of the passes they run, so the prepared pipeline is consumed
+			// by each input and has to be rebuilt before the next one; that is cheap next to process startup.
+			if (!firstInput && !mainObj.prepareOptimizationPasses())
+			{
+				return 1;
+			}
+			firstInput = false;
+			
+			if (moduleOutCount() < 1)
+			{
+				output << "// " << line << '\n';
+			}
+			int inputResult = isolateInputs
+				? processInputIsolated(mainObj, argv, line, output)
+				: processInput(mainObj, argv, line, output);
+			if (inputResult != 0)
+			{
+				// One bad binary shouldn't abort the rest of a corpus run.
+				batchFailures++;
+			}
+		}
+		return batchFailures == 0 ? 0 : 1;
 	}
 	
-	if (moduleOutCount() > 1)
-	{
-		module->print(outs(), nullptr);
-		return 0;
-	}
-	
-	// step three (final step): emit pseudocode
-	return mainObj.generateEquivalentPseudocode(*module, outs()) ? 0 : 1;
+	return processInput(mainObj, argv, inputFile, output);
 }
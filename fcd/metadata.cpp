@@ -33,6 +33,46 @@ namespace
 		}
 		return false;
 	}
+
+	ConstantInt* constantIntFromNode(MDNode* node)
+	{
+		if (node != nullptr)
+		{
+			if (auto constantMD = dyn_cast<ConstantAsMetadata>(node->getOperand(0)))
+			{
+				return dyn_cast<ConstantInt>(constantMD->getValue());
+			}
+		}
+		return nullptr;
+	}
+
+	Function* functionFromNode(MDNode* node)
+	{
+		if (node != nullptr)
+		{
+			if (auto valueAsMd = dyn_cast<ValueAsMetadata>(node->getOperand(0)))
+			{
+				return cast<Function>(valueAsMd->getValue());
+			}
+		}
+		return nullptr;
+	}
+
+	bool callsOnlyPlaceholder(const Function& fn)
+	{
+		// check if it only calls a fcd.placeholder function
+		if (fn.getBasicBlockList().size() == 1)
+		{
+			const BasicBlock& entry = fn.getEntryBlock();
+			if (entry.getInstList().size() == 2)
+			if (const CallInst* call = dyn_cast<CallInst>(entry.begin()))
+			if (Function* func = call->getCalledFunction())
+			{
+				return func->getName().startswith("fcd.placeholder");
+			}
+		}
+		return false;
+	}
 }
 
 void md::ensureFunctionBody(Function& fn)
@@ -84,17 +124,7 @@ ConstantInt* md::getStackPointerArgument(const Function &fn)
 
 ConstantInt* md::getVirtualAddress(const Function& fn)
 {
-	if (auto node = fn.getMetadata("fcd.vaddr"))
-	{
-		if (auto constantMD = dyn_cast<ConstantAsMetadata>(node->getOperand(0)))
-		{
-			if (auto constantInt = dyn_cast<ConstantInt>(constantMD->getValue()))
-			{
-				return constantInt;
-			}
-		}
-	}
-	return nullptr;
+	return constantIntFromNode(fn.getMetadata("fcd.vaddr"));
 }
 
 unsigned md::getFunctionVersion(const Function& fn)
@@ -114,11 +144,16 @@ unsigned md::getFunctionVersion(const Function& fn)
 
 Function* md::getFinalPrototype(const Function& fn)
 {
-	if (auto node = fn.getMetadata("fcd.prototype"))
+	return functionFromNode(fn.getMetadata("fcd.prototype"));
+}
+
+MDString* md::getDuplicateOf(const Function& fn)
+{
+	if (auto node = fn.getMetadata("fcd.duplicate"))
 	{
-		if (auto valueAsMd = dyn_cast<ValueAsMetadata>(node->getOperand(0)))
+		if (auto nameNode = dyn_cast<MDString>(node->getOperand(0)))
 		{
-			return cast<Function>(valueAsMd->getValue());
+			return nameNode;
 		}
 	}
 	return nullptr;
@@ -136,24 +171,7 @@ bool md::areArgumentsRecoverable(const Function &fn)
 
 bool md::isPrototype(const Function &fn)
 {
-	if (fn.isDeclaration() || md::isStub(fn))
-	{
-		return true;
-	}
-	
-	// check if it only calls a fcd.placeholder function
-	if (fn.getBasicBlockList().size() == 1)
-	{
-		const BasicBlock& entry = fn.getEntryBlock();
-		if (entry.getInstList().size() == 2)
-		if (const CallInst* call = dyn_cast<CallInst>(entry.begin()))
-		if (Function* func = call->getCalledFunction())
-		{
-			return func->getName().startswith("fcd.placeholder");
-		}
-	}
-	
-	return false;
+	return fn.isDeclaration() || md::isStub(fn) || callsOnlyPlaceholder(fn);
 }
 
 bool md::isStackFrame(const AllocaInst &alloca)
@@ -214,6 +232,15 @@ void md::setFinalPrototype(Function& stub, Function& target)
 	stub.setMetadata("fcd.prototype", MDNode::get(stub.getContext(), ValueAsMetadata::get(&target)));
 }
 
+void md::setDuplicateOf(Function& fn, Function& original)
+{
+	ensureFunctionBody(fn);
+	LLVMContext& ctx = fn.getContext();
+	// By name rather than by value: argument recovery replaces the original function with a
+	// parameterized clone that takes its name, which would leave a value reference dangling.
+	fn.setMetadata("fcd.duplicate", MDNode::get(ctx, MDString::get(ctx, original.getName())));
+}
+
 void md::setIsStub(Function &fn, bool stub)
 {
 	ensureFunctionBody(fn);
@@ -263,6 +290,23 @@ void md::setAssemblyString(Function &fn, StringRef assembly)
 	fn.setMetadata("fcd.asm", asmNode);
 }
 
+uint64_t md::getTimingNanoseconds(const Function& fn, StringRef phase)
+{
+	if (auto value = constantIntFromNode(fn.getMetadata(("fcd.time." + phase).str())))
+	{
+		return value->getLimitedValue();
+	}
+	return 0;
+}
+
+void md::addTimingNanoseconds(Function& fn, StringRef phase, uint64_t nanoseconds)
+{
+	ensureFunctionBody(fn);
+	auto& ctx = fn.getContext();
+	ConstantInt* cTotal = ConstantInt::get(Type::getInt64Ty(ctx), getTimingNanoseconds(fn, phase) + nanoseconds);
+	fn.setMetadata(("fcd.time." + phase).str(), MDNode::get(ctx, ConstantAsMetadata::get(cTotal)));
+}
+
 void md::setStackFrame(AllocaInst &alloca)
 {
 	setFlag(alloca, "fcd.stackframe");
@@ -381,3 +425,65 @@ StringRef md::getRecoveredReturnFieldName(Module& module, StructType& returnType
 	
 	return "";
 }
+
+md::MetadataKinds::MetadataKinds(LLVMContext& ctx)
+: virtualAddressKind(ctx.getMDKindID("fcd.vaddr"))
+, prototypeKind(ctx.getMDKindID("fcd.prototype"))
+, stubKind(ctx.getMDKindID("fcd.stub"))
+, recoverableKind(ctx.getMDKindID("fcd.recoverable"))
+, stackFrameKind(ctx.getMDKindID("fcd.stackframe"))
+, programMemoryKind(ctx.getMDKindID("fcd.prgmem"))
+, registersKind(ctx.getMDKindID("fcd.registers"))
+{
+}
+
+ConstantInt* md::MetadataKinds::getVirtualAddress(const Function& fn) const
+{
+	return constantIntFromNode(fn.getMetadata(virtualAddressKind));
+}
+
+Function* md::MetadataKinds::getFinalPrototype(const Function& fn) const
+{
+	return functionFromNode(fn.getMetadata(prototypeKind));
+}
+
+bool md::MetadataKinds::isStub(const Function& fn) const
+{
+	return fn.getMetadata(stubKind) != nullptr;
+}
+
+bool md::MetadataKinds::areArgumentsRecoverable(const Function& fn) const
+{
+	return fn.getMetadata(recoverableKind) != nullptr;
+}
+
+bool md::MetadataKinds::isPrototype(const Function& fn) const
+{
+	return fn.isDeclaration() || isStub(fn) || callsOnlyPlaceholder(fn);
+}
+
+bool md::MetadataKinds::isStackFrame(const AllocaInst& alloca) const
+{
+	return alloca.getMetadata(stackFrameKind) != nullptr;
+}
+
+bool md::MetadataKinds::isProgramMemory(const Instruction& value) const
+{
+	return value.getMetadata(programMemoryKind) != nullptr;
+}
+
+bool md::MetadataKinds::isRegisterStruct(const Value& value) const
+{
+	if (auto arg = dyn_cast<Argument>(&value))
+	{
+		const Function& fn = *arg->getParent();
+		return areArgumentsRecoverable(fn) && arg == &*fn.arg_begin();
+	}
+
+	if (auto alloca = dyn_cast<AllocaInst>(&value))
+	{
+		return alloca->getMetadata(registersKind) != nullptr;
+	}
+
+	return false;
+}
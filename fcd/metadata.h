@@ -29,22 +29,29 @@ namespace md
 	llvm::ConstantInt* getVirtualAddress(const llvm::Function& fn);
 	unsigned getFunctionVersion(const llvm::Function& fn);
 	llvm::Function* getFinalPrototype(const llvm::Function& fn);
+	llvm::MDString* getDuplicateOf(const llvm::Function& fn);
 	bool isStub(const llvm::Function& fn);
 	bool areArgumentsRecoverable(const llvm::Function& fn);
 	bool isPrototype(const llvm::Function& fn);
 	llvm::MDString* getAssemblyString(const llvm::Function& fn);
+	// Accumulated wall-clock cost of a decompilation phase ("lift", "structure") for this function,
+	// or 0 when the phase never ran on it. Stored as metadata so it survives the bitcode round-trips
+	// that the parallel phases use.
+	uint64_t getTimingNanoseconds(const llvm::Function& fn, llvm::StringRef phase);
 	bool isStackFrame(const llvm::AllocaInst& alloca);
 	bool isProgramMemory(const llvm::Instruction& value);
 
 	void addIncludedFiles(llvm::Module& module, const std::vector<std::string>& includedFiles);
 	void setVirtualAddress(llvm::Function& fn, uint64_t virtualAddress);
 	void setFinalPrototype(llvm::Function& stub, llvm::Function& target);
+	void setDuplicateOf(llvm::Function& fn, llvm::Function& original);
 	void incrementFunctionVersion(llvm::Function& fn);
 	void setIsStub(llvm::Function& fn, bool stub = true);
 	void setArgumentsRecoverable(llvm::Function& fn, bool recoverable = true);
 	void setStackPointerArgument(llvm::Function& fn, unsigned argIndex);
 	void removeStackPointerArgument(llvm::Function& fn);
 	void setAssemblyString(llvm::Function& fn, llvm::StringRef assembly);
+	void addTimingNanoseconds(llvm::Function& fn, llvm::StringRef phase, uint64_t nanoseconds);
 	void setStackFrame(llvm::AllocaInst& alloca);
 	void setProgramMemory(llvm::Instruction& value, bool isProgramMemory = true);
 	
@@ -52,9 +59,36 @@ namespace md
 	
 	bool isRegisterStruct(const llvm::Value& value);
 	void setRegisterStruct(llvm::AllocaInst& alloca, bool registerStruct = true);
-	
+
 	void setRecoveredReturnFieldNames(llvm::Module& module, llvm::StructType& returnType, const CallInformation& callInfo);
 	llvm::StringRef getRecoveredReturnFieldName(llvm::Module& module, llvm::StructType& returnType, unsigned i);
+
+	// Accessor for the queries above that resolves the "fcd.*" metadata kind IDs of a context
+	// once instead of hashing the kind name on every call. The free helpers are fine for
+	// occasional queries; build one of these when querying per function, per instruction or per
+	// alias query. Kind IDs are stable for the lifetime of the context.
+	class MetadataKinds
+	{
+		unsigned virtualAddressKind;
+		unsigned prototypeKind;
+		unsigned stubKind;
+		unsigned recoverableKind;
+		unsigned stackFrameKind;
+		unsigned programMemoryKind;
+		unsigned registersKind;
+
+	public:
+		MetadataKinds(llvm::LLVMContext& ctx);
+
+		llvm::ConstantInt* getVirtualAddress(const llvm::Function& fn) const;
+		llvm::Function* getFinalPrototype(const llvm::Function& fn) const;
+		bool isStub(const llvm::Function& fn) const;
+		bool areArgumentsRecoverable(const llvm::Function& fn) const;
+		bool isPrototype(const llvm::Function& fn) const;
+		bool isStackFrame(const llvm::AllocaInst& alloca) const;
+		bool isProgramMemory(const llvm::Instruction& value) const;
+		bool isRegisterStruct(const llvm::Value& value) const;
+	};
 }
 
 #endif /* fcd__metadata_h */
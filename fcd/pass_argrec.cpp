@@ -51,27 +51,48 @@ void ArgumentRecovery::getAnalysisUsage(AnalysisUsage& au) const
 
 bool ArgumentRecovery::runOnModule(Module& module)
 {
+	registerPtr.reserve(module.getFunctionList().size());
 	for (Function& fn : module.getFunctionList())
 	{
 		getRegisterPtr(fn);
 	}
-	
-	bool changed = false;
+
+	// Decide every signature and create the parameterized shells up front, while every use list
+	// is still untouched. Interleaving creation with call site rewriting made each function pay
+	// for use-list churn caused by the previous ones on large modules.
+	vector<SignatureRewrite> plan;
+	plan.reserve(module.getFunctionList().size());
 	for (Function& fn : module.getFunctionList())
 	{
 		if (md::areArgumentsRecoverable(fn))
 		{
-			changed |= recoverArguments(fn);
+			planSignature(fn, plan);
 		}
 	}
-	
+
+	// With every target shell in place, one sweep moves all the call sites over...
+	for (SignatureRewrite& rewrite : plan)
+	{
+		fixCallSites(*rewrite.oldFunction, *rewrite.newFunction, *rewrite.callInfo);
+	}
+
+	// ...and another moves the bodies, so the rewritten calls travel into their final functions.
+	for (SignatureRewrite& rewrite : plan)
+	{
+		if (!md::isPrototype(*rewrite.oldFunction))
+		{
+			updateFunctionBody(*rewrite.oldFunction, *rewrite.newFunction, *rewrite.callInfo);
+			functionsToErase.push_back(rewrite.oldFunction);
+		}
+	}
+
 	getAnalysis<CallGraphWrapperPass>().releaseMemory();
 	for (Function* toErase : functionsToErase)
 	{
 		toErase->eraseFromParent();
 	}
-	
-	return changed;
+
+	return !plan.empty();
 }
 
 Function& ArgumentRecovery::createParameterizedFunction(Function& base, const CallInformation& callInfo)
@@ -433,10 +454,10 @@ CallInst* ArgumentRecovery::createCallSite(TargetInfo& targetInfo, const CallInf
 	return newCall;
 }
 
-bool ArgumentRecovery::recoverArguments(Function& fn)
+void ArgumentRecovery::planSignature(Function& fn, vector<SignatureRewrite>& plan)
 {
 	ParameterRegistry& paramRegistry = getAnalysis<ParameterRegistry>();
-	
+
 	unique_ptr<CallInformation> uniqueCallInfo;
 	const CallInformation* callInfo = nullptr;
 	Function* parameterizedFunction = nullptr;
@@ -450,9 +471,9 @@ bool ArgumentRecovery::recoverArguments(Function& fn)
 			{
 				prototype->deleteBody();
 			}
-			
+
 			parameterizedFunction->takeName(&fn);
-			
+
 			// Set stub parameter names.
 			SmallVector<string, 8> parameterNames;
 			auto& module = *prototype->getParent();
@@ -467,12 +488,13 @@ bool ArgumentRecovery::recoverArguments(Function& fn)
 			}
 		}
 	}
-	
+
 	if (callInfo == nullptr)
 	{
 		if (md::isPrototype(fn))
 		{
-			// find a call site and consider it canon
+			// Find a call site and consider it canon. This has to happen in the planning phase,
+			// before the rewrite sweep starts erasing calls.
 			for (auto user : fn.users())
 			{
 				if (auto call = dyn_cast<CallInst>(user))
@@ -487,21 +509,16 @@ bool ArgumentRecovery::recoverArguments(Function& fn)
 		{
 			callInfo = paramRegistry.getCallInfo(fn);
 		}
-		parameterizedFunction = &createParameterizedFunction(fn, *callInfo);
+		if (callInfo != nullptr)
+		{
+			parameterizedFunction = &createParameterizedFunction(fn, *callInfo);
+		}
 	}
-	
+
 	if (callInfo != nullptr)
 	{
-		fixCallSites(fn, *parameterizedFunction, *callInfo);
-		
-		if (!md::isPrototype(fn))
-		{
-			updateFunctionBody(fn, *parameterizedFunction, *callInfo);
-			functionsToErase.push_back(&fn);
-		}
-		return true;
+		plan.push_back({ &fn, parameterizedFunction, callInfo, move(uniqueCallInfo) });
 	}
-	return false;
 }
 
 ModulePass* createArgumentRecoveryPass()
@@ -16,21 +16,33 @@
 #include <llvm/Analysis/Passes.h>
 #include <llvm/IR/Module.h>
 
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 class ArgumentRecovery final : public llvm::ModulePass
 {
+	// One function whose signature gets rewritten: the shell with the recovered signature already
+	// exists, call sites and body still have to follow.
+	struct SignatureRewrite
+	{
+		llvm::Function* oldFunction;
+		llvm::Function* newFunction;
+		const CallInformation* callInfo;
+		std::unique_ptr<CallInformation> ownedCallInfo;
+	};
+
 	std::unordered_map<const llvm::Function*, llvm::Value*> registerPtr;
 	llvm::SmallVector<llvm::Function*, 10> functionsToErase;
-	
+
 	llvm::Value* getRegisterPtr(llvm::Function& fn);
-	
+
 	llvm::Function& createParameterizedFunction(llvm::Function& base, const CallInformation& ci);
 	void fixCallSites(llvm::Function& base, llvm::Function& newTarget, const CallInformation& ci);
 	llvm::Value* createReturnValue(llvm::Function& function, const CallInformation& ci, llvm::Instruction* insertionPoint);
 	void updateFunctionBody(llvm::Function& oldFunction, llvm::Function& newTarget, const CallInformation& ci);
-	bool recoverArguments(llvm::Function& fn);
-	
+	void planSignature(llvm::Function& fn, std::vector<SignatureRewrite>& plan);
+
 public:
 	static char ID;
 	
@@ -9,6 +9,8 @@
 
 #include "passes.h"
 
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/PatternMatch.h>
 
@@ -159,14 +161,142 @@ namespace
 		return nullptr;
 	}
 	
+	// Shared tail for idioms that fold down to one comparison: widen it back to the original type
+	// if needed and take over the instruction's uses.
+	bool replaceWithComparison(Instruction& inst, Instruction* comparison)
+	{
+		if (comparison == nullptr)
+		{
+			return false;
+		}
+		Instruction* resultInst = inst.getType() != comparison->getType()
+			? (Instruction*)CastInst::Create(CastInst::ZExt, comparison, inst.getType(), "", &inst)
+			: (Instruction*)comparison;
+		inst.replaceAllUsesWith(resultInst);
+		return true;
+	}
+
+	bool handleUnsignedSubOverflow(Instruction& inst)
+	{
+		Value* arg0 = nullptr;
+		Value* arg1 = nullptr;
+		if (!match(&inst, m_Intrinsic<Intrinsic::usub_with_overflow>(m_Value(arg0), m_Value(arg1))))
+		{
+			return false;
+		}
+
+		bool changed = false;
+		for (auto user : inst.users())
+		{
+			if (auto extract = dyn_cast<ExtractValueInst>(user))
+			{
+				auto indices = extract->getIndices();
+				if (indices.size() == 1 && indices[0] == 1)
+				{
+					auto icmp = ICmpInst::Create(Instruction::ICmp, ICmpInst::ICMP_ULT, arg0, arg1, "", &inst);
+					extract->replaceAllUsesWith(icmp);
+					changed = true;
+				}
+			}
+		}
+		return changed;
+	}
+
+	bool handleOverflowSignXor(Instruction& inst)
+	{
+		Value* arg0 = nullptr;
+		Value* arg1 = nullptr;
+		if (match(&inst, m_Xor(m_Value(arg0), m_Value(arg1))))
+		if (unique_ptr<Subtraction> sub = matchOverflowSignFlag(*arg0, *arg1))
+		{
+			auto comparison = ICmpInst::Create(Instruction::ICmp, ICmpInst::ICMP_SLT, sub->left, sub->right, "", &inst);
+			return replaceWithComparison(inst, comparison);
+		}
+		return false;
+	}
+
+	bool handleOverflowSignEquality(Instruction& inst)
+	{
+		Value* arg0 = nullptr;
+		Value* arg1 = nullptr;
+		ICmpInst::Predicate pred;
+		if (match(&inst, m_ICmp(pred, m_Value(arg0), m_Value(arg1))))
+		if (pred == ICmpInst::ICMP_EQ || pred == ICmpInst::ICMP_NE)
+		if (unique_ptr<Subtraction> sub = matchOverflowSignFlag(*arg0, *arg1))
+		{
+			CmpInst::Predicate comparisonPred = pred == ICmpInst::ICMP_NE ? ICmpInst::ICMP_SLT : ICmpInst::ICMP_SGE;
+			auto comparison = ICmpInst::Create(Instruction::ICmp, comparisonPred, sub->left, sub->right, "", &inst);
+			return replaceWithComparison(inst, comparison);
+		}
+		return false;
+	}
+
+	bool handleShiftOrZeroTest(Instruction& inst)
+	{
+		// For some time, LLVM has "simplified" instructions that are almost signed comparisons
+		// with zero into ((var >> 31) | (var == 0)). This tests against this very specific
+		// pattern.
+		uint64_t shiftAmount;
+		Value* shiftedValue;
+		Value* testedValue;
+		ICmpInst::Predicate pred;
+		if (match(&inst, m_Or(m_LShr(m_Value(shiftedValue), m_ConstantInt(shiftAmount)), m_ZExt(m_ICmp(pred, m_Value(testedValue), m_ConstantInt<0>())))))
+		if (shiftedValue == testedValue)
+		if (shiftAmount == shiftedValue->getType()->getIntegerBitWidth() - 1)
+		{
+			auto zero = ConstantInt::get(shiftedValue->getType(), 0);
+			auto comparison = ICmpInst::Create(Instruction::ICmp, CmpInst::ICMP_SLE, shiftedValue, zero, "", &inst);
+			return replaceWithComparison(inst, comparison);
+		}
+		return false;
+	}
+
+	// The idiom registry, bucketed by the root opcode of the pattern. Recognition costs one map
+	// lookup per instruction and only runs the handlers whose bucket matches, so adding idioms
+	// doesn't slow down the instructions they can't apply to.
+	using IdiomHandler = bool (*)(Instruction&);
+
+	struct IdiomTableEntry
+	{
+		unsigned opcode;
+		IdiomHandler handler;
+	};
+
+	const IdiomTableEntry flagIdioms[] = {
+		{ Instruction::Call, &handleUnsignedSubOverflow },
+		{ Instruction::Xor, &handleOverflowSignXor },
+		{ Instruction::ICmp, &handleOverflowSignEquality },
+		{ Instruction::Or, &handleShiftOrZeroTest },
+	};
+
+	const SmallDenseMap<unsigned, SmallVector<IdiomHandler, 2>, 8>& idiomsByOpcode()
+	{
+		static const auto buckets = []
+		{
+			SmallDenseMap<unsigned, SmallVector<IdiomHandler, 2>, 8> table;
+			for (const auto& entry : flagIdioms)
+			{
+				table[entry.opcode].push_back(entry.handler);
+			}
+			return table;
+		}();
+		return buckets;
+	}
+
 	struct ConditionSimplification final : public FunctionPass
 	{
 		static char ID;
-		
+
 		ConditionSimplification() : FunctionPass(ID)
 		{
 		}
-		
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			// Substitutes comparison instructions within blocks; the CFG is untouched.
+			au.setPreservesCFG();
+		}
+
 		virtual bool runOnFunction(Function& fn) override
 		{
 			bool result = false;
@@ -176,84 +306,25 @@ namespace
 			}
 			return result;
 		}
-		
+
 		bool runOnBasicBlock(BasicBlock& bb)
 		{
 			bool result = false;
+			const auto& idioms = idiomsByOpcode();
 			for (auto& inst : bb)
 			{
-				Value* arg0 = nullptr;
-				Value* arg1 = nullptr;
-				if (match(&inst, m_Intrinsic<Intrinsic::usub_with_overflow>(m_Value(arg0), m_Value(arg1))))
+				auto bucket = idioms.find(inst.getOpcode());
+				if (bucket == idioms.end())
 				{
-					for (auto user : inst.users())
-					{
-						if (auto extract = dyn_cast<ExtractValueInst>(user))
-						{
-							auto indices = extract->getIndices();
-							if (indices.size() == 1 && indices[0] == 1)
-							{
-								auto icmp = ICmpInst::Create(Instruction::ICmp, ICmpInst::ICMP_ULT, arg0, arg1, "", &inst);
-								extract->replaceAllUsesWith(icmp);
-							}
-						}
-					}
+					continue;
 				}
-				else
+
+				for (IdiomHandler handler : bucket->second)
 				{
-					Instruction* comparison = nullptr;
-					ICmpInst::Predicate pred;
-					if (match(&inst, m_Xor(m_Value(arg0), m_Value(arg1))))
-					{
-						if (unique_ptr<Subtraction> sub = matchOverflowSignFlag(*arg0, *arg1))
-						{
-							comparison = ICmpInst::Create(Instruction::ICmp, ICmpInst::ICMP_SLT, sub->left, sub->right, "", &inst);
-						}
-					}
-					else if (match(&inst, m_ICmp(pred, m_Value(arg0), m_Value(arg1))))
-					{
-						if (pred == ICmpInst::ICMP_EQ || pred == ICmpInst::ICMP_NE)
-						if (unique_ptr<Subtraction> sub = matchOverflowSignFlag(*arg0, *arg1))
-						{
-							CmpInst::Predicate comparisonPred;
-							if (pred == ICmpInst::ICMP_NE)
-							{
-								comparisonPred = ICmpInst::ICMP_SLT;
-							}
-							else if (pred == ICmpInst::ICMP_EQ)
-							{
-								comparisonPred = ICmpInst::ICMP_SGE;
-							}
-							else
-							{
-								continue;
-							}
-							comparison = ICmpInst::Create(Instruction::ICmp, comparisonPred, sub->left, sub->right, "", &inst);
-						}
-					}
-					else
-					{
-						// For some time, LLVM has "simplified" instructions that are almost signed comparisons
-						// with zero into ((var >> 31) | (var == 0)). This tests against this very specific
-						// pattern.
-						uint64_t shiftAmount;
-						Value* shiftedValue;
-						Value* testedValue;
-						if (match(&inst, m_Or(m_LShr(m_Value(shiftedValue), m_ConstantInt(shiftAmount)), m_ZExt(m_ICmp(pred, m_Value(testedValue), m_ConstantInt<0>())))))
-						if (shiftedValue == testedValue)
-						if (shiftAmount == shiftedValue->getType()->getIntegerBitWidth() - 1)
-						{
-							auto zero = ConstantInt::get(shiftedValue->getType(), 0);
-							comparison = ICmpInst::Create(Instruction::ICmp, CmpInst::ICMP_SLE, shiftedValue, zero, "", &inst);
-						}
-					}
-					
-					if (comparison != nullptr)
+					if (handler(inst))
 					{
-						Instruction* resultInst = inst.getType() != comparison->getType()
-							? (Instruction*)CastInst::Create(CastInst::ZExt, comparison, inst.getType(), "", &inst)
-							: (Instruction*)comparison;
-						inst.replaceAllUsesWith(resultInst);
+						result = true;
+						break;
 					}
 				}
 			}
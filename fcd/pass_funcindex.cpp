@@ -0,0 +1,72 @@
+//
+// pass_funcindex.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "metadata.h"
+#include "pass_funcindex.h"
+
+#include <algorithm>
+
+using namespace llvm;
+using namespace std;
+
+void FunctionAddressIndex::build(Module& module)
+{
+	sortedFunctions.clear();
+	addresses.clear();
+	sortedFunctions.reserve(module.getFunctionList().size());
+	for (Function& fn : module)
+	{
+		if (auto address = md::getVirtualAddress(fn))
+		{
+			uint64_t value = address->getLimitedValue();
+			sortedFunctions.push_back({ value, &fn });
+			addresses[&fn] = value;
+		}
+	}
+
+	// Name as tiebreaker: folded duplicates share an address with their original, and a stable
+	// output order shouldn't depend on module iteration order.
+	sort(sortedFunctions.begin(), sortedFunctions.end(), [](const pair<uint64_t, Function*>& a, const pair<uint64_t, Function*>& b)
+	{
+		if (a.first != b.first)
+		{
+			return a.first < b.first;
+		}
+		return a.second->getName() < b.second->getName();
+	});
+}
+
+Function* FunctionAddressIndex::getFunctionAtAddress(uint64_t address) const
+{
+	auto iter = lower_bound(sortedFunctions.begin(), sortedFunctions.end(), address, [](const pair<uint64_t, Function*>& entry, uint64_t address)
+	{
+		return entry.first < address;
+	});
+	if (iter != sortedFunctions.end() && iter->first == address)
+	{
+		return iter->second;
+	}
+	return nullptr;
+}
+
+char FunctionAddressIndexWrapper::ID = 0;
+
+void FunctionAddressIndexWrapper::getAnalysisUsage(AnalysisUsage& au) const
+{
+	au.setPreservesAll();
+}
+
+bool FunctionAddressIndexWrapper::runOnModule(Module& module)
+{
+	index.build(module);
+	return false;
+}
+
+INITIALIZE_PASS_BEGIN(FunctionAddressIndexWrapper, "funcindex", "Address-to-function index", false, true)
+INITIALIZE_PASS_END(FunctionAddressIndexWrapper, "funcindex", "Address-to-function index", false, true)
@@ -0,0 +1,69 @@
+//
+// pass_funcindex.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__pass_funcindex_h
+#define fcd__pass_funcindex_h
+
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Address-sorted side index over a module's lifted functions. md::getVirtualAddress decodes an
+// MDNode on every call, so consumers that match or order functions by address used to pay one
+// metadata decode per query; the index decodes each function once and answers queries with a
+// binary search or a hash probe.
+class FunctionAddressIndex
+{
+	std::vector<std::pair<uint64_t, llvm::Function*>> sortedFunctions;
+	llvm::DenseMap<const llvm::Function*, uint64_t> addresses;
+
+public:
+	void build(llvm::Module& module);
+
+	// Functions without an address annotation (imports, synthesized helpers) are absent from the
+	// index; duplicates folded onto an original keep theirs and share the slot's address.
+	llvm::Function* getFunctionAtAddress(uint64_t address) const;
+
+	// Returns 0 for functions that carry no address annotation.
+	uint64_t getAddress(const llvm::Function& fn) const { return addresses.lookup(&fn); }
+
+	const std::vector<std::pair<uint64_t, llvm::Function*>>& functionsByAddress() const { return sortedFunctions; }
+};
+
+// Pass-manager face of the index, for IR passes that want address↔function queries without
+// scanning the module themselves. (AstBackEnd runs outside a pass manager and builds a
+// FunctionAddressIndex directly.)
+class FunctionAddressIndexWrapper final : public llvm::ModulePass
+{
+	FunctionAddressIndex index;
+
+public:
+	static char ID;
+
+	FunctionAddressIndexWrapper() : ModulePass(ID)
+	{
+	}
+
+	FunctionAddressIndex& getIndex() { return index; }
+
+	virtual void getAnalysisUsage(llvm::AnalysisUsage& au) const override;
+	virtual bool runOnModule(llvm::Module& module) override;
+};
+
+namespace llvm
+{
+	void initializeFunctionAddressIndexWrapperPass(PassRegistry& pr);
+}
+
+#endif /* fcd__pass_funcindex_h */
@@ -56,6 +56,8 @@ namespace
 		virtual void getAnalysisUsage(AnalysisUsage& au) const override
 		{
 			au.addRequired<DemandedBitsWrapperPass>();
+			// Narrowing swaps value widths instruction by instruction; the CFG is untouched.
+			au.setPreservesCFG();
 		}
 		
 		Value* narrowDown(Value* thatValue, unsigned size)
@@ -73,9 +75,31 @@ namespace
 				auto binOp = dyn_cast<BinaryOperator>(thatValue);
 				if (binOp != nullptr && isMod2Equivalent(binOp->getOpcode()))
 				{
-					Value* left = narrowDown(binOp->getOperand(0), size);
-					Value* right = narrowDown(binOp->getOperand(1), size);
-					value = BinaryOperator::Create(binOp->getOpcode(), left, right, "", binOp);
+					// If a wider narrowed copy already exists, derive this one from it with a single trunc:
+					// mod-2^n arithmetic truncates freely, and this saves re-walking the whole operand chain
+					// for every distinct demanded width.
+					Instruction* wider = nullptr;
+					unsigned widerSize = valueSize;
+					for (const auto& pair : valueMap)
+					{
+						if (pair.second != nullptr && pair.first > size && pair.first < widerSize)
+						{
+							wider = pair.second;
+							widerSize = pair.first;
+						}
+					}
+
+					if (wider != nullptr)
+					{
+						Type* truncatedType = Type::getIntNTy(thatValue->getContext(), size);
+						value = CastInst::Create(Instruction::Trunc, wider, truncatedType, "", wider->getNextNode());
+					}
+					else
+					{
+						Value* left = narrowDown(binOp->getOperand(0), size);
+						Value* right = narrowDown(binOp->getOperand(1), size);
+						value = BinaryOperator::Create(binOp->getOpcode(), left, right, "", binOp);
+					}
 				}
 				else
 				{
@@ -27,7 +27,7 @@ namespace
 		}
 		return maybeCast;
 	}
-	
+
 	bool replaceWithDivision(Instruction& insertionPoint, Value* left, uint64_t denom, bool signedDiv = true)
 	{
 		auto denominator = ConstantInt::get(left->getType(), denom);
@@ -42,234 +42,280 @@ namespace
 		insertionPoint.replaceAllUsesWith(result);
 		return true;
 	}
-	
-	// Has to happen after instcombine
-	struct IntOperations : public FunctionPass
+
+	// Signed division by a power of two
+	bool matchSignedPowerOfTwoDivision(BinaryOperator& shiftRight)
 	{
-		static char ID;
-		
-		IntOperations() : FunctionPass(ID)
+		Value* addOperand;
+		Value* truncOperand;
+		Value* largeShiftOperand;
+		uint64_t smallShiftAmount, largeShiftAmount, mask;
+		if (match(&shiftRight, m_AShr(m_Add(m_And(m_Trunc(m_Value(truncOperand)), m_ConstantInt(mask)), m_Value(addOperand)), m_ConstantInt(smallShiftAmount))))
+		if (match(unwrapCast(truncOperand), m_LShr(m_Value(largeShiftOperand), m_ConstantInt(largeShiftAmount))))
+		if (unwrapCast(largeShiftOperand) == unwrapCast(addOperand))
+		if (addOperand->getType()->getIntegerBitWidth() < largeShiftAmount)
+		if (((mask + 1) & mask) == 0) // mask starts at least significant bit and is contiguous?
+		if (__builtin_ctzll(~mask) == smallShiftAmount)
 		{
+			return replaceWithDivision(shiftRight, addOperand, 1ull << smallShiftAmount);
 		}
-		
-		virtual bool runOnFunction(Function& fn) override
+		return false;
+	}
+
+	// Unsigned division by a constant, multiply-and-shift form
+	bool matchUnsignedMagicDivision(BinaryOperator& shiftRight)
+	{
+		uint64_t twoPower;
+		uint64_t multiplier;
+		Value* operand;
+		if (match(&shiftRight, m_LShr(m_Mul(m_Value(operand), m_ConstantInt(multiplier)), m_ConstantInt(twoPower))))
 		{
-			bool changed = false;
-			
-			for (BasicBlock& bb : fn)
+			if (twoPower < numeric_limits<double>::digits) // this would cause our verification to break down
 			{
-				for (Instruction& inst : bb)
+				Value* originalValue = unwrapCast(operand);
+				uint64_t bitWidth = originalValue->getType()->getIntegerBitWidth();
+				double denominator = static_cast<double>(1ull << twoPower) / multiplier;
+				double ceiled = ceil(denominator);
+				if (1 / (ceiled - denominator) >= (1ull << bitWidth) / ceiled)
 				{
-					if (inst.getOpcode() == BinaryOperator::AShr)
-					{
-						// (Signed division by a power of two)
-						auto& shiftRight = cast<BinaryOperator>(inst);
-						changed |= handleArithmeticShiftRight(shiftRight);
-					}
-					else if (inst.getOpcode() == BinaryOperator::LShr)
-					{
-						auto& shiftRight = cast<BinaryOperator>(inst);
-						changed |= handleLogicalShiftRight(shiftRight);
-					}
-					else if (inst.getOpcode() == BinaryOperator::Add)
-					{
-						// (Signed division by a constant)
-						auto& addInst = cast<BinaryOperator>(inst);
-						changed |= handleAdd(addInst);
-					}
-					else if (inst.getOpcode() == BinaryOperator::Sub)
-					{
-						auto& subInst = cast<BinaryOperator>(inst);
-						changed |= handleSub(subInst);
-					}
+					return replaceWithDivision(shiftRight, originalValue, static_cast<uint64_t>(ceiled), false);
 				}
 			}
-			
-			return changed;
 		}
-		
-		bool handleArithmeticShiftRight(BinaryOperator& shiftRight)
+		return false;
+	}
+
+	// Unsigned division by a constant, with the add-and-shift correction step
+	bool matchUnsignedCorrectedMagicDivision(BinaryOperator& shiftRight)
+	{
+		// With a as the operand and r as the result, we are trying to match:
+		//  m = (a * C) >> Z
+		//  r = (m + ((a - m) >> Y)) >> X
+		// Given this, we also know that:
+		//  r = a / D
+		// We just need to isolate D:
+		//  D = (1 << X+Y+Z) / (C * ((1 << Y) - 1) + (1 << Z)
+		// and make sure that it is correct in the domain that the division targets.
+		uint64_t twoPower;
+		uint64_t multiplier;
+		Value* operand;
+		uint64_t x, y;
+		Value* subtraction;
+		Value* originalValue;
+		Value* mulTreeValue;
+		Value* m;
+		if (match(&shiftRight, m_LShr(m_Add(m_Value(mulTreeValue), m_LShr(m_Value(subtraction), m_ConstantInt(y))), m_ConstantInt(x))))
+		if (match(mulTreeValue, m_LShr(m_Mul(m_Value(operand), m_ConstantInt(multiplier)), m_ConstantInt(twoPower))))
+		if (match(unwrapCast(subtraction), m_Sub(m_Value(originalValue), m_Value(m))))
+		if (unwrapCast(operand) == unwrapCast(originalValue) && unwrapCast(m) == mulTreeValue)
 		{
-			// Signed division by a power of two
+			Value* original = unwrapCast(operand);
+			uint64_t bitWidth = original->getType()->getIntegerBitWidth();
+			double denominator = static_cast<double>(1ull << (x + y + twoPower)) / (multiplier * ((1ull << y) - 1) + (1ull << twoPower));
+			double ceiled = ceil(denominator);
+			if (1 / (ceiled - denominator) >= (1ull << bitWidth) / ceiled)
 			{
-				Value* addOperand;
-				Value* truncOperand;
-				Value* largeShiftOperand;
-				uint64_t smallShiftAmount, largeShiftAmount, mask;
-				if (match(&shiftRight, m_AShr(m_Add(m_And(m_Trunc(m_Value(truncOperand)), m_ConstantInt(mask)), m_Value(addOperand)), m_ConstantInt(smallShiftAmount))))
-				if (match(unwrapCast(truncOperand), m_LShr(m_Value(largeShiftOperand), m_ConstantInt(largeShiftAmount))))
-				if (unwrapCast(largeShiftOperand) == unwrapCast(addOperand))
-				if (addOperand->getType()->getIntegerBitWidth() < largeShiftAmount)
-				if (((mask + 1) & mask) == 0) // mask starts at least significant bit and is contiguous?
-				if (__builtin_ctzll(~mask) == smallShiftAmount)
-				{
-					return replaceWithDivision(shiftRight, addOperand, 1ull << smallShiftAmount);
-				}
+				return replaceWithDivision(shiftRight, original, static_cast<uint64_t>(ceiled), false);
 			}
-			
-			return false;
 		}
-		
-		bool handleLogicalShiftRight(BinaryOperator& shiftRight)
+		return false;
+	}
+
+	// Unsigned remainder
+	bool matchUnsignedRemainder(BinaryOperator& addInst)
+	{
+		Value* addRight;
+		Value* divLeft;
+		Value* andOperand;
+		uint64_t denominator;
+		uint64_t mask;
+		uint64_t multiplier;
+		if (match(&addInst, m_Add(m_Mul(m_And(m_Value(andOperand), m_ConstantInt(mask)), m_ConstantInt(multiplier)), m_Value(addRight))))
+		if (match(unwrapCast(andOperand), m_UDiv(m_Value(divLeft), m_ConstantInt(denominator))))
+		if (addRight == divLeft)
 		{
-			uint64_t twoPower;
-			uint64_t multiplier;
-			Value* operand;
-			auto mulTree = m_LShr(m_Mul(m_Value(operand), m_ConstantInt(multiplier)), m_ConstantInt(twoPower));
-			
-			if (match(&shiftRight, mulTree))
+			uint64_t maxValue = 1ull << addRight->getType()->getIntegerBitWidth();
+			if (multiplier == maxValue - denominator && maxValue / denominator <= mask)
 			{
-				if (twoPower < numeric_limits<double>::digits) // this would cause our verification to break down
-				{
-					Value* originalValue = unwrapCast(operand);
-					uint64_t bitWidth = originalValue->getType()->getIntegerBitWidth();
-					double denominator = static_cast<double>(1ull << twoPower) / multiplier;
-					double ceiled = ceil(denominator);
-					if (1 / (ceiled - denominator) >= (1ull << bitWidth) / ceiled)
-					{
-						return replaceWithDivision(shiftRight, originalValue, static_cast<uint64_t>(ceiled), false);
-					}
-				}
-			}
-			else
-			{
-				// With a as the operand and r as the result, we are trying to match:
-				//  m = (a * C) >> Z
-				//  r = (m + ((a - m) >> Y)) >> X
-				// Given this, we also know that:
-				//  r = a / D
-				// We just need to isolate D:
-				//  D = (1 << X+Y+Z) / (C * ((1 << Y) - 1) + (1 << Z)
-				// and make sure that it is correct in the domain that the division targets.
-				uint64_t x, y;
-				Value* subtraction;
-				Value* originalValue;
-				Value* mulTreeValue;
-				Value* m;
-				if (match(&shiftRight, m_LShr(m_Add(m_Value(mulTreeValue), m_LShr(m_Value(subtraction), m_ConstantInt(y))), m_ConstantInt(x))))
-				if (match(mulTreeValue, mulTree))
-				if (match(unwrapCast(subtraction), m_Sub(m_Value(originalValue), m_Value(m))))
-				if (unwrapCast(operand) == unwrapCast(originalValue) && unwrapCast(m) == mulTreeValue)
-				{
-					Value* originalValue = unwrapCast(operand);
-					uint64_t bitWidth = originalValue->getType()->getIntegerBitWidth();
-					double denominator = static_cast<double>(1ull << (x + y + twoPower)) / (multiplier * ((1ull << y) - 1) + (1ull << twoPower));
-					double ceiled = ceil(denominator);
-					if (1 / (ceiled - denominator) >= (1ull << bitWidth) / ceiled)
-					{
-						return replaceWithDivision(shiftRight, originalValue, static_cast<uint64_t>(ceiled), false);
-					}
-				}
+				denominator *= 1 << __builtin_ctzll(mask);
+				auto constantDenominator = ConstantInt::get(divLeft->getType(), denominator);
+				auto urem = BinaryOperator::CreateURem(divLeft, constantDenominator, "", &addInst);
+				addInst.replaceAllUsesWith(urem);
+				return true;
 			}
-			return false;
 		}
-		
-		bool handleAdd(BinaryOperator& addInst)
+		return false;
+	}
+
+	// Signed division by a constant
+	bool matchSignedMagicDivision(BinaryOperator& addInst)
+	{
+		Value* truncOperands[2];
+		Value* shiftOperands[2];
+		Value* multipliedValue;
+		uint64_t smallShiftAmount, largeShiftAmount, multiplier;
+
+		if (match(&addInst, m_Add(m_Value(truncOperands[0]), m_Value(truncOperands[1]))))
+		if (match(unwrapCast(truncOperands[0]), m_LShr(m_Value(shiftOperands[0]), m_ConstantInt(smallShiftAmount))) || match(unwrapCast(truncOperands[0]), m_AShr(m_Value(shiftOperands[0]), m_ConstantInt(smallShiftAmount))))
+		if (match(unwrapCast(truncOperands[1]), m_LShr(m_Value(shiftOperands[1]), m_ConstantInt(largeShiftAmount))) || match(unwrapCast(truncOperands[1]), m_AShr(m_Value(shiftOperands[1]), m_ConstantInt(largeShiftAmount))))
+		if (shiftOperands[0] == shiftOperands[1])
 		{
-			// Unsigned remainder
+			uint64_t shiftWidth = shiftOperands[0]->getType()->getIntegerBitWidth();
+			if (shiftWidth == largeShiftAmount + 1)
 			{
-				Value* addRight;
-				Value* divLeft;
-				Value* andOperand;
-				uint64_t denominator;
-				uint64_t mask;
-				uint64_t multiplier;
-				if (match(&addInst, m_Add(m_Mul(m_And(m_Value(andOperand), m_ConstantInt(mask)), m_ConstantInt(multiplier)), m_Value(addRight))))
-				if (match(unwrapCast(andOperand), m_UDiv(m_Value(divLeft), m_ConstantInt(denominator))))
-				if (addRight == divLeft)
+				if (match(shiftOperands[0], m_Mul(m_Value(multipliedValue), m_ConstantInt(multiplier))))
 				{
-					uint64_t maxValue = 1ull << addRight->getType()->getIntegerBitWidth();
-					if (multiplier == maxValue - denominator && maxValue / denominator <= mask)
+					Value* originalValue = unwrapCast(multipliedValue);
+					uint64_t originalBitWidth = originalValue->getType()->getIntegerBitWidth();
+					if (originalBitWidth <= smallShiftAmount)
 					{
-						denominator *= 1 << __builtin_ctzll(mask);
-						auto constantDenominator = ConstantInt::get(divLeft->getType(), denominator);
-						auto urem = BinaryOperator::CreateURem(divLeft, constantDenominator, "", &addInst);
-						addInst.replaceAllUsesWith(urem);
-						return true;
+						double denominator = static_cast<double>(1ull << smallShiftAmount) / multiplier;
+						double ceiled = ceil(denominator);
+						uint64_t resultWidth = shiftWidth - smallShiftAmount - 1;
+						if (1 / (ceiled - denominator) >= (1ull << resultWidth) / ceiled)
+						{
+							return replaceWithDivision(addInst, originalValue, static_cast<uint64_t>(ceiled));
+						}
 					}
 				}
-			}
-			
-			// Signed division
-			{
-				Value* truncOperands[2];
-				Value* shiftOperands[2];
-				Value* multipliedValue;
-				uint64_t smallShiftAmount, largeShiftAmount, multiplier;
-				
-				if (match(&addInst, m_Add(m_Value(truncOperands[0]), m_Value(truncOperands[1]))))
-				if (match(unwrapCast(truncOperands[0]), m_LShr(m_Value(shiftOperands[0]), m_ConstantInt(smallShiftAmount))) || match(unwrapCast(truncOperands[0]), m_AShr(m_Value(shiftOperands[0]), m_ConstantInt(smallShiftAmount))))
-				if (match(unwrapCast(truncOperands[1]), m_LShr(m_Value(shiftOperands[1]), m_ConstantInt(largeShiftAmount))) || match(unwrapCast(truncOperands[1]), m_AShr(m_Value(shiftOperands[1]), m_ConstantInt(largeShiftAmount))))
-				if (shiftOperands[0] == shiftOperands[1])
+				else
 				{
-					uint64_t shiftWidth = shiftOperands[0]->getType()->getIntegerBitWidth();
-					if (shiftWidth == largeShiftAmount + 1)
+					Value* originalValue[2];
+					uint64_t widthShift;
+					if (match(shiftOperands[0], m_Add(m_Trunc(m_LShr(m_Mul(m_SExt(m_Value(originalValue[0])), m_ConstantInt(multiplier)), m_ConstantInt(widthShift))), m_Value(originalValue[1]))))
+					if (originalValue[0] == originalValue[1] && widthShift == originalValue[0]->getType()->getIntegerBitWidth())
 					{
-						if (match(shiftOperands[0], m_Mul(m_Value(multipliedValue), m_ConstantInt(multiplier))))
-						{
-							Value* originalValue = unwrapCast(multipliedValue);
-							uint64_t originalBitWidth = originalValue->getType()->getIntegerBitWidth();
-							if (originalBitWidth <= smallShiftAmount)
-							{
-								double denominator = static_cast<double>(1ull << smallShiftAmount) / multiplier;
-								double ceiled = ceil(denominator);
-								uint64_t resultWidth = shiftWidth - smallShiftAmount - 1;
-								if (1 / (ceiled - denominator) >= (1ull << resultWidth) / ceiled)
-								{
-									return replaceWithDivision(addInst, originalValue, static_cast<uint64_t>(ceiled));
-								}
-							}
-						}
-						else
+						uint64_t multiplierMask = (1ull << widthShift) - 1;
+						double denominator = static_cast<double>(1ull << (widthShift + smallShiftAmount)) / (multiplier & multiplierMask);
+						double ceiled = ceil(denominator);
+						uint64_t resultWidth = widthShift - smallShiftAmount - 1;
+						if (1 / (ceiled - denominator) >= (1ull << resultWidth) / ceiled)
 						{
-							Value* originalValue[2];
-							uint64_t widthShift;
-							if (match(shiftOperands[0], m_Add(m_Trunc(m_LShr(m_Mul(m_SExt(m_Value(originalValue[0])), m_ConstantInt(multiplier)), m_ConstantInt(widthShift))), m_Value(originalValue[1]))))
-							if (originalValue[0] == originalValue[1] && widthShift == originalValue[0]->getType()->getIntegerBitWidth())
-							{
-								uint64_t multiplierMask = (1ull << widthShift) - 1;
-								double denominator = static_cast<double>(1ull << (widthShift + smallShiftAmount)) / (multiplier & multiplierMask);
-								double ceiled = ceil(denominator);
-								uint64_t resultWidth = widthShift - smallShiftAmount - 1;
-								if (1 / (ceiled - denominator) >= (1ull << resultWidth) / ceiled)
-								{
-									return replaceWithDivision(addInst, originalValue[0], static_cast<uint64_t>(ceiled));
-								}
-							}
+							return replaceWithDivision(addInst, originalValue[0], static_cast<uint64_t>(ceiled));
 						}
 					}
 				}
 			}
-			return false;
 		}
-		
-		bool handleSub(BinaryOperator& subInst)
+		return false;
+	}
+
+	// Signed remainder of a power of two
+	bool matchSignedPowerOfTwoRemainder(BinaryOperator& subInst)
+	{
+		Value* originalValue[3];
+		Value* addOperand;
+		Value* andOperand;
+		uint64_t largeMask, smallMask, shiftAmount;
+		if (match(&subInst, m_Sub(m_Value(originalValue[0]), m_And(m_Add(m_Value(addOperand), m_Value(originalValue[1])), m_ConstantInt(largeMask)))))
+		if (match(unwrapCast(addOperand), m_And(m_Value(andOperand), m_ConstantInt(smallMask))))
+		if (match(unwrapCast(andOperand), m_LShr(m_Value(originalValue[2]), m_ConstantInt(shiftAmount))))
+		if (originalValue[0] == unwrapCast(originalValue[1]) && originalValue[0] == unwrapCast(originalValue[2]))
+		if (((smallMask + 1) & smallMask) == 0) // mask starts at least significant bit and is contiguous?
+		{
+			uint64_t allOnes = (1ull << originalValue[0]->getType()->getIntegerBitWidth()) - 1;
+			if (((smallMask ^ largeMask) & allOnes) == allOnes)
+			{
+				auto constantDenominator = ConstantInt::get(originalValue[0]->getType(), smallMask + 1);
+				auto srem = BinaryOperator::CreateSRem(originalValue[0], constantDenominator, "", &subInst);
+				subInst.replaceAllUsesWith(srem);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Registry of recognized arithmetic idioms. Each recognizer anchors on the opcode of the
+	// expression root, so adding an idiom is one table row; the dispatcher below only ever tries
+	// the recognizers whose root opcode matches the instruction at hand.
+	struct ArithmeticIdiom
+	{
+		BinaryOperator::BinaryOps rootOpcode;
+		bool (*recognize)(BinaryOperator&);
+	};
+
+	const ArithmeticIdiom arithmeticIdioms[] = {
+		{ BinaryOperator::AShr, matchSignedPowerOfTwoDivision },
+		{ BinaryOperator::LShr, matchUnsignedMagicDivision },
+		{ BinaryOperator::LShr, matchUnsignedCorrectedMagicDivision },
+		{ BinaryOperator::Add, matchUnsignedRemainder },
+		{ BinaryOperator::Add, matchSignedMagicDivision },
+		{ BinaryOperator::Sub, matchSignedPowerOfTwoRemainder },
+	};
+
+	// Per-opcode bitmask over arithmeticIdioms, precomputed once so that dispatching costs one
+	// array load and a bit scan over just the applicable entries.
+	struct IdiomApplicability
+	{
+		uint64_t masks[Instruction::BinaryOpsEnd];
+
+		IdiomApplicability()
 		{
-			// Signed remainder of a power of two
-			Value* originalValue[3];
-			Value* addOperand;
-			Value* andOperand;
-			uint64_t largeMask, smallMask, shiftAmount;
-			if (match(&subInst, m_Sub(m_Value(originalValue[0]), m_And(m_Add(m_Value(addOperand), m_Value(originalValue[1])), m_ConstantInt(largeMask)))))
-			if (match(unwrapCast(addOperand), m_And(m_Value(andOperand), m_ConstantInt(smallMask))))
-			if (match(unwrapCast(andOperand), m_LShr(m_Value(originalValue[2]), m_ConstantInt(shiftAmount))))
-			if (originalValue[0] == unwrapCast(originalValue[1]) && originalValue[0] == unwrapCast(originalValue[2]))
-			if (((smallMask + 1) & smallMask) == 0) // mask starts at least significant bit and is contiguous?
+			static_assert(sizeof arithmeticIdioms / sizeof arithmeticIdioms[0] <= 64, "idiom masks are 64 bits wide");
+			fill(begin(masks), end(masks), 0);
+			uint64_t bit = 1;
+			for (const ArithmeticIdiom& idiom : arithmeticIdioms)
 			{
-				uint64_t allOnes = (1ull << originalValue[0]->getType()->getIntegerBitWidth()) - 1;
-				if (((smallMask ^ largeMask) & allOnes) == allOnes)
+				masks[idiom.rootOpcode] |= bit;
+				bit <<= 1;
+			}
+		}
+
+		uint64_t operator[](unsigned opcode) const
+		{
+			return opcode < Instruction::BinaryOpsEnd ? masks[opcode] : 0;
+		}
+	};
+
+	const IdiomApplicability applicableIdioms;
+
+	// Has to happen after instcombine
+	struct IntOperations : public FunctionPass
+	{
+		static char ID;
+
+		IntOperations() : FunctionPass(ID)
+		{
+		}
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			// Replaces arithmetic instruction by instruction without touching the CFG.
+			au.setPreservesCFG();
+		}
+
+		virtual bool runOnFunction(Function& fn) override
+		{
+			bool changed = false;
+
+			for (BasicBlock& bb : fn)
+			{
+				for (Instruction& inst : bb)
 				{
-					auto constantDenominator = ConstantInt::get(originalValue[0]->getType(), smallMask + 1);
-					auto srem = BinaryOperator::CreateSRem(originalValue[0], constantDenominator, "", &subInst);
-					subInst.replaceAllUsesWith(srem);
-					return true;
+					if (auto binOp = dyn_cast<BinaryOperator>(&inst))
+					{
+						changed |= peephole::simplifyIntegerOperation(*binOp);
+					}
 				}
 			}
-			return false;
+
+			return changed;
 		}
 	};
-	
+
 	char IntOperations::ID = 0;
-	
+
 	RegisterPass<IntOperations> intOps("intops", "Simplify integer operations");
 }
+
+bool peephole::simplifyIntegerOperation(BinaryOperator& inst)
+{
+	for (uint64_t mask = applicableIdioms[inst.getOpcode()]; mask != 0; mask &= mask - 1)
+	{
+		if (arithmeticIdioms[__builtin_ctzll(mask)].recognize(inst))
+		{
+			return true;
+		}
+	}
+	return false;
+}
@@ -7,12 +7,14 @@
 // license. See LICENSE.md for details.
 //
 
+#include "command_line.h"
 #include "dumb_allocator.h"
 #include "metadata.h"
 #include "passes.h"
 
 #include <llvm/IR/PatternMatch.h>
 
+#include <algorithm>
 #include <deque>
 #include <map>
 #include <unordered_map>
@@ -24,6 +26,8 @@ using namespace std;
 
 namespace
 {
+	cl::opt<unsigned> maxPreciseFrameFields("stack-frame-field-limit", cl::desc("Degrade stack frames with more than this many distinct fields to a flat byte array (0 = no limit)"), cl::init(4096), whitelist());
+
 	template<typename T, size_t N>
 	constexpr size_t countof(const T (&)[N])
 	{
@@ -827,6 +831,22 @@ namespace
 		}
 	};
 	
+	void collectFlatObjects(const StructureStackObject& structure, int64_t base, vector<pair<int64_t, const ObjectStackObject*>>& objects)
+	{
+		for (const auto& field : structure)
+		{
+			int64_t offset = base + field.offset;
+			if (auto object = dyn_cast<ObjectStackObject>(field.object.get()))
+			{
+				objects.push_back({offset, object});
+			}
+			else if (auto child = dyn_cast<StructureStackObject>(field.object.get()))
+			{
+				collectFlatObjects(*child, offset, objects);
+			}
+		}
+	}
+
 	// This pass needs to run AFTER argument recovery.
 	struct IdentifyLocals final : public ModulePass
 	{
@@ -1070,11 +1090,86 @@ namespace
 			}
 		}
 		
+		void createFlatStackFrame(Function& fn, const vector<pair<int64_t, const ObjectStackObject*>>& objects)
+		{
+			LLVMContext& ctx = fn.getContext();
+
+			// Nested structure extents can overlap their siblings, so compute the frame extent over every
+			// object instead of trusting the collection order.
+			int64_t frameBase = objects.front().first;
+			int64_t frameEnd = frameBase;
+			for (const auto& pair : objects)
+			{
+				uint64_t size = 1;
+				SmallPtrSet<Type*, 4> types;
+				pair.second->getUnionTypes(types);
+				for (Type* type : types)
+				{
+					if (!type->isVoidTy())
+					{
+						size = max(size, dl->getTypeStoreSize(type));
+					}
+				}
+				frameBase = min(frameBase, pair.first);
+				frameEnd = max(frameEnd, pair.first + static_cast<int64_t>(size));
+			}
+
+			auto allocaInsert = &*fn.getEntryBlock().getFirstInsertionPt();
+			Type* i8 = Type::getInt8Ty(ctx);
+			Type* frameType = ArrayType::get(i8, static_cast<uint64_t>(frameEnd - frameBase));
+			AllocaInst* stackFrame = new AllocaInst(frameType, "stackframe", allocaInsert);
+			md::setStackFrame(*stackFrame);
+
+			Type* i64 = Type::getInt64Ty(ctx);
+			ConstantInt* zero = ConstantInt::get(i64, 0);
+			for (const auto& pair : objects)
+			{
+				Value* offsetValue = pair.second->getOffsetValue();
+				Instruction* insertionPoint = dyn_cast<Instruction>(offsetValue);
+
+				Value* indices[] = { zero, ConstantInt::get(i64, static_cast<uint64_t>(pair.first - frameBase)) };
+				auto gep = GetElementPtrInst::Create(frameType, stackFrame, indices, "", insertionPoint);
+				auto ptr2int = CastInst::Create(CastInst::PtrToInt, gep, offsetValue->getType(), "", insertionPoint);
+				offsetValue->replaceAllUsesWith(ptr2int);
+				if (auto inst = dyn_cast<Instruction>(offsetValue))
+				{
+					inst->dropAllReferences();
+					inst->eraseFromParent();
+				}
+			}
+			changed = true;
+		}
+
 		void tryToCreateStackFrame(Function& fn)
 		{
-			if (Argument* stackPointer = getStackPointer(fn))
-			if (auto root = readObject(*stackPointer, nullptr))
-			if (auto llvmFrame = LlvmStackFrame::representObject(fn.getContext(), *dl, cast<StructureStackObject>(*root)))
+			Argument* stackPointer = getStackPointer(fn);
+			if (stackPointer == nullptr)
+			{
+				return;
+			}
+
+			auto root = readObject(*stackPointer, nullptr);
+			if (root == nullptr)
+			{
+				return;
+			}
+
+			auto& structure = cast<StructureStackObject>(*root);
+			vector<pair<int64_t, const ObjectStackObject*>> flatObjects;
+			collectFlatObjects(structure, 0, flatObjects);
+			if (flatObjects.size() == 0)
+			{
+				return;
+			}
+
+			if (maxPreciseFrameFields != 0 && flatObjects.size() > maxPreciseFrameFields)
+			{
+				// Degraded mode for huge frames: the precise representation below creates a struct type and a
+				// GEP link chain per field, which balloons on frames with thousands of distinct accesses. A
+				// flat byte array costs one GEP per access and leaves typing to the casts that already exist.
+				createFlatStackFrame(fn, flatObjects);
+			}
+			else if (auto llvmFrame = LlvmStackFrame::representObject(fn.getContext(), *dl, structure))
 			{
 				auto allocaInsert = &*fn.getEntryBlock().getFirstInsertionPt();
 				Type* naiveType = llvmFrame->getNaiveType(*root);
@@ -1084,7 +1179,7 @@ namespace
 				{
 					Value* offsetInstruction = object->getOffsetValue();
 					Instruction* insertionPoint = dyn_cast<Instruction>(offsetInstruction);
-					
+
 					Value* pointer = llvmFrame->getPointerToObject(*object, stackFrame, insertionPoint);
 					auto ptr2int = CastInst::Create(CastInst::PtrToInt, pointer, offsetInstruction->getType(), "", insertionPoint);
 					offsetInstruction->replaceAllUsesWith(ptr2int);
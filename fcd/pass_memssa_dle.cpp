@@ -32,8 +32,10 @@ namespace
 		
 		virtual void getAnalysisUsage(AnalysisUsage& au) const override
 		{
-			au.addRequired<AAResultsWrapperPass>();
-			au.addRequired<DominatorTreeWrapperPass>();
+			// Use the pass manager's cached MemorySSA instead of building a private copy, and keep it
+			// valid through removeMemoryAccess so that neighboring passes can share the analysis.
+			au.addRequired<MemorySSAWrapperPass>();
+			au.addPreserved<MemorySSAWrapperPass>();
 			au.setPreservesAll();
 		}
 		
@@ -85,10 +87,8 @@ namespace
 		
 		virtual bool runOnFunction(Function& f) override
 		{
-			auto& aaResults = getAnalysis<AAResultsWrapperPass>().getAAResults();
-			auto& domTree = getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-			MemorySSA mssa(f, &aaResults, &domTree);
-			
+			MemorySSA& mssa = getAnalysis<MemorySSAWrapperPass>().getMSSA();
+
 			bool changed = false;
 			for (BasicBlock* bb : ReversePostOrderTraversal<BasicBlock*>(&f.getEntryBlock()))
 			{
@@ -30,46 +30,52 @@ using namespace std;
 
 namespace
 {
-	struct NoopCastEliminator : public FunctionPass
+	Value* uncastedValue(Value* value)
 	{
-		static char ID;
-		
-		NoopCastEliminator() : FunctionPass(ID)
-		{
-		}
-		
-		static Value* uncastedValue(Value* value)
+		while (auto cast = dyn_cast<CastInst>(value))
 		{
-			while (auto cast = dyn_cast<CastInst>(value))
+			if (cast->getOpcode() == CastInst::Trunc)
 			{
-				if (cast->getOpcode() == CastInst::Trunc)
-				{
-					break;
-				}
-				value = cast->getOperand(0);
+				break;
 			}
-			return value;
+			value = cast->getOperand(0);
 		}
-		
-		static GetElementPtrInst* gepUpToType(Value* pointer, Type* type)
+		return value;
+	}
+
+	GetElementPtrInst* gepUpToType(Value* pointer, Type* type)
+	{
+		assert(type->isPointerTy());
+		PointerType* pointerType = cast<PointerType>(pointer->getType());
+		Type* elementType = pointerType->getElementType();
+
+		auto zero = ConstantInt::getNullValue(Type::getInt32Ty(pointer->getContext()));
+		SmallVector<Value*, 4> gepIndices = {zero};
+		while (Type* gepType = GetElementPtrInst::getIndexedType(elementType, gepIndices))
 		{
-			assert(type->isPointerTy());
-			PointerType* pointerType = cast<PointerType>(pointer->getType());
-			Type* elementType = pointerType->getElementType();
-			
-			auto zero = ConstantInt::getNullValue(Type::getInt32Ty(pointer->getContext()));
-			SmallVector<Value*, 4> gepIndices = {zero};
-			while (Type* gepType = GetElementPtrInst::getIndexedType(elementType, gepIndices))
+			if (gepType->getPointerTo() == type)
 			{
-				if (gepType->getPointerTo() == type)
-				{
-					return GetElementPtrInst::Create(nullptr, pointer, gepIndices);
-				}
-				gepIndices.push_back(zero);
+				return GetElementPtrInst::Create(nullptr, pointer, gepIndices);
 			}
-			return nullptr;
+			gepIndices.push_back(zero);
+		}
+		return nullptr;
+	}
+
+	struct NoopCastEliminator : public FunctionPass
+	{
+		static char ID;
+
+		NoopCastEliminator() : FunctionPass(ID)
+		{
+		}
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			// Only replaces and erases cast and store instructions; the CFG is untouched.
+			au.setPreservesCFG();
 		}
-		
+
 		virtual bool runOnFunction(Function& fn) override
 		{
 			bool changed = false;
@@ -78,41 +84,46 @@ namespace
 				auto iter = bb.begin();
 				while (iter != bb.end())
 				{
-					if (auto store = dyn_cast<StoreInst>(iter))
+					Instruction& inst = *iter;
+					++iter;
+					if (auto store = dyn_cast<StoreInst>(&inst))
 					{
-						Value* pointer = store->getPointerOperand();
-						Value* storeValue = store->getValueOperand();
-						Value* uncastedPointer = uncastedValue(pointer);
-						Value* uncastedStoreValue = uncastedValue(storeValue);
-						if (pointer != uncastedPointer && storeValue != uncastedStoreValue)
-						if (auto pointerType = dyn_cast<PointerType>(uncastedPointer->getType()))
-						{
-							if (uncastedStoreValue->getType()->getPointerTo() != pointerType)
-							if (auto subPointer = dyn_cast<PointerType>(pointerType->getElementType()))
-							if (auto subValue = gepUpToType(uncastedStoreValue, subPointer))
-							{
-								subValue->insertBefore(store);
-								uncastedStoreValue = subValue;
-							}
-							
-							if (uncastedStoreValue->getType()->getPointerTo() == pointerType)
-							{
-								StoreInst* result = new StoreInst(uncastedStoreValue, uncastedPointer, store);
-								store->eraseFromParent();
-								iter = result->getIterator();
-								changed = true;
-							}
-						}
+						changed |= peephole::eliminateCastRoundTrip(*store);
 					}
-					++iter;
 				}
 			}
 			return changed;
 		}
 	};
-	
+
 	char NoopCastEliminator::ID = 0;
-	
+
 	RegisterPass<NoopCastEliminator> noopCastElim("eliminatecasts", "Eliminate cast roundtrips");
 }
 
+bool peephole::eliminateCastRoundTrip(StoreInst& store)
+{
+	Value* pointer = store.getPointerOperand();
+	Value* storeValue = store.getValueOperand();
+	Value* uncastedPointer = uncastedValue(pointer);
+	Value* uncastedStoreValue = uncastedValue(storeValue);
+	if (pointer != uncastedPointer && storeValue != uncastedStoreValue)
+	if (auto pointerType = dyn_cast<PointerType>(uncastedPointer->getType()))
+	{
+		if (uncastedStoreValue->getType()->getPointerTo() != pointerType)
+		if (auto subPointer = dyn_cast<PointerType>(pointerType->getElementType()))
+		if (auto subValue = gepUpToType(uncastedStoreValue, subPointer))
+		{
+			subValue->insertBefore(&store);
+			uncastedStoreValue = subValue;
+		}
+
+		if (uncastedStoreValue->getType()->getPointerTo() == pointerType)
+		{
+			new StoreInst(uncastedStoreValue, uncastedPointer, &store);
+			store.eraseFromParent();
+			return true;
+		}
+	}
+	return false;
+}
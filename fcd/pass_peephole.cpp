@@ -0,0 +1,77 @@
+//
+// pass_peephole.cpp
+// Copyright (C) 2017 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "passes.h"
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	// Applies the signext, intops and eliminatecasts rewrites in a single instruction traversal,
+	// instead of paying a full-function walk and a pass manager round for each. The standalone passes
+	// still exist for custom pipelines; this driver replaces them in the default one. fixindirects is
+	// not part of the driver: it only visits the users of the two indirection intrinsics and needs
+	// ParameterRegistry, so it never walks the module in the first place.
+	struct InstructionPeepholes final : public FunctionPass
+	{
+		static char ID;
+
+		InstructionPeepholes() : FunctionPass(ID)
+		{
+		}
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			// Single-instruction rewrites never touch terminators, so dominators and every other
+			// CFG-only analysis survive into the next pass instead of being recomputed.
+			au.setPreservesCFG();
+		}
+
+		virtual StringRef getPassName() const override
+		{
+			return "Combined peepholes";
+		}
+
+		virtual bool runOnFunction(Function& fn) override
+		{
+			bool changed = false;
+			for (BasicBlock& bb : fn)
+			{
+				// Advance before dispatching: eliminateCastRoundTrip replaces the store it is given.
+				auto iter = bb.begin();
+				while (iter != bb.end())
+				{
+					Instruction& inst = *iter;
+					++iter;
+					if (auto store = dyn_cast<StoreInst>(&inst))
+					{
+						changed |= peephole::eliminateCastRoundTrip(*store);
+					}
+					else if (auto binOp = dyn_cast<BinaryOperator>(&inst))
+					{
+						if (binOp->getOpcode() == Instruction::Or)
+						{
+							changed |= peephole::simplifySignExtension(*binOp);
+						}
+						else
+						{
+							changed |= peephole::simplifyIntegerOperation(*binOp);
+						}
+					}
+				}
+			}
+			return changed;
+		}
+	};
+
+	char InstructionPeepholes::ID = 0;
+
+	RegisterPass<InstructionPeepholes> peepholes("peepholes", "Combined single-traversal peepholes");
+}
@@ -27,20 +27,39 @@
 using namespace llvm;
 using namespace std;
 
-namespace
+ProgramMemoryAAResult::ProgramMemoryAAResult()
 {
-	bool isProgramMemory(const Value& pointer)
+}
+
+ProgramMemoryAAResult::~ProgramMemoryAAResult()
+{
+}
+
+bool ProgramMemoryAAResult::isProgramMemory(const Value& pointer)
+{
+	auto iter = programMemoryCache.find(&pointer);
+	if (iter != programMemoryCache.end())
+	{
+		return iter->second;
+	}
+
+	if (!mdKinds)
+	{
+		mdKinds.reset(new md::MetadataKinds(pointer.getContext()));
+	}
+
+	bool result = false;
+	for (const User* user : pointer.users())
 	{
-		for (const User* user : pointer.users())
+		if (auto inst = dyn_cast<Instruction>(user))
+		if (inst->getOpcode() == Instruction::Load || inst->getOpcode() == Instruction::Store)
 		{
-			if (auto inst = dyn_cast<Instruction>(user))
-			if (inst->getOpcode() == Instruction::Load || inst->getOpcode() == Instruction::Store)
-			{
-				return md::isProgramMemory(*inst);
-			}
+			result = mdKinds->isProgramMemory(*inst);
+			break;
 		}
-		return false;
 	}
+	programMemoryCache.insert({&pointer, result});
+	return result;
 }
 
 AliasResult ProgramMemoryAAResult::alias(const MemoryLocation& a, const MemoryLocation& b)
@@ -11,18 +11,37 @@
 #define pass_regaa_h
 
 #include <llvm/Analysis/AliasAnalysis.h>
+#include <llvm/IR/ValueMap.h>
 #include <llvm/Pass.h>
 
 #include <memory>
 
+// (metadata.h includes params_registry.h, which includes this header)
+namespace md
+{
+	class MetadataKinds;
+}
+
 class ProgramMemoryAAResult : public llvm::AAResultBase<ProgramMemoryAAResult>
 {
 	friend llvm::AAResultBase<ProgramMemoryAAResult>;
-	
+
+	// GVN queries this result at very high frequency, and classifying a pointer means walking its
+	// user list; memoize the answer per pointer. A live pointer's classification comes from how the
+	// lifter emitted its accesses and doesn't change, and ValueMap drops entries when values die or
+	// get replaced, so the cache stays sound across rewrites.
+	llvm::ValueMap<const llvm::Value*, bool> programMemoryCache;
+	std::unique_ptr<md::MetadataKinds> mdKinds;
+
+	bool isProgramMemory(const llvm::Value& pointer);
+
 public:
+	ProgramMemoryAAResult();
+	~ProgramMemoryAAResult();
+
 	bool invalidate(llvm::Function& fn, const llvm::PreservedAnalyses& pa)
 	{
-		// Stateless.
+		// The cache maintains itself through value handles.
 		return false;
 	}
 	
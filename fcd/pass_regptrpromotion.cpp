@@ -32,7 +32,13 @@ namespace
 		RegisterPointerPromotion() : FunctionPass(ID)
 		{
 		}
-		
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			// Rewrites GEP/cast chains in place; the CFG is untouched.
+			au.setPreservesCFG();
+		}
+
 		virtual bool runOnFunction(Function& f) override
 		{
 			bool modified = false;
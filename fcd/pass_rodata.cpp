@@ -0,0 +1,148 @@
+//
+// pass_rodata.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "metadata.h"
+#include "passes.h"
+#include "statistics.h"
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/Module.h>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	StatCounter rodataLoadsFolded("opt.rodata.loads_folded");
+
+	// Returns whether `pointer` is a constant address, either as a folded inttoptr expression or as
+	// an inttoptr instruction whose operand is constant.
+	bool getConstantAddress(Value* pointer, uint64_t& address)
+	{
+		Value* intValue = nullptr;
+		if (auto expr = dyn_cast<ConstantExpr>(pointer))
+		{
+			if (expr->getOpcode() == Instruction::IntToPtr)
+			{
+				intValue = expr->getOperand(0);
+			}
+		}
+		else if (auto intToPtr = dyn_cast<IntToPtrInst>(pointer))
+		{
+			intValue = intToPtr->getOperand(0);
+		}
+
+		if (intValue != nullptr)
+		if (auto constantInt = dyn_cast<ConstantInt>(intValue))
+		{
+			address = constantInt->getLimitedValue();
+			return true;
+		}
+		return false;
+	}
+
+	// Folds loads from constant addresses in read-only, file-backed program memory into the bytes
+	// that the executable actually contains. Jump tables, string pointers and vtables all come out
+	// of the lifter as such loads; resolving them before instcombine and GVN run removes whole
+	// expression trees instead of leaving them for later phases to chew on.
+	struct RodataFolding final : public FunctionPass
+	{
+		static char ID;
+
+		RodataFolding() : FunctionPass(ID)
+		{
+		}
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			au.addRequired<ExecutableWrapper>();
+			au.setPreservesCFG();
+			FunctionPass::getAnalysisUsage(au);
+		}
+
+		virtual bool runOnFunction(Function& fn) override
+		{
+			Executable* executable = getAnalysis<ExecutableWrapper>().getExecutable();
+			if (executable == nullptr)
+			{
+				return false;
+			}
+
+			const DataLayout& dl = fn.getParent()->getDataLayout();
+			bool changed = false;
+			for (BasicBlock& bb : fn)
+			{
+				for (auto iter = bb.begin(); iter != bb.end(); )
+				{
+					Instruction& inst = *iter;
+					++iter;
+					if (auto load = dyn_cast<LoadInst>(&inst))
+					{
+						changed |= foldLoad(*executable, dl, *load);
+					}
+				}
+			}
+			return changed;
+		}
+
+		bool foldLoad(Executable& executable, const DataLayout& dl, LoadInst& load)
+		{
+			if (load.isVolatile() || !md::isProgramMemory(load))
+			{
+				return false;
+			}
+
+			auto intType = dyn_cast<IntegerType>(load.getType());
+			if (intType == nullptr)
+			{
+				return false;
+			}
+
+			uint64_t size = dl.getTypeStoreSize(intType);
+			uint64_t address;
+			if (size > sizeof (uint64_t) || !getConstantAddress(load.getPointerOperand(), address))
+			{
+				return false;
+			}
+
+			if (!executable.isReadOnlyRange(address, size))
+			{
+				return false;
+			}
+
+			const uint8_t* bytes = executable.map(address);
+			if (bytes == nullptr)
+			{
+				return false;
+			}
+
+			// x86 only: program memory is little-endian.
+			uint64_t value = 0;
+			for (uint64_t i = 0; i < size; ++i)
+			{
+				value |= static_cast<uint64_t>(bytes[i]) << (8 * i);
+			}
+
+			load.replaceAllUsesWith(ConstantInt::get(intType, value));
+			load.eraseFromParent();
+			++rodataLoadsFolded;
+			return true;
+		}
+	};
+
+	char RodataFolding::ID = 0;
+	RegisterPass<RodataFolding> rodataFolding("rodatafold", "Fold loads from read-only segments");
+}
+
+FunctionPass* createRodataFoldingPass()
+{
+	return new RodataFolding;
+}
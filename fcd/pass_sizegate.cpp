@@ -0,0 +1,83 @@
+//
+// pass_sizegate.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "passes.h"
+#include "statistics.h"
+
+#include <llvm/IR/Function.h>
+#include <llvm/Support/raw_ostream.h>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	cl::opt<unsigned> gateInstructionLimit("gate-instruction-limit", cl::desc("Functions with more instructions than this run a reduced optimization pass set; one pathological function should not cost more than the rest of the module combined. 0 disables the gate."), cl::init(500000), whitelist());
+
+	StatCounter gatedFunctions("opt.sizegate.gated_functions");
+
+	// Marks functions above --gate-instruction-limit with optnone so that the superlinear stock
+	// passes downstream (sroa, instcombine, gvn, dse, sccp, memssadle, simplifycfg) skip them
+	// through skipFunction(). fcd's own recovery passes don't consult the attribute, so indirect
+	// call fixing, argument recovery and stack frame recovery — the passes the output needs to be
+	// correct at all — still run; the gated function only loses polish. noinline accompanies
+	// optnone because the verifier requires the pair.
+	struct SizeGate final : public FunctionPass
+	{
+		static char ID;
+
+		SizeGate() : FunctionPass(ID)
+		{
+		}
+
+		virtual StringRef getPassName() const override
+		{
+			return "Size-Adaptive Pass Gating";
+		}
+
+		virtual void getAnalysisUsage(AnalysisUsage& au) const override
+		{
+			au.setPreservesAll();
+		}
+
+		virtual bool runOnFunction(Function& fn) override
+		{
+			if (gateInstructionLimit == 0 || fn.hasFnAttribute(Attribute::OptimizeNone))
+			{
+				return false;
+			}
+
+			size_t instructionCount = 0;
+			for (BasicBlock& bb : fn)
+			{
+				instructionCount += bb.size();
+			}
+			if (instructionCount <= gateInstructionLimit)
+			{
+				return false;
+			}
+
+			errs() << "fcd: " << fn.getName() << ": " << instructionCount << " instructions exceed the gating limit; running reduced pass set\n";
+			fn.addFnAttr(Attribute::NoInline);
+			fn.addFnAttr(Attribute::OptimizeNone);
+			++gatedFunctions;
+			return true;
+		}
+	};
+
+	char SizeGate::ID = 0;
+
+	RegisterPass<SizeGate> sizeGate("sizegate", "Run a reduced pass set on very large functions");
+}
+
+unsigned sizeGateInstructionLimit()
+{
+	return gateInstructionLimit;
+}
@@ -13,14 +13,30 @@
 #include "pass_argrec.h"
 #include "pass_backend.h"
 #include "pass_executable.h"
+#include "pass_funcindex.h"
 #include "pass_regaa.h"
 #include "targetinfo.h"
 
 #include <llvm/Analysis/AliasAnalysis.h>
 #include <llvm/Analysis/Passes.h>
+#include <llvm/IR/Instructions.h>
 #include <llvm/Pass.h>
 #include <llvm/Transforms/Utils/MemorySSA.h>
 
 llvm::FunctionPass*		createRegisterPointerPromotionPass();
+llvm::FunctionPass*		createRodataFoldingPass();
+
+// Current value of --gate-instruction-limit (see pass_sizegate.cpp); exposed so that the optimized
+// IR cache key can account for it.
+unsigned sizeGateInstructionLimit();
+
+// Single-instruction rewrites shared between the standalone passes and the fused "peepholes"
+// driver. Each returns true if it rewrote the instruction it was given.
+namespace peephole
+{
+	bool simplifySignExtension(llvm::BinaryOperator& orInst);
+	bool simplifyIntegerOperation(llvm::BinaryOperator& inst);
+	bool eliminateCastRoundTrip(llvm::StoreInst& store);
+}
 
 #endif /* defined(fcd__passes_h) */
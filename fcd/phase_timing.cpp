@@ -0,0 +1,123 @@
+//
+// phase_timing.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "phase_timing.h"
+
+#include <llvm/Support/Format.h>
+
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include <sys/resource.h>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	cl::opt<bool> timePhases("time-phases", cl::desc("Print a per-phase and per-pass timing report at exit (also enables LLVM's -time-passes)"), whitelist());
+
+	struct PhaseRecord
+	{
+		double seconds;
+		long maxRssDeltaKb;
+		size_t invocations;
+	};
+
+	double secondsNow()
+	{
+		auto now = chrono::steady_clock::now().time_since_epoch();
+		return chrono::duration<double>(now).count();
+	}
+
+	long maxRssNow()
+	{
+		rusage usage;
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+		return usage.ru_maxrss;
+	}
+
+	struct PhaseRecordTable
+	{
+		mutex lock;
+		map<string, PhaseRecord> records;
+
+		// The report prints during static destruction so that it runs after the very last phase,
+		// mirroring how LLVM's -time-passes reports.
+		~PhaseRecordTable()
+		{
+			if (timePhases && records.size() > 0)
+			{
+				printPhaseTimings(errs());
+			}
+		}
+	};
+
+	PhaseRecordTable table;
+}
+
+bool arePhaseTimingsEnabled()
+{
+	return timePhases;
+}
+
+void printPhaseTimings(raw_ostream& os)
+{
+	vector<pair<string, PhaseRecord>> sorted;
+	{
+		lock_guard<mutex> guard(table.lock);
+		sorted.assign(table.records.begin(), table.records.end());
+	}
+	sort(sorted.begin(), sorted.end(), [](const pair<string, PhaseRecord>& a, const pair<string, PhaseRecord>& b)
+	{
+		return a.second.seconds > b.second.seconds;
+	});
+
+	os << "===-------------------------------------------------------------------===\n";
+	os << "                          fcd phase timings\n";
+	os << "===-------------------------------------------------------------------===\n";
+	os << format("%10s %12s %6s  %s\n", "seconds", "peak rss kB", "runs", "phase");
+	for (const auto& pair : sorted)
+	{
+		os << format("%10.4f %12ld %6zu  ", pair.second.seconds, pair.second.maxRssDeltaKb, pair.second.invocations);
+		os << pair.first << '\n';
+	}
+}
+
+PhaseTimingScope::PhaseTimingScope(string name)
+: name(move(name)), secondsAtStart(0), maxRssAtStart(0), enabled(timePhases)
+{
+	if (enabled)
+	{
+		maxRssAtStart = maxRssNow();
+		secondsAtStart = secondsNow();
+	}
+}
+
+PhaseTimingScope::~PhaseTimingScope()
+{
+	if (enabled)
+	{
+		double elapsed = secondsNow() - secondsAtStart;
+		long rssDelta = maxRssNow() - maxRssAtStart;
+
+		lock_guard<mutex> guard(table.lock);
+		PhaseRecord& record = table.records[name];
+		record.seconds += elapsed;
+		record.maxRssDeltaKb += rssDelta;
+		record.invocations++;
+	}
+}
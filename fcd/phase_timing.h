@@ -0,0 +1,35 @@
+//
+// phase_timing.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__phase_timing_h
+#define fcd__phase_timing_h
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <string>
+
+// --time-phases support: lightweight wall-clock, peak-RSS-delta and invocation accounting, aggregated
+// by phase or pass name and reported at exit. LLVM passes are covered separately by LLVM's own
+// -time-passes machinery, which --time-phases also turns on.
+bool arePhaseTimingsEnabled();
+void printPhaseTimings(llvm::raw_ostream& os);
+
+class PhaseTimingScope
+{
+	std::string name;
+	double secondsAtStart;
+	long maxRssAtStart;
+	bool enabled;
+
+public:
+	PhaseTimingScope(std::string name);
+	~PhaseTimingScope();
+};
+
+#endif /* fcd__phase_timing_h */
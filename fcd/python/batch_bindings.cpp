@@ -0,0 +1,131 @@
+//
+// batch_bindings.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "bindings.h"
+
+#include <llvm-c/Core.h>
+#include <llvm/ADT/DenseMap.h>
+
+#include <vector>
+
+// The generated bindings construct one Python object per C API call, which dominates the runtime
+// of scripted passes that scan every instruction. These hand-written module functions marshal an
+// entire basic block in one call, as flat arrays that scripts can scan at array speed; per-object
+// wrappers are only needed for the instructions a script actually decides to touch.
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	PyObject* bytesFromVector(const vector<uint8_t>& data)
+	{
+		return PyByteArray_FromStringAndSize(reinterpret_cast<const char*>(data.data()), static_cast<Py_ssize_t>(data.size()));
+	}
+
+	PyObject* bytesFromVector(const vector<int32_t>& data)
+	{
+		return PyString_FromStringAndSize(reinterpret_cast<const char*>(data.data()), static_cast<Py_ssize_t>(data.size() * sizeof (int32_t)));
+	}
+
+	PyObject* batchInstructions(PyObject*, PyObject* args)
+	{
+		Py_LLVM_Wrapped<LLVMBasicBlockRef>* wrappedBlock;
+		if (!PyArg_ParseTuple(args, "O!", &Py_LLVMBasicBlock_Type, &wrappedBlock))
+		{
+			return nullptr;
+		}
+
+		LLVMBasicBlockRef block = wrappedBlock->obj;
+		DenseMap<LLVMValueRef, int32_t> indexOf;
+		int32_t instructionCount = 0;
+		for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != nullptr; inst = LLVMGetNextInstruction(inst))
+		{
+			indexOf[inst] = instructionCount;
+			instructionCount++;
+		}
+
+		vector<uint8_t> opcodes;
+		vector<int32_t> operandCounts;
+		vector<int32_t> operandIndices;
+		opcodes.reserve(static_cast<size_t>(instructionCount));
+		operandCounts.reserve(static_cast<size_t>(instructionCount));
+		for (LLVMValueRef inst = LLVMGetFirstInstruction(block); inst != nullptr; inst = LLVMGetNextInstruction(inst))
+		{
+			opcodes.push_back(static_cast<uint8_t>(LLVMGetInstructionOpcode(inst)));
+			int operandCount = LLVMGetNumOperands(inst);
+			operandCounts.push_back(operandCount);
+			for (int i = 0; i < operandCount; ++i)
+			{
+				auto iter = indexOf.find(LLVMGetOperand(inst, static_cast<unsigned>(i)));
+				operandIndices.push_back(iter == indexOf.end() ? -1 : iter->second);
+			}
+		}
+
+		auto opcodeArray = TAKEREF bytesFromVector(opcodes);
+		auto countArray = TAKEREF bytesFromVector(operandCounts);
+		auto indexArray = TAKEREF bytesFromVector(operandIndices);
+		if (!opcodeArray || !countArray || !indexArray)
+		{
+			return nullptr;
+		}
+		return makeTuple(opcodeArray, countArray, indexArray).release();
+	}
+
+	PyObject* instructionAtIndex(PyObject*, PyObject* args)
+	{
+		Py_LLVM_Wrapped<LLVMBasicBlockRef>* wrappedBlock;
+		long long index;
+		if (!PyArg_ParseTuple(args, "O!L", &Py_LLVMBasicBlock_Type, &wrappedBlock, &index))
+		{
+			return nullptr;
+		}
+
+		LLVMValueRef inst = LLVMGetFirstInstruction(wrappedBlock->obj);
+		for (long long i = 0; i < index && inst != nullptr; ++i)
+		{
+			inst = LLVMGetNextInstruction(inst);
+		}
+
+		if (index < 0 || inst == nullptr)
+		{
+			PyErr_SetString(PyExc_IndexError, "instruction index out of range");
+			return nullptr;
+		}
+
+		auto result = PyObject_New(Py_LLVM_Wrapped<LLVMValueRef>, &Py_LLVMValue_Type);
+		result->obj = inst;
+		return (PyObject*)result;
+	}
+
+	PyMethodDef batchMethods[] = {
+		{"BatchInstructions", &batchInstructions, METH_VARARGS,
+			"BatchInstructions(bb) -> (opcodes, operandCounts, operandIndices)\n"
+			"Marshals a whole basic block in one call. `opcodes` is a bytearray with one LLVM\n"
+			"opcode per instruction, in block order. `operandCounts` and `operandIndices` are\n"
+			"native-endian int32 buffers (decode with array.array('i', ...)): the former holds\n"
+			"one operand count per instruction, the latter the concatenated operands of every\n"
+			"instruction as the in-block index of the defining instruction, or -1 for values\n"
+			"defined elsewhere (arguments, constants, other blocks)."},
+		{"InstructionAtIndex", &instructionAtIndex, METH_VARARGS,
+			"InstructionAtIndex(bb, i) -> Value\n"
+			"Wraps the instruction at in-block index i, as numbered by BatchInstructions."},
+		{nullptr}
+	};
+}
+
+void addBatchBindings(PyObject* module)
+{
+	for (PyMethodDef* method = batchMethods; method->ml_name != nullptr; ++method)
+	{
+		auto function = TAKEREF PyCFunction_NewEx(method, nullptr, nullptr);
+		// AddObject steals the reference on success.
+		PyModule_AddObject(module, method->ml_name, function.release());
+	}
+}
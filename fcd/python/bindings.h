@@ -23,6 +23,10 @@ struct Py_LLVM_Wrapped
 
 PyMODINIT_FUNC initLlvmModule(PyObject** module);
 
+// Registers the hand-written batch marshalling functions (batch_bindings.cpp) on top of the
+// generated module.
+void addBatchBindings(PyObject* module);
+
 extern PyTypeObject Py_LLVMUse_Type;
 extern PyTypeObject Py_LLVMModuleProvider_Type;
 extern PyTypeObject Py_LLVMBuilder_Type;
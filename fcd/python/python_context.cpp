@@ -13,8 +13,11 @@
 #include "python_helpers.h"
 
 #include <llvm/IR/Module.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/Path.h>
 
+#include <map>
+
 using namespace llvm;
 using namespace std;
 
@@ -32,7 +35,21 @@ namespace
 		: module(move(module)), run(move(run)), name(name)
 		{
 		}
-		
+
+		PythonWrapper(PythonWrapper&&) = default;
+
+		~PythonWrapper()
+		{
+			// The pass manager deletes passes with the GIL released; dropping the last references
+			// needs it back. Moved-from wrappers have nothing to release.
+			if (module || run)
+			{
+				PyGILLock gil;
+				run.reset();
+				module.reset();
+			}
+		}
+
 		bool runWithObject(PyObject* object)
 		{
 			PyErr_Clear();
@@ -69,6 +86,7 @@ namespace
 		
 		virtual bool runOnModule(Module& m) override
 		{
+			PyGILLock gil;
 			auto pyModuleObject = TAKEREF Py_LLVMModule_Type.tp_alloc(&Py_LLVMModule_Type, 0);
 			((Py_LLVM_Wrapped<LLVMModuleRef>*)pyModuleObject.get())->obj = wrap(&m);
 			return runWithObject(pyModuleObject.get());
@@ -91,6 +109,7 @@ namespace
 		
 		virtual bool runOnFunction(Function& fn) override
 		{
+			PyGILLock gil;
 			auto pyModuleObject = TAKEREF Py_LLVMValue_Type.tp_alloc(&Py_LLVMValue_Type, 0);
 			((Py_LLVM_Wrapped<LLVMValueRef>*)pyModuleObject.get())->obj = wrap(&fn);
 			return runWithObject(pyModuleObject.get());
@@ -108,23 +127,86 @@ namespace
 // needs external linkage to be available during debugging
 void dump(PyObject* obj)
 {
+	PyGILLock gil;
 	PyObject_Print(obj, stderr, 0);
 }
 #endif
 
+namespace
+{
+	// Lazily-started interpreter state. Py_SetProgramName keeps the pointer it is given, so the
+	// name lives here for the duration of the process.
+	string pythonProgramName;
+	PyObject* llvmModule;
+	PyThreadState* savedThreadState;
+	bool interpreterUp = false;
+
+	// Scripts already imported this process, keyed by path. Batch runs create the same passes for
+	// every input, and re-running the import machinery each time dominates scripted corpus runs;
+	// the recorded modification time lets an edited script take effect without a restart. Entries
+	// hold interpreter references, so the cache must be emptied under the GIL before Py_Finalize.
+	struct CachedScript
+	{
+		AutoPyObject module;
+		sys::TimePoint<> modificationTime;
+	};
+	map<string, CachedScript> loadedScripts;
+
+	// Returns the module for `path`, importing it only if it isn't cached or has changed on disk.
+	// Must be called with the GIL held.
+	ErrorOr<AutoPyObject> loadModuleCached(const string& path)
+	{
+		sys::fs::file_status status;
+		bool hasStatus = !sys::fs::status(path, status);
+
+		auto iter = loadedScripts.find(path);
+		if (iter != loadedScripts.end() && hasStatus && iter->second.modificationTime == status.getLastModificationTime())
+		{
+			return ADDREF iter->second.module.get();
+		}
+
+		auto moduleOrError = loadModule(path);
+		if (moduleOrError && hasStatus)
+		{
+			auto& entry = loadedScripts[path];
+			entry.module = ADDREF moduleOrError.get().get();
+			entry.modificationTime = status.getLastModificationTime();
+		}
+		return moduleOrError;
+	}
+}
+
 #pragma mark - Implementation
 PythonContext::PythonContext(const string& programPath)
 {
-	unique_ptr<char, decltype(free)&> mutableName(strdup(programPath.c_str()), free);
-	Py_SetProgramName(mutableName.get());
+	pythonProgramName = programPath;
+}
+
+void PythonContext::ensureInterpreter()
+{
+	if (interpreterUp)
+	{
+		return;
+	}
+	interpreterUp = true;
+
+	Py_SetProgramName(&pythonProgramName[0]);
 	Py_Initialize();
-	
+	PyEval_InitThreads();
+
 	initLlvmModule(&llvmModule);
+	addBatchBindings(llvmModule);
+
+	// Park the main thread's interpreter state and drop the GIL: merely loading a script must not
+	// serialize the native pipeline. Everything that re-enters the C API takes a PyGILLock.
+	savedThreadState = PyEval_SaveThread();
 }
 
 ErrorOr<Pass*> PythonContext::createPass(const std::string &path)
 {
-	auto moduleOrError = loadModule(path);
+	ensureInterpreter();
+	PyGILLock gil;
+	auto moduleOrError = loadModuleCached(path);
 	if (!moduleOrError)
 	{
 		return moduleOrError.getError();
@@ -192,7 +274,13 @@ ErrorOr<Pass*> PythonContext::createPass(const std::string &path)
 
 PythonContext::~PythonContext()
 {
-	Py_Finalize();
+	if (interpreterUp)
+	{
+		interpreterUp = false;
+		PyEval_RestoreThread(savedThreadState);
+		loadedScripts.clear();
+		Py_Finalize();
+	}
 }
 
 namespace llvm
@@ -17,16 +17,18 @@
 #include <memory>
 #include <string>
 
-struct _object;
-
 class PythonContext
 {
-	_object* llvmModule;
-	
 public:
 	PythonContext(const std::string& programPath);
 	~PythonContext();
-	
+
+	// Starts the interpreter if it isn't up yet. Construction alone doesn't: most runs use no
+	// Python feature at all, and Py_Initialize is a measurable slice of a short run's lifetime.
+	// Every Python entry point that can run first (pass creation, script-loaded executables)
+	// calls this before taking the GIL.
+	static void ensureInterpreter();
+
 	llvm::ErrorOr<llvm::Pass*> createPass(const std::string& path);
 };
 
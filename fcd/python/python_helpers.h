@@ -26,6 +26,18 @@ struct PyErrClearAtEnd
 	~PyErrClearAtEnd() { PyErr_Clear(); }
 };
 
+// Holds the global interpreter lock for the scope. PythonContext releases the GIL as soon as the
+// interpreter is initialized so that native passes can run on several threads without serializing
+// on it; in exchange, every entry into the C API must sit under one of these. Acquisition nests
+// safely on a thread that already holds the lock.
+struct PyGILLock
+{
+	PyGILState_STATE state;
+
+	PyGILLock() : state(PyGILState_Ensure()) {}
+	~PyGILLock() { PyGILState_Release(state); }
+};
+
 struct PyDecRef
 {
 	void operator()(PyObject* obj) const
@@ -0,0 +1,89 @@
+//
+// statistics.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "statistics.h"
+
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	cl::opt<string> statsJson("stats-json", cl::desc("Write counter statistics to this file as JSON at exit"), cl::value_desc("filename"), whitelist());
+
+	struct StatRegistry
+	{
+		mutex lock;
+		vector<const StatCounter*> counters;
+
+		// The dump runs during static destruction so that it sees the very last increments.
+		// Counters themselves are trivially destructible statics, so reading them here is safe
+		// even though their destructors have already run.
+		~StatRegistry()
+		{
+			if (statsJson.getNumOccurrences() == 0)
+			{
+				return;
+			}
+
+			vector<const StatCounter*> sorted;
+			{
+				lock_guard<mutex> guard(lock);
+				sorted = counters;
+			}
+			sort(sorted.begin(), sorted.end(), [](const StatCounter* a, const StatCounter* b) {
+				return strcmp(a->getName(), b->getName()) < 0;
+			});
+
+			error_code errorCode;
+			raw_fd_ostream os(statsJson, errorCode, sys::fs::F_None);
+			if (errorCode)
+			{
+				errs() << "can't write statistics to " << statsJson << ": " << errorCode.message() << '\n';
+				return;
+			}
+
+			os << "{";
+			bool first = true;
+			for (const StatCounter* counter : sorted)
+			{
+				os << (first ? "\n" : ",\n");
+				os << "\t\"" << counter->getName() << "\": " << counter->get();
+				first = false;
+			}
+			os << "\n}\n";
+		}
+	};
+
+	// Constructed the first time a counter registers, which guarantees that it is destroyed (and
+	// dumps) after every counter has finished counting.
+	StatRegistry& registry()
+	{
+		static StatRegistry instance;
+		return instance;
+	}
+}
+
+StatCounter::StatCounter(const char* name)
+: name(name), count(0)
+{
+	StatRegistry& reg = registry();
+	lock_guard<mutex> guard(reg.lock);
+	reg.counters.push_back(this);
+}
@@ -0,0 +1,44 @@
+//
+// statistics.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__statistics_h
+#define fcd__statistics_h
+
+#include <atomic>
+#include <cstdint>
+
+// --stats-json support: process-wide counters for the lifter, parameter recovery and the AST
+// passes, written to a JSON file at exit so that throughput regressions can be correlated with
+// workload shape across runs. Counters are lock-free and cheap enough to stay enabled
+// unconditionally; declare them with static duration and bump them from any thread.
+class StatCounter
+{
+	const char* name;
+	std::atomic<uint64_t> count;
+
+public:
+	StatCounter(const char* name);
+
+	const char* getName() const { return name; }
+	uint64_t get() const { return count.load(std::memory_order_relaxed); }
+
+	StatCounter& operator++()
+	{
+		count.fetch_add(1, std::memory_order_relaxed);
+		return *this;
+	}
+
+	StatCounter& operator+=(uint64_t value)
+	{
+		count.fetch_add(value, std::memory_order_relaxed);
+		return *this;
+	}
+};
+
+#endif /* fcd__statistics_h */
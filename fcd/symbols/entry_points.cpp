@@ -10,32 +10,122 @@
 #include "command_line.h"
 #include "entry_points.h"
 
-#include <unordered_set>
+#include <algorithm>
 
 using namespace llvm;
 using namespace std;
 
+namespace
+{
+	// splitmix64's finalizer: cheap, and mixes the low entropy of code addresses (aligned, tightly
+	// clustered) into both halves of the result, which serve as the two bloom probes.
+	uint64_t mixAddress(uint64_t x)
+	{
+		x ^= x >> 30;
+		x *= 0xbf58476d1ce4e5b9;
+		x ^= x >> 27;
+		x *= 0x94d049bb133111eb;
+		x ^= x >> 31;
+		return x;
+	}
+
+	void setBloomBit(vector<uint64_t>& bits, uint64_t bit)
+	{
+		bits[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+
+	bool testBloomBit(const vector<uint64_t>& bits, uint64_t bit)
+	{
+		return ((bits[bit / 64] >> (bit % 64)) & 1) != 0;
+	}
+}
+
 void EntryPointRepository::addProvider(EntryPointProvider &provider)
 {
 	providers.push_back(&provider);
+	invalidateIndex();
+}
+
+void EntryPointRepository::ensureIndex() const
+{
+	if (indexValid)
+	{
+		return;
+	}
+
+	// Collect later providers first so that the stable sort and deduplication below keep their entries,
+	// the same precedence that lookups falling through to the providers get.
+	index.clear();
+	for (auto iter = providers.rbegin(); iter != providers.rend(); ++iter)
+	{
+		for (uint64_t address : (*iter)->getVisibleEntryPoints())
+		{
+			if (const SymbolInfo* info = (*iter)->getInfo(address))
+			{
+				index.emplace_back(address, info);
+			}
+		}
+	}
+
+	stable_sort(index.begin(), index.end(), [](const pair<uint64_t, const SymbolInfo*>& a, const pair<uint64_t, const SymbolInfo*>& b)
+	{
+		return a.first < b.first;
+	});
+	index.erase(unique(index.begin(), index.end(), [](const pair<uint64_t, const SymbolInfo*>& a, const pair<uint64_t, const SymbolInfo*>& b)
+	{
+		return a.first == b.first;
+	}), index.end());
+
+	size_t bitCount = 64;
+	while (bitCount < index.size() * 8)
+	{
+		bitCount <<= 1;
+	}
+	bloomBits.assign(bitCount / 64, 0);
+	bloomMask = bitCount - 1;
+	for (const auto& entry : index)
+	{
+		uint64_t hash = mixAddress(entry.first);
+		setBloomBit(bloomBits, hash & bloomMask);
+		setBloomBit(bloomBits, (hash >> 32) & bloomMask);
+	}
+
+	indexValid = true;
 }
 
 vector<uint64_t> EntryPointRepository::getVisibleEntryPoints() const
 {
-	unordered_set<uint64_t> entryPoints;
-	for (auto provider : providers)
+	ensureIndex();
+	vector<uint64_t> entryPoints;
+	entryPoints.reserve(index.size());
+	for (const auto& entry : index)
 	{
-		auto entryPointList = provider->getVisibleEntryPoints();
-		entryPoints.insert(entryPointList.begin(), entryPointList.end());
+		entryPoints.push_back(entry.first);
 	}
-	return vector<uint64_t>(entryPoints.begin(), entryPoints.end());
+	return entryPoints;
 }
 
 const SymbolInfo* EntryPointRepository::getInfo(uint64_t address) const
 {
-	for (auto iter = providers.rbegin(); iter != providers.rend(); ++iter)
+	ensureIndex();
+	uint64_t hash = mixAddress(address);
+	if (testBloomBit(bloomBits, hash & bloomMask) && testBloomBit(bloomBits, (hash >> 32) & bloomMask))
+	{
+		auto iter = lower_bound(index.begin(), index.end(), address, [](const pair<uint64_t, const SymbolInfo*>& entry, uint64_t address)
+		{
+			return entry.first < address;
+		});
+		if (iter != index.end() && iter->first == address)
+		{
+			return iter->second;
+		}
+	}
+
+	// Providers can know about addresses that they do not advertise as entry points (for instance,
+	// executables synthesize symbol info for any mapped address), so a miss still goes to them.
+	for (auto providerIter = providers.rbegin(); providerIter != providers.rend(); ++providerIter)
 	{
-		if (auto info = (*iter)->getInfo(address))
+		if (auto info = (*providerIter)->getInfo(address))
 		{
 			return info;
 		}
@@ -10,13 +10,19 @@
 #ifndef entry_points_h
 #define entry_points_h
 
+#include <llvm/ADT/StringRef.h>
+
 #include <cstddef>
 #include <string>
+#include <utility>
 #include <vector>
 
 struct SymbolInfo
 {
-	std::string name;
+	// View into storage owned by the provider that handed out this info: executables point into
+	// their mapped image or their interning arena, so million-symbol binaries don't pay a string
+	// allocation per name. Lives as long as the provider does.
+	llvm::StringRef name;
 	uint64_t virtualAddress;
 };
 
@@ -32,10 +38,30 @@ public:
 class EntryPointRepository final : public EntryPointProvider
 {
 	std::vector<const EntryPointProvider*> providers;
-	
+
+	// Consolidated index over every provider's visible entry points, sorted by address and built on
+	// first use. Entries from later providers shadow earlier ones, matching getInfo's lookup order.
+	mutable std::vector<std::pair<uint64_t, const SymbolInfo*>> index;
+	// Bloom filter over the index's addresses (~8 bits per entry, 2 probes). Discovery asks about
+	// far more addresses than the providers advertise, so the common miss costs one hash and two
+	// bit tests instead of a binary search through the index.
+	mutable std::vector<uint64_t> bloomBits;
+	mutable uint64_t bloomMask;
+	mutable bool indexValid;
+
+	void ensureIndex() const;
+
 public:
+	EntryPointRepository()
+	: bloomMask(0), indexValid(false)
+	{
+	}
+
 	void addProvider(EntryPointProvider& provider);
-	
+
+	// Call when a provider's set of visible entry points may have changed.
+	void invalidateIndex() { indexValid = false; }
+
 	std::vector<uint64_t> getVisibleEntryPoints() const override;
 	const SymbolInfo* getInfo(uint64_t address) const override;
 };
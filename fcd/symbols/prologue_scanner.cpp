@@ -0,0 +1,121 @@
+//
+// prologue_scanner.cpp
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#include "command_line.h"
+#include "prologue_scanner.h"
+
+#include <llvm/Support/CommandLine.h>
+
+#include <cstring>
+
+using namespace llvm;
+using namespace std;
+
+namespace
+{
+	cl::opt<bool> scanPrologues("scan-prologues", cl::desc("Scan executable regions for x86_64 function prologues and treat every match as an entry point (useful on stripped binaries)"), whitelist());
+
+	// Each pattern is anchored on its first byte so that the sweep can ride memchr from candidate
+	// to candidate. Libc vectorizes memchr with whatever the CPU offers, which keeps the scan at
+	// memory bandwidth without hand-written SIMD here.
+	struct ProloguePattern
+	{
+		uint8_t bytes[4];
+		size_t length;
+	};
+
+	const ProloguePattern prologuePatterns[] = {
+		{{0xf3, 0x0f, 0x1e, 0xfa}, 4}, // endbr64
+		{{0x55, 0x48, 0x89, 0xe5}, 4}, // push rbp; mov rbp, rsp
+		{{0x55, 0x48, 0x8b, 0xec}, 4}, // push rbp; mov rbp, rsp (8b form)
+	};
+
+	// A prologue-shaped byte sequence in the middle of a basic block is just data or a coincidental
+	// instruction boundary. Real function starts are either aligned or follow the padding and
+	// epilogue bytes that compilers leave between functions.
+	bool looksLikeFunctionStart(const uint8_t* regionBegin, const uint8_t* candidate, uint64_t address)
+	{
+		if (address % 16 == 0 || candidate == regionBegin)
+		{
+			return true;
+		}
+		uint8_t previous = candidate[-1];
+		return previous == 0x90 || previous == 0xcc || previous == 0xc3;
+	}
+}
+
+void PrologueScanner::scan() const
+{
+	scanned = true;
+	for (const auto& region : executable.getExecutableRegions())
+	{
+		const uint8_t* regionBegin = executable.map(region.first);
+		if (regionBegin == nullptr)
+		{
+			continue;
+		}
+
+		const uint8_t* regionEnd = regionBegin + region.second;
+		for (const auto& pattern : prologuePatterns)
+		{
+			const uint8_t* cursor = regionBegin;
+			while (cursor + pattern.length <= regionEnd)
+			{
+				auto searchLength = static_cast<size_t>(regionEnd - cursor) - (pattern.length - 1);
+				cursor = static_cast<const uint8_t*>(memchr(cursor, pattern.bytes[0], searchLength));
+				if (cursor == nullptr)
+				{
+					break;
+				}
+
+				if (memcmp(cursor + 1, pattern.bytes + 1, pattern.length - 1) == 0)
+				{
+					uint64_t address = region.first + static_cast<uint64_t>(cursor - regionBegin);
+					if (looksLikeFunctionStart(regionBegin, cursor, address))
+					{
+						candidates[address].virtualAddress = address;
+					}
+				}
+				++cursor;
+			}
+		}
+	}
+}
+
+bool PrologueScanner::isEnabled()
+{
+	return scanPrologues;
+}
+
+vector<uint64_t> PrologueScanner::getVisibleEntryPoints() const
+{
+	if (!scanned)
+	{
+		scan();
+	}
+
+	vector<uint64_t> result;
+	result.reserve(candidates.size());
+	for (const auto& pair : candidates)
+	{
+		result.push_back(pair.first);
+	}
+	return result;
+}
+
+const SymbolInfo* PrologueScanner::getInfo(uint64_t address) const
+{
+	if (!scanned)
+	{
+		scan();
+	}
+
+	auto iter = candidates.find(address);
+	return iter == candidates.end() ? nullptr : &iter->second;
+}
@@ -0,0 +1,44 @@
+//
+// prologue_scanner.h
+// Copyright (C) 2015 Félix Cloutier.
+// All Rights Reserved.
+//
+// This file is distributed under the University of Illinois Open Source
+// license. See LICENSE.md for details.
+//
+
+#ifndef fcd__symbols_prologue_scanner_h
+#define fcd__symbols_prologue_scanner_h
+
+#include "entry_points.h"
+#include "executable.h"
+
+#include <map>
+
+// Discovers likely function entry points by sweeping an executable's code regions for common
+// x86_64 prologue patterns, so that stripped binaries can be fully disassembled without feeding
+// fcd externally-generated --other-entry guesses. Candidates are anonymous: lifted functions get
+// the usual address-derived name. Enabled with --scan-prologues.
+class PrologueScanner final : public EntryPointProvider
+{
+	const Executable& executable;
+	// Candidates live in a node-based map because getInfo hands out pointers that callers keep.
+	mutable std::map<uint64_t, SymbolInfo> candidates;
+	mutable bool scanned;
+
+	void scan() const;
+
+public:
+	PrologueScanner(const Executable& executable)
+	: executable(executable), scanned(false)
+	{
+	}
+
+	// Whether --scan-prologues was passed; callers only register the provider when it was.
+	static bool isEnabled();
+
+	virtual std::vector<uint64_t> getVisibleEntryPoints() const override;
+	virtual const SymbolInfo* getInfo(uint64_t address) const override;
+};
+
+#endif /* fcd__symbols_prologue_scanner_h */
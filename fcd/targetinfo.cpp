@@ -16,22 +16,75 @@
 #include <llvm/IR/Module.h>
 
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
 using namespace llvm;
 using namespace std;
 
-unique_ptr<TargetInfo> TargetInfo::getTargetInfo(const Module& module)
+TargetInfo* TargetInfo::getTargetInfo(const Module& module)
 {
-	Triple triple(module.getTargetTriple());
-	auto arch = triple.getArch();
-	if (arch == Triple::x86_64)
+	// One instance per module, kept for the lifetime of the process. The lock only matters when
+	// lifter worker threads ask about distinct modules at the same time; after the first request
+	// for a module, calls are a map lookup.
+	static mutex cacheLock;
+	static unordered_map<const Module*, unique_ptr<TargetInfo>> cache;
+
+	lock_guard<mutex> lock(cacheLock);
+	auto insertResult = cache.insert({&module, nullptr});
+	auto& slot = insertResult.first->second;
+	if (insertResult.second)
 	{
-		auto info = new TargetInfo;
-		info->dl = &module.getDataLayout();
-		x86TargetInfo(info);
-		return unique_ptr<TargetInfo>(info);
+		Triple triple(module.getTargetTriple());
+		auto arch = triple.getArch();
+		if (arch == Triple::x86_64)
+		{
+			auto info = new TargetInfo;
+			info->dl = &module.getDataLayout();
+			info->mdKinds.reset(new md::MetadataKinds(module.getContext()));
+			x86TargetInfo(info);
+			slot.reset(info);
+		}
 	}
-	return nullptr;
+	return slot.get();
+}
+
+TargetInfo::~TargetInfo()
+{
+}
+
+void TargetInfo::setTargetRegisterInfo(const vector<TargetRegisterInfo>& targetRegInfos)
+{
+	targetRegInfo = &targetRegInfos;
+
+	registersByName.clear();
+	for (const TargetRegisterInfo& info : targetRegInfos)
+	{
+		registersByName[info.name] = &info;
+	}
+
+	// The table is sorted by offset and a register's leader is the enclosing register that opened
+	// the current span; record it per entry so largestOverlappingRegister is a plain load.
+	largestOverlapping.clear();
+	largestOverlapping.reserve(targetRegInfos.size());
+	canonicalIndices.clear();
+	canonicalIndices.reserve(targetRegInfos.size());
+	canonicalRegisters.clear();
+	auto iter = targetRegInfos.begin();
+	auto end = targetRegInfos.end();
+	while (iter != end)
+	{
+		const TargetRegisterInfo& currentTarget = *iter;
+		canonicalRegisters.push_back(&currentTarget);
+		while (iter != end && iter->offset < currentTarget.offset + currentTarget.size)
+		{
+			largestOverlapping.push_back(&currentTarget);
+			canonicalIndices.push_back(static_cast<unsigned>(canonicalRegisters.size() - 1));
+			++iter;
+		}
+	}
+	// Bitmask register sets depend on leaders fitting in 64 bits.
+	assert(canonicalRegisters.size() <= 64);
 }
 
 Instruction* TargetInfo::getRegister(llvm::Value *registerStruct, const TargetRegisterInfo& info, Instruction& insertionPoint) const
@@ -105,7 +158,7 @@ const TargetRegisterInfo* TargetInfo::registerInfo(const Value& value) const
 
 const TargetRegisterInfo* TargetInfo::registerInfo(const GetElementPtrInst &gep) const
 {
-	if (md::isRegisterStruct(*gep.getPointerOperand()))
+	if (metadataKinds().isRegisterStruct(*gep.getPointerOperand()))
 	{
 		APInt offset(64, 0, false);
 		if (gep.accumulateConstantOffset(*dl, offset))
@@ -120,16 +173,16 @@ const TargetRegisterInfo* TargetInfo::registerInfo(const GetElementPtrInst &gep)
 
 const TargetRegisterInfo* TargetInfo::registerInfo(size_t offset, size_t size) const
 {
-	for (const auto& info : targetRegisterInfo())
+	const auto& registers = targetRegisterInfo();
+	auto iter = lower_bound(registers.begin(), registers.end(), offset, [](const TargetRegisterInfo& info, size_t offset)
 	{
-		if (info.offset == offset && info.size == size)
-		{
-			return &info;
-		}
-		
-		if (info.offset > offset)
+		return info.offset < offset;
+	});
+	for (; iter != registers.end() && iter->offset == offset; ++iter)
+	{
+		if (iter->size == size)
 		{
-			break;
+			return &*iter;
 		}
 	}
 	return nullptr;
@@ -137,19 +190,8 @@ const TargetRegisterInfo* TargetInfo::registerInfo(size_t offset, size_t size) c
 
 const TargetRegisterInfo& TargetInfo::largestOverlappingRegister(const TargetRegisterInfo& overlapped) const
 {
-	auto iter = targetRegisterInfo().begin();
-	auto end = targetRegisterInfo().end();
-	while (iter != end)
-	{
-		const auto& currentTarget = *iter;
-		while (iter->offset < currentTarget.offset + currentTarget.size)
-		{
-			if (&*iter == &overlapped)
-			{
-				return currentTarget;
-			}
-			iter++;
-		}
-	}
-	llvm_unreachable("Missing register in largestOverlappingRegister?!");
+	const auto& registers = targetRegisterInfo();
+	size_t index = &overlapped - registers.data();
+	assert(index < largestOverlapping.size() && "Missing register in largestOverlappingRegister?!");
+	return *largestOverlapping[index];
 }
@@ -10,6 +10,7 @@
 #ifndef fcd__targetinfo_h
 #define fcd__targetinfo_h
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/IR/DataLayout.h>
 #include <llvm/IR/Instructions.h>
 
@@ -18,6 +19,12 @@
 #include <string>
 #include <vector>
 
+// (metadata.h includes params_registry.h, which includes this header)
+namespace md
+{
+	class MetadataKinds;
+}
+
 struct TargetRegisterInfo
 {
 	size_t offset;
@@ -34,25 +41,44 @@ class TargetInfo
 	size_t spIndex;
 	const std::vector<TargetRegisterInfo>* targetRegInfo;
 	const llvm::DataLayout* dl;
-	
+	std::unique_ptr<md::MetadataKinds> mdKinds;
+
+	// Precomputed from the register table when it's bound: name and overlap queries run for
+	// essentially every register access in the module, so the linear scans added up.
+	llvm::StringMap<const TargetRegisterInfo*> registersByName;
+	std::vector<const TargetRegisterInfo*> largestOverlapping;
+	// Dense numbering of the leader registers, parallel to the table; see canonicalRegisterIndex.
+	std::vector<unsigned> canonicalIndices;
+	std::vector<const TargetRegisterInfo*> canonicalRegisters;
+
 	TargetInfo()
 	: spIndex(std::numeric_limits<size_t>::max()), targetRegInfo(nullptr), dl(nullptr)
 	{
 	}
 
 public:
-	static std::unique_ptr<TargetInfo> getTargetInfo(const llvm::Module& module);
-	
+	// Returns the module's shared TargetInfo, built on first request, or null for unsupported
+	// targets. Every pass used to construct its own copy (and re-run the register table setup and
+	// name resolution) at each pass boundary; the instance lives as long as the process and must
+	// not be freed by callers.
+	static TargetInfo* getTargetInfo(const llvm::Module& module);
+
+	~TargetInfo();
+
+	// Metadata accessor with the module's "fcd.*" kind IDs pre-resolved, for queries on the hot path.
+	inline const md::MetadataKinds& metadataKinds() const
+	{
+		assert(mdKinds != nullptr);
+		return *mdKinds;
+	}
+
 	inline const std::vector<TargetRegisterInfo>& targetRegisterInfo() const
 	{
 		assert(targetRegInfo != nullptr);
 		return *targetRegInfo;
 	}
 	
-	inline void setTargetRegisterInfo(const std::vector<TargetRegisterInfo>& targetRegInfos)
-	{
-		this->targetRegInfo = &targetRegInfos;
-	}
+	void setTargetRegisterInfo(const std::vector<TargetRegisterInfo>& targetRegInfos);
 	
 	inline std::string& targetName()
 	{
@@ -71,14 +97,7 @@ public:
 	
 	inline const TargetRegisterInfo* registerNamed(const char* regname) const
 	{
-		for (const auto& regInfo : targetRegisterInfo())
-		{
-			if (regInfo.name == regname)
-			{
-				return &regInfo;
-			}
-		}
-		return nullptr;
+		return registersByName.lookup(regname);
 	}
 	
 	llvm::Instruction* getRegister(llvm::Value* registerStruct, const TargetRegisterInfo& info, llvm::Instruction& insertionPoint) const;
@@ -88,7 +107,28 @@ public:
 	const TargetRegisterInfo* registerInfo(const llvm::GetElementPtrInst& value) const;
 	const TargetRegisterInfo* registerInfo(size_t offset, size_t size) const;
 	const TargetRegisterInfo& largestOverlappingRegister(const TargetRegisterInfo& overlapped) const;
-	
+
+	// Dense index of a register's leader ("largest overlapping" register). x86_64 has well under
+	// 64 leaders, so register sets encode as uint64_t masks of these indices and union or
+	// intersection of whole sets is a single instruction.
+	inline unsigned canonicalRegisterIndex(const TargetRegisterInfo& reg) const
+	{
+		size_t position = static_cast<size_t>(&reg - targetRegisterInfo().data());
+		assert(position < canonicalIndices.size());
+		return canonicalIndices[position];
+	}
+
+	inline const TargetRegisterInfo& canonicalRegisterAtIndex(unsigned index) const
+	{
+		assert(index < canonicalRegisters.size());
+		return *canonicalRegisters[index];
+	}
+
+	inline size_t canonicalRegisterCount() const
+	{
+		return canonicalRegisters.size();
+	}
+
 	inline void setStackPointer(const TargetRegisterInfo& targetReg)
 	{
 		for (size_t i = 0; i < targetRegisterInfo().size(); i++)
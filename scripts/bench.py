@@ -0,0 +1,137 @@
+#!/usr/bin/env python
+# bench.py
+# Corpus-driven benchmark driver for fcd.
+#
+# Runs fcd over every executable in a corpus directory and times each phase by
+# splitting the pipeline on its module boundary: `fcd -n` measures executable
+# parsing + lifting, and `fcd -m` on the lifted module measures optimization,
+# AST structuring and printing. Results are emitted as machine-readable JSON;
+# pass --compare with a second fcd binary to get an A/B report.
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+
+def run_timed(command, stdout):
+	begin = time.time()
+	with open(os.devnull, "w") as devnull:
+		status = subprocess.call(command, stdout=stdout, stderr=devnull)
+	return time.time() - begin, status
+
+
+def benchmark_input(fcd, path, runs):
+	result = {
+		"input": path,
+		"size": os.path.getsize(path),
+		"lift_seconds": [],
+		"transform_seconds": [],
+		"output_bytes": 0,
+		"status": "ok",
+	}
+
+	module_fd, module_path = tempfile.mkstemp(suffix=".ll")
+	output_fd, output_path = tempfile.mkstemp(suffix=".c")
+	os.close(module_fd)
+	os.close(output_fd)
+	try:
+		for _ in range(runs):
+			with open(module_path, "w") as module_file:
+				elapsed, status = run_timed([fcd, "-n", path], module_file)
+			if status != 0:
+				result["status"] = "lift failed (%d)" % status
+				return result
+			result["lift_seconds"].append(elapsed)
+
+			with open(output_path, "w") as output_file:
+				elapsed, status = run_timed([fcd, "-m", module_path], output_file)
+			if status != 0:
+				result["status"] = "transform failed (%d)" % status
+				return result
+			result["transform_seconds"].append(elapsed)
+
+		result["output_bytes"] = os.path.getsize(output_path)
+	finally:
+		os.unlink(module_path)
+		os.unlink(output_path)
+	return result
+
+
+def benchmark_corpus(fcd, corpus, runs):
+	results = []
+	for name in sorted(os.listdir(corpus)):
+		path = os.path.join(corpus, name)
+		if not os.path.isfile(path):
+			continue
+		sys.stderr.write("bench: %s\n" % path)
+		results.append(benchmark_input(fcd, path, runs))
+	return results
+
+
+def best(samples):
+	return min(samples) if samples else float("nan")
+
+
+def summarize(results):
+	total_lift = sum(best(r["lift_seconds"]) for r in results if r["status"] == "ok")
+	total_transform = sum(best(r["transform_seconds"]) for r in results if r["status"] == "ok")
+	total_bytes = sum(r["size"] for r in results if r["status"] == "ok")
+	return {
+		"lift_seconds": total_lift,
+		"transform_seconds": total_transform,
+		"total_seconds": total_lift + total_transform,
+		"bytes_per_second": total_bytes / (total_lift + total_transform) if total_lift + total_transform else 0,
+		"failures": [r["input"] for r in results if r["status"] != "ok"],
+	}
+
+
+def report_comparison(summary_a, summary_b):
+	for key in ("lift_seconds", "transform_seconds", "total_seconds"):
+		a = summary_a[key]
+		b = summary_b[key]
+		delta = ((b - a) / a * 100) if a else float("nan")
+		sys.stderr.write("%-20s A=%8.3fs B=%8.3fs (%+.1f%%)\n" % (key, a, b, delta))
+
+
+def main():
+	parser = argparse.ArgumentParser(description="fcd benchmark driver")
+	parser.add_argument("--fcd", required=True, help="path to the fcd binary to benchmark")
+	parser.add_argument("--corpus", required=True, help="directory of input executables")
+	parser.add_argument("--compare", help="path to a second fcd binary for A/B comparison")
+	parser.add_argument("--runs", type=int, default=3, help="samples per input (best-of is reported)")
+	parser.add_argument("--output", help="write JSON results to this file instead of stdout")
+	args = parser.parse_args()
+
+	if not os.path.isdir(args.corpus):
+		sys.stderr.write("bench: corpus directory %s doesn't exist\n" % args.corpus)
+		return 1
+
+	report = {
+		"fcd": args.fcd,
+		"corpus": args.corpus,
+		"runs": args.runs,
+		"results": benchmark_corpus(args.fcd, args.corpus, args.runs),
+	}
+	report["summary"] = summarize(report["results"])
+
+	if args.compare:
+		report["compare_fcd"] = args.compare
+		report["compare_results"] = benchmark_corpus(args.compare, args.corpus, args.runs)
+		report["compare_summary"] = summarize(report["compare_results"])
+		report_comparison(report["summary"], report["compare_summary"])
+
+	text = json.dumps(report, indent=2, sort_keys=True)
+	if args.output:
+		with open(args.output, "w") as output_file:
+			output_file.write(text + "\n")
+	else:
+		print(text)
+	return 1 if report["summary"]["failures"] else 0
+
+
+if __name__ == "__main__":
+	sys.exit(main())
@@ -12,6 +12,10 @@ sectionInfo = {}
 executableType = "Portable Executable"
 targetTriple = "unknown-unknown-win32"
 entryPoints = []
+# Bulk tables: fcd reads these once after init instead of calling mapAddress
+# and getStubTarget across the C/Python boundary for every address.
+segments = []
+stubTargets = []
 
 def init(data):
 	global stubs
@@ -19,6 +23,8 @@ def init(data):
 	global sectionInfo
 	global entryPoints
 	global targetTriple
+	global segments
+	global stubTargets
 
 	pe = pefile.PE(data=data)
 	machineType = pefile.MACHINE_TYPE[pe.FILE_HEADER.Machine]
@@ -34,6 +40,7 @@ def init(data):
 		virtualAddress = imageBase + section.VirtualAddress
 		bisect.insort(sectionStart, virtualAddress)
 		sectionInfo[virtualAddress] = (section.PointerToRawData, section.SizeOfRawData)
+		segments.append((virtualAddress, section.PointerToRawData, section.SizeOfRawData))
 	
 	for entry in pe.DIRECTORY_ENTRY_IMPORT:
 		for imp in entry.imports:
@@ -42,6 +49,7 @@ def init(data):
 			else:
 				# make up some name based on the ordinal
 				stubs[imp.address] = (entry.dll, "%s:%i" % (entry.dll, imp.ordinal))
+			stubTargets.append((imp.address,) + stubs[imp.address])
 	
 	entry = (imageBase + pe.OPTIONAL_HEADER.AddressOfEntryPoint, "pe.start")
 	entryPoints.append(entry)
@@ -7,11 +7,19 @@
 //
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <dlfcn.h>
 #include <limits>
+#include <map>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 #include "x86.emulator.h"
 
 using namespace std;
@@ -19,8 +27,14 @@ using namespace std;
 #define DECLARE_TEST(name) extern "C" void x86_test_ ## name (uintptr_t*, uint16_t*, uintptr_t, uintptr_t);
 #include "x86_tests.h"
 
+// Defined in x86_intrin_impl.cpp; cleared for parallel and benchmark runs.
+extern "C" bool x86_emu_print_instructions;
+
 namespace
 {
+	// Serializes harness output so that tests running on different threads don't interleave lines.
+	mutex outputLock;
+
 	enum x86_flag
 	{
 		CF = 1 << 0,
@@ -98,24 +112,32 @@ struct x86_test_entry
 	uintptr_t arg2;
 	bool test_stack;
 	
-	void test() const
+	string describe() const
 	{
 		Dl_info info;
-		if (dladdr(reinterpret_cast<void*>(call), &info) == 1)
+		if (dladdr(reinterpret_cast<void*>(call), &info) != 1)
+		{
+			return string();
+		}
+
+		char arguments[64] = "";
+		if (arg1 != 0 || arg2 != 0)
 		{
-			printf("%s(", info.dli_sname);
-			if (arg1 != 0 || arg2 != 0)
+			if (arg2 != 0)
 			{
-				printf("%#lx", arg1);
-				if (arg2 != 0)
-				{
-					printf(", %#lx", arg2);
-				}
+				snprintf(arguments, sizeof arguments, "%#lx, %#lx", arg1, arg2);
+			}
+			else
+			{
+				snprintf(arguments, sizeof arguments, "%#lx", arg1);
 			}
-			printf(")\n");
 		}
-		
-		result emulated, native;
+		return string(info.dli_sname) + "(" + arguments + ")\n";
+	}
+
+	// Runs just the emulated side; benchmark mode times this without the native run or any output.
+	void emulate(result& emulated) const
+	{
 		x86_regs regs = {
 			.ip = { as_uintptr(x86_native_trampoline_call_ret) },
 			.sp = { as_uintptr(end(emulated.stack)) },
@@ -124,13 +146,24 @@ struct x86_test_entry
 			.d = { arg1 },
 			.c = { arg2 },
 		};
-		
-		x86_native_trampoline(&native.value, &native.flags, arg1, arg2, call, end(native.stack));
 		x86_call_intrin(&config, &regs, as_uintptr(call));
-		
+	}
+
+	void test() const
+	{
+		{
+			lock_guard<mutex> lock(outputLock);
+			printf("%s", describe().c_str());
+		}
+
+		result emulated, native;
+		x86_native_trampoline(&native.value, &native.flags, arg1, arg2, call, end(native.stack));
+		emulate(emulated);
+
+		lock_guard<mutex> lock(outputLock);
 		if (native.value != emulated.value)
 		{
-			printf("Result values are different\n");
+			printf("%sResult values are different\n", describe().c_str());
 			printf("Native:   %#lx\n", native.value);
 			printf("Emulated: %#lx\n", emulated.value);
 			abort();
@@ -141,7 +174,7 @@ struct x86_test_entry
 			uint16_t relevant_native = native.flags & relevant_flags;
 			uint16_t relevant_emulated = emulated.flags & relevant_flags;
 			
-			printf("Result flags are different (mask = %s)\n", flag_string(relevant_flags).c_str());
+			printf("%sResult flags are different (mask = %s)\n", describe().c_str(), flag_string(relevant_flags).c_str());
 			printf("Native:   %s => %s\n", flag_string(native.flags).c_str(), flag_string(relevant_native).c_str());
 			printf("Emulated: %s => %s\n", flag_string(emulated.flags).c_str(), flag_string(relevant_emulated).c_str());
 			if (relevant_emulated != relevant_native)
@@ -154,7 +187,7 @@ struct x86_test_entry
 		{
 			if (memcmp(emulated.stack, native.stack, sizeof emulated.stack) != 0)
 			{
-				printf("Stack leftovers are different\n");
+				printf("%sStack leftovers are different\n", describe().c_str());
 				printf("Native:   %s\n", native.dump_stack().c_str());
 				printf("Emulated: %s\n", emulated.dump_stack().c_str());
 				abort();
@@ -420,9 +453,349 @@ const x86_test_entry tests[] = {
 	{ &x86_test_xor, OF|SF|ZF|CF|PF, 0x8000000000000000, 0x8000000000000000 },
 };
 
+namespace
+{
+	// Shape of a generated benchmark binary; see run_generator.
+	struct generator_params
+	{
+		size_t functions = 256;
+		unsigned branchDensity = 30;	// percent of blocks that end in a conditional branch
+		unsigned depth = 8;				// call graph depth; functions only call the next level down
+		unsigned repFrequency = 10;		// percent of functions that contain a rep string operation
+		uint64_t seed = 1;
+	};
+
+	uint64_t next_random(uint64_t& state)
+	{
+		// xorshift64: fast, stateless across platforms, and good enough to shape a corpus.
+		state ^= state << 13;
+		state ^= state >> 7;
+		state ^= state << 17;
+		return state;
+	}
+
+	// Emits a synthetic x86_64 image with a controlled shape — function count, branch density,
+	// call graph depth, rep-string frequency — so phase benchmarks get reproducible scaling
+	// curves instead of depending on binaries we may not be able to share. The output is a flat
+	// binary: function 0 starts at offset 0, so it decompiles with
+	//   fcd --format=flat --flat-org=<base> -e <base> <file>
+	// Same seed, same shape, same bytes.
+	int run_generator(const char* path, const generator_params& params)
+	{
+		vector<uint8_t> image;
+		vector<size_t> functionStarts(params.functions);
+		struct call_fixup
+		{
+			size_t location;
+			size_t targetFunction;
+		};
+		vector<call_fixup> fixups;
+		uint64_t state = params.seed == 0 ? 1 : params.seed;
+
+		auto emit = [&](initializer_list<uint8_t> bytes)
+		{
+			image.insert(image.end(), bytes);
+		};
+		auto emit32 = [&](uint32_t value)
+		{
+			emit({
+				static_cast<uint8_t>(value),
+				static_cast<uint8_t>(value >> 8),
+				static_cast<uint8_t>(value >> 16),
+				static_cast<uint8_t>(value >> 24),
+			});
+		};
+
+		// Function i sits at call graph level i * depth / functions, so each level is a
+		// contiguous index range and levels get deeper as addresses grow.
+		auto levelOf = [&](size_t fn)
+		{
+			return fn * params.depth / params.functions;
+		};
+		auto levelBegin = [&](size_t level)
+		{
+			return (level * params.functions + params.depth - 1) / params.depth;
+		};
+
+		for (size_t fn = 0; fn < params.functions; ++fn)
+		{
+			functionStarts[fn] = image.size();
+			emit({0x55});				// push rbp
+			emit({0x48, 0x89, 0xe5});	// mov rbp, rsp
+
+			constexpr unsigned blocksPerFunction = 4;
+			for (unsigned block = 0; block < blocksPerFunction; ++block)
+			{
+				emit({0x48, 0xc7, 0xc0});	// mov rax, imm32
+				emit32(next_random(state) & 0x7fffffff);
+				emit({0x48, 0x05});			// add rax, imm32
+				emit32(next_random(state) & 0xffff);
+				emit({0x48, 0x31, 0xc8});	// xor rax, rcx
+
+				if (next_random(state) % 100 < params.branchDensity)
+				{
+					// A conditional branch over a 10-byte filler block, so the lifter sees both
+					// a split and a join per branchy block.
+					emit({0x48, 0x83, 0xf8});	// cmp rax, imm8
+					emit({static_cast<uint8_t>(next_random(state) & 0x7f)});
+					emit({0x75, 0x0a});			// jne past the filler
+					emit({0x48, 0xc7, 0xc1});	// mov rcx, imm32
+					emit32(next_random(state) & 0x7fffffff);
+					emit({0x48, 0x01, 0xc8});	// add rax, rcx
+				}
+			}
+
+			if (next_random(state) % 100 < params.repFrequency)
+			{
+				// The generated code is only ever lifted, never run, so rdi can stay whatever the
+				// caller left in it.
+				emit({0xb9});	// mov ecx, imm32
+				emit32(next_random(state) & 0xff);
+				emit({0xf3, 0xaa});	// rep stosb
+			}
+
+			size_t level = levelOf(fn);
+			if (level + 1 < params.depth)
+			{
+				size_t calleeBegin = levelBegin(level + 1);
+				size_t calleeEnd = level + 2 < params.depth ? levelBegin(level + 2) : params.functions;
+				if (calleeBegin < calleeEnd)
+				{
+					size_t calleeCount = calleeEnd - calleeBegin;
+					size_t callerBegin = levelBegin(level);
+					size_t callerCount = calleeBegin - callerBegin;
+					// The first callee spreads callers evenly over the next level, so every
+					// function stays reachable from function 0; the second is random.
+					size_t spread = calleeBegin + (fn - callerBegin) * calleeCount / (callerCount ? callerCount : 1);
+					size_t targets[] = { min(spread, calleeEnd - 1), calleeBegin + next_random(state) % calleeCount };
+					for (size_t target : targets)
+					{
+						emit({0xe8});	// call rel32, patched below
+						fixups.push_back({image.size(), target});
+						emit32(0);
+					}
+				}
+			}
+
+			emit({0x5d});	// pop rbp
+			emit({0xc3});	// ret
+		}
+
+		for (const call_fixup& fixup : fixups)
+		{
+			uint32_t displacement = static_cast<uint32_t>(functionStarts[fixup.targetFunction] - (fixup.location + 4));
+			image[fixup.location] = static_cast<uint8_t>(displacement);
+			image[fixup.location + 1] = static_cast<uint8_t>(displacement >> 8);
+			image[fixup.location + 2] = static_cast<uint8_t>(displacement >> 16);
+			image[fixup.location + 3] = static_cast<uint8_t>(displacement >> 24);
+		}
+
+		FILE* output = fopen(path, "wb");
+		if (output == nullptr)
+		{
+			fprintf(stderr, "can't write generated binary to %s\n", path);
+			return 1;
+		}
+		size_t written = fwrite(image.data(), 1, image.size(), output);
+		fclose(output);
+		if (written != image.size())
+		{
+			fprintf(stderr, "short write to %s\n", path);
+			return 1;
+		}
+		printf("wrote %zu functions (%zu bytes) to %s\n", params.functions, image.size(), path);
+		return 0;
+	}
+
+	// Times the emulated path per instruction class (one class per x86_test_ symbol). The first
+	// run records per-class timings to `baselinePath`; later runs compare against it and fail
+	// loudly when a class got more than 5% slower, so emulator or code generator changes can't
+	// regress throughput silently. Delete the file to re-record baselines.
+	int run_benchmark(const char* baselinePath)
+	{
+		x86_emu_print_instructions = false;
+
+		map<string, vector<const x86_test_entry*>> classes;
+		for (const auto& test : tests)
+		{
+			Dl_info info;
+			const char* name = dladdr(reinterpret_cast<void*>(test.call), &info) == 1 ? info.dli_sname : "?";
+			classes[name].push_back(&test);
+		}
+
+		map<string, double> timings;
+		for (const auto& pair : classes)
+		{
+			// Warm up once (symbol resolution, code paging), then run whole batches until the
+			// measurement lasts long enough to be stable.
+			for (const x86_test_entry* entry : pair.second)
+			{
+				x86_test_entry::result scratch;
+				entry->emulate(scratch);
+			}
+
+			size_t calls = 0;
+			chrono::duration<double> elapsed;
+			auto start = chrono::steady_clock::now();
+			do
+			{
+				for (const x86_test_entry* entry : pair.second)
+				{
+					x86_test_entry::result scratch;
+					entry->emulate(scratch);
+				}
+				calls += pair.second.size();
+				elapsed = chrono::steady_clock::now() - start;
+			} while (elapsed.count() < 0.05);
+			timings[pair.first] = elapsed.count() * 1e9 / calls;
+		}
+
+		FILE* baseline = fopen(baselinePath, "r");
+		if (baseline == nullptr)
+		{
+			baseline = fopen(baselinePath, "w");
+			if (baseline == nullptr)
+			{
+				fprintf(stderr, "can't record baselines to %s\n", baselinePath);
+				return 1;
+			}
+			for (const auto& pair : timings)
+			{
+				fprintf(baseline, "%s %.1f\n", pair.first.c_str(), pair.second);
+			}
+			fclose(baseline);
+			printf("recorded baselines for %zu instruction classes to %s\n", timings.size(), baselinePath);
+			return 0;
+		}
+
+		map<string, double> baselines;
+		char name[128];
+		double nanoseconds;
+		while (fscanf(baseline, "%127s %lf", name, &nanoseconds) == 2)
+		{
+			baselines[name] = nanoseconds;
+		}
+		fclose(baseline);
+
+		int failures = 0;
+		for (const auto& pair : timings)
+		{
+			auto iter = baselines.find(pair.first);
+			if (iter == baselines.end())
+			{
+				printf("%-32s %8.1f ns/call (no baseline)\n", pair.first.c_str(), pair.second);
+				continue;
+			}
+			double ratio = pair.second / iter->second;
+			printf("%-32s %8.1f ns/call, baseline %8.1f (%+.1f%%)\n", pair.first.c_str(), pair.second, iter->second, (ratio - 1) * 100);
+			if (ratio > 1.05)
+			{
+				fprintf(stderr, "%s is %.1f%% slower than its baseline\n", pair.first.c_str(), (ratio - 1) * 100);
+				failures++;
+			}
+		}
+		return failures == 0 ? 0 : 1;
+	}
+}
+
 int main(int argc, const char * argv[]) {
-	for (const auto& test : tests)
+	unsigned jobs = 1;
+	const char* baselinePath = nullptr;
+	const char* generatePath = nullptr;
+	generator_params genParams;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+		{
+			jobs = static_cast<unsigned>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+		{
+			baselinePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--generate") == 0 && i + 1 < argc)
+		{
+			generatePath = argv[++i];
+		}
+		else if (strcmp(argv[i], "--functions") == 0 && i + 1 < argc)
+		{
+			genParams.functions = static_cast<size_t>(atoll(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--branch-density") == 0 && i + 1 < argc)
+		{
+			genParams.branchDensity = static_cast<unsigned>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+		{
+			genParams.depth = static_cast<unsigned>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--rep-frequency") == 0 && i + 1 < argc)
+		{
+			genParams.repFrequency = static_cast<unsigned>(atoi(argv[++i]));
+		}
+		else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+		{
+			genParams.seed = strtoull(argv[++i], nullptr, 0);
+		}
+		else
+		{
+			fprintf(stderr, "usage: %s [-j jobs] [--bench baseline-file]\n", argv[0]);
+			fprintf(stderr, "       %s --generate output-file [--functions n] [--branch-density pct] [--depth n] [--rep-frequency pct] [--seed n]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (generatePath != nullptr)
+	{
+		if (genParams.functions == 0 || genParams.depth == 0 || genParams.depth > genParams.functions)
+		{
+			fprintf(stderr, "--depth must be between 1 and --functions\n");
+			return 1;
+		}
+		return run_generator(generatePath, genParams);
+	}
+	if (jobs == 0)
+	{
+		jobs = thread::hardware_concurrency();
+		if (jobs == 0)
+		{
+			jobs = 1;
+		}
+	}
+
+	if (baselinePath != nullptr)
+	{
+		return run_benchmark(baselinePath);
+	}
+
+	if (jobs == 1)
+	{
+		for (const auto& test : tests)
+		{
+			test.test();
+		}
+		return 0;
+	}
+
+	// Tests only share the output lock and the emulator's thread-local state, so they can be
+	// pulled off a shared index in any order. The per-instruction trace would interleave
+	// meaninglessly, so it's off in parallel runs.
+	x86_emu_print_instructions = false;
+	atomic<size_t> nextTest(0);
+	vector<thread> workers;
+	for (unsigned i = 0; i < jobs; ++i)
+	{
+		workers.emplace_back([&]()
+		{
+			constexpr size_t testCount = sizeof tests / sizeof tests[0];
+			for (size_t index; (index = nextTest.fetch_add(1)) < testCount; )
+			{
+				tests[index].test();
+			}
+		});
+	}
+	for (thread& worker : workers)
 	{
-		test.test();
+		worker.join();
 	}
+	return 0;
 }
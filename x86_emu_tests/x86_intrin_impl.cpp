@@ -25,31 +25,37 @@ namespace
 		return N;
 	}
 	
-	jmp_buf jump_to;
+	// One jump buffer per thread so that tests can emulate on several threads at once.
+	thread_local jmp_buf jump_to;
 
 	typedef void (*x86_impl)(CPTR(x86_config), CPTR(cs_x86), PTR(x86_regs), PTR(x86_flags_reg));
-	
+
 	const char* emulator_func_names[X86_INS_ENDING] = {
 		"", // X86_INS_INVALID
-		
+
 #define X86_INSTRUCTION_DECL(enum, shortName) [enum] = "x86_" #shortName,
 #include "x86_insts.h"
 	};
-	
+
 	x86_impl get_emulator_impl(x86_insn inst)
 	{
-		static bool initialized = false;
-		static x86_impl emulator_funcs[X86_INS_ENDING];
-		if (!initialized)
+		struct impl_table
 		{
-			for (size_t i = 0; i < X86_INS_ENDING; ++i)
+			x86_impl funcs[X86_INS_ENDING];
+
+			impl_table()
 			{
-				emulator_funcs[i] = reinterpret_cast<x86_impl>(dlsym(RTLD_MAIN_ONLY, emulator_func_names[i]));
+				for (size_t i = 0; i < X86_INS_ENDING; ++i)
+				{
+					funcs[i] = reinterpret_cast<x86_impl>(dlsym(RTLD_MAIN_ONLY, emulator_func_names[i]));
+				}
 			}
-			initialized = true;
-		}
-		
-		return emulator_funcs[inst];
+		};
+
+		// The constructor of a function-local static runs exactly once even with concurrent
+		// callers, which makes the dlsym sweep safe for parallel test runs.
+		static impl_table table;
+		return table.funcs[inst];
 	}
 	
 	template<typename TInt>
@@ -67,6 +73,10 @@ namespace
 
 extern const char x86_test_epilogue[];
 
+// The per-instruction trace is nice when a single test fails, useless when tests interleave on
+// several threads, and fatal to measurements in benchmark mode; the harness turns it off then.
+extern "C" bool x86_emu_print_instructions = true;
+
 // Ignore segments.
 extern "C" void x86_write_mem(x86_reg, uint64_t address, size_t size, uint64_t value)
 {
@@ -133,7 +143,7 @@ extern "C" void x86_call_intrin(CPTR(x86_config) config, PTR(x86_regs) regs, uin
 		abort();
 	}
 	
-	bool print = true;
+	bool print = x86_emu_print_instructions;
 	while (true)
 	{
 		auto code_begin = reinterpret_cast<const uint8_t*>(regs->ip.qword);